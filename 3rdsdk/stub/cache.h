@@ -2,9 +2,20 @@
 
 #include <map>
 #include <string>
+#include <ctime>
 #include <mutex>
+#include <memory>
+#include <random>
+#include <algorithm>
 #include <functional>
 
+#include <bthread/mutex.h>
+#include <bthread/condition_variable.h>
+
+#include "common/helper/time_tool.h"
+#include "common/helper/singleton.h"
+#include "common/helper/threadpool.h"
+
 #include "3rdsdk/stub/po_type.h"
 
 namespace sdkproxy {
@@ -13,6 +24,37 @@ namespace sdk {
 //过期时间30分钟
 const uint64_t EXPIRE_TIME = 1800;
 
+typedef struct tagCacheStats {
+    uint64_t hits;            // 未过期命中
+    uint64_t staleHits;       // 过期后返回旧值，同时在后台刷新
+    uint64_t misses;          // 没有缓存，调用方等待查询结果
+    uint64_t coalesced;       // 等待其他请求正在进行的查询
+    uint64_t refreshes;       // 查询次数，包括首次查询和后台刷新
+    uint64_t refreshFailures;
+    uint64_t refreshTotalMs;
+    uint64_t refreshMaxMs;
+} CacheStats;
+
+// 所有缓存共用的后台刷新线程，线程数固定，退出时等待正在进行的刷新结束
+class CacheRefreshPool {
+public:
+    enum { THREADS = 4 };
+
+    CacheRefreshPool() : pool_(THREADS) {}
+
+    void Post(std::function<void()> call) { pool_.commit(call); }
+
+private:
+    std::threadpool pool_;
+};
+
+inline CacheRefreshPool &CACHE_REFRESH_POOL() {
+    return Singleton<CacheRefreshPool>::getInstance();
+}
+
+// 过期后先返回旧值并在后台刷新，同一个键同时只有一个查询，查询时不持有锁，其他键的读取不受影响
+// 后台刷新在CACHE_REFRESH_POOL()中执行，查询函数需要自己保证用到的对象在刷新期间有效
+// 在brpc的bthread中调用，等待其他请求的查询结果时只让出bthread，不占住工作线程
 template <typename T> class Cache {
 public:
     typedef struct Value_ {
@@ -23,46 +65,151 @@ public:
 
     using QueryFunc = std::function<int32_t(const std::string &key, Value &value)>;
 
-public:
-    int Query(const std::string &key, Value &value) {
-        std::unique_lock<std::mutex> lck(mutex_);
+    enum {
+        RETRY_MS = 5000, // 刷新失败后继续使用旧值，最快的重试间隔
+    };
+
+    // ttlMs之后过期，每次写入在[0, jitterMs]之间随机延长，避免所有键同时过期
+    // maxStaleMs为0时旧值一直可用，否则过期超过这个时间后按未命中处理
+    Cache(uint64_t ttlMs = EXPIRE_TIME * 1000, uint64_t jitterMs = 0, uint64_t maxStaleMs = 0)
+        : state_(std::make_shared<State>(ttlMs, jitterMs, maxStaleMs)) {}
 
-        if (key.empty() || nullptr == queryFunc_) {
+    int Query(const std::string &key, Value &value) { return Query(key, value, queryFunc_); }
+
+    int Query(const std::string &key, Value &value, QueryFunc queryFunc) {
+        if (key.empty() || nullptr == queryFunc) {
             return -1;
         }
 
-        auto cache_iter = cache_.find(key);
-        if (cache_iter != cache_.end()) { /*缓存里面存在值*/
-            const Value &value_t = cache_iter->second;
-            /*判断缓存是否已过期*/
-            if ((time(NULL) - value_t.createTime) < EXPIRE_TIME) {
-                /*未过期则返回值*/
-                value = value_t;
+        std::shared_ptr<State> state = state_;
+        std::unique_lock<bthread::Mutex> lck(state->mutex);
+        Entry &entry = state->entries[key];
+        uint64_t now = TimeTool::now_to_ms();
+
+        if (entry.valid) {
+            if (now < entry.expireAt) {
+                state->stats.hits++;
+                value = entry.value;
                 return 0;
             }
+            if (0 == state->maxStaleMs || now - entry.expireAt < state->maxStaleMs) {
+                state->stats.staleHits++;
+                value = entry.value;
+                if (!entry.loading) {
+                    entry.loading = true;
+                    CACHE_REFRESH_POOL().Post([state, key, queryFunc]() { load(state, key, queryFunc); });
+                }
+                return 0;
+            }
+        }
+
+        // 没有可用的值，等待正在进行的查询或者由当前请求查询
+        state->stats.misses++;
+        if (entry.loading) {
+            state->stats.coalesced++;
+            uint64_t version = entry.version;
+            while (state->entries[key].loading && state->entries[key].version == version) {
+                state->cond.wait(lck);
+            }
+            Entry &done = state->entries[key];
+            if (!done.valid || 0 != done.error) {
+                return 0 != done.error ? done.error : -1;
+            }
+            value = done.value;
+            return 0;
         }
 
-        /*已过期或不存在缓存中,通过DB去查询需要的Value*/
-        int32_t ret = queryFunc_(key, value);
+        entry.loading = true;
+        lck.unlock();
+        int32_t ret = load(state, key, queryFunc);
+        lck.lock();
+        Entry &done = state->entries[key];
         if (0 != ret) {
-            /*DB查询失效*/
             return ret;
         }
-
-        /*设置时间，并放入存储*/
-        value.createTime = time(NULL);
-        cache_[key]      = value;
+        value = done.value;
         return 0;
     }
 
+    void Invalidate(const std::string &key) {
+        std::unique_lock<bthread::Mutex> lck(state_->mutex);
+        auto iter = state_->entries.find(key);
+        if (iter != state_->entries.end() && !iter->second.loading) {
+            state_->entries.erase(iter);
+        }
+    }
+
+    CacheStats Stats() {
+        std::unique_lock<bthread::Mutex> lck(state_->mutex);
+        return state_->stats;
+    }
+
     void setQueryFunc(QueryFunc q) { this->queryFunc_ = q; }
 
 private:
-    std::mutex mutex_;
-    typedef std::map<std::string, Value> MyCache;
-    MyCache cache_;
+    typedef struct tagEntry {
+        bool valid;
+        bool loading;
+        int32_t error;    // 最近一次查询的结果
+        uint64_t version; // 每次查询结束加1，等待者据此判断查询已经完成
+        uint64_t expireAt;
+        Value value;
+
+        tagEntry() : valid(false), loading(false), error(0), version(0), expireAt(0) {}
+    } Entry;
+
+    // 后台刷新可能比Cache活得更久，共享的状态单独分配
+    typedef struct tagState {
+        bthread::Mutex mutex;
+        bthread::ConditionVariable cond;
+        std::map<std::string, Entry> entries;
+        uint64_t ttlMs;
+        uint64_t jitterMs;
+        uint64_t maxStaleMs;
+        std::minstd_rand random;
+        CacheStats stats;
+
+        tagState(uint64_t ttl, uint64_t jitter, uint64_t maxStale)
+            : ttlMs(ttl), jitterMs(jitter), maxStaleMs(maxStale), random((uint32_t)TimeTool::now_to_ms()), stats() {}
+    } State;
+
+    // 不持有锁调用查询函数，完成后更新缓存并唤醒等待者
+    static int32_t load(std::shared_ptr<State> state, const std::string &key, QueryFunc queryFunc) {
+        Value value;
+        value.key = key;
+
+        uint64_t start  = TimeTool::now_to_ms();
+        int32_t ret     = queryFunc(key, value);
+        uint64_t now    = TimeTool::now_to_ms();
+        uint64_t costMs = now - start;
+
+        std::unique_lock<bthread::Mutex> lck(state->mutex);
+        Entry &entry  = state->entries[key];
+        entry.loading = false;
+        entry.error   = ret;
+        entry.version++;
+        state->stats.refreshes++;
+        state->stats.refreshTotalMs += costMs;
+        state->stats.refreshMaxMs = std::max(state->stats.refreshMaxMs, costMs);
+        if (0 == ret) {
+            value.createTime = time(NULL);
+            entry.value      = value;
+            entry.valid      = true;
+            entry.expireAt   = now + state->ttlMs + (state->jitterMs > 0 ? state->random() % (state->jitterMs + 1) : 0);
+        } else {
+            state->stats.refreshFailures++;
+            if (entry.valid) {
+                entry.expireAt = now + std::min<uint64_t>(state->ttlMs, RETRY_MS);
+            }
+        }
+        state->cond.notify_all();
+        return ret;
+    }
+
+private:
+    std::shared_ptr<State> state_;
     QueryFunc queryFunc_;
 };
 
 } // namespace sdk
-} // namespace sdkproxy
\ No newline at end of file
+} // namespace sdkproxy
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cerrno>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+namespace sdkproxy {
+namespace sdk {
+
+typedef struct tagProbeTarget {
+    std::string ip;
+    int port;
+} ProbeTarget;
+
+// 用非阻塞connect和epoll同时探测大量地址的端口是否可以连接，每个地址单独计算超时
+// 每次调用使用自己的epoll，可以在多个线程中同时调用
+class ConnectProber {
+public:
+    enum {
+        DEFAULT_TIMEOUT_MS   = 3000,
+        DEFAULT_MAX_INFLIGHT = 1024, // 同时进行中的连接数，受限于进程的文件描述符个数
+    };
+
+    explicit ConnectProber(int32_t maxInflight = DEFAULT_MAX_INFLIGHT) : maxInflight_(maxInflight > 0 ? maxInflight : 1) {}
+
+    // 返回每个地址的连接耗时(ms)，无法连接或者超时时为-1
+    std::vector<int32_t> Probe(const std::vector<ProbeTarget> &targets, int32_t timeoutMs = DEFAULT_TIMEOUT_MS) const {
+        std::vector<int32_t> results(targets.size(), -1);
+        if (targets.empty()) {
+            return results;
+        }
+
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            return results;
+        }
+
+        std::vector<Attempt> attempts(targets.size());
+        std::deque<uint32_t> pending; // 按开始时间排列，超时时间相同所以也是按截止时间排列
+        std::vector<struct epoll_event> events(std::min<size_t>(targets.size(), (size_t)maxInflight_));
+        size_t next      = 0;
+        int32_t inflight = 0;
+
+        while (next < targets.size() || inflight > 0) {
+            // 1. 发起新的连接
+            while (next < targets.size() && inflight < maxInflight_) {
+                uint32_t idx = (uint32_t)next++;
+                int fd       = start(targets[idx], results[idx]);
+                if (fd < 0) {
+                    continue;
+                }
+                struct epoll_event ev;
+                ev.events   = EPOLLOUT;
+                ev.data.u32 = idx;
+                if (0 != epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+                    close(fd);
+                    continue;
+                }
+                attempts[idx].fd       = fd;
+                attempts[idx].start    = nowMs();
+                attempts[idx].deadline = attempts[idx].start + timeoutMs;
+                pending.push_back(idx);
+                inflight++;
+            }
+            if (0 == inflight) {
+                break;
+            }
+
+            // 2. 等待连接完成，最多等到最早的截止时间
+            while (!pending.empty() && attempts[pending.front()].fd < 0) {
+                pending.pop_front();
+            }
+            int64_t wait = pending.empty() ? 0 : std::max<int64_t>(0, attempts[pending.front()].deadline - nowMs());
+            int n        = epoll_wait(epfd, events.data(), (int)events.size(), (int)wait);
+            if (n < 0 && EINTR != errno) {
+                break;
+            }
+            int64_t now = nowMs();
+            for (int i = 0; i < n; i++) {
+                uint32_t idx = events[i].data.u32;
+                Attempt &a   = attempts[idx];
+                if (a.fd < 0) {
+                    continue;
+                }
+                int err       = 0;
+                socklen_t len = sizeof(err);
+                if (0 == getsockopt(a.fd, SOL_SOCKET, SO_ERROR, &err, &len) && 0 == err) {
+                    results[idx] = (int32_t)(now - a.start);
+                }
+                finish(epfd, a);
+                inflight--;
+            }
+
+            // 3. 关闭超时的连接
+            while (!pending.empty()) {
+                Attempt &a = attempts[pending.front()];
+                if (a.fd >= 0 && a.deadline > now) {
+                    break;
+                }
+                if (a.fd >= 0) {
+                    finish(epfd, a);
+                    inflight--;
+                }
+                pending.pop_front();
+            }
+        }
+
+        // epoll_wait出错时关闭剩下的连接
+        for (auto &a : attempts) {
+            if (a.fd >= 0) {
+                finish(epfd, a);
+            }
+        }
+        close(epfd);
+        return results;
+    }
+
+private:
+    typedef struct tagAttempt {
+        int fd;
+        int64_t start;
+        int64_t deadline;
+
+        tagAttempt() : fd(-1), start(0), deadline(0) {}
+    } Attempt;
+
+    // 返回等待完成的socket，立即成功或者失败时返回-1并设置结果
+    static int start(const ProbeTarget &target, int32_t &result) {
+        struct sockaddr_in addr = {};
+        addr.sin_family         = AF_INET;
+        addr.sin_port           = htons(target.port);
+        if (1 != inet_pton(AF_INET, target.ip.c_str(), &addr.sin_addr)) {
+            return -1;
+        }
+
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (0 == connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+            result = 0;
+            close(fd);
+            return -1;
+        }
+        if (EINPROGRESS != errno) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    static void finish(int epfd, Attempt &a) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, a.fd, nullptr);
+        close(a.fd);
+        a.fd = -1;
+    }
+
+    static int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    int32_t maxInflight_;
+};
+
+} // namespace sdk
+} // namespace sdkproxy
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <mutex>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include "common/helper/logger.h"
+
+namespace sdkproxy {
+namespace sdk {
+
+// 加密保存在元数据库中的nvr密码，AES-256-GCM，ip作为附加数据，密文不能挪到其他设备的记录上使用
+// 密钥保存在元数据库之外的文件中，第一次使用时随机生成，只有属主可读，只拷走元数据库时拿不到密码
+class CredentialCipher {
+public:
+    static const size_t KEY_SIZE = 32;
+    static const size_t IV_SIZE  = 12;
+    static const size_t TAG_SIZE = 16;
+
+    explicit CredentialCipher(const std::string &keyFile) : keyFile_(keyFile), loaded_(false) {}
+
+    // 返回hex(iv | tag | 密文)，密钥不可用时返回空
+    std::string Seal(const std::string &plain, const std::string &aad) {
+        std::string key;
+        unsigned char iv[IV_SIZE];
+        if (!getKey(key) || 1 != RAND_bytes(iv, sizeof(iv))) {
+            return "";
+        }
+
+        std::string out(IV_SIZE + TAG_SIZE + plain.size(), '\0');
+        unsigned char *p    = (unsigned char *)&out[0];
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        int len             = 0;
+        bool ok             = nullptr != ctx && 1 == EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, (const unsigned char *)key.data(), iv)
+                           && 1 == EVP_EncryptUpdate(ctx, nullptr, &len, (const unsigned char *)aad.data(), (int)aad.size())
+                           && 1 == EVP_EncryptUpdate(ctx, p + IV_SIZE + TAG_SIZE, &len, (const unsigned char *)plain.data(), (int)plain.size())
+                           && 1 == EVP_EncryptFinal_ex(ctx, p + IV_SIZE + TAG_SIZE + len, &len)
+                           && 1 == EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, (int)TAG_SIZE, p + IV_SIZE);
+        EVP_CIPHER_CTX_free(ctx);
+        if (!ok) {
+            LOG_ERROR("Failed to encrypt the credential");
+            return "";
+        }
+        memcpy(p, iv, IV_SIZE);
+        return toHex(out);
+    }
+
+    // 密钥不对、附加数据不对或者密文被改过时返回false
+    bool Open(const std::string &sealed, const std::string &aad, std::string &plain) {
+        std::string key;
+        std::string in;
+        if (!getKey(key) || !fromHex(sealed, in) || in.size() < IV_SIZE + TAG_SIZE) {
+            return false;
+        }
+
+        const unsigned char *p = (const unsigned char *)in.data();
+        std::string out(in.size() - IV_SIZE - TAG_SIZE, '\0');
+        unsigned char *q    = (unsigned char *)&out[0];
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        int len             = 0;
+        bool ok             = nullptr != ctx && 1 == EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, (const unsigned char *)key.data(), p)
+                           && 1 == EVP_DecryptUpdate(ctx, nullptr, &len, (const unsigned char *)aad.data(), (int)aad.size())
+                           && 1 == EVP_DecryptUpdate(ctx, q, &len, p + IV_SIZE + TAG_SIZE, (int)out.size())
+                           && 1 == EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, (int)TAG_SIZE, (void *)(p + IV_SIZE))
+                           && 1 == EVP_DecryptFinal_ex(ctx, q + len, &len);
+        EVP_CIPHER_CTX_free(ctx);
+        if (!ok) {
+            return false;
+        }
+        plain.swap(out);
+        return true;
+    }
+
+private:
+    // 密钥文件不存在时生成，先写临时文件再改名，不会留下不完整的密钥
+    bool getKey(std::string &key) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (loaded_) {
+            key = key_;
+            return true;
+        }
+
+        char buf[KEY_SIZE];
+        int fd = open(keyFile_.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            close(fd);
+            if (n != (ssize_t)sizeof(buf)) {
+                LOG_ERROR("Invalid credential key file {}", keyFile_);
+                return false;
+            }
+        } else if (ENOENT == errno) {
+            std::string tmp = keyFile_ + ".tmp";
+            if (1 != RAND_bytes((unsigned char *)buf, sizeof(buf)) || (fd = open(tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0600)) < 0) {
+                LOG_ERROR("Failed to create credential key file {}, errno {}", keyFile_, errno);
+                return false;
+            }
+            bool ok = write(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) && 0 == fsync(fd);
+            close(fd);
+            if (!ok || 0 != rename(tmp.c_str(), keyFile_.c_str())) {
+                LOG_ERROR("Failed to write credential key file {}, errno {}", keyFile_, errno);
+                unlink(tmp.c_str());
+                return false;
+            }
+            LOG_INFO("Created credential key file {}", keyFile_);
+        } else {
+            LOG_ERROR("Failed to open credential key file {}, errno {}", keyFile_, errno);
+            return false;
+        }
+        key_.assign(buf, sizeof(buf));
+        loaded_ = true;
+        key     = key_;
+        return true;
+    }
+
+    static std::string toHex(const std::string &in) {
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(in.size() * 2);
+        for (unsigned char c : in) {
+            out.push_back(digits[c >> 4]);
+            out.push_back(digits[c & 0x0f]);
+        }
+        return out;
+    }
+
+    static bool fromHex(const std::string &in, std::string &out) {
+        if (in.size() % 2 != 0) {
+            return false;
+        }
+        out.clear();
+        out.reserve(in.size() / 2);
+        for (size_t i = 0; i < in.size(); i += 2) {
+            int hi = hexValue(in[i]);
+            int lo = hexValue(in[i + 1]);
+            if (hi < 0 || lo < 0) {
+                return false;
+            }
+            out.push_back((char)((hi << 4) | lo));
+        }
+        return true;
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+
+private:
+    std::string keyFile_;
+    std::string key_;
+    bool loaded_;
+    std::mutex mutex_;
+};
+
+} // namespace sdk
+} // namespace sdkproxy
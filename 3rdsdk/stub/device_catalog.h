@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+
+#include "3rdsdk/stub/po_type.h"
+
+namespace sdkproxy {
+namespace sdk {
+
+// nvr通道列表的只读快照，建好后不再修改，多个线程可以不加锁同时查询
+// 通道ip或名称重复时以列表中最后一个为准，和原来逐个比较的结果一致
+class DeviceCatalog {
+public:
+    explicit DeviceCatalog(std::vector<Device> devices) : devices_(std::move(devices)), version_(nextVersion()) {
+        ip2Index_.reserve(devices_.size());
+        id2Index_.reserve(devices_.size());
+        name2Index_.reserve(devices_.size());
+        for (size_t i = 0; i < devices_.size(); i++) {
+            ip2Index_[devices_[i].ip]     = i;
+            id2Index_[devices_[i].id]     = i;
+            name2Index_[devices_[i].name] = i;
+        }
+    }
+
+    const std::vector<Device> &GetDevices() const { return devices_; }
+
+    // 每个快照不同，可以作为缓存的响应内容的版本
+    uint64_t GetVersion() const { return version_; }
+
+    std::string ChannelIp2Id(const std::string &channelIp) const {
+        auto iter = ip2Index_.find(channelIp);
+        return iter == ip2Index_.end() ? "" : devices_[iter->second].id;
+    }
+
+    std::string Name2Id(const std::string &name) const {
+        auto iter = name2Index_.find(name);
+        return iter == name2Index_.end() ? "" : devices_[iter->second].id;
+    }
+
+    const Device *FindById(const std::string &id) const {
+        auto iter = id2Index_.find(id);
+        return iter == id2Index_.end() ? nullptr : &devices_[iter->second];
+    }
+
+private:
+    static uint64_t nextVersion() {
+        static std::atomic<uint64_t> version(0);
+        return ++version;
+    }
+
+private:
+    std::vector<Device> devices_;
+    uint64_t version_;
+    std::unordered_map<std::string, size_t> ip2Index_;
+    std::unordered_map<std::string, size_t> id2Index_;
+    std::unordered_map<std::string, size_t> name2Index_;
+};
+
+} // namespace sdk
+} // namespace sdkproxy
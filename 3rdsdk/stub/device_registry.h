@@ -0,0 +1,209 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <algorithm>
+
+#include "json/json.hpp"
+#include "common/helper/logger.h"
+#include "common/helper/time_tool.h"
+
+#include "3rdsdk/stub/metadata_store.h"
+#include "3rdsdk/stub/credential_cipher.h"
+
+namespace sdkproxy {
+namespace sdk {
+
+typedef struct tagEventJobRecord {
+    std::string channelIp;
+    std::string devCode;
+} EventJobRecord;
+
+typedef struct tagDeviceRecord {
+    std::string ip;
+    std::string vendor;
+    std::string user;
+    std::string password; // 只在内存中是明文，保存时加密
+    std::string secret;   // 保存的密文，为空时保存前重新加密
+    uint64_t lastLogin;   // 最近一次登录成功的时间(ms)
+    std::vector<EventJobRecord> eventJobs;
+} DeviceRecord;
+
+// 记录正在使用的nvr和上面的事件分析任务，重启后据此预先登录并恢复任务
+// 密码用CredentialCipher加密后和厂商信息一起保存在本地的元数据库中，旧版本保存的明文密码读出后改为加密保存
+class DeviceRegistry {
+public:
+    const std::string PREFIX = "device/";
+
+    DeviceRegistry(MetaDataStore &store, const std::string &keyFile) : store_(store), cipher_(keyFile) {}
+
+    // 登录成功时调用，厂商和账号没有变化时只更新登录时间，沿用保存的密文
+    void Remember(const std::string &ip, const std::string &vendor, const std::string &user, const std::string &password) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        DeviceRecord record;
+        if (!load(ip, record)) {
+            record.ip = ip;
+        }
+        if (vendor != record.vendor || user != record.user || password != record.password) {
+            record.secret.clear();
+        }
+        record.vendor    = vendor;
+        record.user      = user;
+        record.password  = password;
+        record.lastLogin = TimeTool::now_to_ms();
+        save(record);
+    }
+
+    void Forget(const std::string &ip) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        store_.Delete(PREFIX + ip);
+    }
+
+    void AddEventJob(const std::string &ip, const std::string &channelIp, const std::string &devCode) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        DeviceRecord record;
+        if (!load(ip, record)) {
+            return;
+        }
+        for (auto &job : record.eventJobs) {
+            if (devCode == job.devCode && channelIp == job.channelIp) {
+                return;
+            }
+        }
+        record.eventJobs.push_back(EventJobRecord{channelIp, devCode});
+        save(record);
+    }
+
+    void RemoveEventJob(const std::string &devCode) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (auto &record : loadAll()) {
+            size_t count = record.eventJobs.size();
+            record.eventJobs.erase(std::remove_if(record.eventJobs.begin(), record.eventJobs.end(),
+                                                  [&devCode](const EventJobRecord &job) { return devCode == job.devCode; }),
+                                   record.eventJobs.end());
+            if (count != record.eventJobs.size()) {
+                save(record);
+            }
+        }
+    }
+
+    void ClearEventJobs() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (auto &record : loadAll()) {
+            if (!record.eventJobs.empty()) {
+                record.eventJobs.clear();
+                save(record);
+            }
+        }
+    }
+
+    // maxAgeMs时间内登录过或者还有事件分析任务的设备
+    std::vector<DeviceRecord> Load(uint64_t maxAgeMs) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        uint64_t now = TimeTool::now_to_ms();
+        std::vector<DeviceRecord> records;
+        std::vector<DeviceRecord> all = loadAll();
+        if (!plainFound_.empty()) {
+            for (auto &record : all) {
+                if (plainFound_.count(record.ip)) {
+                    save(record);
+                }
+            }
+            LOG_INFO("Encrypted {} saved passwords", plainFound_.size());
+            plainFound_.clear();
+        }
+        for (auto &record : all) {
+            if (!record.eventJobs.empty() || now - record.lastLogin <= maxAgeMs) {
+                records.push_back(record);
+            }
+        }
+        return records;
+    }
+
+private:
+    // 持有mutex_时调用
+    bool load(const std::string &ip, DeviceRecord &record) {
+        std::string value;
+        return store_.Get(PREFIX + ip, value) && parse(value, record);
+    }
+
+    std::vector<DeviceRecord> loadAll() {
+        std::vector<DeviceRecord> records;
+        store_.Scan(PREFIX, [&](const std::string &key, const std::string &value) {
+            DeviceRecord record;
+            if (parse(value, record)) {
+                records.push_back(record);
+            }
+            return true;
+        });
+        return records;
+    }
+
+    // 持有mutex_时调用，需要加密而密钥不可用时不保存，避免保存空的密文让下次启动的预热登录失败
+    void save(DeviceRecord &record) {
+        if (record.secret.empty()) {
+            record.secret = cipher_.Seal(record.password, record.ip);
+            if (record.secret.empty()) {
+                LOG_ERROR("Failed to encrypt the password of {}, not saved", record.ip);
+                return;
+            }
+        }
+        nlohmann::json jobs = nlohmann::json::array();
+        for (auto &job : record.eventJobs) {
+            nlohmann::json j;
+            j["channelIp"] = job.channelIp;
+            j["devCode"]   = job.devCode;
+            jobs.push_back(j);
+        }
+        nlohmann::json j;
+        j["ip"]        = record.ip;
+        j["vendor"]    = record.vendor;
+        j["user"]      = record.user;
+        j["secret"]    = record.secret;
+        j["lastLogin"] = record.lastLogin;
+        j["eventJobs"] = jobs;
+        store_.Put(PREFIX + record.ip, j.dump());
+    }
+
+    // 持有mutex_时调用，密码解密失败时为空，预热登录会失败，下次登录成功时重新保存
+    bool parse(const std::string &value, DeviceRecord &record) {
+        nlohmann::json j = nlohmann::json::parse(value, nullptr, false);
+        if (j.is_discarded() || !j.is_object()) {
+            return false;
+        }
+        record.ip        = j.value("ip", "");
+        record.vendor    = j.value("vendor", "");
+        record.user      = j.value("user", "");
+        record.lastLogin = j.value("lastLogin", (uint64_t)0);
+        record.password.clear();
+        record.secret.clear();
+        if (j.count("secret")) {
+            record.secret = j.value("secret", "");
+            if (!cipher_.Open(record.secret, record.ip, record.password)) {
+                LOG_ERROR("Failed to decrypt the saved password of {}", record.ip);
+            }
+        } else if (j.count("password")) {
+            record.password = j.value("password", "");
+            plainFound_.insert(record.ip);
+        }
+        record.eventJobs.clear();
+        if (j.count("eventJobs") && j["eventJobs"].is_array()) {
+            for (auto &job : j["eventJobs"]) {
+                record.eventJobs.push_back(EventJobRecord{job.value("channelIp", ""), job.value("devCode", "")});
+            }
+        }
+        return !record.ip.empty() && !record.user.empty();
+    }
+
+private:
+    MetaDataStore &store_;
+    CredentialCipher cipher_;
+    std::set<std::string> plainFound_; // 还是明文保存的记录
+    std::mutex mutex_;
+};
+
+} // namespace sdk
+} // namespace sdkproxy
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+namespace sdkproxy {
+namespace sdk {
+
+// 一路下载的进度
+typedef struct tagDownloadProgress {
+    uint64_t id;
+    std::string ip; // 下载的nvr
+    std::string name;
+    uint64_t bytes;
+    int32_t percent;
+    uint64_t rate;    // 字节/秒
+    uint64_t avgRate; // 从开始到现在的平均速率，字节/秒
+    int32_t speed;    // 设备接受的倍速
+    int32_t requestedSpeed;
+    uint64_t startTime;
+    uint64_t updateTime;
+    bool done;
+} DownloadProgress;
+
+// 已经结束的下载的累计吞吐量，accelerated是倍速下载
+typedef struct tagDownloadStats {
+    uint64_t finished;
+    uint64_t bytes;
+    uint64_t elapsedMs;
+    uint64_t accelerated;
+    uint64_t acceleratedBytes;
+    uint64_t acceleratedMs;
+    uint64_t refused; // 设备没有接受请求的倍速
+} DownloadStats;
+
+// 一路下载的进度跟踪，由厂商的下载上下文持有，sdk回调中更新字节数
+class DownloadTracker {
+public:
+    DownloadTracker(uint64_t id, const std::string &ip, const std::string &name)
+        : id_(id), ip_(ip), name_(name), bytes_(0), percent_(0), rate_(0), speed_(1), requestedSpeed_(1), startTime_(TimeTool::now_to_ms()),
+          updateTime_(startTime_), done_(false), lastRateBytes_(0), lastRateTime_(startTime_) {}
+
+    uint64_t GetId() const { return id_; }
+
+    void AddBytes(uint64_t n) { bytes_ += n; }
+
+    void SetPercent(int32_t percent) {
+        percent_    = percent;
+        updateTime_ = TimeTool::now_to_ms();
+    }
+
+    void SetDone() {
+        percent_ = 100;
+        done_    = true;
+    }
+
+    bool IsDone() const { return done_; }
+
+    void SetSpeed(int32_t requested, int32_t applied) {
+        requestedSpeed_ = requested;
+        speed_          = applied;
+    }
+
+    DownloadProgress Snapshot() const {
+        DownloadProgress p;
+        p.id             = id_;
+        p.ip             = ip_;
+        p.name           = name_;
+        p.bytes          = bytes_;
+        p.percent        = percent_;
+        p.rate           = rate_;
+        p.avgRate        = bytes_ * 1000 / std::max<uint64_t>(1, TimeTool::now_to_ms() - startTime_);
+        p.speed          = speed_;
+        p.requestedSpeed = requestedSpeed_;
+        p.startTime      = startTime_;
+        p.updateTime     = updateTime_;
+        p.done           = done_;
+        return p;
+    }
+
+private:
+    friend class DownloadPoller;
+
+    // 只在轮询线程中调用，按两次更新之间的字节数计算速率
+    void updateRate(uint64_t now) {
+        if (now - lastRateTime_ < 500) {
+            return;
+        }
+        uint64_t bytes = bytes_;
+        rate_          = (bytes - lastRateBytes_) * 1000 / (now - lastRateTime_);
+        lastRateBytes_ = bytes;
+        lastRateTime_  = now;
+    }
+
+private:
+    uint64_t id_;
+    std::string ip_;
+    std::string name_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<int32_t> percent_;
+    std::atomic<uint64_t> rate_;
+    std::atomic<int32_t> speed_;
+    std::atomic<int32_t> requestedSpeed_;
+    uint64_t startTime_;
+    std::atomic<uint64_t> updateTime_;
+    std::atomic<bool> done_;
+    uint64_t lastRateBytes_;
+    uint64_t lastRateTime_;
+};
+
+// 全进程共享的下载进度轮询，一个时间轮线程批量查询所有下载的进度，取代每路下载一个定时器线程
+// 离完成越远轮询间隔越长，按进度的增长速度估算剩余时间，间隔取剩余时间的1/4
+class DownloadPoller {
+public:
+    // 返回0~100的进度，小于0表示出错
+    using PollFunc = std::function<int32_t()>;
+    // 下载完成或出错时在轮询线程中调用一次
+    using DoneFunc = std::function<void(bool ok)>;
+
+    enum {
+        TICK_MS         = 50,
+        WHEEL_SLOTS     = 120,
+        MIN_INTERVAL_MS = 100,
+        MAX_INTERVAL_MS = 3000,
+    };
+
+    DownloadPoller() : nextId_(1), running_(true), pollingId_(0), tick_(0), wheel_(WHEEL_SLOTS), stats_() {
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~DownloadPoller() {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            running_ = false;
+        }
+        cond_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    // 只跟踪字节数，进度由厂商的回调设置，不需要轮询
+    std::shared_ptr<DownloadTracker> Track(const std::string &ip, const std::string &name) {
+        std::shared_ptr<DownloadTracker> tracker = std::make_shared<DownloadTracker>(nextId_++, ip, name);
+        std::unique_lock<std::mutex> lck(mutex_);
+        trackers_[tracker->GetId()] = tracker;
+        return tracker;
+    }
+
+    std::shared_ptr<DownloadTracker> Add(const std::string &ip, const std::string &name, PollFunc poll, DoneFunc done) {
+        std::shared_ptr<DownloadTracker> tracker = Track(ip, name);
+
+        std::shared_ptr<Entry> e = std::make_shared<Entry>();
+        e->tracker               = tracker;
+        e->poll                  = poll;
+        e->done                  = done;
+        e->interval              = MIN_INTERVAL_MS;
+        e->lastPercent           = 0;
+        e->lastPollTime          = TimeTool::now_to_ms();
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        entries_[tracker->GetId()] = e;
+        schedule(e);
+        return tracker;
+    }
+
+    // 返回后不会再回调poll和done，不能在poll和done中调用
+    void Remove(const std::shared_ptr<DownloadTracker> &tracker) {
+        if (nullptr == tracker) {
+            return;
+        }
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (trackers_.erase(tracker->GetId()) > 0) {
+            account(tracker->Snapshot());
+        }
+        auto iter = entries_.find(tracker->GetId());
+        if (iter != entries_.end()) {
+            iter->second->removed = true;
+            entries_.erase(iter);
+        }
+        if (std::this_thread::get_id() != thread_.get_id()) {
+            cond_.wait(lck, [&]() { return pollingId_ != tracker->GetId(); });
+        }
+    }
+
+    bool Get(uint64_t id, DownloadProgress &progress) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = trackers_.find(id);
+        if (iter == trackers_.end()) {
+            return false;
+        }
+        progress = iter->second->Snapshot();
+        return true;
+    }
+
+    // ip为空时返回所有nvr的下载
+    std::vector<DownloadProgress> Dump(const std::string &ip = "") {
+        std::vector<DownloadProgress> all;
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (auto &p : trackers_) {
+            if (!ip.empty() && p.second->ip_ != ip) {
+                continue;
+            }
+            all.push_back(p.second->Snapshot());
+        }
+        return all;
+    }
+
+    DownloadStats Stats() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return stats_;
+    }
+
+    size_t Size() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return entries_.size();
+    }
+
+private:
+    typedef struct tagEntry {
+        std::shared_ptr<DownloadTracker> tracker;
+        PollFunc poll;
+        DoneFunc done;
+        uint32_t interval;
+        uint32_t rounds; // 时间轮还要转几圈
+        int32_t lastPercent;
+        uint64_t lastPollTime;
+        bool removed;
+
+        tagEntry() : interval(0), rounds(0), lastPercent(0), lastPollTime(0), removed(false) {}
+    } Entry;
+
+    // 持有mutex_时调用，累计结束的下载的吞吐量
+    void account(const DownloadProgress &p) {
+        uint64_t elapsed = TimeTool::now_to_ms() - p.startTime;
+        stats_.finished++;
+        stats_.bytes += p.bytes;
+        stats_.elapsedMs += elapsed;
+        if (p.speed > 1) {
+            stats_.accelerated++;
+            stats_.acceleratedBytes += p.bytes;
+            stats_.acceleratedMs += elapsed;
+        }
+        if (p.speed < p.requestedSpeed) {
+            stats_.refused++;
+        }
+    }
+
+    // 持有mutex_时调用
+    void schedule(std::shared_ptr<Entry> e) {
+        uint32_t ticks = std::max<uint32_t>(1, e->interval / TICK_MS);
+        e->rounds      = (ticks - 1) / WHEEL_SLOTS;
+        wheel_[(tick_ + ticks) % WHEEL_SLOTS].push_back(e);
+    }
+
+    // 按进度的增长速度估算剩余时间
+    static uint32_t nextInterval(const Entry &e, int32_t percent, uint64_t now) {
+        if (percent >= 95 || percent <= e.lastPercent || now <= e.lastPollTime) {
+            return percent >= 95 ? (uint32_t)MIN_INTERVAL_MS : std::min<uint32_t>(e.interval * 2, MAX_INTERVAL_MS);
+        }
+        double perMs     = (double)(percent - e.lastPercent) / (now - e.lastPollTime);
+        double remaining = (100 - percent) / perMs;
+        return std::max<uint32_t>(MIN_INTERVAL_MS, std::min<uint32_t>(MAX_INTERVAL_MS, (uint32_t)(remaining / 4)));
+    }
+
+    void run() {
+        auto next = std::chrono::steady_clock::now();
+        while (true) {
+            std::list<std::shared_ptr<Entry>> due;
+            {
+                std::unique_lock<std::mutex> lck(mutex_);
+                next += std::chrono::milliseconds(TICK_MS);
+                cond_.wait_until(lck, next, [this]() { return !running_; });
+                if (!running_) {
+                    break;
+                }
+
+                tick_ = (tick_ + 1) % WHEEL_SLOTS;
+
+                // 每秒更新一次所有下载的速率
+                if (0 == tick_ % (1000 / TICK_MS)) {
+                    uint64_t now = TimeTool::now_to_ms();
+                    for (auto &p : trackers_) {
+                        p.second->updateRate(now);
+                    }
+                }
+
+                auto &slot = wheel_[tick_];
+                for (auto iter = slot.begin(); iter != slot.end();) {
+                    if ((*iter)->removed) {
+                        iter = slot.erase(iter);
+                    } else if ((*iter)->rounds > 0) {
+                        (*iter)->rounds--;
+                        ++iter;
+                    } else {
+                        due.push_back(*iter);
+                        iter = slot.erase(iter);
+                    }
+                }
+            }
+
+            // 同一个槽里的下载批量查询
+            for (auto &e : due) {
+                poll(e);
+            }
+        }
+    }
+
+    void poll(std::shared_ptr<Entry> e) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (e->removed) {
+                return;
+            }
+            pollingId_ = e->tracker->GetId();
+        }
+
+        uint64_t now    = TimeTool::now_to_ms();
+        int32_t percent = e->poll();
+
+        bool finished = percent < 0 || percent >= 100;
+        if (finished) {
+            if (percent >= 100) {
+                e->tracker->SetDone();
+            }
+            e->done(percent >= 100);
+        } else {
+            e->tracker->SetPercent(percent);
+            e->interval     = nextInterval(*e, percent, now);
+            e->lastPercent  = percent;
+            e->lastPollTime = now;
+        }
+
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            pollingId_ = 0;
+            if (finished) {
+                entries_.erase(e->tracker->GetId());
+            } else if (!e->removed) {
+                schedule(e);
+            }
+        }
+        cond_.notify_all();
+    }
+
+private:
+    std::atomic<uint64_t> nextId_;
+    bool running_;
+    uint64_t pollingId_; // 正在轮询的下载，Remove需要等待它结束
+    uint32_t tick_;
+    std::vector<std::list<std::shared_ptr<Entry>>> wheel_;
+    std::map<uint64_t, std::shared_ptr<Entry>> entries_;
+    std::map<uint64_t, std::shared_ptr<DownloadTracker>> trackers_;
+    DownloadStats stats_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::thread thread_;
+};
+
+inline DownloadPoller &DOWNLOAD_POLLER() {
+    return Singleton<DownloadPoller>::getInstance();
+}
+
+} // namespace sdk
+} // namespace sdkproxy
@@ -3,6 +3,8 @@
 #include <string>
 #include <cstdint>
 #include <exception>
+#include <memory>
+#include <functional>
 
 #include "leveldb/db.h"
 
@@ -23,10 +25,31 @@ public:
 
     ~MetaDataStore() { delete db_; }
 
-    bool Put(const std::string &key, const std::string &value) { return db_->Put(leveldb::WriteOptions(), key, value).ok(); }
+    // sync为true时写入落盘后才返回，用于崩溃后必须一致的元数据
+    bool Put(const std::string &key, const std::string &value, bool sync = false) {
+        leveldb::WriteOptions options;
+        options.sync = sync;
+        return db_->Put(options, key, value).ok();
+    }
 
     bool Get(const std::string &key, std::string &value) { return db_->Get(leveldb::ReadOptions(), key, &value).ok(); }
 
+    bool Delete(const std::string &key, bool sync = false) {
+        leveldb::WriteOptions options;
+        options.sync = sync;
+        return db_->Delete(options, key).ok();
+    }
+
+    // 按顺序遍历前缀为prefix的所有键，fn返回false时停止
+    void Scan(const std::string &prefix, std::function<bool(const std::string &key, const std::string &value)> fn) {
+        std::unique_ptr<leveldb::Iterator> iter(db_->NewIterator(leveldb::ReadOptions()));
+        for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+            if (!fn(iter->key().ToString(), iter->value().ToString())) {
+                break;
+            }
+        }
+    }
+
 private:
     leveldb::DB *db_;
 };
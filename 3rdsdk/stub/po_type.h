@@ -31,7 +31,8 @@ typedef struct tagTimePoint {
 
     const time_t ToTime() const {
         time_t t;
-        tm tm;
+        tm tm       = {0};
+        tm.tm_isdst = -1; // 由mktime判断夏令时，避免未初始化的值导致时间偏移
         strptime(ToString().c_str(), TIME_FORMAT, &tm); //将字符串转换为tm时间
         t = mktime(&tm);                                //将tm时间转换为秒时间
         return t;
@@ -3,6 +3,7 @@
 #include "json/json.hpp"
 #include "3rdsdk/stub/po_type.h"
 #include "3rdsdk/stub/sdk_stub.h"
+#include "3rdsdk/stub/download_poller.h"
 
 // json序列化/反序列化
 
@@ -24,6 +25,21 @@ void to_json(json &j, const Device &p) {
     j["ip"]   = p.ip;
 }
 
+void to_json(json &j, const DownloadProgress &p) {
+    j["id"]             = p.id;
+    j["ip"]             = p.ip;
+    j["name"]           = p.name;
+    j["bytes"]          = p.bytes;
+    j["percent"]        = p.percent;
+    j["rate"]           = p.rate;
+    j["avgRate"]        = p.avgRate;
+    j["speed"]          = p.speed;
+    j["requestedSpeed"] = p.requestedSpeed;
+    j["startTime"]      = p.startTime;
+    j["updateTime"]     = p.updateTime;
+    j["done"]           = p.done;
+}
+
 void to_json(json &j, const FtpInfo &p) {
     j["enable"]   = p.enable;
     j["hostIp"]   = p.hostIp;
@@ -1,17 +1,28 @@
 #pragma once
 
 #include <map>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <functional>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-#include <arpa/inet.h>
+#include <bthread/mutex.h>
+#include <bthread/condition_variable.h>
 
 #include "common/helper/singleton.h"
 #include "common/helper/logger.h"
 #include "common/helper/threadpool.h"
+#include "common/helper/time_tool.h"
 
 #include "3rdsdk/stub/sdk_stub.h"
 #include "3rdsdk/stub/sdk_stub_factory.h"
 #include "3rdsdk/stub/metadata_store.h"
+#include "3rdsdk/stub/connect_prober.h"
+#include "3rdsdk/stub/device_registry.h"
 
 namespace sdkproxy {
 namespace sdk {
@@ -26,51 +37,585 @@ public:
     const char *what() const throw() override { return "Login failed"; }
 };
 
+enum SessionState {
+    SESSION_CONNECTING   = 0, // 正在登录，其他请求等待登录结果
+    SESSION_ONLINE       = 1,
+    SESSION_RECONNECTING = 2, // sdk报告断线，先等sdk自己重连，超时后在后台重新登录
+    SESSION_DEAD         = 3, // 登录失败或者重新登录超时，熔断关闭后下一个请求重新登录
+};
+
+inline const char *SessionStateToString(SessionState state) {
+    switch (state) {
+    case SESSION_CONNECTING:
+        return "connecting";
+    case SESSION_ONLINE:
+        return "online";
+    case SESSION_RECONNECTING:
+        return "reconnecting";
+    default:
+        return "dead";
+    }
+}
+
+// 登录失败后的熔断状态，打开时同一账号的请求直接失败，不再阻塞在connect和sdk登录上
+enum CircuitState {
+    CIRCUIT_CLOSED    = 0,
+    CIRCUIT_OPEN      = 1,
+    CIRCUIT_HALF_OPEN = 2, // 正在后台探测，或者等待下一个请求试探登录
+};
+
+inline const char *CircuitStateToString(CircuitState state) {
+    switch (state) {
+    case CIRCUIT_CLOSED:
+        return "closed";
+    case CIRCUIT_OPEN:
+        return "open";
+    default:
+        return "halfOpen";
+    }
+}
+
+typedef struct tagSessionInfo {
+    std::string ip;
+    std::string vendor;
+    SessionState state;
+    uint64_t since;    // 进入当前状态的时间
+    uint32_t attempts; // 断线后后台重新登录的次数
+    uint64_t logins;
+    std::string lastError;
+    CircuitState circuit;
+    uint32_t failures; // 连续登录失败的次数
+    uint64_t retryAt;  // 熔断打开时下一次探测的时间
+    uint64_t rejected; // 熔断期间直接拒绝的请求数
+    CacheStats deviceCache;
+} SessionInfo;
+
+typedef struct tagReachability {
+    std::string ip;
+    bool reachable;
+    std::string vendor;     // 根据开放的sdk端口推测的厂商
+    std::vector<int> ports; // 可以连接的sdk端口
+    int32_t latency;        // 最快的端口连接耗时(ms)
+} Reachability;
+
+typedef struct tagWarmUpProgress {
+    bool running;
+    uint32_t total;
+    uint32_t done;
+    uint32_t succeeded;
+    uint32_t failed;
+    uint64_t startTime;
+    uint64_t elapsedMs;
+} WarmUpProgress;
+
+// 每个nvr一个会话，同一个nvr同时只有一个登录，其他请求等待这次登录的结果
 class SdkManager {
 public:
-    SdkManager() : probeWorker_(4), metaStore_("/mnt/sdk_meta") {}
+    enum {
+        RECONNECT_GRACE_MS = 30000,  // 断线后等待sdk自动重连的时间
+        RELOGIN_MIN_MS     = 1000,   // 后台重新登录的退避时间
+        RELOGIN_MAX_MS     = 60000,
+        DEAD_AFTER_MS      = 300000, // 断线超过这个时间还没有恢复时放弃后台重新登录
+        IDLE_EVICT_MS      = 600000, // 失效的会话超过这个时间没有请求时删除
+        MAINTAIN_MS        = 1000,
+        BREAKER_MIN_MS     = 2000,   // 熔断后第一次探测的等待时间，之后每次失败翻倍
+        BREAKER_MAX_MS     = 120000,
+        PROBE_TIMEOUT_MS   = 4000,   // 探测sdk端口的连接超时
+        PROBE_WORKERS      = 16,     // sdk登录线程数，重启预热时多个设备同时登录
+    };
+
+    // 预热时每个设备登录成功后回调，用于恢复设备上的任务
+    using OnWarmUp = std::function<void(const DeviceRecord &record, std::shared_ptr<SdkStub> stub)>;
+
+    SdkManager()
+        : probeWorker_(PROBE_WORKERS), reloginWorker_(2), metaStore_("/mnt/sdk_meta"), registry_(metaStore_, "/mnt/sdk_credential.key"),
+          running_(true), warmUp_() {
+        maintainer_ = std::thread([this]() { maintain(); });
+    }
+
+    DeviceRegistry &Registry() { return registry_; }
+
+    // 启动时在后台并行登录最近使用过的设备，最多parallel个同时登录，和请求触发的登录共用会话
+    void WarmUp(int32_t parallel, uint64_t maxAgeMs, OnWarmUp fn) {
+        std::vector<DeviceRecord> records = registry_.Load(maxAgeMs);
+        {
+            std::unique_lock<bthread::Mutex> lck(mutex_);
+            if (warmUp_.running || warmer_.joinable()) {
+                return;
+            }
+            warmUp_.running   = true;
+            warmUp_.total     = records.size();
+            warmUp_.startTime = TimeTool::now_to_ms();
+        }
+        LOG_INFO("Warm up {} devices, parallel {}", records.size(), parallel);
+        warmer_ = std::thread([this, records, parallel, fn]() { warmUp(records, std::max(parallel, 1), fn); });
+    }
 
-    std::shared_ptr<SdkStub> TryLoginAndGet(const std::string &ip, const std::string &user, const std::string &password) {
+    // 等待预热结束，超时返回false
+    bool WaitWarmUp(uint64_t timeoutMs) {
+        uint64_t deadline = TimeTool::now_to_ms() + timeoutMs;
+        std::unique_lock<bthread::Mutex> lck(mutex_);
+        while (warmUp_.running) {
+            uint64_t now = TimeTool::now_to_ms();
+            if (now >= deadline) {
+                return false;
+            }
+            warmUpCond_.wait_for(lck, (long)(deadline - now) * 1000);
+        }
+        return true;
+    }
+
+    WarmUpProgress GetWarmUpProgress() {
+        std::unique_lock<bthread::Mutex> lck(mutex_);
+        WarmUpProgress progress = warmUp_;
+        if (progress.running) {
+            progress.elapsedMs = TimeTool::now_to_ms() - progress.startTime;
+        }
+        return progress;
+    }
+
+    // remember为false时登录成功也不写入设备记录，用于按已有记录预热，不需要再保存一次密码
+    std::shared_ptr<SdkStub> TryLoginAndGet(const std::string &ip, const std::string &user, const std::string &password, bool remember = true) {
         if (ip.empty() || user.empty() || password.empty()) {
-            LOG_ERROR("Invalid param, ip={}, user={}, password={}", ip, user, password);
+            LOG_ERROR("Invalid param, ip={}, user={}", ip, user);
             return nullptr;
         }
 
         std::string key = buildSdkKey(ip);
-
-        // find from cache
+        std::shared_ptr<Session> session;
         {
-            std::unique_lock<std::mutex> lck(mutex_);
-            if (sdks_.find(key) != sdks_.end()) {
-                return sdks_[key];
+            std::unique_lock<bthread::Mutex> lck(mutex_);
+            std::shared_ptr<Session> &s = sessions_[key];
+            if (nullptr == s) {
+                s = std::make_shared<Session>(key, ip);
+            }
+            session             = s;
+            session->lastAccess = TimeTool::now_to_ms();
+
+            // 其他请求正在登录，等待它的结果
+            bool waited = false;
+            while (SESSION_CONNECTING == session->state) {
+                waited = true;
+                session->cond.wait(lck);
+            }
+            // 断线重连期间仍然返回原来的stub，调用失败由调用方处理
+            if (SESSION_ONLINE == session->state || SESSION_RECONNECTING == session->state) {
+                return session->stub;
+            }
+            // 等到的登录失败了，直接共享失败结果，不再重复登录
+            if (waited) {
+                if (session->loginFailed) {
+                    throw LoginException();
+                }
+                throw NetworkException();
+            }
+            // 熔断打开时同一账号直接失败，换了账号密码的请求仍然尝试登录
+            if (isRejected(session, user, password)) {
+                session->rejected++;
+                if (session->loginFailed) {
+                    throw LoginException();
+                }
+                throw NetworkException();
             }
+            // 由当前请求登录
+            session->state    = SESSION_CONNECTING;
+            session->since    = TimeTool::now_to_ms();
+            session->user     = user;
+            session->password = password;
         }
 
-        try {
-            auto stub = tryProbe(ip, user, password);
+        std::shared_ptr<SdkStub> stub;
+        bool loginFailed = false;
+        std::string error;
+        login(ip, user, password, stub, loginFailed, error);
 
-            // save to cache
-            std::unique_lock<std::mutex> lck(mutex_);
-            sdks_[key] = stub;
+        std::shared_ptr<SdkStub> old;
+        {
+            std::unique_lock<bthread::Mutex> lck(mutex_);
+            if (nullptr != stub) {
+                old = online(session, stub);
+            } else {
+                trip(session, loginFailed, error);
+                old.swap(session->stub);
+            }
+            session->cond.notify_all();
+        }
+        // 旧的stub在锁外释放，析构时会登出
+        old.reset();
 
+        if (nullptr != stub) {
             LOG_INFO("Probe address {} succeed, {}", ip, stub->GetDescription());
-
+            if (remember) {
+                registry_.Remember(ip, stub->GetVendor(), user, password);
+            }
             return stub;
-        } catch (std::exception &e) {
-            LOG_ERROR("Probe address {} failed, {}", ip, e.what());
-            throw;
         }
+        LOG_ERROR("Probe address {} failed, {}", ip, error);
+        if (loginFailed) {
+            throw LoginException();
+        }
+        throw NetworkException();
+    }
+
+    std::vector<SessionInfo> Sessions() {
+        std::vector<SessionInfo> infos;
+        std::unique_lock<bthread::Mutex> lck(mutex_);
+        for (auto &p : sessions_) {
+            SessionInfo info;
+            info.ip        = p.second->ip;
+            info.vendor    = nullptr == p.second->stub ? "" : p.second->stub->GetVendor();
+            info.state     = p.second->state;
+            info.since     = p.second->since;
+            info.attempts  = p.second->attempts;
+            info.logins    = p.second->logins;
+            info.lastError = p.second->lastError;
+            info.circuit   = circuitState(p.second);
+            info.failures  = p.second->failures;
+            info.retryAt   = p.second->nextRetry;
+            info.rejected  = p.second->rejected;
+            if (nullptr != p.second->stub) {
+                info.deviceCache = p.second->stub->GetDeviceCacheStats();
+            } else {
+                info.deviceCache = CacheStats();
+            }
+            infos.push_back(info);
+        }
+        return infos;
+    }
+
+    CircuitState GetCircuitState(const std::string &ip) {
+        std::unique_lock<bthread::Mutex> lck(mutex_);
+        auto iter = sessions_.find(buildSdkKey(ip));
+        return iter == sessions_.end() ? CIRCUIT_CLOSED : circuitState(iter->second);
+    }
+
+    // 登录成功过的nvr，元数据库中记录了厂商
+    bool IsKnown(const std::string &ip) {
+        std::string vendor;
+        return metaStore_.Get(buildSdkKey(ip), vendor);
+    }
+
+    // 批量探测nvr的sdk端口，不登录，同一批地址的所有端口同时连接
+    std::vector<Reachability> ProbeReachability(const std::vector<std::string> &ips, int32_t timeoutMs = PROBE_TIMEOUT_MS) {
+        std::vector<std::string> vendors = SdkStubFactory::GetVendors();
+        std::vector<ProbeTarget> targets;
+        for (auto &ip : ips) {
+            for (auto &v : vendors) {
+                targets.push_back(ProbeTarget{ip, vendorPort(v)});
+            }
+        }
+        std::vector<int32_t> latencies = prober_.Probe(targets, timeoutMs);
+
+        std::vector<Reachability> infos;
+        for (size_t i = 0; i < ips.size(); i++) {
+            Reachability info;
+            info.ip        = ips[i];
+            info.reachable = false;
+            info.latency   = -1;
+
+            std::string stored;
+            metaStore_.Get(buildSdkKey(ips[i]), stored);
+            for (size_t k = 0; k < vendors.size(); k++) {
+                int32_t latency = latencies[i * vendors.size() + k];
+                if (latency < 0) {
+                    continue;
+                }
+                // 多个厂商端口都开放时优先使用之前登录成功的厂商
+                if (info.vendor.empty() || stored == vendors[k]) {
+                    info.vendor = vendors[k];
+                }
+                if (!info.reachable || latency < info.latency) {
+                    info.latency = latency;
+                }
+                info.reachable = true;
+                info.ports.push_back(vendorPort(vendors[k]));
+            }
+            infos.push_back(info);
+        }
+        return infos;
     }
 
     ~SdkManager() {
-        std::unique_lock<std::mutex> lck(mutex_);
-        for (auto &p : sdks_) {
-            p.second->Logout();
+        {
+            std::unique_lock<bthread::Mutex> lck(mutex_);
+            running_ = false;
+        }
+        maintainCond_.notify_all();
+        if (maintainer_.joinable()) {
+            maintainer_.join();
+        }
+        if (warmer_.joinable()) {
+            warmer_.join();
+        }
+
+        // 在锁外登出，sdk的断线回调可能同时在等待锁
+        std::map<std::string, std::shared_ptr<Session>> sessions;
+        {
+            std::unique_lock<bthread::Mutex> lck(mutex_);
+            sessions.swap(sessions_);
+        }
+        for (auto &p : sessions) {
+            if (nullptr != p.second->stub) {
+                p.second->stub->Logout();
+            }
         }
-        sdks_.clear();
     }
 
 private:
+    typedef struct tagSession {
+        std::string key;
+        std::string ip;
+        std::string user;
+        std::string password;
+        SessionState state;
+        std::shared_ptr<SdkStub> stub;
+        bthread::ConditionVariable cond; // 等待登录的请求在bthread中，只挂起bthread
+        uint64_t since;
+        uint64_t lastAccess;
+        uint64_t nextRetry;
+        uint32_t attempts;
+        uint64_t logins;
+        bool relogging;
+        bool loginFailed; // 最近一次失败是密码错误，不在后台重试
+        std::string lastError;
+        uint32_t failures; // 大于0时熔断打开
+        uint64_t rejected;
+
+        tagSession(const std::string &k, const std::string &i)
+            : key(k), ip(i), state(SESSION_DEAD), since(TimeTool::now_to_ms()), lastAccess(since), nextRetry(0), attempts(0), logins(0),
+              relogging(false), loginFailed(false), failures(0), rejected(0) {}
+    } Session;
+
+    typedef struct tagProbeResult {
+        std::mutex mutex;
+        std::shared_ptr<SdkStub> stub;
+    } ProbeResult;
+
+    void login(const std::string &ip, const std::string &user, const std::string &password, std::shared_ptr<SdkStub> &stub, bool &loginFailed,
+               std::string &error) {
+        try {
+            stub = tryProbe(ip, user, password);
+            if (nullptr == stub) {
+                error = NetworkException().what();
+            }
+        } catch (LoginException &e) {
+            loginFailed = true;
+            error       = e.what();
+        } catch (std::exception &e) {
+            error = e.what();
+        }
+    }
+
+    // 持有mutex_时调用，返回被替换的stub，由调用方在锁外释放
+    std::shared_ptr<SdkStub> online(std::shared_ptr<Session> session, std::shared_ptr<SdkStub> stub) {
+        std::shared_ptr<SdkStub> old = session->stub;
+        session->stub                = stub;
+        session->state               = SESSION_ONLINE;
+        session->since               = TimeTool::now_to_ms();
+        session->attempts            = 0;
+        session->loginFailed         = false;
+        session->lastError.clear();
+        session->logins++;
+        if (session->failures > 0) {
+            LOG_INFO("Session {} circuit closed after {} failures", session->key, session->failures);
+            session->failures = 0;
+        }
+
+        // 只处理当前stub的断线和重连通知
+        std::string key = session->key;
+        SdkStub *ptr    = stub.get();
+        stub->SetConnectionListener([this, key, ptr](bool online) { onConnection(key, ptr, online); });
+        return old;
+    }
+
+    // 持有mutex_时调用，登录失败，打开熔断并按失败次数退避
+    void trip(std::shared_ptr<Session> session, bool loginFailed, const std::string &error) {
+        uint64_t now         = TimeTool::now_to_ms();
+        session->state       = SESSION_DEAD;
+        session->since       = now;
+        session->loginFailed = loginFailed;
+        session->lastError   = error;
+        session->failures++;
+        uint64_t backoff   = std::min<uint64_t>(BREAKER_MAX_MS, (uint64_t)BREAKER_MIN_MS << std::min<uint32_t>(session->failures - 1, 16));
+        session->nextRetry = now + backoff;
+        LOG_ERROR("Session {} circuit open, {} failures, {}, retry in {} ms", session->key, session->failures, error, backoff);
+    }
+
+    // 网络不通时由后台探测决定何时关闭熔断；密码错误时不在后台重试，避免nvr锁定账号，
+    // 退避时间过后放行下一个请求试探登录
+    bool isRejected(std::shared_ptr<Session> session, const std::string &user, const std::string &password) {
+        if (SESSION_DEAD != session->state || 0 == session->failures || user != session->user || password != session->password) {
+            return false;
+        }
+        return !session->loginFailed || TimeTool::now_to_ms() < session->nextRetry;
+    }
+
+    CircuitState circuitState(std::shared_ptr<Session> session) {
+        if (SESSION_DEAD != session->state || 0 == session->failures) {
+            return CIRCUIT_CLOSED;
+        }
+        if (session->relogging || (session->loginFailed && TimeTool::now_to_ms() >= session->nextRetry)) {
+            return CIRCUIT_HALF_OPEN;
+        }
+        return CIRCUIT_OPEN;
+    }
+
+    void warmUp(std::vector<DeviceRecord> records, int32_t parallel, OnWarmUp fn) {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> threads;
+        for (int32_t i = 0; i < parallel && i < (int32_t)records.size(); i++) {
+            threads.push_back(std::thread([this, &records, &next, fn]() {
+                for (size_t idx = next++; idx < records.size(); idx = next++) {
+                    {
+                        std::unique_lock<bthread::Mutex> lck(mutex_);
+                        if (!running_) {
+                            break;
+                        }
+                    }
+                    const DeviceRecord &record = records[idx];
+                    std::shared_ptr<SdkStub> stub;
+                    try {
+                        stub = TryLoginAndGet(record.ip, record.user, record.password, false);
+                    } catch (std::exception &e) {
+                        LOG_ERROR("Warm up device {} failed, {}", record.ip, e.what());
+                    }
+                    if (nullptr != stub && nullptr != fn) {
+                        fn(record, stub);
+                    }
+
+                    std::unique_lock<bthread::Mutex> lck(mutex_);
+                    warmUp_.done++;
+                    if (nullptr != stub) {
+                        warmUp_.succeeded++;
+                    } else {
+                        warmUp_.failed++;
+                    }
+                }
+            }));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+
+        std::unique_lock<bthread::Mutex> lck(mutex_);
+        warmUp_.running   = false;
+        warmUp_.elapsedMs = TimeTool::now_to_ms() - warmUp_.startTime;
+        LOG_INFO("Warm up finished in {} ms, {} succeed, {} failed", warmUp_.elapsedMs, warmUp_.succeeded, warmUp_.failed);
+        warmUpCond_.notify_all();
+    }
+
+    void onConnection(const std::string &key, SdkStub *stub, bool online) {
+        std::unique_lock<bthread::Mutex> lck(mutex_);
+        auto iter = sessions_.find(key);
+        if (iter == sessions_.end() || iter->second->stub.get() != stub) {
+            return;
+        }
+        std::shared_ptr<Session> session = iter->second;
+        uint64_t now                     = TimeTool::now_to_ms();
+        if (!online && SESSION_ONLINE == session->state) {
+            LOG_INFO("Session {} disconnected, wait for reconnecting", key);
+            session->state     = SESSION_RECONNECTING;
+            session->since     = now;
+            session->attempts  = 0;
+            session->nextRetry = now + RECONNECT_GRACE_MS;
+        } else if (online && SESSION_RECONNECTING == session->state) {
+            LOG_INFO("Session {} reconnected after {} ms", key, now - session->since);
+            session->state    = SESSION_ONLINE;
+            session->since    = now;
+            session->attempts = 0;
+        }
+    }
+
+    // 后台线程：断线太久的会话重新登录，长时间没有请求的失效会话删除
+    void maintain() {
+        while (true) {
+            std::vector<std::shared_ptr<Session>> relogins;
+            std::vector<std::shared_ptr<Session>> evicted;
+            {
+                std::unique_lock<bthread::Mutex> lck(mutex_);
+                if (running_) {
+                    maintainCond_.wait_for(lck, (long)MAINTAIN_MS * 1000);
+                }
+                if (!running_) {
+                    break;
+                }
+                uint64_t now = TimeTool::now_to_ms();
+                for (auto iter = sessions_.begin(); iter != sessions_.end();) {
+                    std::shared_ptr<Session> session = iter->second;
+                    if (SESSION_RECONNECTING == session->state && !session->relogging) {
+                        if (now - session->since >= DEAD_AFTER_MS) {
+                            LOG_ERROR("Session {} is dead, disconnected for {} ms, {} relogin attempts", session->key, now - session->since,
+                                      session->attempts);
+                            trip(session, false, session->lastError.empty() ? NetworkException().what() : session->lastError);
+                        } else if (now >= session->nextRetry) {
+                            session->relogging = true;
+                            relogins.push_back(session);
+                        }
+                    } else if (SESSION_DEAD == session->state && session->failures > 0 && !session->loginFailed && !session->relogging &&
+                               now >= session->nextRetry) {
+                        // 熔断打开的会话只有这一个后台探测
+                        session->relogging = true;
+                        relogins.push_back(session);
+                    }
+                    if (SESSION_DEAD == session->state && !session->relogging && now - session->lastAccess >= IDLE_EVICT_MS) {
+                        evicted.push_back(session);
+                        iter = sessions_.erase(iter);
+                    } else {
+                        ++iter;
+                    }
+                }
+            }
+
+            for (auto &session : relogins) {
+                reloginWorker_.commit([this, session]() { relogin(session); });
+            }
+            for (auto &session : evicted) {
+                LOG_INFO("Session {} evicted", session->key);
+            }
+            // evicted析构时在锁外释放stub
+        }
+    }
+
+    void relogin(std::shared_ptr<Session> session) {
+        std::string ip, user, password;
+        SessionState state;
+        {
+            std::unique_lock<bthread::Mutex> lck(mutex_);
+            ip       = session->ip;
+            user     = session->user;
+            password = session->password;
+            state    = session->state;
+        }
+
+        LOG_INFO("Relogin session {}", session->key);
+        std::shared_ptr<SdkStub> stub;
+        bool loginFailed = false;
+        std::string error;
+        login(ip, user, password, stub, loginFailed, error);
+
+        std::shared_ptr<SdkStub> old;
+        {
+            std::unique_lock<bthread::Mutex> lck(mutex_);
+            session->relogging = false;
+            session->attempts++;
+            if (state != session->state) {
+                // 等待期间sdk自己重连成功了，或者有请求重新登录了，丢弃新登录的stub
+                old = stub;
+            } else if (nullptr != stub) {
+                LOG_INFO("Session {} relogin succeed after {} attempts", session->key, session->attempts);
+                old = online(session, stub);
+                session->cond.notify_all();
+            } else if (SESSION_DEAD == state || loginFailed) {
+                trip(session, loginFailed, error);
+            } else {
+                uint64_t backoff   = std::min<uint64_t>(RELOGIN_MAX_MS, (uint64_t)RELOGIN_MIN_MS << std::min<uint32_t>(session->attempts - 1, 16));
+                session->nextRetry = TimeTool::now_to_ms() + backoff;
+                session->lastError = error;
+                LOG_ERROR("Session {} relogin failed, {}, retry in {} ms", session->key, error, backoff);
+            }
+        }
+    }
+
     std::shared_ptr<SdkStub> tryProbe(const std::string &ip, const std::string &user, const std::string &password) {
         std::shared_ptr<SdkStub> stub = nullptr;
         std::string key               = buildSdkKey(ip);
@@ -120,22 +665,33 @@ private:
             return nullptr;
         }
 
-        std::shared_ptr<SdkStub> stub = nullptr;
+        // quick check the address, 所有厂商的端口同时探测，只登录端口开放的厂商
+        std::vector<ProbeTarget> targets;
+        for (auto &v : vendorList) {
+            targets.push_back(ProbeTarget{ip, vendorPort(v)});
+        }
+        std::vector<int32_t> latencies = prober_.Probe(targets, PROBE_TIMEOUT_MS);
+
+        // 找到后不等待其他厂商的探测结束，结果放在共享的状态中
+        std::shared_ptr<ProbeResult> found = std::make_shared<ProbeResult>();
         std::vector<std::future<int>> results;
 
         // start asynchronous probe
-        for (auto &v : vendorList) {
-            results.push_back(probeWorker_.commit([this, v, ip, user, password, &stub]() {
+        for (size_t i = 0; i < vendorList.size(); i++) {
+            if (latencies[i] < 0) {
+                continue;
+            }
+            std::string v = vendorList[i];
+            results.push_back(probeWorker_.commit([this, v, ip, user, password, found]() {
                 std::shared_ptr<SdkStub> s = SdkStubFactory::Create(v);
-                // quick check the address
-                if (!isHostReachable(ip, s->GetPort())) {
-                    return -1;
-                }
                 // try login
                 if (0 != s->Login(ip, user, password)) {
                     return -2;
                 }
-                stub = s;
+                std::unique_lock<std::mutex> lck(found->mutex);
+                if (nullptr == found->stub) {
+                    found->stub = s;
+                }
                 return 0;
             }));
         }
@@ -152,6 +708,11 @@ private:
         }
 
         // check result
+        std::shared_ptr<SdkStub> stub;
+        {
+            std::unique_lock<std::mutex> lck(found->mutex);
+            stub = found->stub;
+        }
         if (nullptr == stub) {
             if (loginErrorTimes > 0) {
                 throw LoginException();
@@ -163,38 +724,37 @@ private:
         }
     }
 
-    bool isHostReachable(const std::string &ip, int port) {
-        int fd;
-        struct sockaddr_in addr;
-        struct timeval timeo = {4, 0};
-        socklen_t len        = sizeof(timeo);
-        bool reachable       = true;
-
-        fd = socket(AF_INET, SOCK_STREAM, 0);
-        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeo, len);
-
-        addr.sin_family      = AF_INET;
-        addr.sin_addr.s_addr = inet_addr(ip.c_str());
-        addr.sin_port        = htons(port);
-
-        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
-            reachable = false;
-            //             if (errno == EINPROGRESS) {
-            //                 //timeout? return true
-            //                 reachable = true;
-            //             }
+    // 厂商sdk的默认端口，第一次用到时创建stub获取
+    int vendorPort(const std::string &vendor) {
+        std::unique_lock<std::mutex> lck(portMutex_);
+        auto iter = vendorPorts_.find(vendor);
+        if (iter != vendorPorts_.end()) {
+            return iter->second;
         }
-        close(fd);
-        return reachable;
+        int port             = SdkStubFactory::Create(vendor)->GetPort();
+        vendorPorts_[vendor] = port;
+        return port;
     }
 
     std::string buildSdkKey(const std::string &ip) { return ip; }
 
 private:
-    std::mutex mutex_;
-    std::map<std::string, std::shared_ptr<SdkStub>> sdks_;
+    // 在brpc的bthread中等待其他请求的登录结果，用bthread的锁和条件变量，不占住工作线程
+    bthread::Mutex mutex_;
+    std::map<std::string, std::shared_ptr<Session>> sessions_;
     std::threadpool probeWorker_;
+    std::threadpool reloginWorker_;
     MetaDataStore metaStore_;
+    DeviceRegistry registry_;
+    ConnectProber prober_;
+    std::mutex portMutex_;
+    std::map<std::string, int> vendorPorts_;
+    bool running_;
+    bthread::ConditionVariable maintainCond_;
+    std::thread maintainer_;
+    WarmUpProgress warmUp_;
+    bthread::ConditionVariable warmUpCond_;
+    std::thread warmer_;
 };
 
 SdkManager &SDK_MNG() {
@@ -5,10 +5,14 @@
 #include <vector>
 #include <sstream>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 #include "common/helper/logger.h"
 #include "3rdsdk/stub/po_type.h"
 #include "3rdsdk/stub/cache.h"
+#include "3rdsdk/stub/device_catalog.h"
 
 namespace sdkproxy {
 namespace sdk {
@@ -18,15 +22,26 @@ public:
     void *thisClass;
 };
 
-class SdkStub {
+class SdkStub : public std::enable_shared_from_this<SdkStub> {
 public:
+    // 下载数据回调，buffer为nullptr表示结束，bufferLen为0是正常结束，小于0是出错
     using OnDownloadData = std::function<void(intptr_t id, const uint8_t *buffer, int32_t bufferLen)>;
     using OnRealPlayData = std::function<void(intptr_t id, const uint8_t *buffer, int32_t bufferLen)>;
+    // 流式查询录像的回调，返回false时停止查询
+    using OnRecord = std::function<bool(const RecordInfo &record)>;
     using OnAnalyzeData =
         std::function<void(intptr_t id, int type, const std::string &jsonData, const uint8_t *imgBuffer, int32_t imgBufferLen, void *userData)>;
+    // 与设备的连接断开或恢复，在sdk的回调线程中调用
+    using OnConnection = std::function<void(bool online)>;
 
 public:
-    SdkStub(const std::string &vendor, const std::string &description, int port) : vendor_(vendor), description_(description), port_(port) {
+    enum {
+        DEVICE_CACHE_JITTER_MS = 300000, // 各nvr的设备列表错开过期
+        CATALOG_CHECK_MS       = 1000,
+    };
+
+    SdkStub(const std::string &vendor, const std::string &description, int port)
+        : vendor_(vendor), description_(description), port_(port), deviceCache_(EXPIRE_TIME * 1000, DEVICE_CACHE_JITTER_MS), catalogCheckAt_(0) {
         LOG_INFO("\033[0;33mInitialize sdk for {}, {}\033[0m", vendor, description);
     }
 
@@ -38,35 +53,76 @@ public:
 
     int GetPort() const { return port_; }
 
-    std::string ChannelIp2Id(const std::string &channelIp) {
-        std::string id = "";
-        std::vector<Device> devices;
-        int ret = QueryDeviceCache(devices);
-        if (ret == 0) {
-            for (auto &d : devices) {
-                if (d.ip == channelIp) {
-                    id = d.id;
-                }
-            }
+    void SetConnectionListener(OnConnection listener) {
+        std::unique_lock<std::mutex> lck(connectionMutex_);
+        connectionListener_ = listener;
+    }
+
+    // 由厂商实现在sdk的断线和重连回调中调用
+    void NotifyConnection(bool online) {
+        OnConnection listener;
+        {
+            std::unique_lock<std::mutex> lck(connectionMutex_);
+            listener = connectionListener_;
+        }
+        if (nullptr != listener) {
+            listener(online);
         }
+    }
+
+    std::string ChannelIp2Id(const std::string &channelIp) {
+        std::shared_ptr<const DeviceCatalog> catalog = GetDeviceCatalog();
+        std::string id                               = nullptr == catalog ? "" : catalog->ChannelIp2Id(channelIp);
         LOG_INFO("ChannelIp2Id: {} -> {}", channelIp, id);
         return id;
     }
 
     int32_t QueryDeviceCache(std::vector<Device> &devices) {
-        deviceCache_.setQueryFunc([&](const std::string &k, Cache<std::vector<Device>>::Value &v) { return QueryDevice(v.value); });
+        std::shared_ptr<const DeviceCatalog> catalog = GetDeviceCatalog();
+        if (nullptr == catalog) {
+            return -1;
+        }
+        devices = catalog->GetDevices();
+        return 0;
+    }
 
-        Cache<std::vector<Device>>::Value v;
-        int ret = deviceCache_.Query("device", v);
-        if (0 != ret) {
-            return ret;
+    // 通道列表的快照，查询时不加锁也不复制，每隔CATALOG_CHECK_MS经过一次缓存，过期时触发后台刷新
+    // 刷新成功后整体替换快照，已经拿到旧快照的调用方不受影响
+    std::shared_ptr<const DeviceCatalog> GetDeviceCatalog() {
+        uint64_t now                                 = TimeTool::now_to_ms();
+        std::shared_ptr<const DeviceCatalog> catalog = std::atomic_load(&catalog_);
+        if (nullptr != catalog && now < catalogCheckAt_.load()) {
+            return catalog;
         }
+        catalogCheckAt_ = now + CATALOG_CHECK_MS;
 
-        devices = v.value;
+        // 设备列表过期后返回旧的列表，在后台刷新，刷新期间持有stub
+        std::weak_ptr<SdkStub> self = shared_from_this();
 
-        return 0;
+        auto queryFunc = [self](const std::string &k, Cache<std::shared_ptr<const DeviceCatalog>>::Value &v) -> int32_t {
+            std::shared_ptr<SdkStub> stub = self.lock();
+            if (nullptr == stub) {
+                return -1;
+            }
+            std::vector<Device> devices;
+            int32_t ret = stub->QueryDevice(devices);
+            if (0 != ret) {
+                return ret;
+            }
+            v.value = std::make_shared<const DeviceCatalog>(std::move(devices));
+            std::atomic_store(&stub->catalog_, v.value);
+            return 0;
+        };
+
+        Cache<std::shared_ptr<const DeviceCatalog>>::Value v;
+        if (0 != deviceCache_.Query("device", v, queryFunc)) {
+            return catalog;
+        }
+        return v.value;
     }
 
+    CacheStats GetDeviceCacheStats() { return deviceCache_.Stats(); }
+
     virtual int32_t Login(const std::string &ip, const std::string &user, const std::string &password) { return -1; };
 
     virtual int32_t Logout() { return -1; };
@@ -81,6 +137,22 @@ public:
         return -1;
     }
 
+    // 流式查询录像，按开始时间顺序每找到一条回调一次，不需要在内存中保存全部结果
+    // 默认用QueryRecord实现，支持设备端分页的厂商应该重载
+    virtual int32_t FindRecord(const std::string &devId, const TimePoint &startTime, const TimePoint &endTime, OnRecord onRecord) {
+        std::vector<RecordInfo> records;
+        int32_t ret = QueryRecord(devId, startTime, endTime, records);
+        if (0 != ret) {
+            return ret;
+        }
+        for (auto &r : records) {
+            if (!onRecord(r)) {
+                break;
+            }
+        }
+        return 0;
+    }
+
     virtual int32_t DownloadRecordByTime(const std::string &devId, const TimePoint &startTime, const TimePoint &endTime, OnDownloadData onData,
                                          intptr_t &jobId) {
         return -1;
@@ -88,6 +160,18 @@ public:
 
     virtual int32_t StopDownloadRecord(intptr_t &jobId) { return -1; }
 
+    // 暂停或恢复录像下载，用于客户端慢时的流量控制
+    virtual int32_t PauseDownloadRecord(intptr_t jobId, bool pause) { return -1; }
+
+    // 请求nvr按speed倍速下载，设备拒绝时退回到能接受的最高倍速，返回实际生效的倍速，不支持时返回1
+    virtual int32_t SetDownloadSpeed(intptr_t jobId, int32_t speed) { return 1; }
+
+    // 启动下载的错误码是否表示nvr的会话数或连接数到了上限，只有这种错误才值得排队重试
+    virtual bool IsSessionLimitError(int32_t ret) { return false; }
+
+    // 下载进度在DOWNLOAD_POLLER()中的id，0表示不支持查询进度
+    virtual uint64_t GetDownloadProgressId(intptr_t jobId) { return 0; }
+
     virtual int32_t StartEventAnalyze(const std::string &devId, OnAnalyzeData onData, void *userData, intptr_t &jobId) { return -1; }
 
     virtual int32_t StopEventAnalyze(intptr_t &jobId) { return -1; }
@@ -110,7 +194,11 @@ private:
     std::string vendor_;
     std::string description_;
     int port_;
-    Cache<std::vector<Device>> deviceCache_;
+    Cache<std::shared_ptr<const DeviceCatalog>> deviceCache_;
+    std::shared_ptr<const DeviceCatalog> catalog_;
+    std::atomic<uint64_t> catalogCheckAt_;
+    std::mutex connectionMutex_;
+    OnConnection connectionListener_;
 };
 
 } // namespace sdk
@@ -0,0 +1,799 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace sdkproxy {
+
+enum MediaFrameType {
+    FRAME_OTHER     = 0,
+    FRAME_HEADER    = 1, // 流头，例如海康的40字节IMKH头
+    FRAME_VIDEO_KEY = 2,
+    FRAME_VIDEO     = 3,
+    FRAME_AUDIO     = 4,
+};
+
+enum MediaFormat {
+    FORMAT_UNKNOWN = 0,
+    FORMAT_PS      = 1,
+    FORMAT_TS      = 2,
+    FORMAT_DAV     = 3,
+};
+
+enum VideoCodec {
+    CODEC_UNKNOWN = 0,
+    CODEC_H264    = 1,
+    CODEC_H265    = 2,
+};
+
+enum AudioCodec {
+    AUDIO_UNKNOWN = 0,
+    AUDIO_AAC     = 1,
+    AUDIO_MPEG    = 2, // MP2/MP3
+    AUDIO_G711A   = 3,
+    AUDIO_G711U   = 4,
+};
+
+// 一个完整的媒体帧，sync表示播放器可以从这一帧开始解码
+typedef struct tagMediaFrame {
+    MediaFrameType type;
+    MediaFormat format;
+    bool sync;
+    std::string data;
+    std::shared_ptr<const std::string> psi; // TS关键帧前没有PAT/PMT时，最近一次的PAT/PMT
+
+    tagMediaFrame() : type(FRAME_OTHER), format(FORMAT_UNKNOWN), sync(false) {}
+
+    bool IsKey() const { return FRAME_VIDEO_KEY == type; }
+} MediaFrame;
+
+typedef std::shared_ptr<const MediaFrame> MediaFramePtr;
+
+// 把sdk回调的任意分块数据切分成完整的帧，支持PS、TS和大华DAV，其他格式按原始分块透传
+// 只在生产者线程中使用，非线程安全
+class FrameSplitter {
+public:
+    FrameSplitter() : format_(FORMAT_UNKNOWN), codec_(CODEC_UNKNOWN), detected_(false), scanPos_(0), tsVideoPid_(-1), tsPmtPid_(-1) {}
+
+    MediaFormat GetFormat() const { return format_; }
+
+    VideoCodec GetCodec() const { return codec_; }
+
+    void Feed(const uint8_t *buffer, size_t len, std::vector<MediaFramePtr> &out) {
+        if (!detected_) {
+            // 海康的第一个回调是40字节的系统头
+            if (len == 40 && 0 == memcmp(buffer, "IMKH", 4)) {
+                out.push_back(makeFrame(FRAME_HEADER, true, std::string((const char *)buffer, len)));
+                return;
+            }
+            buf_.append((const char *)buffer, len);
+            if (!detect()) {
+                return;
+            }
+        } else if (FORMAT_UNKNOWN == format_) {
+            out.push_back(makeFrame(FRAME_OTHER, true, std::string((const char *)buffer, len)));
+            return;
+        } else {
+            buf_.append((const char *)buffer, len);
+        }
+
+        switch (format_) {
+        case FORMAT_PS:
+            splitPs(out);
+            break;
+        case FORMAT_TS:
+            splitTs(out);
+            break;
+        case FORMAT_DAV:
+            splitDav(out);
+            break;
+        default:
+            if (!buf_.empty()) {
+                out.push_back(makeFrame(FRAME_OTHER, true, buf_));
+                buf_.clear();
+            }
+            break;
+        }
+    }
+
+    // 流结束时输出剩余的数据
+    void Flush(std::vector<MediaFramePtr> &out) {
+        if (FORMAT_PS == format_ && !buf_.empty()) {
+            std::string last;
+            last.swap(buf_);
+            onPack((const uint8_t *)last.data(), last.size(), out);
+        }
+        if (nullptr != cur_) {
+            cur_->data.append(buf_);
+            out.push_back(cur_);
+            cur_ = nullptr;
+        } else if (!buf_.empty()) {
+            out.push_back(makeFrame(FRAME_OTHER, FORMAT_UNKNOWN == format_, buf_));
+        }
+        buf_.clear();
+        scanPos_ = 0;
+    }
+
+private:
+    std::shared_ptr<MediaFrame> makeFrame(MediaFrameType type, bool sync, const std::string &data) const {
+        std::shared_ptr<MediaFrame> f = std::make_shared<MediaFrame>();
+        f->type                       = type;
+        f->format                     = format_;
+        f->sync                       = sync;
+        f->data                       = data;
+        return f;
+    }
+
+    static bool isStartCode(const uint8_t *p, size_t n, uint8_t id) { return n >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 1 && p[3] == id; }
+
+    bool detect() {
+        if (buf_.size() < 4) {
+            return false;
+        }
+        const uint8_t *p = (const uint8_t *)buf_.data();
+        if (0 == memcmp(p, "DHAV", 4)) {
+            format_ = FORMAT_DAV;
+        } else if (isStartCode(p, buf_.size(), 0xBA)) {
+            format_ = FORMAT_PS;
+        } else if (p[0] == 0x47) {
+            if (buf_.size() <= 188) {
+                return false;
+            }
+            format_ = p[188] == 0x47 ? FORMAT_TS : FORMAT_UNKNOWN;
+        } else {
+            format_ = FORMAT_UNKNOWN;
+        }
+        detected_ = true;
+        return true;
+    }
+
+    // 根据NAL类型判断关键帧，SPS/VPS也视为关键帧的开始
+    bool hasKeyNal(const uint8_t *p, size_t n) const {
+        for (size_t i = 0; i + 3 < n; i++) {
+            if (p[i] != 0 || p[i + 1] != 0 || p[i + 2] != 1) {
+                continue;
+            }
+            uint8_t nal = p[i + 3];
+            if (CODEC_H265 == codec_) {
+                int type = (nal >> 1) & 0x3f;
+                if ((type >= 16 && type <= 21) || (type >= 32 && type <= 34)) {
+                    return true;
+                }
+            } else {
+                int type = nal & 0x1f;
+                if (type == 5 || type == 7) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void setCodec(uint8_t streamType) {
+        if (streamType == 0x1b) {
+            codec_ = CODEC_H264;
+        } else if (streamType == 0x24) {
+            codec_ = CODEC_H265;
+        }
+    }
+
+    /**-------------------------------- PS --------------------------------**/
+
+    enum PackKind {
+        PACK_VIDEO_KEY,
+        PACK_VIDEO,
+        PACK_VIDEO_CONT, // 大帧被拆成多个pack时的后续部分
+        PACK_AUDIO,
+        PACK_OTHER,
+    };
+
+    // 解析PSM，获取视频编码类型
+    void parsePsm(const uint8_t *p, size_t n) {
+        if (n < 12) {
+            return;
+        }
+        size_t infoLen = (p[8] << 8) | p[9];
+        size_t pos     = 10 + infoLen;
+        if (pos + 2 > n) {
+            return;
+        }
+        size_t mapLen = (p[pos] << 8) | p[pos + 1];
+        size_t end    = std::min(n, pos + 2 + mapLen);
+        for (pos += 2; pos + 4 <= end;) {
+            uint8_t streamType = p[pos];
+            uint8_t esId       = p[pos + 1];
+            size_t esInfoLen   = (p[pos + 2] << 8) | p[pos + 3];
+            if (esId >= 0xE0 && esId <= 0xEF) {
+                setCodec(streamType);
+            }
+            pos += 4 + esInfoLen;
+        }
+    }
+
+    PackKind classifyPack(const uint8_t *p, size_t n) {
+        if (n < 14) {
+            return PACK_OTHER;
+        }
+        bool sysHeader = false;
+        size_t pos     = 14 + (p[13] & 0x07);
+        while (pos + 6 <= n) {
+            if (p[pos] != 0 || p[pos + 1] != 0 || p[pos + 2] != 1) {
+                break;
+            }
+            uint8_t id    = p[pos + 3];
+            size_t pesLen = (p[pos + 4] << 8) | p[pos + 5];
+            if (id == 0xBB) {
+                sysHeader = true;
+            } else if (id == 0xBC) {
+                sysHeader = true;
+                parsePsm(p + pos, std::min(n - pos, pesLen + 6));
+            } else if (id >= 0xE0 && id <= 0xEF) {
+                if (pos + 9 > n) {
+                    break;
+                }
+                size_t payload = pos + 9 + p[pos + 8];
+                if (payload + 3 > n) {
+                    break;
+                }
+                const uint8_t *es = p + payload;
+                bool newFrame     = es[0] == 0 && es[1] == 0 && (es[2] == 1 || (payload + 4 <= n && es[2] == 0 && es[3] == 1));
+                if (sysHeader) {
+                    return PACK_VIDEO_KEY;
+                }
+                if (!newFrame) {
+                    return PACK_VIDEO_CONT;
+                }
+                return hasKeyNal(es, std::min<size_t>(n - payload, 512)) ? PACK_VIDEO_KEY : PACK_VIDEO;
+            } else if (id >= 0xC0 && id <= 0xDF) {
+                return PACK_AUDIO;
+            }
+            pos += 6 + pesLen;
+        }
+        return sysHeader ? PACK_VIDEO_KEY : PACK_OTHER;
+    }
+
+    void onPack(const uint8_t *p, size_t n, std::vector<MediaFramePtr> &out) {
+        PackKind kind = classifyPack(p, n);
+        if (PACK_VIDEO_CONT == kind && nullptr != cur_) {
+            cur_->data.append((const char *)p, n);
+            return;
+        }
+
+        if (nullptr != cur_) {
+            out.push_back(cur_);
+        }
+
+        switch (kind) {
+        case PACK_VIDEO_KEY:
+            cur_ = makeFrame(FRAME_VIDEO_KEY, true, std::string((const char *)p, n));
+            break;
+        case PACK_VIDEO:
+        case PACK_VIDEO_CONT:
+            cur_ = makeFrame(FRAME_VIDEO, false, std::string((const char *)p, n));
+            break;
+        case PACK_AUDIO:
+            cur_ = makeFrame(FRAME_AUDIO, false, std::string((const char *)p, n));
+            break;
+        default:
+            cur_ = makeFrame(FRAME_OTHER, false, std::string((const char *)p, n));
+            break;
+        }
+    }
+
+    void splitPs(std::vector<MediaFramePtr> &out) {
+        const uint8_t *p = (const uint8_t *)buf_.data();
+        size_t n         = buf_.size();
+        size_t begin     = 0;
+        size_t i         = std::max<size_t>(scanPos_, 1);
+        for (; i + 4 <= n; i++) {
+            if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1 && p[i + 3] == 0xBA) {
+                onPack(p + begin, i - begin, out);
+                begin = i;
+                i += 3;
+            }
+        }
+        buf_.erase(0, begin);
+        scanPos_ = buf_.size() >= 3 ? buf_.size() - 3 : 0;
+        if (scanPos_ < 1) {
+            scanPos_ = 1;
+        }
+
+        // 下一个pack的头已经到达并且不是上一帧的延续时，上一帧已完整，不必等下一个pack结束
+        if (nullptr != cur_ && buf_.size() >= 64) {
+            PackKind kind = classifyPack((const uint8_t *)buf_.data(), buf_.size());
+            if (PACK_VIDEO_CONT != kind && PACK_OTHER != kind) {
+                out.push_back(cur_);
+                cur_ = nullptr;
+            }
+        }
+    }
+
+    /**-------------------------------- TS --------------------------------**/
+
+    static const size_t MAX_TS_FRAME_SIZE = 4 * 1024 * 1024;
+
+    void parsePat(const uint8_t *p, size_t n) {
+        if (n < 8) {
+            return;
+        }
+        size_t sectionLen = ((p[1] & 0x0f) << 8) | p[2];
+        if (sectionLen < 9) {
+            return;
+        }
+        size_t end = std::min(n, 3 + sectionLen) - 4; // crc
+        for (size_t pos = 8; pos + 4 <= end; pos += 4) {
+            int program = (p[pos] << 8) | p[pos + 1];
+            if (program != 0) {
+                tsPmtPid_ = ((p[pos + 2] & 0x1f) << 8) | p[pos + 3];
+                return;
+            }
+        }
+    }
+
+    void parsePmt(const uint8_t *p, size_t n) {
+        if (n < 12 || p[0] != 0x02) {
+            return;
+        }
+        size_t sectionLen = ((p[1] & 0x0f) << 8) | p[2];
+        if (sectionLen < 13) {
+            return;
+        }
+        size_t end     = std::min(n, 3 + sectionLen) - 4; // crc
+        size_t infoLen = ((p[10] & 0x0f) << 8) | p[11];
+        for (size_t pos = 12 + infoLen; pos + 5 <= end;) {
+            uint8_t streamType = p[pos];
+            int pid            = ((p[pos + 1] & 0x1f) << 8) | p[pos + 2];
+            size_t esInfoLen   = ((p[pos + 3] & 0x0f) << 8) | p[pos + 4];
+            if (streamType == 0x1b || streamType == 0x24 || streamType == 0x02 || streamType == 0x10) {
+                tsVideoPid_ = pid;
+                setCodec(streamType);
+            }
+            pos += 5 + esInfoLen;
+        }
+    }
+
+    void onTsPacket(const uint8_t *p, std::vector<MediaFramePtr> &out) {
+        int pid          = ((p[1] & 0x1f) << 8) | p[2];
+        bool pusi        = p[1] & 0x40;
+        int afc          = (p[3] >> 4) & 0x03;
+        size_t payload   = 4;
+        bool randomAccess = false;
+        if (afc & 0x02) {
+            payload += 1 + p[4];
+            randomAccess = p[4] > 0 && (p[5] & 0x40);
+        }
+        if (!(afc & 0x01) || payload >= 188) {
+            payload = 188;
+        }
+
+        // PSI放到下一帧的开头，保证关键帧之前带有PAT/PMT
+        if (pid == 0 || pid == tsPmtPid_) {
+            if (pusi && payload < 188) {
+                size_t section = payload + 1 + p[payload];
+                if (section < 188) {
+                    if (pid == 0) {
+                        parsePat(p + section, 188 - section);
+                    } else {
+                        parsePmt(p + section, 188 - section);
+                    }
+                }
+            }
+            psi_.append((const char *)p, 188);
+            return;
+        }
+
+        // 没有PMT时根据PES的stream id识别视频
+        if (tsVideoPid_ < 0 && pusi && payload + 4 <= 188 && p[payload] == 0 && p[payload + 1] == 0 && p[payload + 2] == 1 &&
+            p[payload + 3] >= 0xE0 && p[payload + 3] <= 0xEF) {
+            tsVideoPid_ = pid;
+        }
+
+        if (pid == tsVideoPid_ && pusi) {
+            if (nullptr != cur_) {
+                out.push_back(cur_);
+            }
+            bool key = randomAccess;
+            if (!key && payload + 9 <= 188) {
+                size_t es = payload + 9 + p[payload + 8];
+                key       = es < 188 && hasKeyNal(p + es, 188 - es);
+            }
+            cur_ = makeFrame(key ? FRAME_VIDEO_KEY : FRAME_VIDEO, key, psi_);
+            if (!psi_.empty()) {
+                lastPsi_ = std::make_shared<const std::string>(psi_);
+            } else if (key) {
+                cur_->psi = lastPsi_;
+            }
+            psi_.clear();
+        } else if (nullptr == cur_) {
+            // 第一个视频帧之前的数据
+            cur_ = makeFrame(FRAME_OTHER, false, psi_);
+            psi_.clear();
+        }
+        cur_->data.append((const char *)p, 188);
+
+        // 没有视频的流，按大小切分
+        if (cur_->data.size() >= MAX_TS_FRAME_SIZE) {
+            out.push_back(cur_);
+            cur_ = makeFrame(FRAME_OTHER, false, "");
+        }
+    }
+
+    void splitTs(std::vector<MediaFramePtr> &out) {
+        const uint8_t *p = (const uint8_t *)buf_.data();
+        size_t n         = buf_.size();
+        size_t pos       = 0;
+        while (pos + 188 <= n) {
+            if (p[pos] != 0x47) {
+                // 失去同步，找下一个同步字节
+                pos++;
+                continue;
+            }
+            onTsPacket(p + pos, out);
+            pos += 188;
+        }
+        buf_.erase(0, pos);
+    }
+
+    /**-------------------------------- DAV --------------------------------**/
+
+    static const size_t MAX_DAV_FRAME_SIZE = 8 * 1024 * 1024;
+
+    // 大华DAV帧: 24字节的DHAV头，帧长度在头的12~15字节(小端)，包含8字节的dhav尾
+    void splitDav(std::vector<MediaFramePtr> &out) {
+        const uint8_t *p = (const uint8_t *)buf_.data();
+        size_t n         = buf_.size();
+        size_t pos       = 0;
+        while (pos + 24 <= n) {
+            if (0 != memcmp(p + pos, "DHAV", 4)) {
+                pos++;
+                continue;
+            }
+            uint32_t frameLen = p[pos + 12] | (p[pos + 13] << 8) | (p[pos + 14] << 16) | ((uint32_t)p[pos + 15] << 24);
+            // 长度异常的头视为误匹配继续找下一个DHAV，避免缓冲区为了等待这一帧无限增长
+            if (frameLen < 24 || frameLen > MAX_DAV_FRAME_SIZE) {
+                pos++;
+                continue;
+            }
+            if (pos + frameLen > n) {
+                break;
+            }
+
+            MediaFrameType type = FRAME_OTHER;
+            switch (p[pos + 4]) {
+            case 0xFD:
+                type = FRAME_VIDEO_KEY;
+                break;
+            case 0xFC:
+            case 0xFB:
+                type = FRAME_VIDEO;
+                break;
+            case 0xF0:
+                type = FRAME_AUDIO;
+                break;
+            default:
+                break;
+            }
+            out.push_back(makeFrame(type, FRAME_VIDEO_KEY == type, std::string((const char *)p + pos, frameLen)));
+            pos += frameLen;
+        }
+        buf_.erase(0, pos);
+    }
+
+private:
+    MediaFormat format_;
+    VideoCodec codec_;
+    bool detected_;
+    std::string buf_;
+    size_t scanPos_;
+    std::shared_ptr<MediaFrame> cur_;
+    // ts
+    int tsVideoPid_;
+    int tsPmtPid_;
+    std::string psi_;
+    std::shared_ptr<const std::string> lastPsi_;
+};
+
+// 从PS、TS或DAV帧中取出视频基本流(Annex B)和以90kHz为单位的时间戳
+// 用于转封装成标准TS，音频只支持DAV
+class EsExtractor {
+public:
+    EsExtractor()
+        : codec_(CODEC_UNKNOWN), audioCodec_(AUDIO_UNKNOWN), audioChannels_(1), audioRateIndex_(0), tsVideoPid_(-1), davLastMs_(0), davAbsMs_(0),
+          davStarted_(false) {}
+
+    VideoCodec GetCodec() const { return codec_; }
+
+    AudioCodec GetAudioCodec() const { return audioCodec_; }
+
+    // 返回false表示不是视频帧或者无法解析
+    bool Extract(const MediaFrame &frame, std::string &es, uint64_t &pts) {
+        if (FRAME_VIDEO_KEY != frame.type && FRAME_VIDEO != frame.type) {
+            return false;
+        }
+
+        es.clear();
+        pts     = 0;
+        bool ok = false;
+        switch (frame.format) {
+        case FORMAT_PS:
+            ok = extractPs((const uint8_t *)frame.data.data(), frame.data.size(), es, pts);
+            break;
+        case FORMAT_TS:
+            ok = extractTs((const uint8_t *)frame.data.data(), frame.data.size(), es, pts);
+            break;
+        case FORMAT_DAV:
+            ok = extractDav((const uint8_t *)frame.data.data(), frame.data.size(), es, pts);
+            break;
+        default:
+            break;
+        }
+        if (ok && CODEC_UNKNOWN == codec_ && frame.IsKey()) {
+            detectCodec(es);
+        }
+        return ok && !es.empty();
+    }
+
+    // 取出DAV音频帧的负载，AAC没有ADTS头时补上，返回false表示不是音频帧或者编码不支持
+    bool ExtractAudio(const MediaFrame &frame, std::string &es, uint64_t &pts) {
+        if (FRAME_AUDIO != frame.type || FORMAT_DAV != frame.format) {
+            return false;
+        }
+
+        const uint8_t *p = (const uint8_t *)frame.data.data();
+        size_t n         = frame.data.size();
+        if (n < 32 || 0 != memcmp(p, "DHAV", 4)) {
+            return false;
+        }
+        size_t begin = 24 + p[22];
+        size_t end   = n - 8;
+        if (begin >= end) {
+            return false;
+        }
+        parseDavExt(p + 24, p[22]);
+        if (AUDIO_UNKNOWN == audioCodec_) {
+            return false;
+        }
+
+        es.clear();
+        if (AUDIO_AAC == audioCodec_ && !(end - begin >= 2 && p[begin] == 0xff && (p[begin + 1] & 0xf0) == 0xf0)) {
+            writeAdts(end - begin, es);
+        }
+        es.append((const char *)p + begin, end - begin);
+        pts = davPts(p[20] | (p[21] << 8));
+        return true;
+    }
+
+private:
+    static uint64_t readPts(const uint8_t *p) {
+        return ((uint64_t)(p[0] & 0x0e) << 29) | ((uint64_t)p[1] << 22) | ((uint64_t)(p[2] & 0xfe) << 14) | ((uint64_t)p[3] << 7) | (p[4] >> 1);
+    }
+
+    // 关键帧以参数集开始，H265的VPS是0x40 0x01
+    void detectCodec(const std::string &es) {
+        const uint8_t *p = (const uint8_t *)es.data();
+        for (size_t i = 0; i + 3 < es.size(); i++) {
+            if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1) {
+                uint8_t nal = p[i + 3];
+                codec_      = ((nal >> 1) & 0x3f) == 32 ? CODEC_H265 : CODEC_H264;
+                return;
+            }
+        }
+    }
+
+    // 解析PES头，返回负载的偏移
+    static size_t parsePes(const uint8_t *p, size_t n, uint64_t &pts, bool &hasPts) {
+        if (n < 9) {
+            return n;
+        }
+        size_t hdrLen = p[8];
+        if ((p[7] & 0x80) && n >= 14) {
+            pts    = readPts(p + 9);
+            hasPts = true;
+        }
+        return std::min(n, 9 + hdrLen);
+    }
+
+    bool extractPs(const uint8_t *p, size_t n, std::string &es, uint64_t &pts) {
+        bool hasPts = false;
+        size_t pos  = 0;
+        while (pos + 6 <= n) {
+            if (p[pos] != 0 || p[pos + 1] != 0 || p[pos + 2] != 1) {
+                pos++;
+                continue;
+            }
+            uint8_t id = p[pos + 3];
+            if (id == 0xBA) {
+                pos += pos + 14 <= n ? 14 + (p[pos + 13] & 0x07) : 4;
+                continue;
+            }
+            size_t pesLen = (p[pos + 4] << 8) | p[pos + 5];
+            size_t end    = std::min(n, pos + 6 + pesLen);
+            if (id >= 0xE0 && id <= 0xEF) {
+                uint64_t t     = 0;
+                bool tsPresent = false;
+                size_t payload = pos + parsePes(p + pos, end - pos, t, tsPresent);
+                if (tsPresent && !hasPts) {
+                    pts    = t;
+                    hasPts = true;
+                }
+                es.append((const char *)p + payload, end - payload);
+            }
+            pos = end;
+        }
+        return hasPts;
+    }
+
+    bool extractTs(const uint8_t *p, size_t n, std::string &es, uint64_t &pts) {
+        bool hasPts = false;
+        for (size_t pos = 0; pos + 188 <= n; pos += 188) {
+            const uint8_t *pkt = p + pos;
+            if (pkt[0] != 0x47) {
+                continue;
+            }
+            int pid        = ((pkt[1] & 0x1f) << 8) | pkt[2];
+            bool pusi      = pkt[1] & 0x40;
+            int afc        = (pkt[3] >> 4) & 0x03;
+            size_t payload = 4;
+            if (afc & 0x02) {
+                payload += 1 + pkt[4];
+            }
+            if (!(afc & 0x01) || payload >= 188) {
+                continue;
+            }
+            if (pusi && payload + 4 <= 188 && pkt[payload] == 0 && pkt[payload + 1] == 0 && pkt[payload + 2] == 1 && pkt[payload + 3] >= 0xE0 &&
+                pkt[payload + 3] <= 0xEF) {
+                tsVideoPid_ = pid;
+            }
+            if (pid != tsVideoPid_) {
+                continue;
+            }
+            if (pusi) {
+                uint64_t t     = 0;
+                bool tsPresent = false;
+                payload += parsePes(pkt + payload, 188 - payload, t, tsPresent);
+                if (tsPresent && !hasPts) {
+                    pts    = t;
+                    hasPts = true;
+                }
+            }
+            es.append((const char *)pkt + payload, 188 - payload);
+        }
+        return hasPts;
+    }
+
+    // DAV头的20~21字节是16位的毫秒时间戳，约65秒回绕一次，22字节是扩展头长度
+    bool extractDav(const uint8_t *p, size_t n, std::string &es, uint64_t &pts) {
+        if (n < 32 || 0 != memcmp(p, "DHAV", 4)) {
+            return false;
+        }
+        size_t begin = 24 + p[22];
+        size_t end   = n - 8;
+        if (begin >= end) {
+            return false;
+        }
+        es.assign((const char *)p + begin, end - begin);
+        pts = davPts(p[20] | (p[21] << 8));
+        return true;
+    }
+
+    // 16位毫秒数按与上一帧的有符号差值累加，音视频交错时的小幅回退不会被当成回绕
+    uint64_t davPts(uint16_t ms) {
+        if (!davStarted_) {
+            davStarted_ = true;
+            davLastMs_  = ms;
+            davAbsMs_   = ms;
+            return davAbsMs_ * 90;
+        }
+        int16_t delta = (int16_t)(uint16_t)(ms - davLastMs_);
+        if (delta < 0) {
+            return (davAbsMs_ >= (uint64_t)-delta ? davAbsMs_ + delta : 0) * 90;
+        }
+        davLastMs_ = ms;
+        davAbsMs_ += delta;
+        return davAbsMs_ * 90;
+    }
+
+    // DAV扩展头由若干个标签组成，0x83和0x8c描述音频的声道数、编码和采样率
+    void parseDavExt(const uint8_t *p, size_t n) {
+        size_t pos = 0;
+        while (pos < n) {
+            uint8_t tag = p[pos];
+            size_t len  = 4;
+            switch (tag) {
+            case 0x83:
+                if (pos + 4 <= n) {
+                    setAudio(p[pos + 1], p[pos + 2], p[pos + 3]);
+                }
+                break;
+            case 0x8c:
+                len = 8;
+                if (pos + 5 <= n) {
+                    setAudio(p[pos + 2], p[pos + 3], p[pos + 4]);
+                }
+                break;
+            case 0x80:
+            case 0x81:
+                break;
+            case 0x82:
+            case 0x88:
+            case 0x91:
+            case 0x92:
+            case 0x93:
+            case 0x95:
+            case 0x9a:
+            case 0x9b:
+            case 0xb3:
+                len = 8;
+                break;
+            default:
+                return;
+            }
+            pos += len;
+        }
+    }
+
+    void setAudio(uint8_t channels, uint8_t codec, uint8_t rateIndex) {
+        switch (codec) {
+        case 0x1a:
+            audioCodec_ = AUDIO_AAC;
+            break;
+        case 0x1f:
+        case 0x21:
+            audioCodec_ = AUDIO_MPEG;
+            break;
+        case 0x0e:
+            audioCodec_ = AUDIO_G711A;
+            break;
+        case 0x0a:
+            audioCodec_ = AUDIO_G711U;
+            break;
+        default:
+            audioCodec_ = AUDIO_UNKNOWN;
+            break;
+        }
+        audioChannels_  = channels > 0 ? channels : 1;
+        audioRateIndex_ = rateIndex;
+    }
+
+    // DAV的采样率序号转换成ADTS的采样率序号
+    void writeAdts(size_t payloadLen, std::string &out) const {
+        static const uint32_t DAV_RATES[]  = {8000, 4000, 8000, 11025, 16000, 20000, 22050, 32000, 44100, 48000, 96000, 192000, 64000};
+        static const uint32_t ADTS_RATES[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+        uint32_t rate = audioRateIndex_ < sizeof(DAV_RATES) / sizeof(DAV_RATES[0]) ? DAV_RATES[audioRateIndex_] : 8000;
+        uint8_t index = 11;
+        for (uint8_t i = 0; i < sizeof(ADTS_RATES) / sizeof(ADTS_RATES[0]); i++) {
+            if (ADTS_RATES[i] == rate) {
+                index = i;
+                break;
+            }
+        }
+
+        size_t frameLen = payloadLen + 7;
+        uint8_t adts[7];
+        adts[0] = 0xff;
+        adts[1] = 0xf1; // MPEG-4, 无CRC
+        adts[2] = (1 << 6) | (index << 2) | ((audioChannels_ >> 2) & 0x01); // AAC LC
+        adts[3] = ((audioChannels_ & 0x03) << 6) | ((frameLen >> 11) & 0x03);
+        adts[4] = (frameLen >> 3) & 0xff;
+        adts[5] = ((frameLen & 0x07) << 5) | 0x1f;
+        adts[6] = 0xfc;
+        out.append((const char *)adts, sizeof(adts));
+    }
+
+private:
+    VideoCodec codec_;
+    AudioCodec audioCodec_;
+    uint8_t audioChannels_;
+    uint8_t audioRateIndex_;
+    int tsVideoPid_;
+    uint16_t davLastMs_;
+    uint64_t davAbsMs_; // 上一帧展开后的毫秒数
+    bool davStarted_;
+};
+
+} // namespace sdkproxy
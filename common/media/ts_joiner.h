@@ -0,0 +1,156 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <map>
+
+namespace sdkproxy {
+
+// 把依次输入的多段独立封装的MPEG-TS拼接成一路连续的流
+// 每段的连续计数器从0开始，时间戳也有各自的起点，直接拼接时播放器会报错或者卡顿
+// 每个PID的连续计数器接着上一段继续，PTS/DTS/PCR整体平移到上一段之后，只改写这些字段，输出的长度和输入一致
+// 只在一个线程中使用，非线程安全
+class TsJoiner {
+public:
+    static const uint64_t TS_CLOCK_MASK = (1ULL << 33) - 1;
+    static const uint64_t JOIN_GAP      = 3600; // 两段之间的时间间隔，90kHz下40ms
+
+    TsJoiner() : segment_(0), offset_(0), offsetSet_(true), lastPts_(0), hasPts_(false) {}
+
+    // 开始新的一段，上一段剩余的不完整的包原样输出
+    void Begin(std::string &out) {
+        Finish(out);
+        segment_++;
+        offsetSet_ = !hasPts_;
+        offset_    = 0;
+    }
+
+    // 输入任意分块的数据，完整的包改写后追加到out
+    void Feed(const char *data, size_t len, std::string &out) {
+        size_t begin = out.size();
+        out.append(pending_);
+        out.append(data, len);
+        pending_.clear();
+
+        uint8_t *p = (uint8_t *)&out[begin];
+        size_t n   = out.size() - begin;
+        size_t pos = 0;
+        for (; pos + 188 <= n; pos += 188) {
+            if (0x47 == p[pos]) {
+                rewrite(p + pos);
+            }
+        }
+        pending_.assign((const char *)p + pos, n - pos);
+        out.resize(begin + pos);
+    }
+
+    // 输入结束，不完整的包原样输出
+    void Finish(std::string &out) {
+        out.append(pending_);
+        pending_.clear();
+    }
+
+private:
+    typedef struct tagPidState {
+        uint64_t segment; // 计算delta时的段号
+        uint8_t delta;
+        uint8_t last;
+
+        tagPidState() : segment(0), delta(0), last(0) {}
+    } PidState;
+
+    void rewrite(uint8_t *pkt) {
+        int pid         = ((pkt[1] & 0x1f) << 8) | pkt[2];
+        uint8_t afc     = (pkt[3] >> 4) & 0x03;
+        bool hasPayload = 0 != (afc & 0x01);
+        if (0x1fff == pid) {
+            return;
+        }
+
+        // 连续计数器只在带负载的包上递增，新一段的第一个包接着上一段的最后一个
+        uint8_t cc     = pkt[3] & 0x0f;
+        auto iter      = pids_.find(pid);
+        PidState &st   = pids_[pid];
+        if (st.segment != segment_) {
+            st.segment = segment_;
+            st.delta   = iter == pids_.end() ? 0 : (uint8_t)((st.last + (hasPayload ? 1 : 0) - cc) & 0x0f);
+        }
+        st.last = (cc + st.delta) & 0x0f;
+        pkt[3]  = (pkt[3] & 0xf0) | st.last;
+
+        size_t off = 4;
+        if (afc & 0x02) {
+            size_t afLen = pkt[4];
+            if (afLen > 183) {
+                return;
+            }
+            off += 1 + afLen;
+        }
+
+        // PES头中的PTS/DTS，新一段的第一个时间戳决定这一段的平移量
+        if (hasPayload && (pkt[1] & 0x40) && off + 19 <= 188) {
+            const uint8_t *pes = pkt + off;
+            if (0 == pes[0] && 0 == pes[1] && 1 == pes[2] && isMediaStream(pes[3])) {
+                uint8_t flags = pes[7] >> 6;
+                if (flags & 0x02) {
+                    shift(pkt + off + 9, readPts(pkt + off + 9));
+                    if (0x03 == flags) {
+                        shift(pkt + off + 14, readPts(pkt + off + 14));
+                    }
+                }
+            }
+        }
+
+        // PCR，只有PCR没有PTS的包出现在新一段的开头时按PCR计算平移量
+        if ((afc & 0x02) && pkt[4] >= 7 && (pkt[5] & 0x10)) {
+            uint8_t *pcr  = pkt + 6;
+            uint64_t base = ((uint64_t)pcr[0] << 25) | ((uint64_t)pcr[1] << 17) | ((uint64_t)pcr[2] << 9) | ((uint64_t)pcr[3] << 1) | (pcr[4] >> 7);
+            if (!offsetSet_) {
+                offset_    = (lastPts_ + JOIN_GAP - base) & TS_CLOCK_MASK;
+                offsetSet_ = true;
+            }
+            base   = (base + offset_) & TS_CLOCK_MASK;
+            pcr[0] = (base >> 25) & 0xff;
+            pcr[1] = (base >> 17) & 0xff;
+            pcr[2] = (base >> 9) & 0xff;
+            pcr[3] = (base >> 1) & 0xff;
+            pcr[4] = (uint8_t)(((base & 0x01) << 7) | (pcr[4] & 0x7f));
+        }
+    }
+
+    static bool isMediaStream(uint8_t streamId) { return (streamId & 0xe0) == 0xc0 || (streamId & 0xf0) == 0xe0 || 0xbd == streamId; }
+
+    static uint64_t readPts(const uint8_t *p) {
+        return ((uint64_t)((p[0] >> 1) & 0x07) << 30) | ((uint64_t)p[1] << 22) | ((uint64_t)(p[2] >> 1) << 15) | ((uint64_t)p[3] << 7) | (p[4] >> 1);
+    }
+
+    void shift(uint8_t *p, uint64_t pts) {
+        if (!offsetSet_) {
+            offset_    = (lastPts_ + JOIN_GAP - pts) & TS_CLOCK_MASK;
+            offsetSet_ = true;
+        }
+        pts = (pts + offset_) & TS_CLOCK_MASK;
+        // 记录输出的最大时间戳，处理33位回绕
+        if (!hasPts_ || ((pts - lastPts_) & TS_CLOCK_MASK) < (TS_CLOCK_MASK >> 1)) {
+            lastPts_ = pts;
+            hasPts_  = true;
+        }
+        p[0] = (uint8_t)((p[0] & 0xf1) | (((pts >> 30) & 0x07) << 1));
+        p[1] = (pts >> 22) & 0xff;
+        p[2] = (uint8_t)((((pts >> 15) & 0x7f) << 1) | 0x01);
+        p[3] = (pts >> 7) & 0xff;
+        p[4] = (uint8_t)(((pts & 0x7f) << 1) | 0x01);
+    }
+
+private:
+    std::string pending_;
+    std::map<int, PidState> pids_;
+    uint64_t segment_;
+    uint64_t offset_; // 当前段的时间戳平移量
+    bool offsetSet_;
+    uint64_t lastPts_;
+    bool hasPts_;
+};
+
+} // namespace sdkproxy
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "common/media/frame_parser.h"
+
+namespace sdkproxy {
+
+// 把H264/H265的访问单元和音频帧封装成MPEG-TS，一路视频和最多一路音频
+class TsMuxer {
+public:
+    static const int PMT_PID   = 0x1000;
+    static const int VIDEO_PID = 0x100;
+    static const int AUDIO_PID = 0x101;
+
+    TsMuxer() : codec_(CODEC_H264), audioCodec_(AUDIO_UNKNOWN), pmtVersion_(0), patCc_(0), pmtCc_(0), videoCc_(0), audioCc_(0) {}
+
+    void SetCodec(VideoCodec codec) { codec_ = CODEC_H265 == codec ? CODEC_H265 : CODEC_H264; }
+
+    // 音频编码变化时PMT的版本号加一，返回true表示需要重新写PAT和PMT
+    bool SetAudioCodec(AudioCodec codec) {
+        if (codec == audioCodec_) {
+            return false;
+        }
+        audioCodec_ = codec;
+        pmtVersion_ = (pmtVersion_ + 1) & 0x1f;
+        return true;
+    }
+
+    // 写PAT和PMT，每个分片的开头和每个关键帧之前都需要
+    void WriteTables(std::string &out) {
+        // PAT: program 1 -> PMT_PID
+        uint8_t pat[] = {0x00, 0xb0, 0x0d, 0x00, 0x01, 0xc1, 0x00, 0x00, 0x00, 0x01, (uint8_t)(0xe0 | (PMT_PID >> 8)), (uint8_t)(PMT_PID & 0xff)};
+        writeSection(0, patCc_, pat, sizeof(pat), out);
+
+        // PMT: PCR在视频PID上
+        uint8_t pmt[32] = {0x02, 0xb0, 0x00, 0x00, 0x01, (uint8_t)(0xc1 | (pmtVersion_ << 1)), 0x00, 0x00, (uint8_t)(0xe0 | (VIDEO_PID >> 8)),
+                           (uint8_t)(VIDEO_PID & 0xff), 0xf0, 0x00};
+        size_t len      = 12;
+        len += writeStream(pmt + len, CODEC_H265 == codec_ ? 0x24 : 0x1b, VIDEO_PID);
+        if (0 != audioStreamType()) {
+            len += writeStream(pmt + len, audioStreamType(), AUDIO_PID);
+        }
+        pmt[2] = (uint8_t)(len + 4 - 3); // 段长度包含CRC
+        writeSection(PMT_PID, pmtCc_, pmt, len, out);
+    }
+
+    // pts以90kHz为单位，关键帧带随机访问标记和PCR
+    void WriteVideo(const uint8_t *es, size_t len, uint64_t pts, bool key, std::string &out) {
+        if (key) {
+            WriteTables(out);
+        }
+        writePes(VIDEO_PID, videoCc_, 0xe0, es, len, pts, true, key, out);
+    }
+
+    // 音频帧，编码没有设置或者不支持时丢弃
+    void WriteAudio(const uint8_t *es, size_t len, uint64_t pts, std::string &out) {
+        if (0 == audioStreamType()) {
+            return;
+        }
+        writePes(AUDIO_PID, audioCc_, 0xc0, es, len, pts, false, false, out);
+    }
+
+private:
+    // G711没有标准的流类型，0x90/0x91是安防设备常用的私有类型
+    uint8_t audioStreamType() const {
+        switch (audioCodec_) {
+        case AUDIO_AAC:
+            return 0x0f;
+        case AUDIO_MPEG:
+            return 0x03;
+        case AUDIO_G711A:
+            return 0x90;
+        case AUDIO_G711U:
+            return 0x91;
+        default:
+            return 0;
+        }
+    }
+
+    static size_t writeStream(uint8_t *p, uint8_t streamType, int pid) {
+        p[0] = streamType;
+        p[1] = 0xe0 | (pid >> 8);
+        p[2] = pid & 0xff;
+        p[3] = 0xf0;
+        p[4] = 0x00;
+        return 5;
+    }
+
+    // PES头之后是基本流，视频的PES长度为0表示不限
+    void writePes(int pid, uint8_t &cc, uint8_t streamId, const uint8_t *es, size_t len, uint64_t pts, bool pcr, bool key, std::string &out) {
+        uint8_t pes[14] = {0x00, 0x00, 0x01, streamId, 0x00, 0x00, 0x80, 0x80, 0x05};
+        writePts(pes + 9, 0x20, pts);
+        if (0xe0 != streamId && len + 8 <= 0xffff) {
+            pes[4] = (uint8_t)((len + 8) >> 8);
+            pes[5] = (uint8_t)((len + 8) & 0xff);
+        }
+
+        size_t pos   = 0;
+        bool first   = true;
+        size_t total = sizeof(pes) + len;
+        while (pos < total) {
+            uint8_t pkt[188];
+            pkt[0] = 0x47;
+            pkt[1] = (first ? 0x40 : 0x00) | (pid >> 8);
+            pkt[2] = pid & 0xff;
+
+            // 自适应字段：视频的第一个包带PCR，最后一个包用填充补齐
+            size_t afLen = 0;
+            uint8_t af[188];
+            if (first && pcr) {
+                af[0] = 0;
+                af[1] = key ? 0x50 : 0x10; // random access + PCR
+                writePcr(af + 2, pts);
+                afLen = 8;
+            }
+            size_t room   = 184 - afLen;
+            size_t remain = total - pos;
+            if (remain < room) {
+                size_t stuff = room - remain;
+                if (afLen == 0) {
+                    // 需要新建自适应字段
+                    if (stuff == 1) {
+                        af[0] = 0;
+                        afLen = 1;
+                    } else {
+                        af[0] = 0;
+                        af[1] = 0x00;
+                        memset(af + 2, 0xff, stuff - 2);
+                        afLen = stuff;
+                    }
+                } else {
+                    memset(af + afLen, 0xff, stuff);
+                    afLen += stuff;
+                }
+                room = remain;
+            }
+            if (afLen > 0) {
+                af[0]  = (uint8_t)(afLen - 1);
+                pkt[3] = 0x30 | (cc++ & 0x0f);
+                memcpy(pkt + 4, af, afLen);
+            } else {
+                pkt[3] = 0x10 | (cc++ & 0x0f);
+            }
+
+            // 负载先是PES头，再是基本流
+            uint8_t *dst = pkt + 4 + afLen;
+            size_t n     = room;
+            while (n > 0) {
+                if (pos < sizeof(pes)) {
+                    size_t c = std::min(n, sizeof(pes) - pos);
+                    memcpy(dst, pes + pos, c);
+                    dst += c;
+                    pos += c;
+                    n -= c;
+                } else {
+                    size_t c = std::min(n, total - pos);
+                    memcpy(dst, es + (pos - sizeof(pes)), c);
+                    dst += c;
+                    pos += c;
+                    n -= c;
+                }
+            }
+            out.append((const char *)pkt, sizeof(pkt));
+            first = false;
+        }
+    }
+
+    static void writePts(uint8_t *p, uint8_t prefix, uint64_t pts) {
+        p[0] = prefix | (((pts >> 30) & 0x07) << 1) | 0x01;
+        p[1] = (pts >> 22) & 0xff;
+        p[2] = (((pts >> 15) & 0x7f) << 1) | 0x01;
+        p[3] = (pts >> 7) & 0xff;
+        p[4] = ((pts & 0x7f) << 1) | 0x01;
+    }
+
+    static void writePcr(uint8_t *p, uint64_t pcr) {
+        p[0] = (pcr >> 25) & 0xff;
+        p[1] = (pcr >> 17) & 0xff;
+        p[2] = (pcr >> 9) & 0xff;
+        p[3] = (pcr >> 1) & 0xff;
+        p[4] = ((pcr & 0x01) << 7) | 0x7e;
+        p[5] = 0x00;
+    }
+
+    static uint32_t crc32(const uint8_t *p, size_t n) {
+        uint32_t crc = 0xffffffff;
+        for (size_t i = 0; i < n; i++) {
+            crc ^= (uint32_t)p[i] << 24;
+            for (int k = 0; k < 8; k++) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    void writeSection(int pid, uint8_t &cc, const uint8_t *section, size_t len, std::string &out) {
+        uint8_t pkt[188];
+        memset(pkt, 0xff, sizeof(pkt));
+        pkt[0] = 0x47;
+        pkt[1] = 0x40 | (pid >> 8);
+        pkt[2] = pid & 0xff;
+        pkt[3] = 0x10 | (cc++ & 0x0f);
+        pkt[4] = 0x00; // pointer field
+        memcpy(pkt + 5, section, len);
+        uint32_t crc     = crc32(section, len);
+        pkt[5 + len]     = crc >> 24;
+        pkt[5 + len + 1] = (crc >> 16) & 0xff;
+        pkt[5 + len + 2] = (crc >> 8) & 0xff;
+        pkt[5 + len + 3] = crc & 0xff;
+        out.append((const char *)pkt, sizeof(pkt));
+    }
+
+private:
+    VideoCodec codec_;
+    AudioCodec audioCodec_;
+    uint8_t pmtVersion_;
+    uint8_t patCc_;
+    uint8_t pmtCc_;
+    uint8_t videoCc_;
+    uint8_t audioCc_;
+};
+
+} // namespace sdkproxy
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <vector>
+
+#include "common/media/frame_parser.h"
+#include "common/media/ts_muxer.h"
+
+namespace sdkproxy {
+
+// 流式转封装：把sdk回调的DAV(或PS)分块数据重新封装成标准MPEG-TS，只搬移基本流，不解码
+// 输出从第一个关键帧开始，只在一个线程中使用，非线程安全
+class TsRemuxer {
+public:
+    TsRemuxer() : started_(false), frames_(0), droppedFrames_(0) {}
+
+    // 输入任意分块的数据，完整帧转封装后追加到out
+    void Feed(const uint8_t *buffer, size_t len, std::string &out) {
+        batch_.clear();
+        splitter_.Feed(buffer, len, batch_);
+        for (auto &f : batch_) {
+            remux(*f, out);
+        }
+    }
+
+    // 输入结束，输出缓存中剩余的帧
+    void Flush(std::string &out) {
+        batch_.clear();
+        splitter_.Flush(batch_);
+        for (auto &f : batch_) {
+            remux(*f, out);
+        }
+        batch_.clear();
+    }
+
+    MediaFormat GetFormat() const { return splitter_.GetFormat(); }
+
+    uint64_t GetFrames() const { return frames_; }
+
+    // 无法解析或者在第一个关键帧之前被丢弃的帧
+    uint64_t GetDroppedFrames() const { return droppedFrames_; }
+
+private:
+    void remux(const MediaFrame &frame, std::string &out) {
+        uint64_t pts = 0;
+        if (FRAME_AUDIO == frame.type) {
+            if (!started_ || !extractor_.ExtractAudio(frame, es_, pts)) {
+                droppedFrames_++;
+                return;
+            }
+            // 音频编码变化时立即更新PMT
+            if (muxer_.SetAudioCodec(extractor_.GetAudioCodec())) {
+                muxer_.WriteTables(out);
+            }
+            muxer_.WriteAudio((const uint8_t *)es_.data(), es_.size(), pts, out);
+            frames_++;
+            return;
+        }
+
+        if (!extractor_.Extract(frame, es_, pts)) {
+            if (FRAME_VIDEO_KEY == frame.type || FRAME_VIDEO == frame.type) {
+                droppedFrames_++;
+            }
+            return;
+        }
+        if (!started_) {
+            if (!frame.IsKey()) {
+                droppedFrames_++;
+                return;
+            }
+            started_ = true;
+        }
+        muxer_.SetCodec(extractor_.GetCodec());
+        muxer_.WriteVideo((const uint8_t *)es_.data(), es_.size(), pts, frame.IsKey(), out);
+        frames_++;
+    }
+
+private:
+    FrameSplitter splitter_;
+    EsExtractor extractor_;
+    TsMuxer muxer_;
+    std::vector<MediaFramePtr> batch_;
+    std::string es_;
+    bool started_;
+    uint64_t frames_;
+    uint64_t droppedFrames_;
+};
+
+} // namespace sdkproxy
@@ -6,6 +6,7 @@
 #include <brpc/server.h>
 
 #include "server/service/real_stream_service.h"
+#include "server/service/hls_service.h"
 #include "server/service/vod_service.h"
 #include "server/service/device_query_service.h"
 #include "server/service/event_analyze_service.h"
@@ -19,6 +20,9 @@ DEFINE_int32(port, 7011, "TCP Port of this server");
 DEFINE_int32(idle_timeout_s, -1,
              "Connection will be closed if there is no "
              "read/write operations during the last `idle_timeout_s'");
+DEFINE_int32(warmup_parallel, 16, "Devices logged in concurrently when warming up after start");
+DEFINE_int32(warmup_max_age_h, 72, "Only warm up devices logged in during the last hours");
+DEFINE_int32(warmup_wait_s, 0, "Seconds to wait for warming up before accepting requests, 0 to warm up in background");
 
 int main(int argc, char *argv[]) {
     GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
@@ -28,6 +32,7 @@ int main(int argc, char *argv[]) {
 
     // Instance of your service.
     sdkproxy::RealStreamServiceImpl realStreamServiceImpl;
+    sdkproxy::HlsServiceImpl hlsServiceImpl;
     sdkproxy::VodServiceImpl vodServiceImpl;
     sdkproxy::DeviceQueryServiceImpl deviceQueryServiceImpl;
     sdkproxy::EventAnalyzeServiceImpl eventAnalyzeServiceImpl;
@@ -39,6 +44,7 @@ int main(int argc, char *argv[]) {
     // service is put on stack, we don't want server to delete it, otherwise
     // use brpc::SERVER_OWNS_SERVICE.
     if (server.AddService(&realStreamServiceImpl, brpc::SERVER_DOESNT_OWN_SERVICE) != 0
+        || server.AddService(&hlsServiceImpl, brpc::SERVER_DOESNT_OWN_SERVICE) != 0
         || server.AddService(&vodServiceImpl, brpc::SERVER_DOESNT_OWN_SERVICE) != 0
         || server.AddService(&deviceQueryServiceImpl, brpc::SERVER_DOESNT_OWN_SERVICE) != 0
         || server.AddService(&eventAnalyzeServiceImpl, brpc::SERVER_DOESNT_OWN_SERVICE) != 0
@@ -49,6 +55,15 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    // 重新登录重启前使用的设备并恢复事件分析任务，和请求触发的登录共用会话
+    auto restore = [&eventAnalyzeServiceImpl](const sdkproxy::sdk::DeviceRecord &record, std::shared_ptr<sdkproxy::sdk::SdkStub> stub) {
+        eventAnalyzeServiceImpl.Restore(record, stub);
+    };
+    sdkproxy::sdk::SDK_MNG().WarmUp(FLAGS_warmup_parallel, (uint64_t)FLAGS_warmup_max_age_h * 3600 * 1000, restore);
+    if (FLAGS_warmup_wait_s > 0 && !sdkproxy::sdk::SDK_MNG().WaitWarmUp((uint64_t)FLAGS_warmup_wait_s * 1000)) {
+        std::cout << "Warm up not finished, continue in background" << std::endl;
+    }
+
     // Start the server.
     brpc::ServerOptions options;
     options.idle_timeout_sec = FLAGS_idle_timeout_s;
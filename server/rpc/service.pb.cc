@@ -54,7 +54,7 @@ static void InitDefaultsscc_info_HttpResponse_service_2eproto() {
 
 static ::PROTOBUF_NAMESPACE_ID::Metadata file_level_metadata_service_2eproto[2];
 static constexpr ::PROTOBUF_NAMESPACE_ID::EnumDescriptor const** file_level_enum_descriptors_service_2eproto = nullptr;
-static const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* file_level_service_descriptors_service_2eproto[8];
+static const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* file_level_service_descriptors_service_2eproto[9];
 
 const ::PROTOBUF_NAMESPACE_ID::uint32 TableStruct_service_2eproto::offsets[] PROTOBUF_SECTION_VARIABLE(protodesc_cold) = {
   ~0u,  // no _has_bits_
@@ -85,26 +85,35 @@ const char descriptor_table_protodef_service_2eproto[] PROTOBUF_SECTION_VARIABLE
   "kproxy.HttpResponse\"\000\0228\n\005Query\022\025.sdkprox"
   "y.HttpRequest\032\026.sdkproxy.HttpResponse\"\0002"
   "M\n\021RealStreamService\0228\n\005Start\022\025.sdkproxy"
-  ".HttpRequest\032\026.sdkproxy.HttpResponse\"\0002\211"
-  "\001\n\nVodService\0228\n\005Query\022\025.sdkproxy.HttpRe"
-  "quest\032\026.sdkproxy.HttpResponse\"\000\022A\n\016Downl"
-  "oadByTime\022\025.sdkproxy.HttpRequest\032\026.sdkpr"
+  ".HttpRequest\032\026.sdkproxy.HttpResponse\"\0002\205"
+  "\001\n\nHlsService\022;\n\010Playlist\022\025.sdkproxy.Htt"
+  "pRequest\032\026.sdkproxy.HttpResponse\"\000\022:\n\007Se"
+  "gment\022\025.sdkproxy.HttpRequest\032\026.sdkproxy."
+  "HttpResponse\"\0002\301\002\n\nVodService\0228\n\005Query\022\025"
+  ".sdkproxy.HttpRequest\032\026.sdkproxy.HttpRes"
+  "ponse\"\000\022A\n\016DownloadByTime\022\025.sdkproxy.Htt"
+  "pRequest\032\026.sdkproxy.HttpResponse\"\000\022;\n\010Pr"
+  "ogress\022\025.sdkproxy.HttpRequest\032\026.sdkproxy"
+  ".HttpResponse\"\000\0228\n\005Queue\022\025.sdkproxy.Http"
+  "Request\032\026.sdkproxy.HttpResponse\"\000\022\?\n\014Ava"
+  "ilability\022\025.sdkproxy.HttpRequest\032\026.sdkpr"
   "oxy.HttpResponse\"\0002\374\001\n\023EventAnalyzeServi"
   "ce\0228\n\005Reset\022\025.sdkproxy.HttpRequest\032\026.sdk"
   "proxy.HttpResponse\"\000\0228\n\005Query\022\025.sdkproxy"
   ".HttpRequest\032\026.sdkproxy.HttpResponse\"\000\0228"
   "\n\005Start\022\025.sdkproxy.HttpRequest\032\026.sdkprox"
   "y.HttpResponse\"\000\0227\n\004Stop\022\025.sdkproxy.Http"
-  "Request\032\026.sdkproxy.HttpResponse\"\0002J\n\rHea"
-  "lthService\0229\n\006Health\022\025.sdkproxy.HttpRequ"
-  "est\032\026.sdkproxy.HttpResponse\"\0002\205\001\n\rConfig"
-  "Service\0229\n\006GetFtp\022\025.sdkproxy.HttpRequest"
-  "\032\026.sdkproxy.HttpResponse\"\000\0229\n\006SetFtp\022\025.s"
-  "dkproxy.HttpRequest\032\026.sdkproxy.HttpRespo"
-  "nse\"\0002Z\n\027VisitorsFlowRateService\022\?\n\014Quer"
-  "yHistory\022\025.sdkproxy.HttpRequest\032\026.sdkpro"
-  "xy.HttpResponse\"\0002\026\n\024EntranceGuardServic"
-  "eB\003\200\001\001b\006proto3"
+  "Request\032\026.sdkproxy.HttpResponse\"\0002\206\001\n\rHe"
+  "althService\0229\n\006Health\022\025.sdkproxy.HttpReq"
+  "uest\032\026.sdkproxy.HttpResponse\"\000\022:\n\007Stream"
+  "s\022\025.sdkproxy.HttpRequest\032\026.sdkproxy.Http"
+  "Response\"\0002\205\001\n\rConfigService\0229\n\006GetFtp\022\025"
+  ".sdkproxy.HttpRequest\032\026.sdkproxy.HttpRes"
+  "ponse\"\000\0229\n\006SetFtp\022\025.sdkproxy.HttpRequest"
+  "\032\026.sdkproxy.HttpResponse\"\0002Z\n\027VisitorsFl"
+  "owRateService\022\?\n\014QueryHistory\022\025.sdkproxy"
+  ".HttpRequest\032\026.sdkproxy.HttpResponse\"\0002\026"
+  "\n\024EntranceGuardServiceB\003\200\001\001b\006proto3"
   ;
 static const ::PROTOBUF_NAMESPACE_ID::internal::DescriptorTable*const descriptor_table_service_2eproto_deps[1] = {
 };
@@ -115,7 +124,7 @@ static ::PROTOBUF_NAMESPACE_ID::internal::SCCInfoBase*const descriptor_table_ser
 static ::PROTOBUF_NAMESPACE_ID::internal::once_flag descriptor_table_service_2eproto_once;
 static bool descriptor_table_service_2eproto_initialized = false;
 const ::PROTOBUF_NAMESPACE_ID::internal::DescriptorTable descriptor_table_service_2eproto = {
-  &descriptor_table_service_2eproto_initialized, descriptor_table_protodef_service_2eproto, "service.proto", 1014,
+  &descriptor_table_service_2eproto_initialized, descriptor_table_protodef_service_2eproto, "service.proto", 1395,
   &descriptor_table_service_2eproto_once, descriptor_table_service_2eproto_sccs, descriptor_table_service_2eproto_deps, 2, 0,
   schemas, file_default_instances, TableStruct_service_2eproto::offsets,
   file_level_metadata_service_2eproto, 2, file_level_enum_descriptors_service_2eproto, file_level_service_descriptors_service_2eproto,
@@ -634,11 +643,124 @@ void RealStreamService_Stub::Start(::PROTOBUF_NAMESPACE_ID::RpcController* contr
 }
 // ===================================================================
 
+HlsService::~HlsService() {}
+
+const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* HlsService::descriptor() {
+  ::PROTOBUF_NAMESPACE_ID::internal::AssignDescriptors(&descriptor_table_service_2eproto);
+  return file_level_service_descriptors_service_2eproto[2];
+}
+
+const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* HlsService::GetDescriptor() {
+  return descriptor();
+}
+
+void HlsService::Playlist(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                         const ::sdkproxy::HttpRequest*,
+                         ::sdkproxy::HttpResponse*,
+                         ::google::protobuf::Closure* done) {
+  controller->SetFailed("Method Playlist() not implemented.");
+  done->Run();
+}
+
+void HlsService::Segment(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                         const ::sdkproxy::HttpRequest*,
+                         ::sdkproxy::HttpResponse*,
+                         ::google::protobuf::Closure* done) {
+  controller->SetFailed("Method Segment() not implemented.");
+  done->Run();
+}
+
+void HlsService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method,
+                             ::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                             const ::PROTOBUF_NAMESPACE_ID::Message* request,
+                             ::PROTOBUF_NAMESPACE_ID::Message* response,
+                             ::google::protobuf::Closure* done) {
+  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[2]);
+  switch(method->index()) {
+    case 0:
+      Playlist(controller,
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<const ::sdkproxy::HttpRequest*>(
+                 request),
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<::sdkproxy::HttpResponse*>(
+                 response),
+             done);
+      break;
+    case 1:
+      Segment(controller,
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<const ::sdkproxy::HttpRequest*>(
+                 request),
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<::sdkproxy::HttpResponse*>(
+                 response),
+             done);
+      break;
+    default:
+      GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
+      break;
+  }
+}
+
+const ::PROTOBUF_NAMESPACE_ID::Message& HlsService::GetRequestPrototype(
+    const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method) const {
+  GOOGLE_DCHECK_EQ(method->service(), descriptor());
+  switch(method->index()) {
+    case 0:
+      return ::sdkproxy::HttpRequest::default_instance();
+    case 1:
+      return ::sdkproxy::HttpRequest::default_instance();
+    default:
+      GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
+      return *::PROTOBUF_NAMESPACE_ID::MessageFactory::generated_factory()
+          ->GetPrototype(method->input_type());
+  }
+}
+
+const ::PROTOBUF_NAMESPACE_ID::Message& HlsService::GetResponsePrototype(
+    const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method) const {
+  GOOGLE_DCHECK_EQ(method->service(), descriptor());
+  switch(method->index()) {
+    case 0:
+      return ::sdkproxy::HttpResponse::default_instance();
+    case 1:
+      return ::sdkproxy::HttpResponse::default_instance();
+    default:
+      GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
+      return *::PROTOBUF_NAMESPACE_ID::MessageFactory::generated_factory()
+          ->GetPrototype(method->output_type());
+  }
+}
+
+HlsService_Stub::HlsService_Stub(::PROTOBUF_NAMESPACE_ID::RpcChannel* channel)
+  : channel_(channel), owns_channel_(false) {}
+HlsService_Stub::HlsService_Stub(
+    ::PROTOBUF_NAMESPACE_ID::RpcChannel* channel,
+    ::PROTOBUF_NAMESPACE_ID::Service::ChannelOwnership ownership)
+  : channel_(channel),
+    owns_channel_(ownership == ::PROTOBUF_NAMESPACE_ID::Service::STUB_OWNS_CHANNEL) {}
+HlsService_Stub::~HlsService_Stub() {
+  if (owns_channel_) delete channel_;
+}
+
+void HlsService_Stub::Playlist(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                              const ::sdkproxy::HttpRequest* request,
+                              ::sdkproxy::HttpResponse* response,
+                              ::google::protobuf::Closure* done) {
+  channel_->CallMethod(descriptor()->method(0),
+                       controller, request, response, done);
+}
+void HlsService_Stub::Segment(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                              const ::sdkproxy::HttpRequest* request,
+                              ::sdkproxy::HttpResponse* response,
+                              ::google::protobuf::Closure* done) {
+  channel_->CallMethod(descriptor()->method(1),
+                       controller, request, response, done);
+}
+// ===================================================================
+
 VodService::~VodService() {}
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* VodService::descriptor() {
   ::PROTOBUF_NAMESPACE_ID::internal::AssignDescriptors(&descriptor_table_service_2eproto);
-  return file_level_service_descriptors_service_2eproto[2];
+  return file_level_service_descriptors_service_2eproto[3];
 }
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* VodService::GetDescriptor() {
@@ -661,12 +783,36 @@ void VodService::DownloadByTime(::PROTOBUF_NAMESPACE_ID::RpcController* controll
   done->Run();
 }
 
+void VodService::Progress(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                         const ::sdkproxy::HttpRequest*,
+                         ::sdkproxy::HttpResponse*,
+                         ::google::protobuf::Closure* done) {
+  controller->SetFailed("Method Progress() not implemented.");
+  done->Run();
+}
+
+void VodService::Queue(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                         const ::sdkproxy::HttpRequest*,
+                         ::sdkproxy::HttpResponse*,
+                         ::google::protobuf::Closure* done) {
+  controller->SetFailed("Method Queue() not implemented.");
+  done->Run();
+}
+
+void VodService::Availability(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                         const ::sdkproxy::HttpRequest*,
+                         ::sdkproxy::HttpResponse*,
+                         ::google::protobuf::Closure* done) {
+  controller->SetFailed("Method Availability() not implemented.");
+  done->Run();
+}
+
 void VodService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method,
                              ::PROTOBUF_NAMESPACE_ID::RpcController* controller,
                              const ::PROTOBUF_NAMESPACE_ID::Message* request,
                              ::PROTOBUF_NAMESPACE_ID::Message* response,
                              ::google::protobuf::Closure* done) {
-  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[2]);
+  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[3]);
   switch(method->index()) {
     case 0:
       Query(controller,
@@ -684,6 +830,30 @@ void VodService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* met
                  response),
              done);
       break;
+    case 2:
+      Progress(controller,
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<const ::sdkproxy::HttpRequest*>(
+                 request),
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<::sdkproxy::HttpResponse*>(
+                 response),
+             done);
+      break;
+    case 3:
+      Queue(controller,
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<const ::sdkproxy::HttpRequest*>(
+                 request),
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<::sdkproxy::HttpResponse*>(
+                 response),
+             done);
+      break;
+    case 4:
+      Availability(controller,
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<const ::sdkproxy::HttpRequest*>(
+                 request),
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<::sdkproxy::HttpResponse*>(
+                 response),
+             done);
+      break;
     default:
       GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
       break;
@@ -698,6 +868,12 @@ const ::PROTOBUF_NAMESPACE_ID::Message& VodService::GetRequestPrototype(
       return ::sdkproxy::HttpRequest::default_instance();
     case 1:
       return ::sdkproxy::HttpRequest::default_instance();
+    case 2:
+      return ::sdkproxy::HttpRequest::default_instance();
+    case 3:
+      return ::sdkproxy::HttpRequest::default_instance();
+    case 4:
+      return ::sdkproxy::HttpRequest::default_instance();
     default:
       GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
       return *::PROTOBUF_NAMESPACE_ID::MessageFactory::generated_factory()
@@ -713,6 +889,12 @@ const ::PROTOBUF_NAMESPACE_ID::Message& VodService::GetResponsePrototype(
       return ::sdkproxy::HttpResponse::default_instance();
     case 1:
       return ::sdkproxy::HttpResponse::default_instance();
+    case 2:
+      return ::sdkproxy::HttpResponse::default_instance();
+    case 3:
+      return ::sdkproxy::HttpResponse::default_instance();
+    case 4:
+      return ::sdkproxy::HttpResponse::default_instance();
     default:
       GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
       return *::PROTOBUF_NAMESPACE_ID::MessageFactory::generated_factory()
@@ -745,13 +927,34 @@ void VodService_Stub::DownloadByTime(::PROTOBUF_NAMESPACE_ID::RpcController* con
   channel_->CallMethod(descriptor()->method(1),
                        controller, request, response, done);
 }
+void VodService_Stub::Progress(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                              const ::sdkproxy::HttpRequest* request,
+                              ::sdkproxy::HttpResponse* response,
+                              ::google::protobuf::Closure* done) {
+  channel_->CallMethod(descriptor()->method(2),
+                       controller, request, response, done);
+}
+void VodService_Stub::Queue(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                              const ::sdkproxy::HttpRequest* request,
+                              ::sdkproxy::HttpResponse* response,
+                              ::google::protobuf::Closure* done) {
+  channel_->CallMethod(descriptor()->method(3),
+                       controller, request, response, done);
+}
+void VodService_Stub::Availability(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                              const ::sdkproxy::HttpRequest* request,
+                              ::sdkproxy::HttpResponse* response,
+                              ::google::protobuf::Closure* done) {
+  channel_->CallMethod(descriptor()->method(4),
+                       controller, request, response, done);
+}
 // ===================================================================
 
 EventAnalyzeService::~EventAnalyzeService() {}
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* EventAnalyzeService::descriptor() {
   ::PROTOBUF_NAMESPACE_ID::internal::AssignDescriptors(&descriptor_table_service_2eproto);
-  return file_level_service_descriptors_service_2eproto[3];
+  return file_level_service_descriptors_service_2eproto[4];
 }
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* EventAnalyzeService::GetDescriptor() {
@@ -795,7 +998,7 @@ void EventAnalyzeService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescri
                              const ::PROTOBUF_NAMESPACE_ID::Message* request,
                              ::PROTOBUF_NAMESPACE_ID::Message* response,
                              ::google::protobuf::Closure* done) {
-  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[3]);
+  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[4]);
   switch(method->index()) {
     case 0:
       Reset(controller,
@@ -918,7 +1121,7 @@ HealthService::~HealthService() {}
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* HealthService::descriptor() {
   ::PROTOBUF_NAMESPACE_ID::internal::AssignDescriptors(&descriptor_table_service_2eproto);
-  return file_level_service_descriptors_service_2eproto[4];
+  return file_level_service_descriptors_service_2eproto[5];
 }
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* HealthService::GetDescriptor() {
@@ -933,12 +1136,20 @@ void HealthService::Health(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
   done->Run();
 }
 
+void HealthService::Streams(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                         const ::sdkproxy::HttpRequest*,
+                         ::sdkproxy::HttpResponse*,
+                         ::google::protobuf::Closure* done) {
+  controller->SetFailed("Method Streams() not implemented.");
+  done->Run();
+}
+
 void HealthService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method,
                              ::PROTOBUF_NAMESPACE_ID::RpcController* controller,
                              const ::PROTOBUF_NAMESPACE_ID::Message* request,
                              ::PROTOBUF_NAMESPACE_ID::Message* response,
                              ::google::protobuf::Closure* done) {
-  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[4]);
+  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[5]);
   switch(method->index()) {
     case 0:
       Health(controller,
@@ -948,6 +1159,14 @@ void HealthService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor*
                  response),
              done);
       break;
+    case 1:
+      Streams(controller,
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<const ::sdkproxy::HttpRequest*>(
+                 request),
+             ::PROTOBUF_NAMESPACE_ID::internal::DownCast<::sdkproxy::HttpResponse*>(
+                 response),
+             done);
+      break;
     default:
       GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
       break;
@@ -960,6 +1179,8 @@ const ::PROTOBUF_NAMESPACE_ID::Message& HealthService::GetRequestPrototype(
   switch(method->index()) {
     case 0:
       return ::sdkproxy::HttpRequest::default_instance();
+    case 1:
+      return ::sdkproxy::HttpRequest::default_instance();
     default:
       GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
       return *::PROTOBUF_NAMESPACE_ID::MessageFactory::generated_factory()
@@ -973,6 +1194,8 @@ const ::PROTOBUF_NAMESPACE_ID::Message& HealthService::GetResponsePrototype(
   switch(method->index()) {
     case 0:
       return ::sdkproxy::HttpResponse::default_instance();
+    case 1:
+      return ::sdkproxy::HttpResponse::default_instance();
     default:
       GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
       return *::PROTOBUF_NAMESPACE_ID::MessageFactory::generated_factory()
@@ -998,13 +1221,20 @@ void HealthService_Stub::Health(::PROTOBUF_NAMESPACE_ID::RpcController* controll
   channel_->CallMethod(descriptor()->method(0),
                        controller, request, response, done);
 }
+void HealthService_Stub::Streams(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                              const ::sdkproxy::HttpRequest* request,
+                              ::sdkproxy::HttpResponse* response,
+                              ::google::protobuf::Closure* done) {
+  channel_->CallMethod(descriptor()->method(1),
+                       controller, request, response, done);
+}
 // ===================================================================
 
 ConfigService::~ConfigService() {}
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* ConfigService::descriptor() {
   ::PROTOBUF_NAMESPACE_ID::internal::AssignDescriptors(&descriptor_table_service_2eproto);
-  return file_level_service_descriptors_service_2eproto[5];
+  return file_level_service_descriptors_service_2eproto[6];
 }
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* ConfigService::GetDescriptor() {
@@ -1032,7 +1262,7 @@ void ConfigService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor*
                              const ::PROTOBUF_NAMESPACE_ID::Message* request,
                              ::PROTOBUF_NAMESPACE_ID::Message* response,
                              ::google::protobuf::Closure* done) {
-  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[5]);
+  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[6]);
   switch(method->index()) {
     case 0:
       GetFtp(controller,
@@ -1117,7 +1347,7 @@ VisitorsFlowRateService::~VisitorsFlowRateService() {}
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* VisitorsFlowRateService::descriptor() {
   ::PROTOBUF_NAMESPACE_ID::internal::AssignDescriptors(&descriptor_table_service_2eproto);
-  return file_level_service_descriptors_service_2eproto[6];
+  return file_level_service_descriptors_service_2eproto[7];
 }
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* VisitorsFlowRateService::GetDescriptor() {
@@ -1137,7 +1367,7 @@ void VisitorsFlowRateService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDe
                              const ::PROTOBUF_NAMESPACE_ID::Message* request,
                              ::PROTOBUF_NAMESPACE_ID::Message* response,
                              ::google::protobuf::Closure* done) {
-  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[6]);
+  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[7]);
   switch(method->index()) {
     case 0:
       QueryHistory(controller,
@@ -1203,7 +1433,7 @@ EntranceGuardService::~EntranceGuardService() {}
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* EntranceGuardService::descriptor() {
   ::PROTOBUF_NAMESPACE_ID::internal::AssignDescriptors(&descriptor_table_service_2eproto);
-  return file_level_service_descriptors_service_2eproto[7];
+  return file_level_service_descriptors_service_2eproto[8];
 }
 
 const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* EntranceGuardService::GetDescriptor() {
@@ -1215,7 +1445,7 @@ void EntranceGuardService::CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescr
                              const ::PROTOBUF_NAMESPACE_ID::Message* request,
                              ::PROTOBUF_NAMESPACE_ID::Message* response,
                              ::google::protobuf::Closure* done) {
-  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[7]);
+  GOOGLE_DCHECK_EQ(method->service(), file_level_service_descriptors_service_2eproto[8]);
   switch(method->index()) {
     default:
       GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
@@ -425,6 +425,73 @@ class RealStreamService_Stub : public RealStreamService {
 };
 
 
+// -------------------------------------------------------------------
+
+class HlsService_Stub;
+
+class HlsService : public ::PROTOBUF_NAMESPACE_ID::Service {
+ protected:
+  // This class should be treated as an abstract interface.
+  inline HlsService() {};
+ public:
+  virtual ~HlsService();
+
+  typedef HlsService_Stub Stub;
+
+  static const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* descriptor();
+
+  virtual void Playlist(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+  virtual void Segment(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+
+  // implements Service ----------------------------------------------
+
+  const ::PROTOBUF_NAMESPACE_ID::ServiceDescriptor* GetDescriptor();
+  void CallMethod(const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method,
+                  ::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                  const ::PROTOBUF_NAMESPACE_ID::Message* request,
+                  ::PROTOBUF_NAMESPACE_ID::Message* response,
+                  ::google::protobuf::Closure* done);
+  const ::PROTOBUF_NAMESPACE_ID::Message& GetRequestPrototype(
+    const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method) const;
+  const ::PROTOBUF_NAMESPACE_ID::Message& GetResponsePrototype(
+    const ::PROTOBUF_NAMESPACE_ID::MethodDescriptor* method) const;
+
+ private:
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(HlsService);
+};
+
+class HlsService_Stub : public HlsService {
+ public:
+  HlsService_Stub(::PROTOBUF_NAMESPACE_ID::RpcChannel* channel);
+  HlsService_Stub(::PROTOBUF_NAMESPACE_ID::RpcChannel* channel,
+                   ::PROTOBUF_NAMESPACE_ID::Service::ChannelOwnership ownership);
+  ~HlsService_Stub();
+
+  inline ::PROTOBUF_NAMESPACE_ID::RpcChannel* channel() { return channel_; }
+
+  // implements HlsService ------------------------------------------
+
+  void Playlist(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+  void Segment(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+ private:
+  ::PROTOBUF_NAMESPACE_ID::RpcChannel* channel_;
+  bool owns_channel_;
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(HlsService_Stub);
+};
+
+
 // -------------------------------------------------------------------
 
 class VodService_Stub;
@@ -448,6 +515,18 @@ class VodService : public ::PROTOBUF_NAMESPACE_ID::Service {
                        const ::sdkproxy::HttpRequest* request,
                        ::sdkproxy::HttpResponse* response,
                        ::google::protobuf::Closure* done);
+  virtual void Progress(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+  virtual void Queue(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+  virtual void Availability(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
 
   // implements Service ----------------------------------------------
 
@@ -485,6 +564,18 @@ class VodService_Stub : public VodService {
                        const ::sdkproxy::HttpRequest* request,
                        ::sdkproxy::HttpResponse* response,
                        ::google::protobuf::Closure* done);
+  void Progress(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+  void Queue(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
+  void Availability(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
  private:
   ::PROTOBUF_NAMESPACE_ID::RpcChannel* channel_;
   bool owns_channel_;
@@ -594,6 +685,10 @@ class HealthService : public ::PROTOBUF_NAMESPACE_ID::Service {
                        const ::sdkproxy::HttpRequest* request,
                        ::sdkproxy::HttpResponse* response,
                        ::google::protobuf::Closure* done);
+  virtual void Streams(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
 
   // implements Service ----------------------------------------------
 
@@ -627,6 +722,10 @@ class HealthService_Stub : public HealthService {
                        const ::sdkproxy::HttpRequest* request,
                        ::sdkproxy::HttpResponse* response,
                        ::google::protobuf::Closure* done);
+  void Streams(::PROTOBUF_NAMESPACE_ID::RpcController* controller,
+                       const ::sdkproxy::HttpRequest* request,
+                       ::sdkproxy::HttpResponse* response,
+                       ::google::protobuf::Closure* done);
  private:
   ::PROTOBUF_NAMESPACE_ID::RpcChannel* channel_;
   bool owns_channel_;
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <memory>
 #include <sstream>
+#include <algorithm>
 #include <thread>
 
 #include <sys/types.h>
@@ -19,6 +20,9 @@
 
 #include "server/rpc/service.pb.h"
 #include "server/service/http_request_parser.h"
+#include "server/stream/response_cache.h"
+
+DEFINE_int32(discovery_max_ips, 256, "Max addresses probed by one discovery request");
 
 namespace sdkproxy {
 
@@ -32,10 +36,48 @@ class DeviceQueryServiceImpl : public DeviceQueryService {
         brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
         HttpRequestParser parser(cntl);
 
-        auto sdk = parser.GetSdkStubByRequest();
-        if (nullptr == sdk) {
+        // 批量探测nvr是否在线和厂商，只探测端口不登录，ip为逗号分隔的列表
+        // 和其他接口一样需要nvr的账号密码，用第一个地址登录验证，地址个数和超时都有上限
+        // 只探测登录成功过的nvr，其他地址返回Unknown device，不能用来扫描网络
+        std::vector<std::string> ips = parser.GetListByKey(parser.PARAM_IP);
+        std::string timeout          = parser.GetQueryByKey("timeout");
+        int32_t timeoutMs            = timeout.empty() ? (int32_t)sdk::SdkManager::PROBE_TIMEOUT_MS : atoi(timeout.c_str());
+        if (ips.empty() || (int32_t)ips.size() > FLAGS_discovery_max_ips || timeoutMs <= 0) {
+            LOG_ERROR("Invalid arguments, {} addresses, timeout {}", ips.size(), timeout);
+            parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Invalid arguments");
+            return;
+        }
+        timeoutMs = std::min(timeoutMs, (int32_t)sdk::SdkManager::PROBE_TIMEOUT_MS * 2);
+
+        if (nullptr == parser.GetSdkStub(ips[0])) {
             return;
         }
+
+        std::vector<std::string> known;
+        json devices = json::array();
+        for (auto &ip : ips) {
+            if (sdk::SDK_MNG().IsKnown(ip)) {
+                known.push_back(ip);
+                continue;
+            }
+            json j;
+            j["ip"]        = ip;
+            j["reachable"] = false;
+            j["error"]     = "Unknown device";
+            devices.push_back(j);
+        }
+        for (auto &r : sdk::SDK_MNG().ProbeReachability(known, timeoutMs)) {
+            json j;
+            j["ip"]        = r.ip;
+            j["reachable"] = r.reachable;
+            j["vendor"]    = r.vendor;
+            j["ports"]     = r.ports;
+            j["latency"]   = r.latency;
+            devices.push_back(j);
+        }
+
+        cntl->http_response().set_content_type("application/json");
+        cntl->response_attachment().append(devices.dump());
     }
 
     void Query(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
@@ -50,31 +92,34 @@ class DeviceQueryServiceImpl : public DeviceQueryService {
             return;
         }
 
-        std::vector<sdk::Device> devices;
-        int ret = sdk->QueryDevice(devices);
-        if (0 != ret) {
+        std::shared_ptr<const sdk::DeviceCatalog> catalog = sdk->GetDeviceCatalog();
+        if (nullptr == catalog) {
             LOG_INFO("Failed to query device");
             parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to query device");
             return;
         }
 
+        // 通道列表没有变化时直接回复序列化好的内容
         std::string pretty = parser.GetQueryByKey("pretty");
-        if (pretty == "json") {
-            cntl->http_response().set_content_type("application/json");
-            cntl->response_attachment().append(buildJsonResponseMsg(devices));
-        } else {
-            cntl->http_response().set_content_type("text/html");
-            cntl->response_attachment().append(buildHtmlResponseMsg(devices));
+        std::string key    = "device/" + parser.GetIp() + "/" + pretty;
+        auto cached        = RESPONSE_CACHE().Get(key, catalog->GetVersion());
+        if (nullptr == cached) {
+            if (pretty == "json") {
+                cached = RESPONSE_CACHE().Put(key, catalog->GetVersion(), "application/json", buildJsonResponseMsg(catalog->GetDevices()));
+            } else {
+                cached = RESPONSE_CACHE().Put(key, catalog->GetVersion(), "text/html", buildHtmlResponseMsg(catalog->GetDevices()));
+            }
         }
+        RESPONSE_CACHE().Reply(cntl, cached);
     }
 
 private:
-    std::string buildJsonResponseMsg(std::vector<sdk::Device> &devices) {
+    std::string buildJsonResponseMsg(const std::vector<sdk::Device> &devices) {
         json j = devices;
         return j.dump();
     }
 
-    std::string buildHtmlResponseMsg(std::vector<sdk::Device> &devices) {
+    std::string buildHtmlResponseMsg(const std::vector<sdk::Device> &devices) {
         std::stringstream html;
 
         html << "<!DOCTYPE html>";
@@ -27,6 +27,7 @@
 #include "server/service/http_request_parser.h"
 #include "server/util/io_util.h"
 #include "server/util/progressive_attachment_util.h"
+#include "server/stream/event_uploader.h"
 
 namespace sdkproxy {
 
@@ -47,7 +48,7 @@ public:
 
         LOG_INFO("Event upload destination is {}:{}", eventUploadHost, eventUploadPort);
 
-        client_.reset(new httplib::Client(eventUploadHost, atoi(eventUploadPort)));
+        EVENT_UPLOADER().Start(eventUploadHost, atoi(eventUploadPort));
     }
 
     void Reset(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
@@ -66,6 +67,7 @@ public:
         }
 
         jobCache_.clear();
+        SDK_MNG().Registry().ClearEventJobs();
     }
 
     void Query(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
@@ -103,7 +105,6 @@ public:
         std::string channelIp = parser.GetChannelIp();
         std::string devId     = sdk->ChannelIp2Id(channelIp);
         std::string devCode   = parser.GetQueryByKey("devCode");
-        std::string key       = buildKey(ip, devId);
 
         if (devId.empty() || devCode.empty()) {
             LOG_ERROR("Invalid arguments, devId {}, devCode {}", devId, devCode);
@@ -111,40 +112,24 @@ public:
             return;
         }
 
-        {
-            std::unique_lock<std::mutex> lck(mutex_);
-            if (jobCache_.find(key) != jobCache_.end()) {
-                LOG_INFO("Task exist for {}-{}", ip, devId);
-                jobCache_[key]->time = std::chrono::system_clock::now();
-                return;
-            }
-        }
-
-        std::shared_ptr<JobInfo> jobInfo(new JobInfo());
-        jobInfo->sdkStub   = sdk;
-        jobInfo->time      = std::chrono::system_clock::now();
-        jobInfo->devCode   = devCode;
-        jobInfo->channelIp = channelIp;
-
-        intptr_t jobId = 0;
-        int32_t ret    = sdk->StartEventAnalyze(
-            devId,
-            [this](intptr_t id, int type, const std::string &jsonData, const uint8_t *imgBuffer, int32_t imgBufferLen, void *userData) {
-                uploadEvent(((JobInfo *)userData)->devCode, ((JobInfo *)userData)->channelIp, type, jsonData, imgBuffer, imgBufferLen);
-            },
-            (void *)jobInfo.get(), jobId);
-
-        if (0 != ret) {
-            LOG_ERROR("Failed to start event analyze");
+        if (0 != startJob(sdk, ip, channelIp, devId, devCode)) {
             parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to start event analyze");
             return;
         }
+        // 记录任务，重启后自动恢复
+        SDK_MNG().Registry().AddEventJob(ip, channelIp, devCode);
+    }
 
-        // 保存记录
-        {
-            std::unique_lock<std::mutex> lck(mutex_);
-            jobInfo->jobId = jobId;
-            jobCache_[key] = jobInfo;
+    // 重启预热时设备登录成功后恢复上面的事件分析任务
+    void Restore(const sdk::DeviceRecord &record, std::shared_ptr<sdk::SdkStub> sdk) {
+        for (auto &job : record.eventJobs) {
+            std::string devId = sdk->ChannelIp2Id(job.channelIp);
+            if (devId.empty()) {
+                LOG_ERROR("Failed to restore event analyze for device {}, channel {} not found", job.devCode, job.channelIp);
+                continue;
+            }
+            LOG_INFO("Restore event analyze job for device {}", job.devCode);
+            startJob(sdk, record.ip, job.channelIp, devId, job.devCode);
         }
     }
 
@@ -162,6 +147,8 @@ public:
             return;
         }
 
+        SDK_MNG().Registry().RemoveEventJob(devCode);
+
         std::unique_lock<std::mutex> lck(mutex_);
 
         std::vector<std::string> devList;
@@ -175,26 +162,64 @@ public:
     }
 
 private:
+    int32_t startJob(std::shared_ptr<sdk::SdkStub> sdk, const std::string &ip, const std::string &channelIp, const std::string &devId,
+                     const std::string &devCode) {
+        std::string key = buildKey(ip, devId);
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (jobCache_.find(key) != jobCache_.end()) {
+                LOG_INFO("Task exist for {}-{}", ip, devId);
+                jobCache_[key]->time = std::chrono::system_clock::now();
+                return 0;
+            }
+        }
+
+        std::shared_ptr<JobInfo> jobInfo(new JobInfo());
+        jobInfo->sdkStub   = sdk;
+        jobInfo->time      = std::chrono::system_clock::now();
+        jobInfo->devCode   = devCode;
+        jobInfo->channelIp = channelIp;
+
+        intptr_t jobId = 0;
+        int32_t ret    = sdk->StartEventAnalyze(
+            devId,
+            [this](intptr_t id, int type, const std::string &jsonData, const uint8_t *imgBuffer, int32_t imgBufferLen, void *userData) {
+                uploadEvent(((JobInfo *)userData)->devCode, ((JobInfo *)userData)->channelIp, type, jsonData, imgBuffer, imgBufferLen);
+            },
+            (void *)jobInfo.get(), jobId);
+
+        if (0 != ret) {
+            LOG_ERROR("Failed to start event analyze");
+            return ret;
+        }
+
+        // 保存记录
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            jobInfo->jobId = jobId;
+            jobCache_[key] = jobInfo;
+        }
+        return 0;
+    }
+
+    // 在sdk的告警回调线程中调用，只复制图片并入队，由上传线程发送
     void uploadEvent(const std::string &devCode, const std::string &realIp, int alarmType, const std::string &alarmData, const uint8_t *imgBuffer,
                      int32_t bufferLen) {
-        std::string path = buildImagePath(devCode);
-        auto t           = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        auto t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
         std::stringstream ss;
         ss << std::put_time(std::localtime(&t), "%F %T");
-        std::string nowDateTime = ss.str();
-
-        httplib::MultipartFormDataItems items = {
-            {"path", path, "", ""},
-            {"realIp", realIp, "", ""},
-            {"dateTime", nowDateTime, "", ""},
-            {"alarmType", std::to_string(alarmType), "", ""},
-            {"alarmData", alarmData, "", "application/json"},
-            {"image", std::string((char *)imgBuffer, bufferLen), devCode + ".jpg", "image/jpeg"},
-        };
 
-        LOG_INFO("Upload alarm event, devCode = {}, realIp = {}, alarmType = {}, alarmData = {}", devCode, realIp, alarmType, alarmData);
-
-        client_->Post("/v3/upload", items);
+        UploadEvent event;
+        event.devCode   = devCode;
+        event.realIp    = realIp;
+        event.path      = buildImagePath(devCode);
+        event.dateTime  = ss.str();
+        event.alarmType = alarmType;
+        event.alarmData = alarmData;
+        if (nullptr != imgBuffer && bufferLen > 0) {
+            event.image.assign((const char *)imgBuffer, bufferLen);
+        }
+        EVENT_UPLOADER().Push(std::move(event));
     }
 
     std::string buildKey(const std::string &ip, const std::string &devId) { return ip + "_" + devId; }
@@ -219,6 +244,5 @@ private:
     CppTime::Timer checkTimer_;
     std::mutex mutex_;
     std::string httpCallbackUrl_;
-    std::shared_ptr<httplib::Client> client_;
 };
 } // namespace sdkproxy
\ No newline at end of file
@@ -10,16 +10,26 @@
 
 #include "common/helper/logger.h"
 
+#include "3rdsdk/stub/po_type_serialization.h"
 #include "3rdsdk/stub/sdk_stub.h"
 #include "3rdsdk/stub/sdk_manager.h"
+#include "3rdsdk/stub/download_poller.h"
 
 #include "server/rpc/service.pb.h"
 #include "server/util/io_util.h"
 #include "server/util/progressive_attachment_util.h"
 #include "server/service/http_request_parser.h"
+#include "server/stream/stream_reactor.h"
+#include "server/stream/real_stream_hub.h"
+#include "server/stream/record_cache.h"
+#include "server/stream/record_index.h"
+#include "server/stream/response_cache.h"
+#include "server/stream/event_uploader.h"
 
 namespace sdkproxy {
 
+using json = nlohmann::json;
+
 class HealthServiceImpl : public HealthService {
 public:
     void Health(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
@@ -28,8 +38,210 @@ public:
 
         brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
 
+        // 各nvr会话的状态，熔断没有关闭的nvr单独计数
+        json sessions        = json::array();
+        int32_t openCircuits = 0;
+        for (auto &s : sdk::SDK_MNG().Sessions()) {
+            json j;
+            j["ip"]        = s.ip;
+            j["vendor"]    = s.vendor;
+            j["state"]     = sdk::SessionStateToString(s.state);
+            j["since"]     = s.since;
+            j["attempts"]  = s.attempts;
+            j["logins"]    = s.logins;
+            j["lastError"] = s.lastError;
+            j["circuit"]   = sdk::CircuitStateToString(s.circuit);
+            j["failures"]  = s.failures;
+            j["retryAt"]   = s.retryAt;
+            j["rejected"]  = s.rejected;
+
+            // 设备列表缓存，staleHits是过期后直接返回旧列表的次数
+            json deviceCache;
+            deviceCache["hits"]            = s.deviceCache.hits;
+            deviceCache["staleHits"]       = s.deviceCache.staleHits;
+            deviceCache["misses"]          = s.deviceCache.misses;
+            deviceCache["coalesced"]       = s.deviceCache.coalesced;
+            deviceCache["refreshes"]       = s.deviceCache.refreshes;
+            deviceCache["refreshFailures"] = s.deviceCache.refreshFailures;
+            deviceCache["refreshAvgMs"]    = s.deviceCache.refreshes > 0 ? s.deviceCache.refreshTotalMs / s.deviceCache.refreshes : 0;
+            deviceCache["refreshMaxMs"]    = s.deviceCache.refreshMaxMs;
+            j["deviceCache"]               = deviceCache;
+            sessions.push_back(j);
+            if (sdk::CIRCUIT_CLOSED != s.circuit) {
+                openCircuits++;
+            }
+        }
+        // 重启后的预热进度
+        sdk::WarmUpProgress wp = sdk::SDK_MNG().GetWarmUpProgress();
+        json warmUp;
+        warmUp["running"]   = wp.running;
+        warmUp["total"]     = wp.total;
+        warmUp["done"]      = wp.done;
+        warmUp["succeeded"] = wp.succeeded;
+        warmUp["failed"]    = wp.failed;
+        warmUp["elapsedMs"] = wp.elapsedMs;
+
+        // 告警事件上传队列，dropped是队列满时丢弃的事件，failures是上传失败的事件
+        EventUploadStats es = EVENT_UPLOADER().Stats();
+        json eventUpload;
+        eventUpload["depth"]        = es.depth;
+        eventUpload["bytes"]        = es.bytes;
+        eventUpload["maxDepth"]     = es.maxDepth;
+        eventUpload["capacity"]     = FLAGS_event_upload_queue_size;
+        eventUpload["enqueued"]     = es.enqueued;
+        eventUpload["uploaded"]     = es.uploaded;
+        eventUpload["failures"]     = es.failures;
+        eventUpload["retries"]      = es.retries;
+        eventUpload["dropped"]      = es.dropped;
+        eventUpload["spilled"]      = es.spilled;
+        eventUpload["replayed"]     = es.replayed;
+        eventUpload["batches"]      = es.batches;
+        eventUpload["latencyAvgMs"] = es.uploaded > 0 ? es.latencyTotalMs / es.uploaded : 0;
+        eventUpload["latencyMaxMs"] = es.latencyMaxMs;
+        eventUpload["uploadAvgMs"]  = es.batches > 0 ? es.uploadTotalMs / es.batches : 0;
+        eventUpload["uploadMaxMs"]  = es.uploadMaxMs;
+
+        // 告警事件的spool，pending是还没有上传成功的事件，expired是超过保留限制没有上传就删除的事件
+        EventSpoolStats ss = EVENT_SPOOL().Stats();
+        json eventSpool;
+        eventSpool["enabled"]        = EVENT_SPOOL().IsOpen();
+        eventSpool["segments"]       = ss.segments;
+        eventSpool["bytes"]          = ss.bytes;
+        eventSpool["maxBytes"]       = FLAGS_event_spool_max_bytes;
+        eventSpool["pending"]        = ss.pending;
+        eventSpool["inflight"]       = ss.inflight;
+        eventSpool["appended"]       = ss.appended;
+        eventSpool["acked"]          = ss.acked;
+        eventSpool["expired"]        = ss.expired;
+        eventSpool["appendFailures"] = ss.appendFailures;
+        eventSpool["syncs"]          = ss.syncs;
+        eventSpool["syncAvgMs"]      = ss.syncs > 0 ? ss.syncTotalMs / ss.syncs : 0;
+        eventSpool["syncMaxMs"]      = ss.syncMaxMs;
+
+        json j;
+        j["status"]       = "UP";
+        j["openCircuits"] = openCircuits;
+        j["warmUp"]       = warmUp;
+        j["eventUpload"]  = eventUpload;
+        j["eventSpool"]   = eventSpool;
+        j["sessions"]     = sessions;
+
+        cntl->http_response().set_content_type("application/json");
+        cntl->response_attachment().append(j.dump());
+    }
+
+    void Streams(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
+                 ::google::protobuf::Closure *done) override {
+        brpc::ClosureGuard done_guard(done);
+
+        brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
+
+        json streams = json::array();
+        for (auto &s : STREAM_REACTOR().Dump()) {
+            json j;
+            j["id"]            = s.id;
+            j["kind"]          = s.kind;
+            j["name"]          = s.name;
+            j["bytes"]         = s.bytes;
+            j["startTime"]     = s.startTime;
+            j["idleMs"]        = s.idleMs;
+            j["overflow"]      = s.overflow;
+            j["droppedFrames"] = s.droppedFrames;
+            j["droppedBytes"]  = s.droppedBytes;
+            j["loop"]          = s.loop;
+            streams.push_back(j);
+        }
+
+        // 实时流通道和GOP缓存
+        json channels = json::array();
+        for (auto &c : REAL_STREAM_HUB().Dump()) {
+            json j;
+            j["key"]       = c.key;
+            j["viewers"]   = c.viewers;
+            j["gopFrames"] = c.gopFrames;
+            j["gopBytes"]  = c.gopBytes;
+            channels.push_back(j);
+        }
+
+        json gopCache;
+        gopCache["hits"]     = GOP_CACHE_STATS().hits.load();
+        gopCache["misses"]   = GOP_CACHE_STATS().misses.load();
+        gopCache["bytes"]    = GOP_CACHE_STATS().bytes.load();
+        gopCache["maxBytes"] = FLAGS_gop_cache_max_bytes;
+
+        // 录像磁盘缓存，命中率按字节计算
+        RecordCacheStats rc = RECORD_CACHE().Stats();
+        json vodCache;
+        vodCache["enabled"]      = RECORD_CACHE().IsEnabled();
+        vodCache["entries"]      = rc.entries;
+        vodCache["bytes"]        = rc.bytes;
+        vodCache["maxBytes"]     = rc.maxBytes;
+        vodCache["lookups"]      = rc.lookups;
+        vodCache["hits"]         = rc.hits;
+        vodCache["bytesSaved"]   = rc.servedBytes;
+        vodCache["bytesFetched"] = rc.fetchedBytes;
+        vodCache["bytesStored"]  = rc.storedBytes;
+        vodCache["evictions"]    = rc.evictions;
+        vodCache["queuedBytes"]  = rc.queuedBytes;
+        vodCache["skipped"]      = rc.skipped;
+        vodCache["hitRatio"]     = rc.servedBytes + rc.fetchedBytes > 0 ? (double)rc.servedBytes / (rc.servedBytes + rc.fetchedBytes) : 0.0;
+
+        // 录像查询索引，hits是没有查询nvr的次数
+        RecordIndexStats ri = RECORD_INDEX().Stats();
+        json recordIndex;
+        recordIndex["enabled"]    = FLAGS_vod_record_index_enable;
+        recordIndex["queries"]    = ri.queries;
+        recordIndex["hits"]       = ri.hits;
+        recordIndex["nvrQueries"] = ri.nvrQueries;
+        recordIndex["records"]    = ri.records;
+        recordIndex["maxRecords"] = FLAGS_vod_record_index_max_records;
+        recordIndex["channels"]   = ri.channels;
+        recordIndex["evictions"]  = ri.evictions;
+
+        // 设备列表、客流历史和录像查询的响应缓存，bytesSaved是304和压缩少发送的字节数
+        ResponseCacheStats rs = RESPONSE_CACHE().Stats();
+        json responseCache;
+        responseCache["enabled"]     = FLAGS_response_cache_enable;
+        responseCache["entries"]     = rs.entries;
+        responseCache["bytes"]       = rs.bytes;
+        responseCache["maxBytes"]    = FLAGS_response_cache_max_bytes;
+        responseCache["hits"]        = rs.hits;
+        responseCache["misses"]      = rs.misses;
+        responseCache["notModified"] = rs.notModified;
+        responseCache["gzipped"]     = rs.gzipped;
+        responseCache["bytesSaved"]  = rs.bytesSaved;
+        responseCache["evictions"]   = rs.evictions;
+
+        // nvr录像下载的吞吐量，进行中的下载给出当前速率，倍速下载单独统计
+        sdk::DownloadStats ds = sdk::DOWNLOAD_POLLER().Stats();
+        uint64_t activeRate   = 0;
+        int32_t activeCount   = 0;
+        for (auto &p : sdk::DOWNLOAD_POLLER().Dump()) {
+            activeRate += p.rate;
+            activeCount++;
+        }
+        json vodDownloads;
+        vodDownloads["active"]          = activeCount;
+        vodDownloads["activeRate"]      = activeRate;
+        vodDownloads["finished"]        = ds.finished;
+        vodDownloads["bytes"]           = ds.bytes;
+        vodDownloads["avgRate"]         = ds.elapsedMs > 0 ? ds.bytes * 1000 / ds.elapsedMs : 0;
+        vodDownloads["accelerated"]     = ds.accelerated;
+        vodDownloads["acceleratedRate"] = ds.acceleratedMs > 0 ? ds.acceleratedBytes * 1000 / ds.acceleratedMs : 0;
+        vodDownloads["speedRefused"]    = ds.refused;
+
+        json j;
+        j["total"]         = streams.size();
+        j["streams"]       = streams;
+        j["channels"]      = channels;
+        j["gopCache"]      = gopCache;
+        j["vodCache"]      = vodCache;
+        j["recordIndex"]   = recordIndex;
+        j["responseCache"] = responseCache;
+        j["vodDownloads"]  = vodDownloads;
+
         cntl->http_response().set_content_type("application/json");
-        cntl->response_attachment().append("{\"status\": \"UP\"}");
+        cntl->response_attachment().append(j.dump());
     }
 };
 
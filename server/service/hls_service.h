@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+#include "common/helper/logger.h"
+
+#include "3rdsdk/stub/sdk_stub.h"
+#include "3rdsdk/stub/sdk_manager.h"
+
+#include "server/rpc/service.pb.h"
+#include "server/service/http_request_parser.h"
+#include "server/stream/hls_segmenter.h"
+
+namespace sdkproxy {
+
+// HLS/LL-HLS服务，分片在内存中生成，同一通道的所有客户端共享
+// /HlsService/Playlist?ip=&user=&password=&channelIp=[&_HLS_msn=&_HLS_part=]
+// /HlsService/Segment?stream=&seq=[&part=]
+class HlsServiceImpl final : public HlsService {
+public:
+    ~HlsServiceImpl() {}
+
+    virtual void Playlist(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
+                          ::google::protobuf::Closure *done) override {
+        brpc::ClosureGuard done_guard(done);
+
+        brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
+        HttpRequestParser parser(cntl);
+
+        auto sdk = parser.GetSdkStubByRequest();
+        if (nullptr == sdk) {
+            return;
+        }
+
+        std::string devId = sdk->ChannelIp2Id(parser.GetChannelIp());
+        if (devId.empty()) {
+            LOG_ERROR("Invalid arguments, devId {}", devId);
+            parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Invalid arguments");
+            return;
+        }
+
+        auto channel = HLS_HUB().Open(parser.GetIp(), sdk, devId);
+        if (nullptr == channel) {
+            LOG_ERROR("Failed to start hls channel");
+            parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to start real stream");
+            return;
+        }
+
+        std::string msn  = parser.GetQueryByKey("_HLS_msn");
+        std::string part = parser.GetQueryByKey("_HLS_part");
+
+        // 阻塞刷新的请求由切片在分片生成后应答
+        channel->Playlist(cntl, done_guard.release(), msn.empty() ? -1 : atoll(msn.c_str()), part.empty() ? -1 : atoll(part.c_str()));
+    }
+
+    virtual void Segment(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
+                         ::google::protobuf::Closure *done) override {
+        brpc::ClosureGuard done_guard(done);
+
+        brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
+        HttpRequestParser parser(cntl);
+
+        std::string stream = parser.GetQueryByKey("stream");
+        std::string seq    = parser.GetQueryByKey("seq");
+        std::string part   = parser.GetQueryByKey("part");
+        if (stream.empty() || seq.empty()) {
+            parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Invalid arguments");
+            return;
+        }
+
+        auto channel = HLS_HUB().Find(stream);
+        butil::IOBuf data;
+        if (nullptr == channel || !channel->GetSegment(strtoull(seq.c_str(), nullptr, 10), part.empty() ? -1 : atoll(part.c_str()), data)) {
+            parser.SetResponseError(brpc::HTTP_STATUS_NOT_FOUND, "Segment not found");
+            return;
+        }
+
+        // 分片生成后不再变化，数据块引用计数共享，不复制
+        cntl->http_response().set_content_type("video/mp2t");
+        cntl->http_response().SetHeader("Cache-Control", "max-age=60");
+        cntl->response_attachment().append(data);
+    }
+};
+
+} // namespace sdkproxy
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <sstream>
+#include <butil/endpoint.h>
 #include "common/helper/logger.h"
 #include "common/helper/url_helper.h"
 #include "server/rpc/service.pb.h"
@@ -41,13 +44,37 @@ public:
         return urlhelper::URLDecode(*value);
     }
 
-    std::shared_ptr<sdk::SdkStub> GetSdkStubByRequest() {
+    // 逗号分隔的参数列表，忽略空项
+    std::vector<std::string> GetListByKey(const std::string &key) const {
+        std::vector<std::string> items;
+        std::stringstream ss(GetQueryByKey(key));
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+    // 排队时区分客户端：对端地址加登录nvr的账号，请求参数不能伪造出新的客户端来多占排队的轮次
+    std::string GetClient() const { return GetQueryByKey(PARAM_USEER) + "@" + butil::ip2str(cntl_->remote_side().ip).c_str(); }
+
+    std::string GetHeader(const std::string &key) const {
+        const std::string *value = cntl_->http_request().GetHeader(key);
+        return nullptr == value ? "" : *value;
+    }
+
+    std::shared_ptr<sdk::SdkStub> GetSdkStubByRequest() { return GetSdkStub(GetIp()); }
+
+    // 用请求中的账号密码登录指定的nvr，失败时设置错误响应并返回nullptr
+    std::shared_ptr<sdk::SdkStub> GetSdkStub(const std::string &ip) {
         if (!validateBasicParams()) {
             return nullptr;
         }
 
         try {
-            return sdk::SDK_MNG().TryLoginAndGet(GetIp(), GetUser(), GetPassword());
+            return sdk::SDK_MNG().TryLoginAndGet(ip, GetUser(), GetPassword());
         } catch (sdk::NetworkException &e) {
             SetResponseError(brpc::HTTP_STATUS_REQUEST_TIMEOUT, e.what());
             return nullptr;
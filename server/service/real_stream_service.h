@@ -4,23 +4,110 @@
 #include <cstdint>
 #include <memory>
 #include <sstream>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <gflags/gflags.h>
+
 #include "common/helper/logger.h"
 
 #include "3rdsdk/stub/sdk_stub.h"
 #include "3rdsdk/stub/sdk_manager.h"
 
 #include "server/rpc/service.pb.h"
-#include "server/util/io_util.h"
 #include "server/util/progressive_attachment_util.h"
 #include "server/service/http_request_parser.h"
-#include "server/util/pipe_guard.h"
+#include "server/stream/real_stream_hub.h"
+#include "server/stream/stream_reactor.h"
+
+DEFINE_string(live_drop_policy, "gop", "How a congested live viewer drops data, `gop' drops until the next key frame, `frame' drops only the frames that can not be sent");
 
 namespace sdkproxy {
 
+// 实时流传输任务，把共享环形缓冲中的帧写给一个观看者
+// 连接拥塞时不等待，按live_drop_policy丢弃整帧，之后从下一个关键帧重新同步
+class RealStreamTask final : public StreamTask {
+public:
+    RealStreamTask(std::shared_ptr<RealStreamViewer> viewer, butil::intrusive_ptr<brpc::ProgressiveAttachment> pa, const std::string &name)
+        : StreamTask("live", name), viewer_(viewer), pa_(pa), dropGop_(FLAGS_live_drop_policy != "frame"), waitSync_(false) {}
+
+    int GetFd() override { return viewer_->GetNotifyFd(); }
+
+    bool OnReadable() override {
+        std::vector<SharedMediaRing::Chunk> frames;
+        int r = viewer_->Read(frames, 0);
+        if (-1 == r) {
+            // sdk stream finished
+            return false;
+        }
+        if (viewer_->TakeLost()) {
+            waitSync_ = true;
+        }
+
+        for (auto &f : frames) {
+            if (FRAME_HEADER == f->type) {
+                header_ = f;
+            } else if (waitSync_ && !f->sync) {
+                addDropped(1, f->data.size());
+                continue;
+            }
+
+            // 之前因拥塞没有发出去的流头要在同步帧之前补发
+            if (nullptr != header_ && f != header_ && f->sync) {
+                int ret = ProgressiveAttachmentUtil::trywrite(pa_.get(), header_->data.data(), header_->data.size());
+                if (ret < 0) {
+                    return false;
+                } else if (ret > 0) {
+                    addDropped(1, f->data.size());
+                    waitSync_ = true;
+                    continue;
+                }
+                addBytes(header_->data.size());
+                header_ = nullptr;
+            }
+
+            int ret = ProgressiveAttachmentUtil::trywrite(pa_.get(), f->data.data(), f->data.size());
+            if (ret < 0) {
+                return false;
+            } else if (ret > 0) {
+                // 拥塞，丢弃整帧；关键帧被丢弃或者按GOP丢弃时，等待下一个关键帧
+                addDropped(1, f->data.size());
+                if (dropGop_ || f->sync) {
+                    waitSync_ = true;
+                }
+                continue;
+            }
+
+            if (f == header_) {
+                header_ = nullptr;
+            } else if (f->sync) {
+                waitSync_ = false;
+            }
+            addBytes(f->data.size());
+        }
+        return true;
+    }
+
+    void OnFinished(const std::string &reason) override {
+        // 最后一个观看者离开时停止sdk实时流
+        REAL_STREAM_HUB().Unsubscribe(viewer_);
+        LOG_INFO("The real stream is {}, {}, skipped {}, dropped frames {}, dropped bytes {}", reason, GetName(), viewer_->GetSkipped(),
+                 GetDroppedFrames(), GetDroppedBytes());
+    }
+
+    // 落后太多而被跳过的帧数
+    uint64_t GetOverflow() const override { return viewer_->GetSkipped(); }
+
+private:
+    std::shared_ptr<RealStreamViewer> viewer_;
+    butil::intrusive_ptr<brpc::ProgressiveAttachment> pa_;
+    SharedMediaRing::Chunk header_; // 待发送的流头
+    bool dropGop_;
+    bool waitSync_;
+};
+
 class RealStreamServiceImpl final : public RealStreamService {
 public:
     ~RealStreamServiceImpl() {}
@@ -45,26 +132,10 @@ public:
             return;
         }
 
-        std::shared_ptr<PipeGuard> dataPipe(new PipeGuard());
-        if (0 != dataPipe->Init()) {
-            parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Open pipe failed");
-            return;
-        }
-
-        intptr_t jobId = 0;
-        int ret        = sdk->StartRealStream(
-            devId,
-            [=](intptr_t id, const uint8_t *buffer, int32_t bufferLen) {
-                if (nullptr != buffer) {
-                    IoUtil::writen(dataPipe->GetWriteFd(), (const char *)buffer, bufferLen);
-                } else {
-                    //通知写完毕
-                    dataPipe->NotifyWriteCompleted();
-                }
-            },
-            jobId);
-
-        if (0 != ret) {
+        // 同一通道的多个观看者共享一路sdk实时流
+        std::string ip = parser.GetIp();
+        auto viewer    = REAL_STREAM_HUB().Subscribe(ip, sdk, devId);
+        if (nullptr == viewer) {
             LOG_ERROR("Failed to start real stream");
             parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to start real stream");
             return;
@@ -72,49 +143,11 @@ public:
 
         butil::intrusive_ptr<brpc::ProgressiveAttachment> pa(cntl->CreateProgressiveAttachment());
 
-        // start thread for transport
-        std::thread t([=]() {
-            // non block I/O
-            fcntl(dataPipe->GetReadFd(), F_SETFL, O_NONBLOCK);
-            fd_set rfdset;
-
-            while (true) {
-                FD_ZERO(&rfdset);
-                FD_SET(dataPipe->GetReadFd(), &rfdset);
-
-                struct timeval tv;
-                tv.tv_sec  = 30;
-                tv.tv_usec = 0;
-                int r      = select(dataPipe->GetReadFd() + 1, &rfdset, nullptr, nullptr, &tv);
-                if (-1 == r && errno == EINTR) {
-                    continue;
-                } else if (-1 == r) {
-                    // error
-                    LOG_ERROR("Wait for data error");
-                    break;
-                } else if (0 == r) {
-                    // timeout, no sdk data
-                    LOG_ERROR("Wait for data timeout");
-                    break;
-                } else {
-                    // read data from pipe
-                    char buf[4096];
-                    int len = read(dataPipe->GetReadFd(), buf, sizeof(buf));
-                    if ((len < 0 && errno != EAGAIN) || (len == 0) || (len > 0 && ProgressiveAttachmentUtil::writen(pa.get(), buf, len) < 0)) {
-                        break;
-                    }
-                }
-            }
-
-            //通知读取完毕，当客户端主动关闭时，需要通知pipe的写端停止写
-            dataPipe->NotifyReadCompleted();
-
-            // finished
-            intptr_t jid = jobId;
-            sdk->StopRealStream(jid);
-            LOG_INFO("The real stream is completed, dev {}", devId);
-        });
-        t.detach();
+        // 交给reactor传输，不再为每路流创建线程
+        std::shared_ptr<RealStreamTask> task(new RealStreamTask(viewer, pa, ip + "_" + devId));
+        if (0 != STREAM_REACTOR().Register(task)) {
+            REAL_STREAM_HUB().Unsubscribe(viewer);
+        }
     }
 };
 
@@ -5,6 +5,8 @@
 #include <memory>
 #include <sstream>
 #include <thread>
+#include <ctime>
+#include <algorithm>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -19,6 +21,11 @@
 
 #include "server/rpc/service.pb.h"
 #include "server/service/http_request_parser.h"
+#include "server/stream/response_cache.h"
+
+DEFINE_int32(visitors_history_ttl_s, 3600, "How long a cached flow rate history that ended before visitors_history_settle_s stays valid");
+DEFINE_int32(visitors_live_ttl_s, 10, "How long a cached flow rate history that is still being counted stays valid");
+DEFINE_int32(visitors_history_settle_s, 600, "Flow rate history older than this is treated as final");
 
 namespace sdkproxy {
 using json = nlohmann::json;
@@ -48,18 +55,25 @@ public:
             return;
         }
 
-        std::vector<sdk::VisitorsFlowRateHistory> histories;
-        int ret = sdk->QueryVisitorsFlowRateHistory(devId, atoi(granularity.c_str()), sdk::TimePoint().FromString(startTime),
-                                                    sdk::TimePoint().FromString(endTime), histories);
-        if (0 != ret) {
-            LOG_INFO("Failed to query visitors flow rate history");
-            parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to query visitors flow rate history");
-            return;
-        }
+        // 已经结束的时间段结果不会再变，缓存较长时间，包含最近时间的结果只缓存几秒，合并仪表盘的轮询
+        std::string key = "visitors/" + parser.GetIp() + "/" + devId + "/" + granularity + "/" + startTime + "/" + endTime;
+        auto cached     = RESPONSE_CACHE().Get(key, 0);
+        if (nullptr == cached) {
+            std::vector<sdk::VisitorsFlowRateHistory> histories;
+            int ret = sdk->QueryVisitorsFlowRateHistory(devId, atoi(granularity.c_str()), sdk::TimePoint().FromString(startTime),
+                                                        sdk::TimePoint().FromString(endTime), histories);
+            if (0 != ret) {
+                LOG_INFO("Failed to query visitors flow rate history");
+                parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to query visitors flow rate history");
+                return;
+            }
 
-        json j = histories;
-        cntl->http_response().set_content_type("application/json");
-        cntl->response_attachment().append(j.dump());
+            bool settled = sdk::TimePoint().FromString(endTime).ToTime() < time(NULL) - FLAGS_visitors_history_settle_s;
+            int32_t ttlS = settled ? FLAGS_visitors_history_ttl_s : FLAGS_visitors_live_ttl_s;
+            json j       = histories;
+            cached       = RESPONSE_CACHE().Put(key, 0, "application/json", j.dump(), (uint64_t)std::max(ttlS, 1) * 1000);
+        }
+        RESPONSE_CACHE().Reply(cntl, cached);
     }
 };
 
@@ -4,31 +4,345 @@
 #include <cstdint>
 #include <memory>
 #include <sstream>
-#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <brpc/progressive_attachment.h>
 #include <brpc/errno.pb.h>
+#include <bthread/bthread.h>
 
 #include "common/helper/logger.h"
 #include "common/helper/counttimer.h"
+#include "common/helper/base64.h"
 
 #include "3rdsdk/stub/po_type_serialization.h"
 #include "3rdsdk/stub/sdk_stub.h"
 #include "3rdsdk/stub/sdk_manager.h"
 
 #include "server/rpc/service.pb.h"
-#include "server/util/io_util.h"
 #include "server/util/progressive_attachment_util.h"
 #include "server/service/http_request_parser.h"
-#include "server/util/pipe_guard.h"
+#include "server/stream/media_ring.h"
+#include "server/stream/stream_reactor.h"
+#include "server/stream/segmented_download.h"
+#include "server/stream/download_scheduler.h"
+#include "server/stream/record_index.h"
+#include "server/stream/record_availability.h"
+#include "server/stream/response_cache.h"
+
+DEFINE_int32(vod_max_speed, 16, "Max playback rate a download can ask the nvr for with the speed parameter");
+DEFINE_int32(vod_queue_response_wait_s, 30, "Seconds a download waits for a session on the nvr before answering 503 with Retry-After");
+DEFINE_int32(vod_query_write_timeout_ms, 10000,
+             "How long a streamed record query waits for a client that stops reading, the query is then aborted as if the client disconnected");
 
 namespace sdkproxy {
 
 using json = nlohmann::json;
 
+// 录像下载传输任务，把sdk回调写入环形缓冲的数据零拷贝地发给客户端
+// 下载不能丢数据，连接拥塞时保留未发送的数据稍后重试，缓冲积压过多时暂停sdk下载，不支持暂停时缓冲满后阻塞sdk回调
+// 创建时sdk下载已经启动，结束时停止下载并把会话还给调度器
+class VodDownloadTask final : public StreamTask {
+public:
+    enum {
+        PAUSE_IDLE    = 0,
+        PAUSE_RUNNING = 1, // 暂停或恢复的调用还没有返回
+        PAUSE_OK      = 2,
+        PAUSE_FAILED  = 3,
+    };
+
+    VodDownloadTask(std::shared_ptr<sdk::SdkStub> sdk, std::shared_ptr<MediaRing> ring, butil::intrusive_ptr<brpc::ProgressiveAttachment> pa,
+                    DownloadTicketPtr ticket, intptr_t jobId, const std::string &name)
+        : StreamTask("vod", name), sdk_(sdk), ring_(ring), pa_(pa), ticket_(ticket), jobId_(jobId), backoffMs_(0), paused_(false),
+          pauseFailed_(false), calls_(new SdkCallStrand()), pauseResult_(new std::atomic<int32_t>(PAUSE_IDLE)) {}
+
+    int GetFd() override { return ring_->GetNotifyFd(); }
+
+    bool OnReadable() override {
+        checkPause();
+
+        // 先发送上次拥塞时没有发出去的数据
+        if (!pending_.empty()) {
+            int ret = ProgressiveAttachmentUtil::trywrite(pa_.get(), pending_);
+            if (ret < 0) {
+                return false;
+            } else if (ret > 0) {
+                ring_->ClearNotify();
+                congested();
+                return true;
+            }
+            addBytes(pending_.size());
+            pending_.clear();
+        }
+        backoffMs_ = 0;
+
+        // 一次最多发送stream_read_buffer_size的16倍，避免一路流独占事件循环
+        int len = ring_->Drain(pending_, (size_t)FLAGS_stream_read_buffer_size * 16);
+        if (len < 0) {
+            return false;
+        } else if (len > 0) {
+            int ret = ProgressiveAttachmentUtil::trywrite(pa_.get(), pending_);
+            if (ret < 0) {
+                return false;
+            } else if (ret > 0) {
+                congested();
+                return true;
+            }
+            addBytes(len);
+            pending_.clear();
+        }
+
+        // 积压消化后恢复sdk下载
+        if (paused_ && ring_->Size() <= ring_->Capacity() / 4) {
+            pause(false);
+        }
+        return true;
+    }
+
+    void OnFinished(const std::string &reason) override {
+        //通知读取完毕，当客户端主动关闭时，sdk回调不再写入
+        ring_->Cancel();
+
+        // finished，停止排在还没有返回的暂停调用之后，停止后才把会话还给调度器
+        std::shared_ptr<sdk::SdkStub> sdk = sdk_;
+        DownloadTicketPtr ticket          = ticket_;
+        intptr_t jobId                    = jobId_;
+        calls_->Post([sdk, ticket, jobId]() mutable {
+            sdk->StopDownloadRecord(jobId);
+            DOWNLOAD_SCHEDULER().Release(ticket);
+        });
+        if (ring_->IsAborted()) {
+            LOG_ERROR("The download is aborted, ring overflow, {}, bytes {}, overflow bytes {}", GetName(), GetBytes(), ring_->GetOverflowBytes());
+        } else {
+            LOG_INFO("The download is {}, {}, bytes {}, overflow bytes {}", reason, GetName(), GetBytes(), ring_->GetOverflowBytes());
+        }
+    }
+
+    uint64_t GetOverflow() const override { return ring_->GetOverflowBytes(); }
+
+private:
+    // 连接拥塞，按指数退避稍后重试，而不是在事件循环中空转
+    void congested() {
+        backoffMs_ = backoffMs_ == 0 ? 1 : std::min(backoffMs_ * 2, 64);
+        retryAfter(backoffMs_);
+
+        if (!paused_ && !pauseFailed_ && ring_->Size() >= ring_->Capacity() / 2) {
+            pause(true);
+        }
+    }
+
+    // 在sdk调用线程中暂停或恢复下载，完成后唤醒事件循环，由checkPause处理结果
+    // paused_在发起暂停时就置位，避免重复发起，恢复也一样
+    void pause(bool pause) {
+        if (PAUSE_RUNNING == pauseResult_->load()) {
+            return;
+        }
+        paused_ = pause;
+        pauseResult_->store(PAUSE_RUNNING);
+
+        std::shared_ptr<sdk::SdkStub> sdk          = sdk_;
+        std::shared_ptr<MediaRing> ring            = ring_;
+        std::shared_ptr<std::atomic<int32_t>> done = pauseResult_;
+        intptr_t jobId                             = jobId_;
+        calls_->Post([sdk, ring, done, jobId, pause]() {
+            int32_t ret = sdk->PauseDownloadRecord(jobId, pause);
+            done->store(pause ? (0 == ret ? PAUSE_OK : PAUSE_FAILED) : PAUSE_IDLE);
+            ring->Wake();
+        });
+    }
+
+    // 暂停失败或者sdk不支持暂停时不再尝试，改为缓冲满时阻塞sdk回调，而不是按溢出策略终止下载
+    void checkPause() {
+        if (PAUSE_FAILED != pauseResult_->load()) {
+            return;
+        }
+        pauseResult_->store(PAUSE_IDLE);
+        paused_      = false;
+        pauseFailed_ = true;
+        ring_->SetBlocking((uint32_t)std::max(FLAGS_media_ring_block_ms, 0));
+        LOG_INFO("Failed to pause the download {}, block the sdk callback when the ring is full", GetName());
+    }
+
+private:
+    std::shared_ptr<sdk::SdkStub> sdk_;
+    std::shared_ptr<MediaRing> ring_;
+    butil::intrusive_ptr<brpc::ProgressiveAttachment> pa_;
+    DownloadTicketPtr ticket_;
+    intptr_t jobId_;
+    butil::IOBuf pending_;
+    int backoffMs_;
+    bool paused_;
+    bool pauseFailed_;
+    std::shared_ptr<SdkCallStrand> calls_;
+    std::shared_ptr<std::atomic<int32_t>> pauseResult_;
+};
+
+// 分段并行下载的传输任务，子区间按时间顺序输出，后面的子区间在缓冲中等待
+class VodParallelTask final : public StreamTask {
+public:
+    VodParallelTask(std::shared_ptr<SegmentedDownload> download, butil::intrusive_ptr<brpc::ProgressiveAttachment> pa, const std::string &name)
+        : StreamTask("vod-parallel", name), download_(download), pa_(pa), backoffMs_(0) {}
+
+    int GetFd() override { return download_->GetNotifyFd(); }
+
+    bool OnReadable() override {
+        download_->Pump();
+
+        if (!pending_.empty()) {
+            int ret = ProgressiveAttachmentUtil::trywrite(pa_.get(), pending_);
+            if (ret < 0) {
+                return false;
+            } else if (ret > 0) {
+                congested();
+                return true;
+            }
+            addBytes(pending_.size());
+            pending_.clear();
+        }
+        backoffMs_ = 0;
+
+        int len = download_->Read(pending_, (size_t)FLAGS_stream_read_buffer_size * 16);
+        if (len < 0) {
+            return false;
+        } else if (len > 0) {
+            int ret = ProgressiveAttachmentUtil::trywrite(pa_.get(), pending_);
+            if (ret < 0) {
+                return false;
+            } else if (ret > 0) {
+                congested();
+                return true;
+            }
+            addBytes(len);
+            pending_.clear();
+        }
+
+        // 同一nvr上其他下载释放会话后再启动剩下的子区间，排队等待会话时不算空闲
+        if (download_->HasPending()) {
+            retryAfter(500);
+        }
+        if (download_->IsWaiting()) {
+            addBytes(0);
+        }
+        return true;
+    }
+
+    void OnFinished(const std::string &reason) override {
+        download_->Stop();
+        if (download_->IsFailed()) {
+            LOG_ERROR("The parallel download failed, {}, bytes {}", GetName(), GetBytes());
+        } else {
+            LOG_INFO("The parallel download is {}, {}, segments {}, bytes {}", reason, GetName(), download_->GetSegmentCount(), GetBytes());
+        }
+    }
+
+private:
+    // 连接拥塞时不读取，后面的子区间继续下载到缓冲
+    void congested() {
+        backoffMs_ = backoffMs_ == 0 ? 1 : std::min(backoffMs_ * 2, 64);
+        retryAfter(backoffMs_);
+    }
+
+private:
+    std::shared_ptr<SegmentedDownload> download_;
+    butil::intrusive_ptr<brpc::ProgressiveAttachment> pa_;
+    butil::IOBuf pending_;
+    int backoffMs_;
+};
+
+// 流式输出录像查询结果，攒够一批才发送响应头，查询在此之前失败时仍然可以返回错误码
+// 不分页时输出录像数组，分页时输出{"records": [...], "nextPageToken": ...}
+class RecordJsonStream {
+public:
+    enum { FLUSH_BYTES = 64 * 1024 };
+
+    RecordJsonStream(brpc::Controller *cntl, brpc::ClosureGuard &doneGuard, bool paged)
+        : cntl_(cntl), doneGuard_(doneGuard), paged_(paged), count_(0), failed_(false) {
+        buffer_ = paged_ ? "{\"records\":[" : "[";
+    }
+
+    // 返回false表示客户端已经断开
+    bool Add(const sdk::RecordInfo &record) {
+        if (count_++ > 0) {
+            buffer_.push_back(',');
+        }
+        buffer_.append(json(record).dump());
+        if (buffer_.size() >= FLUSH_BYTES) {
+            flush();
+        }
+        return !failed_;
+    }
+
+    void Finish(int32_t ret, const std::string &nextPageToken) {
+        if (nullptr == pa_.get() && 0 != ret) {
+            cntl_->http_response().set_status_code(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR);
+            cntl_->response_attachment().append("Failed to query record");
+            return;
+        }
+        if (!paged_) {
+            // 已经开始输出后出错时不闭合数组，客户端可以发现结果不完整
+            if (0 != ret) {
+                return;
+            }
+            buffer_.push_back(']');
+        } else {
+            buffer_.append("],\"nextPageToken\":").append(nextPageToken.empty() ? "null" : "\"" + nextPageToken + "\"");
+            if (0 != ret) {
+                buffer_.append(",\"error\":").append(std::to_string(ret));
+            }
+            buffer_.push_back('}');
+        }
+        if (nullptr == pa_.get()) {
+            cntl_->http_response().set_content_type("application/json");
+            cntl_->response_attachment().append(buffer_);
+            return;
+        }
+        flush();
+    }
+
+    // 结果超过FLUSH_BYTES时已经用分块编码输出，否则完整的结果在response_attachment中
+    bool IsStreaming() const { return nullptr != pa_.get(); }
+
+private:
+    // 第一次输出时发送响应头，之后用分块编码继续输出
+    void flush() {
+        if (failed_) {
+            return;
+        }
+        if (nullptr == pa_.get()) {
+            cntl_->http_response().set_content_type("application/json");
+            pa_ = butil::intrusive_ptr<brpc::ProgressiveAttachment>(cntl_->CreateProgressiveAttachment());
+            doneGuard_.release()->Run();
+        }
+        // 查询在brpc的bthread中进行，连接拥塞时只让出bthread，不占住工作线程
+        // 客户端不读也不断开时最多等vod_query_write_timeout_ms，之后按断开处理，Add返回false结束查找，nvr的查找句柄随之关闭
+        uint64_t deadline = TimeTool::now_to_ms() + (uint64_t)std::max(FLAGS_vod_query_write_timeout_ms, 0);
+        int ret;
+        while (1 == (ret = ProgressiveAttachmentUtil::trywrite(pa_.get(), buffer_.data(), buffer_.size()))) {
+            if (TimeTool::now_to_ms() >= deadline) {
+                LOG_ERROR("Record query aborted, client did not read for {} ms", FLAGS_vod_query_write_timeout_ms);
+                ret = -1;
+                break;
+            }
+            bthread_usleep(1000);
+        }
+        failed_ = ret < 0;
+        buffer_.clear();
+    }
+
+private:
+    brpc::Controller *cntl_;
+    brpc::ClosureGuard &doneGuard_;
+    butil::intrusive_ptr<brpc::ProgressiveAttachment> pa_;
+    bool paged_;
+    int64_t count_;
+    bool failed_;
+    std::string buffer_;
+};
+
 class VodServiceImpl : public VodService {
 public:
     void Query(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
@@ -55,17 +369,69 @@ public:
             return;
         }
 
-        std::vector<sdk::RecordInfo> records;
-        int ret = sdk->QueryRecord(devId, sdk::TimePoint().FromString(startTime), sdk::TimePoint().FromString(endTime), records);
+        // 分页：limit是每页的条数，pageToken是上一页返回的nextPageToken，即上一页最后一条录像的开始时间
+        std::string pageToken = parser.GetQueryByKey("pageToken");
+        std::string limit     = parser.GetQueryByKey("limit");
+        sdk::TimePoint start  = sdk::TimePoint().FromString(startTime);
+        time_t after          = 0;
+        if (!pageToken.empty()) {
+            after = (time_t)strtoll(pageToken.c_str(), nullptr, 10);
+            if (after <= 0) {
+                parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Invalid pageToken");
+                return;
+            }
+            if (after > start.ToTime()) {
+                start.FromTime(after);
+            }
+        }
+
+        // 录像由索引回答，只有缺少或过期的时间段才查询nvr，refresh=1时忽略索引
+        bool refresh       = "1" == parser.GetQueryByKey("refresh");
+        sdk::TimePoint end = sdk::TimePoint().FromString(endTime);
+
+        // 索引已经覆盖这个时间段并且没有变化时，直接回复上次序列化好的结果
+        std::string key  = "vod/" + parser.GetIp() + "/" + devId + "/" + startTime + "/" + endTime + "/" + pageToken + "/" + limit;
+        uint64_t version = 0;
+        if (!refresh && RECORD_INDEX().IsCached(parser.GetIp(), devId, start, end, version)) {
+            auto cached = RESPONSE_CACHE().Get(key, version);
+            if (nullptr != cached) {
+                RESPONSE_CACHE().Reply(cntl, cached);
+                return;
+            }
+        }
+
+        // 结果边找边输出，内存占用与录像数量无关
+        RecordJsonStream stream(cntl, done_guard, !pageToken.empty() || !limit.empty());
+        int64_t maxCount = atoll(limit.c_str());
+        int64_t count    = 0;
+        time_t lastStart = 0;
+        bool more        = false;
+        version          = 0;
+        int ret          = RECORD_INDEX().Find(sdk, parser.GetIp(), devId, start, end, [&](const sdk::RecordInfo &r) {
+            time_t t = r.startTime.ToTime();
+            if (t <= after) {
+                return true;
+            }
+            // 开始时间相同的录像放在同一页，下一页从更晚的开始时间继续
+            if (maxCount > 0 && count >= maxCount && t != lastStart) {
+                more = true;
+                return false;
+            }
+            count++;
+            lastStart = t;
+            return stream.Add(r);
+        }, refresh, &version);
         if (0 != ret) {
-            LOG_INFO("Failed to query record");
-            parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to query record");
-            return;
+            LOG_INFO("Failed to query record, ret {}, found {}", ret, count);
         }
+        stream.Finish(ret, more ? std::to_string(lastStart) : "");
 
-        json j = records;
-        cntl->http_response().set_content_type("application/json");
-        cntl->response_attachment().append(j.dump());
+        // 由索引回答的完整结果按索引版本缓存，已经分块输出的大结果不缓存
+        if (0 == ret && 0 != version && !stream.IsStreaming()) {
+            auto cached = RESPONSE_CACHE().Put(key, version, "application/json", cntl->response_attachment().to_string());
+            cntl->response_attachment().clear();
+            RESPONSE_CACHE().Reply(cntl, cached);
+        }
     }
 
     void DownloadByTime(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
@@ -92,78 +458,518 @@ public:
             return;
         }
 
-        std::shared_ptr<PipeGuard> dataPipe(new PipeGuard());
-        if (0 != dataPipe->Init()) {
-            parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Open pipe failed");
+        // 断点续传：offset=N时nvr从startTime之后N秒开始下载
+        // Range: bytes=N-只在内容全部来自录像缓存时支持，nvr每次下载的字节可能不同，其他情况忽略Range返回完整内容
+        std::string offset = parser.GetQueryByKey("offset");
+        if (!offset.empty()) {
+            sdk::TimePoint start = sdk::TimePoint().FromString(startTime);
+            time_t t             = start.ToTime() + atoll(offset.c_str());
+            if (atoll(offset.c_str()) < 0 || t >= sdk::TimePoint().FromString(endTime).ToTime()) {
+                LOG_ERROR("Invalid offset {}, from {} to {}", offset, startTime, endTime);
+                parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Invalid offset");
+                return;
+            }
+            start.FromTime(t);
+            startTime = start.ToString();
+        }
+
+        uint64_t skip = 0;
+        bool ranged   = parseRange(parser, skip);
+
+        // speed=N时请求nvr按N倍速下载，设备拒绝时退回较低的倍速，响应头中给出请求的和实际生效的倍速
+        int32_t speed = std::max(1, std::min(atoi(parser.GetQueryByKey("speed").c_str()), FLAGS_vod_max_speed));
+        if (speed > 1) {
+            cntl->http_response().SetHeader("X-Download-Speed-Requested", std::to_string(speed));
+        }
+
+        // parallel=N时按录像文件边界切成最多N段并行下载，开启录像缓存时也走分段下载，命中的部分从磁盘读
+        int32_t parallel = std::min(atoi(parser.GetQueryByKey("parallel").c_str()), FLAGS_vod_parallel_max_segments);
+        if ((parallel > 1 || RECORD_CACHE().IsEnabled())
+            && downloadSegmented(cntl, parser, sdk, devId, startTime, endTime, parallel, speed, ranged, skip)) {
             return;
         }
 
+        std::shared_ptr<MediaRing> ring(new MediaRing(FLAGS_media_ring_slots));
+
         LOG_INFO("Start to download record, dev {}, from {} to {}", devId, startTime, endTime);
 
-        intptr_t jobId = 0;
-        int ret        = sdk->DownloadRecordByTime(
-            devId, sdk::TimePoint().FromString(startTime), sdk::TimePoint().FromString(endTime),
-            [=](intptr_t id, const uint8_t *buffer, int32_t bufferLen) {
-                if (nullptr != buffer) {
-                    IoUtil::writen(dataPipe->GetWriteFd(), (const char *)buffer, bufferLen);
-                } else {
-                    //通知写完毕
-                    dataPipe->NotifyWriteCompleted();
-                }
-            },
-            jobId);
+        std::shared_ptr<int32_t> applied(new int32_t(1));
+        StartFunc start = [=](intptr_t &jobId) {
+            int32_t ret = sdk->DownloadRecordByTime(
+                devId, sdk::TimePoint().FromString(startTime), sdk::TimePoint().FromString(endTime),
+                [=](intptr_t id, const uint8_t *buffer, int32_t bufferLen) {
+                    // 只拷贝到环形缓冲，不阻塞sdk的回调线程
+                    if (nullptr != buffer) {
+                        ring->Push(buffer, bufferLen);
+                    } else {
+                        //通知写完毕
+                        ring->Close();
+                    }
+                },
+                jobId);
+            if (0 == ret && speed > 1) {
+                *applied = sdk->SetDownloadSpeed(jobId, speed);
+            }
+            return ret;
+        };
 
-        if (0 != ret) {
-            LOG_ERROR("Failed to download file");
+        // nvr的会话已满时排队，获得会话并启动下载后才发出响应头，等待超过vod_queue_response_wait_s时返回503
+        DownloadTicketPtr ticket =
+            DOWNLOAD_SCHEDULER().Acquire(parser.GetIp(), parser.GetClient(), PriorityFromString(parser.GetQueryByKey("priority")), nullptr);
+        intptr_t jobId = 0;
+        int32_t ret    = startWhenGranted(sdk, ticket, start, jobId);
+        if (ret > 0) {
+            setBusyHeaders(cntl, DOWNLOAD_SCHEDULER().GetQueueInfo(ticket));
+            DOWNLOAD_SCHEDULER().Release(ticket);
+            parser.SetResponseError(brpc::HTTP_STATUS_SERVICE_UNAVAILABLE, "No download session available on the nvr");
+            return;
+        } else if (ret < 0) {
+            LOG_ERROR("Failed to download file, error {}", ret);
+            DOWNLOAD_SCHEDULER().Release(ticket);
             parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to download file");
             return;
         }
 
+        // 客户端可以用这个id查询下载进度
+        uint64_t progressId = sdk->GetDownloadProgressId(jobId);
+        if (0 != progressId) {
+            cntl->http_response().SetHeader("X-Download-Id", std::to_string(progressId));
+        }
+        if (speed > 1) {
+            cntl->http_response().SetHeader("X-Download-Speed", std::to_string(*applied));
+        }
+        setResumeHeaders(cntl, makeETag(parser.GetIp(), devId, startTime, endTime, ""), false, 0, -1);
+
         butil::intrusive_ptr<brpc::ProgressiveAttachment> pa(cntl->CreateProgressiveAttachment());
 
-        // start thread for transport
-        std::thread t([=]() {
-            // non block I/O
-            fcntl(dataPipe->GetReadFd(), F_SETFL, O_NONBLOCK);
-            fd_set rfdset;
-
-            while (true) {
-                FD_ZERO(&rfdset);
-                FD_SET(dataPipe->GetReadFd(), &rfdset);
-
-                struct timeval tv;
-                tv.tv_sec  = 30;
-                tv.tv_usec = 0;
-                int r      = select(dataPipe->GetReadFd() + 1, &rfdset, nullptr, nullptr, &tv);
-                if (-1 == r && errno == EINTR) {
+        // 交给reactor传输，不再为每路流创建线程
+        std::string name = devId + "_" + startTime + "_" + endTime;
+        std::shared_ptr<VodDownloadTask> task(new VodDownloadTask(sdk, ring, pa, ticket, jobId, name));
+        if (0 != STREAM_REACTOR().Register(task)) {
+            task->OnFinished("rejected");
+        }
+    }
+
+    // 多个通道的录像分布，按resolution(second/minute/hour或秒数)划分时间片，每个通道返回位图或游程编码
+    // channelIp用逗号分隔，format=binary时返回二进制，否则返回json，数据用base64编码
+    void Availability(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
+                      ::google::protobuf::Closure *done) override {
+        brpc::ClosureGuard done_guard(done);
+
+        brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
+        HttpRequestParser parser(cntl);
+
+        auto sdk = parser.GetSdkStubByRequest();
+        if (nullptr == sdk) {
+            return;
+        }
+
+        std::vector<std::string> channelIps = parser.GetListByKey(parser.PARAM_CHANNEL_IP);
+        std::string startTime               = parser.GetQueryByKey("startTime");
+        std::string endTime                 = parser.GetQueryByKey("endTime");
+        std::string encodingName            = parser.GetQueryByKey("encoding");
+        uint32_t resolution                 = parseResolution(parser.GetQueryByKey("resolution"));
+        time_t start                        = sdk::TimePoint().FromString(startTime).ToTime();
+        time_t end                          = sdk::TimePoint().FromString(endTime).ToTime();
+
+        if (channelIps.empty() || startTime.empty() || endTime.empty() || 0 == resolution || end <= start
+            || !(encodingName.empty() || "bitmap" == encodingName || "rle" == encodingName)) {
+            LOG_ERROR("Invalid arguments, channelIp {}, startTime {}, endTime {}", parser.GetChannelIp(), startTime, endTime);
+            parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Invalid arguments");
+            return;
+        }
+        uint64_t slots = ((uint64_t)(end - start) + resolution - 1) / resolution;
+        if (slots > (uint64_t)FLAGS_vod_availability_max_slots) {
+            parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Too many slots, use a coarser resolution");
+            return;
+        }
+        // 二进制格式中通道数是u16
+        if (channelIps.size() > 0xffff) {
+            parser.SetResponseError(brpc::HTTP_STATUS_BAD_REQUEST, "Too many channels");
+            return;
+        }
+        AvailabilityEncoding encoding = "rle" == encodingName ? AVAILABILITY_RLE : AVAILABILITY_BITMAP;
+
+        // 各通道在bthread中并发查询，录像由索引回答，nvr查询阻塞时不占用新的线程
+        // sdk的查询也可能返回-1，通道不存在单独记录，不用返回值表示
+        std::vector<int32_t> rets(channelIps.size(), 0);
+        std::vector<uint8_t> unknown(channelIps.size(), 0);
+        std::vector<std::string> payloads(channelIps.size());
+        std::vector<uint32_t> counts(channelIps.size(), 0);
+        std::atomic<size_t> next(0);
+        std::string ip               = parser.GetIp();
+        std::function<void()> worker = [&]() {
+            for (size_t i = next++; i < channelIps.size(); i = next++) {
+                std::string devId = sdk->ChannelIp2Id(channelIps[i]);
+                if (devId.empty()) {
+                    unknown[i] = 1;
                     continue;
-                } else if (-1 == r) {
-                    // error
-                    LOG_ERROR("Wait for data error");
-                    break;
-                } else if (0 == r) {
-                    // timeout, no sdk data
-                    LOG_ERROR("Wait for data timeout");
-                    break;
-                } else {
-                    // read data from pipe
-                    char buf[4096];
-                    int len = read(dataPipe->GetReadFd(), buf, sizeof(buf));
-                    if ((len < 0 && errno != EAGAIN) || (len == 0) || (len > 0 && ProgressiveAttachmentUtil::writen(pa.get(), buf, len) < 0)) {
-                        break;
-                    }
                 }
+                RecordAvailability availability(start, resolution, (uint32_t)slots);
+                sdk::TimePoint a, b;
+                a.FromTime(start);
+                b.FromTime(end);
+                rets[i] = RECORD_INDEX().Find(sdk, ip, devId, a, b, [&availability](const sdk::RecordInfo &r) {
+                    availability.Add(r);
+                    return true;
+                });
+                if (0 == rets[i]) {
+                    payloads[i] = availability.Encode(encoding);
+                    counts[i]   = availability.GetCount();
+                }
+            }
+        };
+        // 创建失败时少一个并发，剩下的通道由其他worker和当前bthread查完
+        std::vector<bthread_t> workers;
+        size_t parallel = std::min(channelIps.size(), (size_t)std::max(1, FLAGS_vod_availability_parallel));
+        for (size_t i = 1; i < parallel; i++) {
+            bthread_t tid;
+            if (0 == bthread_start_background(&tid, nullptr, runWorker, &worker)) {
+                workers.push_back(tid);
+            }
+        }
+        worker();
+        for (auto tid : workers) {
+            bthread_join(tid, nullptr);
+        }
+
+        if ("binary" == parser.GetQueryByKey("format")) {
+            cntl->http_response().set_content_type("application/octet-stream");
+            cntl->response_attachment().append(encodeAvailability(encoding, resolution, start, (uint32_t)slots, rets, unknown, payloads));
+            return;
+        }
+
+        json channels = json::array();
+        for (size_t i = 0; i < channelIps.size(); i++) {
+            json c;
+            c["channelIp"] = channelIps[i];
+            if (unknown[i]) {
+                c["error"] = "Unknown channel";
+            } else if (0 == rets[i]) {
+                std::string data;
+                Base64::Encode(payloads[i], &data);
+                c["data"]      = data;
+                c["available"] = counts[i];
+            } else {
+                c["error"] = "Failed to query record, ret " + std::to_string(rets[i]);
             }
+            channels.push_back(c);
+        }
+        json j;
+        j["startTime"]  = startTime;
+        j["endTime"]    = endTime;
+        j["resolution"] = resolution;
+        j["slots"]      = slots;
+        j["encoding"]   = AVAILABILITY_RLE == encoding ? "rle" : "bitmap";
+        j["channels"]   = channels;
 
-            //通知读取完毕，当客户端主动关闭时，需要通知pipe的写端停止写
-            dataPipe->NotifyReadCompleted();
+        cntl->http_response().set_content_type("application/json");
+        cntl->response_attachment().append(j.dump());
+    }
 
-            // finished
-            intptr_t jid = jobId;
-            sdk->StopDownloadRecord(jid);
-            LOG_INFO("The download is completed, dev {}, from {} to {}", devId, startTime, endTime);
-        });
-        t.detach();
+    // 下载排队情况，id是排队列表中的id，重新排队时不变，不指定时返回nvr的会话数和排队的下载
+    // 需要nvr的账号密码，只能看到这台nvr的排队
+    void Queue(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
+               ::google::protobuf::Closure *done) override {
+        brpc::ClosureGuard done_guard(done);
+
+        brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
+        HttpRequestParser parser(cntl);
+
+        auto sdk = parser.GetSdkStubByRequest();
+        if (nullptr == sdk) {
+            return;
+        }
+
+        json j;
+        std::string ip = parser.GetIp();
+        std::string id = parser.GetQueryByKey("id");
+        if (!id.empty()) {
+            DownloadQueueInfo info;
+            if (!DOWNLOAD_SCHEDULER().GetQueueInfo(strtoull(id.c_str(), nullptr, 10), info) || info.ip != ip) {
+                parser.SetResponseError(brpc::HTTP_STATUS_NOT_FOUND, "Download not queued");
+                return;
+            }
+            j = queueToJson(info);
+        } else {
+            json nvrs = json::array();
+            for (auto &n : DOWNLOAD_SCHEDULER().DumpNvrs()) {
+                if (n.ip != ip) {
+                    continue;
+                }
+                json nj;
+                nj["ip"]              = n.ip;
+                nj["limit"]           = n.limit;
+                nj["configuredLimit"] = n.configuredLimit;
+                nj["running"]         = n.running;
+                nj["queued"]          = n.queued;
+                nj["avgHoldMs"]       = n.avgHoldMs;
+                nj["granted"]         = n.granted;
+                nj["refused"]         = n.refused;
+                nvrs.push_back(nj);
+            }
+            json tickets = json::array();
+            for (auto &t : DOWNLOAD_SCHEDULER().DumpTickets(ip)) {
+                tickets.push_back(queueToJson(t));
+            }
+            j["nvrs"]    = nvrs;
+            j["tickets"] = tickets;
+        }
+
+        cntl->http_response().set_content_type("application/json");
+        cntl->response_attachment().append(j.dump());
+    }
+
+    // 下载进度，id是DownloadByTime响应头中的X-Download-Id，不指定时返回这台nvr所有正在进行的下载
+    // 需要nvr的账号密码，只能看到这台nvr的下载
+    void Progress(::google::protobuf::RpcController *controller, const ::sdkproxy::HttpRequest *request, ::sdkproxy::HttpResponse *response,
+                  ::google::protobuf::Closure *done) override {
+        brpc::ClosureGuard done_guard(done);
+
+        brpc::Controller *cntl = static_cast<brpc::Controller *>(controller);
+        HttpRequestParser parser(cntl);
+
+        auto sdk = parser.GetSdkStubByRequest();
+        if (nullptr == sdk) {
+            return;
+        }
+
+        json j;
+        std::string id = parser.GetQueryByKey("id");
+        if (id.empty()) {
+            j = sdk::DOWNLOAD_POLLER().Dump(parser.GetIp());
+        } else {
+            sdk::DownloadProgress progress;
+            if (!sdk::DOWNLOAD_POLLER().Get(strtoull(id.c_str(), nullptr, 10), progress) || progress.ip != parser.GetIp()) {
+                parser.SetResponseError(brpc::HTTP_STATUS_NOT_FOUND, "Download not found");
+                return;
+            }
+            j = progress;
+        }
+
+        cntl->http_response().set_content_type("application/json");
+        cntl->response_attachment().append(j.dump());
+    }
+
+private:
+    using StartFunc = std::function<int32_t(intptr_t &jobId)>;
+
+    static void *runWorker(void *arg) {
+        (*static_cast<std::function<void()> *>(arg))();
+        return nullptr;
+    }
+
+    // 在brpc的bthread中等待nvr的会话并启动下载，sdk调用在SDK_CALL_POOL中进行，等待时只让出bthread
+    // nvr返回会话数上限的错误码时重新排队，其他错误立即失败
+    // 返回0表示已经启动，1表示等待超过vod_queue_response_wait_s，小于0是sdk的错误
+    static int32_t startWhenGranted(std::shared_ptr<sdk::SdkStub> sdk, DownloadTicketPtr ticket, StartFunc start, intptr_t &jobId) {
+        uint64_t deadline = TimeTool::now_to_ms() + (uint64_t)std::max(FLAGS_vod_queue_response_wait_s, 0) * 1000;
+        while (true) {
+            while (!ticket->IsGranted()) {
+                if (TimeTool::now_to_ms() >= deadline || ticket->IsExpired()) {
+                    return 1;
+                }
+                bthread_usleep(10000);
+            }
+
+            std::shared_ptr<SegmentStart> result = std::make_shared<SegmentStart>();
+            SDK_CALL_POOL().Post([start, result]() {
+                intptr_t id   = 0;
+                result->ret   = start(id);
+                result->jobId = id;
+                result->done.store(true, std::memory_order_release);
+            });
+            while (!result->done.load(std::memory_order_acquire)) {
+                bthread_usleep(5000);
+            }
+            if (0 == result->ret) {
+                jobId = result->jobId;
+                return 0;
+            }
+            if (!sdk->IsSessionLimitError(result->ret) || !DOWNLOAD_SCHEDULER().Refuse(ticket)) {
+                return result->ret < 0 ? result->ret : -result->ret;
+            }
+            LOG_INFO("Nvr {} is busy, requeue the download, error {}", ticket->GetIp(), result->ret);
+        }
+    }
+
+    // 返回false表示只能切成一段并且不使用缓存，按普通下载处理
+    bool downloadSegmented(brpc::Controller *cntl, HttpRequestParser &parser, std::shared_ptr<sdk::SdkStub> sdk, const std::string &devId,
+                           const std::string &startTime, const std::string &endTime, int32_t parallel, int32_t speed, bool ranged,
+                           uint64_t skip) {
+        sdk::TimePoint start = sdk::TimePoint().FromString(startTime);
+        sdk::TimePoint end   = sdk::TimePoint().FromString(endTime);
+
+        std::vector<SegmentedDownload::Range> ranges(1, SegmentedDownload::Range(start.ToTime(), end.ToTime()));
+        std::vector<sdk::RecordInfo> records;
+        if (parallel > 1) {
+            if (0 == RECORD_INDEX().Query(sdk, parser.GetIp(), devId, start, end, records)) {
+                ranges = SegmentedDownload::Split(records, start.ToTime(), end.ToTime(), parallel);
+            } else {
+                LOG_ERROR("Failed to query record for parallel download, fall back to a single session");
+            }
+        }
+        if (ranges.size() <= 1 && !RECORD_CACHE().IsEnabled()) {
+            return false;
+        }
+
+        std::shared_ptr<SegmentedDownload> download(new SegmentedDownload(sdk, parser.GetIp(), devId, ranges));
+        download->SetOwner(parser.GetClient(), PriorityFromString(parser.GetQueryByKey("priority")));
+        download->SetSpeed(speed);
+        int64_t total       = download->GetTotalBytes();
+        std::string etag    = makeETag(parser.GetIp(), devId, startTime, endTime, total >= 0 ? download->GetContentTag() : "");
+        std::string ifRange = parser.GetHeader("If-Range");
+        ranged              = ranged && total >= 0 && (ifRange.empty() || ifRange == etag);
+        if (ranged && skip >= (uint64_t)total) {
+            cntl->http_response().SetHeader("Content-Range", "bytes */" + std::to_string(total));
+            parser.SetResponseError(brpc::HTTP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE, "Range not satisfiable");
+            return true;
+        }
+        if (ranged) {
+            download->Skip(skip);
+        }
+        LOG_INFO("Start to download record in {} segments, {} cached, dev {}, from {} to {}", download->GetSegmentCount(), download->GetCachedCount(),
+                 devId, startTime, endTime);
+        // 第一个子区间在sdk调用线程中启动，等待会话和启动结果时只让出bthread，启动之后才发出响应头，启动失败时还可以返回错误码
+        // 等待会话超过vod_queue_response_wait_s时返回503
+        uint64_t deadline = TimeTool::now_to_ms() + (uint64_t)std::max(FLAGS_vod_queue_response_wait_s, 0) * 1000;
+        download->Pump();
+        while (!download->IsFailed() && (download->IsStarting() || (download->IsWaiting() && TimeTool::now_to_ms() < deadline))) {
+            bthread_usleep(download->IsStarting() ? 5000 : 10000);
+            download->Pump();
+        }
+        DownloadQueueInfo queue;
+        if (!download->IsFailed() && download->GetQueueInfo(queue)) {
+            download->Stop();
+            setBusyHeaders(cntl, queue);
+            parser.SetResponseError(brpc::HTTP_STATUS_SERVICE_UNAVAILABLE, "No download session available on the nvr");
+            return true;
+        }
+        if (download->IsFailed()) {
+            download->Stop();
+            parser.SetResponseError(brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to download file");
+            return true;
+        }
+
+        cntl->http_response().SetHeader("X-Download-Segments", std::to_string(download->GetSegmentCount()));
+        if (download->GetCachedCount() > 0) {
+            cntl->http_response().SetHeader("X-Cache-Bytes", std::to_string(download->GetCachedBytes()));
+        }
+        setResumeHeaders(cntl, etag, ranged, skip, total);
+        butil::intrusive_ptr<brpc::ProgressiveAttachment> pa(cntl->CreateProgressiveAttachment());
+
+        std::string name = devId + "_" + startTime + "_" + endTime;
+        std::shared_ptr<VodParallelTask> task(new VodParallelTask(download, pa, name));
+        if (0 != STREAM_REACTOR().Register(task)) {
+            task->OnFinished("rejected");
+        }
+        return true;
+    }
+
+    // 内容全部来自录像缓存时由缓存文件的标识生成强ETag，内容不变时ETag不变
+    // 从nvr下载时同一时间段每次的字节可能不同，只由请求生成弱ETag，不能用于If-Range
+    static std::string makeETag(const std::string &ip, const std::string &devId, const std::string &startTime, const std::string &endTime,
+                                const std::string &contentTag) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (auto &s : {ip, devId, startTime, endTime, contentTag}) {
+            for (unsigned char c : s) {
+                hash = (hash ^ c) * 1099511628211ULL;
+            }
+            hash = (hash ^ '|') * 1099511628211ULL;
+        }
+        char etag[24] = {0};
+        snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)hash);
+        return contentTag.empty() ? std::string("W/") + etag : std::string(etag);
+    }
+
+    // 只支持续传用的bytes=N-，其他形式按完整下载处理，If-Range在总长度已知时检查
+    static bool parseRange(HttpRequestParser &parser, uint64_t &skip) {
+        std::string range = parser.GetHeader("Range");
+        if (range.compare(0, 6, "bytes=") != 0 || range.size() < 8 || range.back() != '-') {
+            return false;
+        }
+        std::string first = range.substr(6, range.size() - 7);
+        if (first.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        skip = strtoull(first.c_str(), nullptr, 10);
+        return true;
+    }
+
+    // 时间片长度，单位秒，无效时返回0
+    static uint32_t parseResolution(const std::string &s) {
+        if (s.empty() || "minute" == s) {
+            return 60;
+        }
+        if ("second" == s) {
+            return 1;
+        }
+        if ("hour" == s) {
+            return 3600;
+        }
+        if (s.find_first_not_of("0123456789") != std::string::npos) {
+            return 0;
+        }
+        return (uint32_t)std::min(strtoull(s.c_str(), nullptr, 10), 86400ULL);
+    }
+
+    // 二进制格式，整数都是小端：
+    // "RAV1" | u8 编码(0位图 1游程) | u8 0 | u16 通道数 | u32 时间片秒数 | i64 开始时间 | u32 时间片数
+    // 然后按请求顺序每个通道：u8 状态(0成功 1未知通道 2查询失败) | u32 数据长度 | 数据
+    static std::string encodeAvailability(AvailabilityEncoding encoding, uint32_t resolution, time_t start, uint32_t slots,
+                                          const std::vector<int32_t> &rets, const std::vector<uint8_t> &unknown,
+                                          const std::vector<std::string> &payloads) {
+        std::string out("RAV1");
+        out.push_back((char)encoding);
+        out.push_back(0);
+        putLittleEndian(out, rets.size(), 2);
+        putLittleEndian(out, resolution, 4);
+        putLittleEndian(out, (uint64_t)(int64_t)start, 8);
+        putLittleEndian(out, slots, 4);
+        for (size_t i = 0; i < rets.size(); i++) {
+            out.push_back((char)(unknown[i] ? 1 : (0 == rets[i] ? 0 : 2)));
+            putLittleEndian(out, payloads[i].size(), 4);
+            out.append(payloads[i]);
+        }
+        return out;
+    }
+
+    static void putLittleEndian(std::string &out, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            out.push_back((char)(v >> (8 * i)));
+        }
+    }
+
+    static json queueToJson(const DownloadQueueInfo &info) {
+        json j;
+        j["id"]       = info.id;
+        j["ip"]       = info.ip;
+        j["client"]   = info.client;
+        j["priority"] = info.priority;
+        j["granted"]  = info.granted;
+        j["position"] = info.position;
+        j["waitedMs"] = info.waitedMs;
+        j["etaMs"]    = info.etaMs;
+        return j;
+    }
+
+    // 等待nvr会话超时的下载，Retry-After按排队位置估算，至少1秒
+    static void setBusyHeaders(brpc::Controller *cntl, const DownloadQueueInfo &queue) {
+        cntl->http_response().SetHeader("Retry-After", std::to_string(std::max<uint64_t>(1, (queue.etaMs + 999) / 1000)));
+        cntl->http_response().SetHeader("X-Queue-Position", std::to_string(queue.position));
+        cntl->http_response().SetHeader("X-Queue-Eta-Ms", std::to_string(queue.etaMs));
+    }
+
+    // 总长度未知时不支持Range，只在总长度已知并且请求了Range时返回206
+    static void setResumeHeaders(brpc::Controller *cntl, const std::string &etag, bool ranged, uint64_t skip, int64_t total) {
+        cntl->http_response().SetHeader("ETag", etag);
+        cntl->http_response().SetHeader("Accept-Ranges", total >= 0 ? "bytes" : "none");
+        if (!ranged || total < 0) {
+            return;
+        }
+        cntl->http_response().set_status_code(brpc::HTTP_STATUS_PARTIAL_CONTENT);
+        cntl->http_response().SetHeader("Content-Range",
+                                        "bytes " + std::to_string(skip) + "-" + std::to_string(total - 1) + "/" + std::to_string(total));
     }
 };
 
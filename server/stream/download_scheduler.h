@@ -0,0 +1,412 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+#include <gflags/gflags.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+DEFINE_int32(vod_sessions_per_nvr, 4, "Max concurrent download sessions on one nvr, lowered automatically when the nvr refuses sessions");
+DEFINE_string(vod_nvr_session_limits, "", "Per-nvr overrides of vod_sessions_per_nvr, ip=n separated by commas");
+DEFINE_int32(vod_queue_timeout_s, 300, "Downloads waiting longer than this for a session on the nvr fail");
+DEFINE_int32(vod_limit_probe_s, 60, "Seconds after the learned session limit of an nvr was lowered before trying one more session");
+
+namespace sdkproxy {
+
+enum DownloadPriority {
+    PRIORITY_INTERACTIVE = 0,
+    PRIORITY_BULK        = 1,
+};
+
+inline DownloadPriority PriorityFromString(const std::string &s) {
+    return s == "bulk" ? PRIORITY_BULK : PRIORITY_INTERACTIVE;
+}
+
+inline const char *PriorityToString(DownloadPriority p) {
+    return PRIORITY_BULK == p ? "bulk" : "interactive";
+}
+
+// 一个下载会话的排队凭证，授予后持有nvr的一个会话，直到Release
+class DownloadTicket {
+public:
+    enum State {
+        WAITING,
+        GRANTED,
+        RELEASED,
+    };
+
+    DownloadTicket(uint64_t id, const std::string &ip, const std::string &client, DownloadPriority priority, std::function<void()> onGrant)
+        : id_(id), ip_(ip), client_(client), priority_(priority), onGrant_(onGrant), state_(WAITING), enqueueTime_(TimeTool::now_to_ms()),
+          grantTime_(0) {}
+
+    uint64_t GetId() const { return id_; }
+
+    const std::string &GetIp() const { return ip_; }
+
+    const std::string &GetClient() const { return client_; }
+
+    DownloadPriority GetPriority() const { return priority_; }
+
+    bool IsGranted() const { return GRANTED == state_; }
+
+    bool IsWaiting() const { return WAITING == state_; }
+
+    // 等待超过vod_queue_timeout_s
+    bool IsExpired() const { return WAITING == state_ && TimeTool::now_to_ms() - enqueueTime_ > (uint64_t)FLAGS_vod_queue_timeout_s * 1000; }
+
+    uint64_t GetWaitedMs() const { return (0 == grantTime_ ? TimeTool::now_to_ms() : (uint64_t)grantTime_) - enqueueTime_; }
+
+private:
+    friend class DownloadScheduler;
+
+    uint64_t id_;
+    std::string ip_;
+    std::string client_;
+    DownloadPriority priority_;
+    std::function<void()> onGrant_;
+    std::atomic<int> state_;
+    uint64_t enqueueTime_;
+    std::atomic<uint64_t> grantTime_;
+};
+
+typedef std::shared_ptr<DownloadTicket> DownloadTicketPtr;
+
+// 排队信息，position是前面还有几个请求，etaMs按会话平均占用时间估算
+typedef struct tagDownloadQueueInfo {
+    uint64_t id;
+    std::string ip;
+    std::string client;
+    std::string priority;
+    bool granted;
+    int32_t position;
+    uint64_t waitedMs;
+    uint64_t etaMs;
+} DownloadQueueInfo;
+
+typedef struct tagNvrScheduleInfo {
+    std::string ip;
+    int32_t limit;
+    int32_t configuredLimit;
+    int32_t running;
+    int32_t queued;
+    uint64_t avgHoldMs;
+    uint64_t granted;
+    uint64_t refused;
+} NvrScheduleInfo;
+
+// 每个nvr的下载会话调度：会话数不超过上限，超过的请求排队等待而不是让sdk报错
+// 交互请求优先于批量导出，同一优先级内按客户端轮转，一个客户端的大量请求不会饿死其他客户端
+// 上限可以按nvr配置，nvr拒绝会话时降到当前会话数，一段时间后再逐个试探恢复
+class DownloadScheduler {
+public:
+    DownloadScheduler() : nextId_(1) {}
+
+    // 申请一个会话，能立即授予时返回的凭证已经是GRANTED，否则排队，授予时在调用Release的线程中回调onGrant
+    DownloadTicketPtr Acquire(const std::string &ip, const std::string &client, DownloadPriority priority, std::function<void()> onGrant) {
+        DownloadTicketPtr ticket = std::make_shared<DownloadTicket>(nextId_++, ip, client, priority, onGrant);
+        std::vector<DownloadTicketPtr> granted;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            Nvr &nvr = getNvr(ip);
+            Queue &q = nvr.queues[priority];
+            if (q.clients[client].empty()) {
+                q.order.push_back(client);
+            }
+            q.clients[client].push_back(ticket);
+            tickets_[ticket->GetId()] = ticket;
+            dispatch(nvr, granted);
+        }
+        // 新申请的凭证不需要回调，调用者直接检查状态
+        notify(granted, ticket);
+        return ticket;
+    }
+
+    // 下载结束或放弃排队
+    void Release(DownloadTicketPtr ticket) {
+        if (nullptr == ticket) {
+            return;
+        }
+        std::vector<DownloadTicketPtr> granted;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            release(ticket);
+            auto iter = nvrs_.find(ticket->GetIp());
+            if (iter != nvrs_.end()) {
+                Nvr &nvr     = iter->second;
+                uint64_t now = TimeTool::now_to_ms();
+                // 会话正常使用过一段时间，说明nvr还有余量，逐个试探恢复上限
+                if (nvr.limit < nvr.configuredLimit && now - nvr.lastDecrease > (uint64_t)FLAGS_vod_limit_probe_s * 1000) {
+                    nvr.limit++;
+                    nvr.lastDecrease = now;
+                    LOG_INFO("Raise learned download session limit of {} to {}", ticket->GetIp(), nvr.limit);
+                }
+                dispatch(nvr, granted);
+            }
+        }
+        notify(granted, nullptr);
+    }
+
+    // 授予的会话被nvr以会话数到了上限为由拒绝，只应该在sdk返回会话数上限的错误码时调用
+    // 还有其他会话在运行时降低上限，凭证放回所在客户端队列的最前面重新等待，id不变，返回true，再次授予时回调onGrant
+    // 没有其他会话在运行时降低上限也没有用，释放凭证并返回false
+    bool Refuse(DownloadTicketPtr ticket) {
+        if (nullptr == ticket) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lck(mutex_);
+        Nvr &nvr = getNvr(ticket->GetIp());
+        nvr.refused++;
+        if (!ticket->IsGranted() || nvr.running <= 1) {
+            release(ticket, false);
+            return false;
+        }
+        nvr.running--;
+        nvr.limit        = std::max(1, nvr.running);
+        nvr.lastDecrease = TimeTool::now_to_ms();
+
+        // 重新排队，排队时间从第一次申请算起
+        ticket->state_     = DownloadTicket::WAITING;
+        ticket->grantTime_ = 0;
+        Queue &q           = nvr.queues[ticket->GetPriority()];
+        auto &tickets      = q.clients[ticket->GetClient()];
+        if (tickets.empty()) {
+            q.order.push_front(ticket->GetClient());
+        }
+        tickets.push_front(ticket);
+        LOG_ERROR("Nvr {} refused a download session with {} running, lower the session limit to {}", ticket->GetIp(), nvr.running, nvr.limit);
+        return true;
+    }
+
+    bool GetQueueInfo(uint64_t id, DownloadQueueInfo &info) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = tickets_.find(id);
+        if (iter == tickets_.end()) {
+            return false;
+        }
+        info = queueInfo(iter->second);
+        return true;
+    }
+
+    DownloadQueueInfo GetQueueInfo(DownloadTicketPtr ticket) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return queueInfo(ticket);
+    }
+
+    // ip为空时返回所有nvr
+    std::vector<DownloadQueueInfo> DumpTickets(const std::string &ip) {
+        std::vector<DownloadQueueInfo> all;
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (auto &p : tickets_) {
+            if (ip.empty() || p.second->GetIp() == ip) {
+                all.push_back(queueInfo(p.second));
+            }
+        }
+        return all;
+    }
+
+    std::vector<NvrScheduleInfo> DumpNvrs() {
+        std::vector<NvrScheduleInfo> all;
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (auto &p : nvrs_) {
+            NvrScheduleInfo info;
+            info.ip              = p.first;
+            info.limit           = p.second.limit;
+            info.configuredLimit = p.second.configuredLimit;
+            info.running         = p.second.running;
+            info.queued          = queued(p.second);
+            info.avgHoldMs       = p.second.avgHoldMs;
+            info.granted         = p.second.granted;
+            info.refused         = p.second.refused;
+            all.push_back(info);
+        }
+        return all;
+    }
+
+private:
+    // 一个优先级的队列，每个客户端一个子队列，order是轮转顺序
+    typedef struct tagQueue {
+        std::map<std::string, std::deque<DownloadTicketPtr>> clients;
+        std::deque<std::string> order;
+    } Queue;
+
+    typedef struct tagNvr {
+        int32_t limit;
+        int32_t configuredLimit;
+        int32_t running;
+        uint64_t lastDecrease;
+        uint64_t avgHoldMs;
+        uint64_t granted;
+        uint64_t refused;
+        Queue queues[2];
+
+        tagNvr() : limit(1), configuredLimit(1), running(0), lastDecrease(0), avgHoldMs(60000), granted(0), refused(0) {}
+    } Nvr;
+
+    static int32_t configuredLimit(const std::string &ip) {
+        const std::string &limits = FLAGS_vod_nvr_session_limits;
+        size_t pos                = 0;
+        while (pos < limits.size()) {
+            size_t end = limits.find(',', pos);
+            if (end == std::string::npos) {
+                end = limits.size();
+            }
+            std::string item = limits.substr(pos, end - pos);
+            size_t eq        = item.find('=');
+            if (eq != std::string::npos && item.substr(0, eq) == ip) {
+                return std::max(1, atoi(item.c_str() + eq + 1));
+            }
+            pos = end + 1;
+        }
+        return std::max(1, FLAGS_vod_sessions_per_nvr);
+    }
+
+    // 持有mutex_时调用
+    Nvr &getNvr(const std::string &ip) {
+        auto iter = nvrs_.find(ip);
+        if (iter == nvrs_.end()) {
+            Nvr nvr;
+            nvr.limit           = configuredLimit(ip);
+            nvr.configuredLimit = nvr.limit;
+            iter                = nvrs_.insert(std::make_pair(ip, nvr)).first;
+        }
+        return iter->second;
+    }
+
+    static int32_t queued(const Nvr &nvr) {
+        int32_t n = 0;
+        for (auto &q : nvr.queues) {
+            for (auto &c : q.clients) {
+                n += c.second.size();
+            }
+        }
+        return n;
+    }
+
+    // 持有mutex_时调用，有空闲会话时按优先级和客户端轮转授予
+    void dispatch(Nvr &nvr, std::vector<DownloadTicketPtr> &granted) {
+        while (nvr.running < nvr.limit) {
+            Queue *q = !nvr.queues[PRIORITY_INTERACTIVE].order.empty() ? &nvr.queues[PRIORITY_INTERACTIVE] : &nvr.queues[PRIORITY_BULK];
+            if (q->order.empty()) {
+                break;
+            }
+            std::string client = q->order.front();
+            q->order.pop_front();
+            auto &tickets            = q->clients[client];
+            DownloadTicketPtr ticket = tickets.front();
+            tickets.pop_front();
+            if (tickets.empty()) {
+                q->clients.erase(client);
+            } else {
+                q->order.push_back(client);
+            }
+
+            ticket->state_     = DownloadTicket::GRANTED;
+            ticket->grantTime_ = TimeTool::now_to_ms();
+            nvr.running++;
+            nvr.granted++;
+            granted.push_back(ticket);
+        }
+    }
+
+    // 持有mutex_时调用
+    void release(DownloadTicketPtr ticket, bool used = true) {
+        int state = ticket->state_.exchange(DownloadTicket::RELEASED);
+        tickets_.erase(ticket->GetId());
+        auto iter = nvrs_.find(ticket->GetIp());
+        if (iter == nvrs_.end() || DownloadTicket::RELEASED == state) {
+            return;
+        }
+        Nvr &nvr = iter->second;
+        if (DownloadTicket::GRANTED == state) {
+            nvr.running--;
+            // 会话平均占用时间，用于估算排队时间
+            if (used) {
+                nvr.avgHoldMs = (nvr.avgHoldMs * 7 + (TimeTool::now_to_ms() - ticket->grantTime_)) / 8;
+            }
+            return;
+        }
+
+        Queue &q    = nvr.queues[ticket->GetPriority()];
+        auto client = q.clients.find(ticket->GetClient());
+        if (client == q.clients.end()) {
+            return;
+        }
+        auto &tickets = client->second;
+        tickets.erase(std::remove(tickets.begin(), tickets.end(), ticket), tickets.end());
+        if (tickets.empty()) {
+            q.clients.erase(client);
+            q.order.erase(std::remove(q.order.begin(), q.order.end(), ticket->GetClient()), q.order.end());
+        }
+    }
+
+    // 按轮转顺序计算前面还有几个请求：每个客户端排在它前面的请求数，加上同一轮中排在前面的客户端
+    DownloadQueueInfo queueInfo(DownloadTicketPtr ticket) {
+        DownloadQueueInfo info;
+        info.id       = ticket->GetId();
+        info.ip       = ticket->GetIp();
+        info.client   = ticket->GetClient();
+        info.priority = PriorityToString(ticket->GetPriority());
+        info.granted  = ticket->IsGranted();
+        info.position = 0;
+        info.waitedMs = ticket->GetWaitedMs();
+        info.etaMs    = 0;
+        if (!ticket->IsWaiting()) {
+            return info;
+        }
+
+        Nvr &nvr = getNvr(ticket->GetIp());
+        Queue &q = nvr.queues[ticket->GetPriority()];
+        if (PRIORITY_BULK == ticket->GetPriority()) {
+            for (auto &c : nvr.queues[PRIORITY_INTERACTIVE].clients) {
+                info.position += c.second.size();
+            }
+        }
+
+        auto &own   = q.clients[ticket->GetClient()];
+        size_t k    = std::find(own.begin(), own.end(), ticket) - own.begin();
+        bool before = true;
+        for (auto &client : q.order) {
+            if (client == ticket->GetClient()) {
+                before = false;
+                continue;
+            }
+            size_t len = q.clients[client].size();
+            info.position += std::min(len, k) + ((before && len > k) ? 1 : 0);
+        }
+        info.position += k;
+        info.etaMs = (uint64_t)(info.position + 1) * nvr.avgHoldMs / std::max(1, nvr.limit);
+        return info;
+    }
+
+    void notify(const std::vector<DownloadTicketPtr> &granted, DownloadTicketPtr except) {
+        for (auto &t : granted) {
+            if (t != except && nullptr != t->onGrant_) {
+                t->onGrant_();
+            }
+        }
+    }
+
+private:
+    std::atomic<uint64_t> nextId_;
+    std::map<std::string, Nvr> nvrs_;
+    std::map<uint64_t, DownloadTicketPtr> tickets_;
+    std::mutex mutex_;
+};
+
+inline DownloadScheduler &DOWNLOAD_SCHEDULER() {
+    return Singleton<DownloadScheduler>::getInstance();
+}
+
+} // namespace sdkproxy
@@ -0,0 +1,701 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <map>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include <gflags/gflags.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+DEFINE_bool(event_spool_enable, true, "Write alarm events to an on-disk spool before uploading, events the receiver did not take are replayed later");
+DEFINE_string(event_spool_dir, "/tmp/sdk_event_spool", "Directory of the alarm event spool");
+DEFINE_int32(event_spool_segment_mb, 64, "Size of a spool segment file, a segment is deleted once all its events are uploaded");
+DEFINE_int64(event_spool_max_bytes, 4LL * 1024 * 1024 * 1024, "Disk budget of the spool, the oldest segments are dropped even if not uploaded");
+DEFINE_int32(event_spool_max_age_h, 72, "Segments whose newest event is older than this are dropped even if not uploaded");
+DEFINE_int32(event_spool_fsync_ms, 200, "Interval of flushing appended events to disk, 0 wakes the flusher on every appended event");
+DEFINE_int32(event_spool_replay_rate, 20, "Max events per second replayed from the spool, spooled events are probed one at a time while the receiver is down");
+
+namespace sdkproxy {
+
+typedef struct tagUploadEvent {
+    std::string devCode;
+    std::string realIp;
+    std::string path;
+    std::string dateTime;
+    int alarmType;
+    std::string alarmData;
+    std::string image;
+    uint64_t queuedAt; // 入队时间(ms)，用于统计从告警到上传完成的延迟
+    uint64_t seq;      // 在spool中的序号，0表示没有写入spool
+
+    tagUploadEvent() : alarmType(0), queuedAt(0), seq(0) {}
+
+    size_t GetBytes() const { return alarmData.size() + image.size(); }
+} UploadEvent;
+
+typedef struct tagEventSpoolStats {
+    uint64_t segments;
+    uint64_t bytes;   // 占用的磁盘空间
+    uint64_t pending; // 还没有上传成功的事件
+    uint64_t inflight;
+    uint64_t appended;
+    uint64_t acked;
+    uint64_t expired; // 超过大小或时间限制时没有上传就删除的事件
+    uint64_t appendFailures;
+    uint64_t syncs;
+    uint64_t syncTotalMs;
+    uint64_t syncMaxMs;
+} EventSpoolStats;
+
+// spool的一个段文件，文件名是第一个事件的序号，预分配后整体映射，追加时直接写入映射的内存
+// 写满后封存，由刷盘线程截断到实际长度，只读不写，全部事件上传成功后删除
+typedef struct tagSpoolSegment {
+    std::string path;
+    int fd;
+    uint8_t *base;
+    size_t mapped;
+    size_t capacity;
+    size_t used;
+    size_t synced;
+    bool sealed;
+    bool truncated; // 封存后已经截断并落盘
+    uint64_t firstSeq;
+    uint64_t newestAt;             // 最新事件的写入时间(ms)
+    std::vector<uint32_t> offsets; // 序号-firstSeq -> 偏移
+
+    tagSpoolSegment() : fd(-1), base(nullptr), mapped(0), capacity(0), used(0), synced(0), sealed(false), truncated(false), firstSeq(0),
+                        newestAt(0) {}
+
+    ~tagSpoolSegment() {
+        if (nullptr != base) {
+            munmap(base, mapped);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    uint64_t EndSeq() const { return firstSeq + offsets.size(); }
+} SpoolSegment;
+
+// 告警事件的预写日志，事件写入spool后再进入上传队列，上传成功后确认
+// 进程崩溃时已经写入映射内存的事件不会丢失，掉电时最多丢失event_spool_fsync_ms内的事件
+// 启动时扫描段文件恢复，确认位置之后没有确认的事件由上传器重放，同一个事件可能上传不止一次
+class EventSpool {
+public:
+    enum {
+        HEADER_BYTES = 32,
+        MAGIC        = 0x50535645, // "EVSP"
+    };
+
+    EventSpool()
+        : open_(false), stopping_(false), wakeup_(false), tail_(1), ackCursor_(1), cursorDirty_(false), dirDirty_(false), cursorFd_(-1), stats_() {}
+
+    ~EventSpool() { Close(); }
+
+    bool Open() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (open_) {
+            return true;
+        }
+        if (!load()) {
+            return false;
+        }
+        open_     = true;
+        stopping_ = false;
+        wakeup_   = true; // 立即预建第一个段
+        flusher_  = std::thread([this]() { flushLoop(); });
+        return true;
+    }
+
+    void Close() {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (!open_) {
+                return;
+            }
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        flusher_.join();
+        flush();
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        open_ = false;
+        segments_.clear();
+        active_ = nullptr;
+        if (nullptr != spare_) {
+            unlink(spare_->path.c_str());
+            spare_ = nullptr;
+        }
+        if (cursorFd_ >= 0) {
+            close(cursorFd_);
+            cursorFd_ = -1;
+        }
+    }
+
+    bool IsOpen() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return open_;
+    }
+
+    // 写入spool并标记为正在上传，成功时设置event.seq
+    // 在sdk回调中调用，只复制到映射的内存，预建段、清理和落盘都在刷盘线程中，event_spool_fsync_ms为0时唤醒刷盘线程
+    bool Append(UploadEvent &event) {
+        std::string head;
+        encodeHead(event, head);
+        size_t len    = head.size() + 4 + event.image.size();
+        size_t stride = (HEADER_BYTES + len + 7) & ~(size_t)7;
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (!open_) {
+            return false;
+        }
+        if ((nullptr == active_ || active_->used + stride > active_->capacity) && !roll(stride)) {
+            stats_.appendFailures++;
+            return false;
+        }
+
+        uint64_t seq = tail_++;
+        uint64_t now = TimeTool::now_to_ms();
+        uint8_t *p   = active_->base + active_->used;
+        uint32_t n   = (uint32_t)event.image.size();
+        memcpy(p + HEADER_BYTES, head.data(), head.size());
+        memcpy(p + HEADER_BYTES + head.size(), &n, 4);
+        memcpy(p + HEADER_BYTES + head.size() + 4, event.image.data(), event.image.size());
+        writeHeader(p, (uint32_t)len, seq, now);
+        active_->offsets.push_back((uint32_t)active_->used);
+        active_->used += stride;
+        active_->newestAt = now;
+
+        event.seq = seq;
+        inflight_.insert(seq);
+        stats_.appended++;
+        if (0 == FLAGS_event_spool_fsync_ms || totalBytes() > (uint64_t)FLAGS_event_spool_max_bytes) {
+            wakeup_ = true;
+            lck.unlock();
+            cond_.notify_all();
+        }
+        return true;
+    }
+
+    // 上传成功或者被接收方拒绝，不再重放
+    void Ack(uint64_t seq) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        inflight_.erase(seq);
+        if (!open_ || seq < ackCursor_) {
+            return;
+        }
+        stats_.acked++;
+        acked_.insert(seq);
+        advance();
+    }
+
+    // 上传失败或者没有进入上传队列，留在spool中等待重放
+    void Release(uint64_t seq) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        inflight_.erase(seq);
+    }
+
+    // 从pos开始找下一个既没有确认也不在上传中的事件，标记为正在上传，pos移到它之后
+    // 找到末尾时返回false，调用方把pos置0从头开始下一轮
+    bool Next(uint64_t &pos, UploadEvent &event) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        uint64_t seq = std::max(pos, ackCursor_);
+        while (open_ && seq < tail_) {
+            auto iter = segments_.upper_bound(seq);
+            if (iter == segments_.begin()) {
+                seq = iter == segments_.end() ? tail_ : iter->first;
+                continue;
+            }
+            std::shared_ptr<SpoolSegment> segment = (--iter)->second;
+            if (seq >= segment->EndSeq()) {
+                ++iter;
+                seq = iter == segments_.end() ? tail_ : iter->first;
+                continue;
+            }
+            if (acked_.count(seq) || inflight_.count(seq)) {
+                seq++;
+                continue;
+            }
+            const uint8_t *p = segment->base + segment->offsets[seq - segment->firstSeq];
+            uint32_t len     = 0;
+            memcpy(&len, p + 8, 4);
+            if (!decode(p + HEADER_BYTES, len, event)) {
+                LOG_ERROR("Drop undecodable event {} in spool segment {}", seq, segment->path);
+                acked_.insert(seq);
+                advance();
+                seq++;
+                continue;
+            }
+            event.seq = seq;
+            inflight_.insert(seq);
+            pos = seq + 1;
+            return true;
+        }
+        pos = seq;
+        return false;
+    }
+
+    EventSpoolStats Stats() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        EventSpoolStats s = stats_;
+        s.segments        = segments_.size();
+        s.bytes           = totalBytes();
+        s.pending         = 0;
+        for (auto &p : segments_) {
+            uint64_t end = p.second->EndSeq();
+            s.pending += end > ackCursor_ ? end - std::max(ackCursor_, p.first) : 0;
+        }
+        s.pending -= std::min<uint64_t>(s.pending, acked_.size());
+        s.inflight = inflight_.size();
+        return s;
+    }
+
+private:
+    // 事件头：alarmType和除图片外的字段，图片单独追加，不再复制到中间缓冲
+    static void encodeHead(const UploadEvent &event, std::string &head) {
+        head.reserve(64 + event.devCode.size() + event.realIp.size() + event.path.size() + event.dateTime.size() + event.alarmData.size());
+        int32_t alarmType = event.alarmType;
+        head.append((const char *)&alarmType, 4);
+        for (const std::string *s : {&event.devCode, &event.realIp, &event.path, &event.dateTime, &event.alarmData}) {
+            uint32_t n = (uint32_t)s->size();
+            head.append((const char *)&n, 4).append(*s);
+        }
+    }
+
+    static bool decode(const uint8_t *p, uint32_t len, UploadEvent &event) {
+        if (len < 4) {
+            return false;
+        }
+        memcpy(&event.alarmType, p, 4);
+        size_t off = 4;
+        for (std::string *s : {&event.devCode, &event.realIp, &event.path, &event.dateTime, &event.alarmData, &event.image}) {
+            uint32_t n = 0;
+            if (off + 4 > len) {
+                return false;
+            }
+            memcpy(&n, p + off, 4);
+            off += 4;
+            if (off + n > len) {
+                return false;
+            }
+            s->assign((const char *)p + off, n);
+            off += n;
+        }
+        return true;
+    }
+
+    // 头部：magic, crc, len, 保留, seq, 写入时间，crc覆盖crc之后的头部和内容，最后写magic
+    static void writeHeader(uint8_t *p, uint32_t len, uint64_t seq, uint64_t ts) {
+        uint32_t reserved = 0;
+        memcpy(p + 8, &len, 4);
+        memcpy(p + 12, &reserved, 4);
+        memcpy(p + 16, &seq, 8);
+        memcpy(p + 24, &ts, 8);
+        uint32_t crc = checksum(p, len);
+        memcpy(p + 4, &crc, 4);
+        uint32_t magic = MAGIC;
+        memcpy(p, &magic, 4);
+    }
+
+    static uint32_t checksum(const uint8_t *p, uint32_t len) {
+        return (uint32_t)crc32(crc32(0L, Z_NULL, 0), p + 8, HEADER_BYTES - 8 + len);
+    }
+
+    // 持有锁时调用，当前段写不下时封存，启用刷盘线程预建的段，只需要改名
+    // 还没有预建好或者单个事件超过段大小时才在这里新建，段按事件大小分配
+    bool roll(size_t stride) {
+        if (nullptr != active_) {
+            seal(active_);
+        }
+        std::shared_ptr<SpoolSegment> segment;
+        std::string path = segmentPath(tail_);
+        if (nullptr != spare_ && spare_->capacity >= stride && 0 == rename(spare_->path.c_str(), path.c_str())) {
+            segment.swap(spare_);
+            segment->path = path;
+        } else {
+            segment = createSegment(path, std::max(segmentBytes(), stride));
+            if (nullptr == segment) {
+                return false;
+            }
+        }
+        segment->firstSeq = tail_;
+        segments_[tail_]  = segment;
+        active_           = segment;
+        dirDirty_         = true;
+        wakeup_           = true;
+        cond_.notify_all();
+        return true;
+    }
+
+    // 新建段文件并整体映射，预分配空间，磁盘满时在这里失败，而不是写映射内存时收到SIGBUS
+    static std::shared_ptr<SpoolSegment> createSegment(const std::string &path, size_t capacity) {
+        std::shared_ptr<SpoolSegment> segment = std::make_shared<SpoolSegment>();
+        segment->path                         = path;
+        segment->capacity                     = capacity;
+        segment->fd                           = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (segment->fd < 0 || 0 != posix_fallocate(segment->fd, 0, capacity)) {
+            LOG_ERROR("Failed to create spool segment {}, {}", path, strerror(errno));
+            unlink(path.c_str());
+            return nullptr;
+        }
+        void *base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        if (MAP_FAILED == base) {
+            LOG_ERROR("Failed to map spool segment {}, {}", path, strerror(errno));
+            unlink(path.c_str());
+            return nullptr;
+        }
+        segment->base   = (uint8_t *)base;
+        segment->mapped = capacity;
+        return segment;
+    }
+
+    static size_t segmentBytes() { return (size_t)std::max(FLAGS_event_spool_segment_mb, 1) * 1024 * 1024; }
+
+    // 持有锁时调用，只做标记，由刷盘线程截断到实际长度并落盘
+    void seal(std::shared_ptr<SpoolSegment> segment) {
+        segment->capacity = segment->used;
+        segment->sealed   = true;
+        if (active_ == segment) {
+            active_ = nullptr;
+        }
+    }
+
+    // 包括预建的段
+    uint64_t totalBytes() const {
+        uint64_t bytes = nullptr != spare_ ? spare_->capacity : 0;
+        for (auto &p : segments_) {
+            bytes += p.second->capacity;
+        }
+        return bytes;
+    }
+
+    // 持有锁时调用，连续确认的事件推进确认位置，之前的段全部确认后删除
+    void advance() {
+        while (!acked_.empty() && *acked_.begin() <= ackCursor_) {
+            if (*acked_.begin() == ackCursor_) {
+                ackCursor_++;
+            }
+            acked_.erase(acked_.begin());
+        }
+        // 被删除的段留下的空洞直接跳过
+        auto iter = segments_.upper_bound(ackCursor_);
+        if (iter != segments_.begin() && ackCursor_ >= std::prev(iter)->second->EndSeq()) {
+            ackCursor_ = iter == segments_.end() ? tail_ : iter->first;
+            if (!acked_.empty() && *acked_.begin() <= ackCursor_) {
+                advance();
+            }
+        }
+        cursorDirty_ = true;
+        while (!segments_.empty() && segments_.begin()->second != active_ && segments_.begin()->second->EndSeq() <= ackCursor_) {
+            drop(segments_.begin()->second);
+        }
+    }
+
+    // 持有锁时调用，超过磁盘空间或者时间限制时从最老的段开始删除，没有上传的事件计入expired
+    void expire(uint64_t now) {
+        uint64_t maxAgeMs = (uint64_t)std::max(FLAGS_event_spool_max_age_h, 1) * 3600 * 1000;
+        while (!segments_.empty()) {
+            std::shared_ptr<SpoolSegment> oldest = segments_.begin()->second;
+            bool tooBig                          = totalBytes() > (uint64_t)FLAGS_event_spool_max_bytes && oldest != active_;
+            bool tooOld                          = now > oldest->newestAt + maxAgeMs;
+            if (!tooBig && !tooOld) {
+                break;
+            }
+            uint64_t end     = oldest->EndSeq();
+            uint64_t expired = end > ackCursor_ ? end - std::max(ackCursor_, oldest->firstSeq) : 0;
+            for (auto iter = acked_.begin(); iter != acked_.end() && *iter < end;) {
+                expired -= expired > 0 ? 1 : 0;
+                iter = acked_.erase(iter);
+            }
+            LOG_ERROR("Spool segment {} is dropped by the {} limit, {} events are not uploaded", oldest->path, tooBig ? "size" : "age", expired);
+            stats_.expired += expired;
+            ackCursor_   = std::max(ackCursor_, end);
+            cursorDirty_ = true;
+            if (oldest == active_) {
+                active_ = nullptr;
+            }
+            drop(oldest);
+            advance();
+        }
+    }
+
+    void drop(std::shared_ptr<SpoolSegment> segment) {
+        unlink(segment->path.c_str());
+        segments_.erase(segment->firstSeq);
+    }
+
+    // 把[synced, used)落盘，映射的长度按页对齐，封存的段截断到实际长度后再落盘一次
+    void sync(std::shared_ptr<SpoolSegment> segment) {
+        size_t from, to;
+        bool truncate;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            from     = segment->synced;
+            to       = segment->used;
+            truncate = segment->sealed && !segment->truncated;
+        }
+        if (from >= to && !truncate) {
+            return;
+        }
+        uint64_t start = TimeTool::now_to_ms();
+        size_t page    = (size_t)sysconf(_SC_PAGESIZE);
+        size_t aligned = from / page * page;
+        int ret        = from < to ? msync(segment->base + aligned, to - aligned, MS_SYNC) : 0;
+        if (0 == ret && truncate) {
+            ret = 0 == ftruncate(segment->fd, to) ? fdatasync(segment->fd) : -1;
+        }
+        uint64_t costMs = TimeTool::now_to_ms() - start;
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (0 != ret) {
+            LOG_ERROR("Failed to sync spool segment {}, {}", segment->path, strerror(errno));
+            return;
+        }
+        segment->synced    = std::max(segment->synced, to);
+        segment->truncated = segment->truncated || truncate;
+        stats_.syncs++;
+        stats_.syncTotalMs += costMs;
+        stats_.syncMaxMs = std::max(stats_.syncMaxMs, costMs);
+    }
+
+    // 批量落盘：每隔event_spool_fsync_ms把所有段新写入的部分、目录和确认位置一起落盘
+    // 同时清理超限的段，并预建下一个段，追加事件时不用等待分配磁盘空间
+    void flush() {
+        std::vector<std::shared_ptr<SpoolSegment>> dirty;
+        bool cursorDirty = false;
+        bool dirDirty    = false;
+        bool needSpare   = false;
+        uint64_t cursor  = 0;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            expire(TimeTool::now_to_ms());
+            for (auto &p : segments_) {
+                if (p.second->synced < p.second->used || (p.second->sealed && !p.second->truncated)) {
+                    dirty.push_back(p.second);
+                }
+            }
+            cursorDirty  = cursorDirty_;
+            dirDirty     = dirDirty_;
+            needSpare    = nullptr == spare_ && !stopping_;
+            cursor       = ackCursor_;
+            cursorDirty_ = false;
+            dirDirty_    = false;
+        }
+        if (needSpare) {
+            std::shared_ptr<SpoolSegment> segment = createSegment(sparePath(), segmentBytes());
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (nullptr != segment && nullptr == spare_) {
+                spare_ = segment;
+            }
+        }
+        for (auto &segment : dirty) {
+            sync(segment);
+        }
+        if (dirDirty) {
+            syncDir();
+        }
+        if (cursorDirty) {
+            uint64_t value[2] = {cursor, ~cursor};
+            if (sizeof(value) != pwrite(cursorFd_, value, sizeof(value), 0) || 0 != fdatasync(cursorFd_)) {
+                LOG_ERROR("Failed to save spool cursor {}, {}", cursor, strerror(errno));
+            }
+        }
+    }
+
+    void flushLoop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lck(mutex_);
+                int32_t intervalMs = FLAGS_event_spool_fsync_ms > 0 ? FLAGS_event_spool_fsync_ms : 1000;
+                cond_.wait_for(lck, std::chrono::milliseconds(intervalMs), [this]() { return stopping_ || wakeup_; });
+                if (stopping_) {
+                    return;
+                }
+                wakeup_ = false;
+            }
+            flush();
+        }
+    }
+
+    // 持有锁时调用，恢复确认位置和段文件，段内从头校验到第一个不完整的事件为止
+    bool load() {
+        std::string path;
+        for (auto &c : FLAGS_event_spool_dir + "/") {
+            if (c == '/' && !path.empty()) {
+                mkdir(path.c_str(), 0755);
+            }
+            path.push_back(c);
+        }
+        unlink(sparePath().c_str());
+        cursorFd_ = open((FLAGS_event_spool_dir + "/cursor").c_str(), O_RDWR | O_CREAT, 0644);
+        if (cursorFd_ < 0) {
+            LOG_ERROR("Failed to open event spool in {}, {}", FLAGS_event_spool_dir, strerror(errno));
+            return false;
+        }
+        uint64_t value[2] = {0, 0};
+        if (sizeof(value) == pread(cursorFd_, value, sizeof(value), 0) && value[0] == ~value[1] && value[0] > 0) {
+            ackCursor_ = value[0];
+        }
+
+        std::vector<uint64_t> seqs;
+        DIR *dir = opendir(FLAGS_event_spool_dir.c_str());
+        if (nullptr != dir) {
+            struct dirent *d;
+            while (nullptr != (d = readdir(dir))) {
+                std::string name = d->d_name;
+                if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wal") == 0) {
+                    seqs.push_back(strtoull(name.c_str(), nullptr, 10));
+                }
+            }
+            closedir(dir);
+        }
+        std::sort(seqs.begin(), seqs.end());
+
+        tail_ = ackCursor_;
+        for (uint64_t first : seqs) {
+            std::shared_ptr<SpoolSegment> segment = recover(first);
+            if (nullptr == segment) {
+                continue;
+            }
+            if (segment->EndSeq() <= ackCursor_ || (first < tail_ && !segments_.empty())) {
+                // 已经全部确认，或者与前一个段重叠
+                drop(segment);
+                continue;
+            }
+            segments_[first] = segment;
+            tail_            = segment->EndSeq();
+        }
+        if (!segments_.empty() && ackCursor_ < segments_.begin()->first) {
+            ackCursor_ = segments_.begin()->first;
+        }
+        tail_ = std::max(tail_, ackCursor_);
+
+        LOG_INFO("Event spool loaded from {}, segments {}, events to replay {}, next seq {}", FLAGS_event_spool_dir, segments_.size(),
+                 tail_ - ackCursor_, tail_);
+        return true;
+    }
+
+    std::shared_ptr<SpoolSegment> recover(uint64_t first) {
+        std::shared_ptr<SpoolSegment> segment = std::make_shared<SpoolSegment>();
+        segment->firstSeq                     = first;
+        segment->path                         = segmentPath(first);
+        segment->fd                           = open(segment->path.c_str(), O_RDWR);
+        // 打不开或者不完整的段直接删除，无法映射的段改名为.bad留待排查，下次启动不再加载
+        struct stat st;
+        if (segment->fd < 0 || 0 != fstat(segment->fd, &st) || st.st_size < HEADER_BYTES) {
+            if (segment->fd >= 0) {
+                close(segment->fd);
+                segment->fd = -1;
+            }
+            unlink(segment->path.c_str());
+            return nullptr;
+        }
+        void *base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        if (MAP_FAILED == base) {
+            LOG_ERROR("Failed to map spool segment {}, {}, moved aside", segment->path, strerror(errno));
+            close(segment->fd);
+            segment->fd = -1;
+            rename(segment->path.c_str(), (segment->path + ".bad").c_str());
+            return nullptr;
+        }
+        segment->base   = (uint8_t *)base;
+        segment->mapped = st.st_size;
+
+        size_t off = 0;
+        while (off + HEADER_BYTES <= segment->mapped) {
+            const uint8_t *p = segment->base + off;
+            uint32_t magic, crc, len;
+            uint64_t seq, ts;
+            memcpy(&magic, p, 4);
+            memcpy(&crc, p + 4, 4);
+            memcpy(&len, p + 8, 4);
+            memcpy(&seq, p + 16, 8);
+            memcpy(&ts, p + 24, 8);
+            size_t stride = (HEADER_BYTES + (size_t)len + 7) & ~(size_t)7;
+            if (MAGIC != magic || segment->EndSeq() != seq || off + stride > segment->mapped || checksum(p, len) != crc) {
+                break;
+            }
+            segment->offsets.push_back((uint32_t)off);
+            segment->newestAt = std::max(segment->newestAt, ts);
+            off += stride;
+        }
+        if (segment->offsets.empty()) {
+            unlink(segment->path.c_str());
+            return nullptr;
+        }
+        segment->used     = off;
+        segment->synced   = off;
+        segment->capacity  = off;
+        segment->sealed    = true;
+        segment->truncated = true;
+        if ((size_t)st.st_size != off && 0 != ftruncate(segment->fd, off)) {
+            LOG_ERROR("Failed to truncate spool segment {}, {}", segment->path, strerror(errno));
+        }
+        return segment;
+    }
+
+    void syncDir() {
+        int fd = open(FLAGS_event_spool_dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+    static std::string segmentPath(uint64_t first) {
+        char name[32] = {0};
+        snprintf(name, sizeof(name), "%020llu.wal", (unsigned long long)first);
+        return FLAGS_event_spool_dir + "/" + name;
+    }
+
+    // 预建的段，启用时改名为segmentPath
+    static std::string sparePath() { return FLAGS_event_spool_dir + "/spare.tmp"; }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool open_;
+    bool stopping_;
+    std::map<uint64_t, std::shared_ptr<SpoolSegment>> segments_; // 第一个序号 -> 段
+    bool wakeup_; // 需要刷盘线程立即处理
+    std::shared_ptr<SpoolSegment> active_;
+    std::shared_ptr<SpoolSegment> spare_; // 刷盘线程预建的下一个段
+    uint64_t tail_;      // 下一个事件的序号
+    uint64_t ackCursor_; // 之前的事件都已经确认
+    std::set<uint64_t> acked_;    // ackCursor_之后已经确认的事件
+    std::set<uint64_t> inflight_; // 在上传队列中或者正在上传的事件
+    bool cursorDirty_;
+    bool dirDirty_; // 新建或改名了段文件，目录需要落盘
+    int cursorFd_;
+    std::thread flusher_;
+    EventSpoolStats stats_;
+};
+
+inline EventSpool &EVENT_SPOOL() {
+    return Singleton<EventSpool>::getInstance();
+}
+
+} // namespace sdkproxy
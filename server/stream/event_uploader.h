@@ -0,0 +1,413 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <condition_variable>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <gflags/gflags.h>
+
+#include "server/util/httplib.h"
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+#include "server/stream/event_spool.h"
+
+DEFINE_int32(event_upload_workers, 4, "Threads uploading alarm events, each keeps its own connection");
+DEFINE_int32(event_upload_queue_size, 1024, "Max alarm events waiting for upload");
+DEFINE_int64(event_upload_queue_max_bytes, 256 * 1024 * 1024, "Max bytes of alarm events waiting for upload, images included");
+DEFINE_int32(event_upload_batch, 8, "Max alarm events a worker sends back to back on one keep-alive connection");
+DEFINE_int32(event_upload_retries, 1, "How many times a failed alarm event upload is retried");
+DEFINE_int32(event_upload_timeout_s, 5, "Connect and read timeout of an alarm event upload");
+DEFINE_string(event_upload_overflow, "drop_oldest",
+              "What to do when the upload queue is full, `drop_oldest' drops the oldest waiting event, `drop_newest' drops the new event, "
+              "`block' waits up to event_upload_block_ms and then drops the new event");
+DEFINE_int32(event_upload_block_ms, 200, "Max time an sdk callback waits for queue space with the `block' overflow policy");
+
+namespace sdkproxy {
+
+typedef struct tagEventUploadStats {
+    uint64_t depth; // 当前排队的事件数和字节数
+    uint64_t bytes;
+    uint64_t maxDepth;
+    uint64_t enqueued;
+    uint64_t uploaded;
+    uint64_t failures; // 被拒绝或者重试后仍然失败的事件
+    uint64_t retries;
+    uint64_t dropped; // 队列满或者上传失败时丢失的事件，没有写入spool的事件才会丢失
+    uint64_t spilled; // 队列满或者上传失败时留在spool中等待重放的事件
+    uint64_t replayed;
+    uint64_t batches;
+    uint64_t latencyTotalMs; // 从入队到上传完成
+    uint64_t latencyMaxMs;
+    uint64_t uploadTotalMs; // 每批的发送时间
+    uint64_t uploadMaxMs;
+} EventUploadStats;
+
+// 连接上依次发送多个请求时，请求头和请求体分两次写，不关闭Nagle算法时每个请求都要等待对端的延迟确认
+class UploadClient : public httplib::Client {
+public:
+    UploadClient(const std::string &host, int port, time_t timeoutSec) : httplib::Client(host.c_str(), port, timeoutSec) {}
+
+private:
+    bool process_and_close_socket(socket_t sock, size_t requestCount,
+                                  std::function<bool(httplib::Stream &strm, bool lastConnection, bool &connectionClose)> callback) override {
+        int on = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        requestCount = std::min(requestCount, keep_alive_max_count_);
+        return httplib::detail::process_and_close_socket(true, sock, requestCount, read_timeout_sec_, read_timeout_usec_, callback);
+    }
+};
+
+// 告警事件的上传队列，sdk的告警回调只入队不做网络请求，由工作线程上传
+// 队列按事件数和字节数限长，满时按event_upload_overflow丢弃，sdk的回调线程最多等待event_upload_block_ms
+// 上传接口每次只接受一个事件，工作线程一次取出多个事件，在同一个keep-alive连接上依次发送
+// 开启spool时事件先写入spool，丢弃和上传失败的事件留在spool中，由重放线程按event_spool_replay_rate重新入队
+class EventUploader {
+public:
+    enum {
+        REPLAY_TICK_MS  = 50,
+        REPLAY_PROBE_MS = 5000, // 接收方不可用时每隔这么久重放一个事件，成功后恢复正常速率
+        REPLAY_IDLE_MS  = 1000,
+    };
+
+    // 先构造spool，保证退出时上传器先析构
+    EventUploader() : port_(0), stopping_(false), healthy_(true), bytes_(0), stats_() { EVENT_SPOOL(); }
+
+    ~EventUploader() { Stop(); }
+
+    void Start(const std::string &host, int port) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (!workers_.empty()) {
+            return;
+        }
+        host_     = host;
+        port_     = port;
+        stopping_ = false;
+        for (int32_t i = 0; i < std::max(FLAGS_event_upload_workers, 1); i++) {
+            workers_.push_back(std::thread([this]() { work(); }));
+        }
+        if (FLAGS_event_spool_enable && EVENT_SPOOL().Open()) {
+            replayer_ = std::thread([this]() { replay(); });
+        }
+        LOG_INFO("Event uploader started, {}:{}, workers {}, queue {}, overflow {}", host, port, workers_.size(), FLAGS_event_upload_queue_size,
+                 FLAGS_event_upload_overflow);
+    }
+
+    // 停止时还在排队的事件留在spool中，下次启动后重放，没有写入spool的丢弃
+    void Stop() {
+        std::vector<std::thread> workers;
+        std::thread replayer;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            stopping_ = true;
+            workers.swap(workers_);
+            replayer.swap(replayer_);
+        }
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+        replayCond_.notify_all();
+        for (auto &t : workers) {
+            t.join();
+        }
+        if (replayer.joinable()) {
+            replayer.join();
+        }
+
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (!queue_.empty()) {
+                LOG_ERROR("Event uploader stopped, {} events are waiting", queue_.size());
+            }
+            for (auto &event : queue_) {
+                discard(event);
+            }
+            queue_.clear();
+            bytes_ = 0;
+        }
+        EVENT_SPOOL().Close();
+    }
+
+    // 在sdk的回调线程中调用，返回false表示事件被丢弃
+    bool Push(UploadEvent event) {
+        event.queuedAt = TimeTool::now_to_ms();
+        size_t size    = event.GetBytes();
+        EVENT_SPOOL().Append(event);
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (stopping_ || workers_.empty()) {
+            discard(event);
+            return false;
+        }
+        if (isFull(size)) {
+            if ("drop_oldest" == FLAGS_event_upload_overflow) {
+                while (!queue_.empty() && isFull(size)) {
+                    LOG_ERROR("Event upload queue is full, drop the oldest event of {}", queue_.front().devCode);
+                    bytes_ -= queue_.front().GetBytes();
+                    discard(queue_.front());
+                    queue_.pop_front();
+                }
+            } else if ("block" == FLAGS_event_upload_overflow) {
+                notFull_.wait_for(lck, std::chrono::milliseconds(FLAGS_event_upload_block_ms), [&]() { return stopping_ || !isFull(size); });
+            }
+            if (stopping_ || isFull(size)) {
+                LOG_ERROR("Event upload queue is full, drop the event of {}, depth {}", event.devCode, queue_.size());
+                discard(event);
+                return false;
+            }
+        }
+
+        bytes_ += size;
+        queue_.push_back(std::move(event));
+        stats_.enqueued++;
+        stats_.maxDepth = std::max<uint64_t>(stats_.maxDepth, queue_.size());
+        lck.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    EventUploadStats Stats() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        EventUploadStats s = stats_;
+        s.depth            = queue_.size();
+        s.bytes            = bytes_;
+        return s;
+    }
+
+private:
+    // 持有锁时调用，写入了spool的事件留待重放，否则丢失
+    void discard(const UploadEvent &event) {
+        if (0 != event.seq) {
+            EVENT_SPOOL().Release(event.seq);
+            stats_.spilled++;
+        } else {
+            stats_.dropped++;
+        }
+    }
+
+    // 按令牌桶限速把spool中没有上传的事件放回队列，只占用队列的一半，不挤占实时事件
+    // 接收方不可用时每隔REPLAY_PROBE_MS试一个，成功后恢复
+    void replay() {
+        uint64_t pos    = 0;
+        double tokens   = 0;
+        uint64_t last   = TimeTool::now_to_ms();
+        uint64_t probed = 0;
+        while (true) {
+            std::unique_lock<std::mutex> lck(mutex_);
+            replayCond_.wait_for(lck, std::chrono::milliseconds(REPLAY_TICK_MS), [this]() { return stopping_; });
+            if (stopping_) {
+                return;
+            }
+            uint64_t now = TimeTool::now_to_ms();
+            tokens       = std::min(tokens + (double)(now - last) * std::max(FLAGS_event_spool_replay_rate, 1) / 1000,
+                                    (double)std::max(FLAGS_event_spool_replay_rate, 1));
+            last         = now;
+            if (!healthy_) {
+                if (now < probed + REPLAY_PROBE_MS) {
+                    continue;
+                }
+                probed = now;
+                tokens = std::min(tokens, 1.0);
+            }
+
+            while (tokens >= 1 && queue_.size() < (size_t)std::max(FLAGS_event_upload_queue_size, 2) / 2) {
+                lck.unlock();
+                UploadEvent event;
+                bool found = EVENT_SPOOL().Next(pos, event);
+                lck.lock();
+                if (!found) {
+                    // 一轮结束，从头开始找上传失败后放回的事件
+                    pos = 0;
+                    replayCond_.wait_for(lck, std::chrono::milliseconds(REPLAY_IDLE_MS), [this]() { return stopping_; });
+                    break;
+                }
+                if (stopping_) {
+                    EVENT_SPOOL().Release(event.seq);
+                    return;
+                }
+                event.queuedAt = TimeTool::now_to_ms();
+                bytes_ += event.GetBytes();
+                queue_.push_back(std::move(event));
+                stats_.replayed++;
+                tokens -= 1;
+                notEmpty_.notify_one();
+            }
+        }
+    }
+
+    // 持有锁时调用，单个事件超过字节上限时只要队列为空就接受
+    bool isFull(size_t size) const {
+        return queue_.size() >= (size_t)std::max(FLAGS_event_upload_queue_size, 1)
+               || (!queue_.empty() && (int64_t)(bytes_ + size) > FLAGS_event_upload_queue_max_bytes);
+    }
+
+    void work() {
+        UploadClient client(host_, port_, FLAGS_event_upload_timeout_s);
+        client.set_read_timeout(FLAGS_event_upload_timeout_s, 0);
+        client.set_keep_alive_max_count(std::max(FLAGS_event_upload_batch, 1));
+
+        while (true) {
+            std::vector<UploadEvent> batch;
+            {
+                std::unique_lock<std::mutex> lck(mutex_);
+                notEmpty_.wait(lck, [this]() { return stopping_ || !queue_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                while (!queue_.empty() && batch.size() < (size_t)std::max(FLAGS_event_upload_batch, 1)) {
+                    bytes_ -= queue_.front().GetBytes();
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+            }
+            notFull_.notify_all();
+            upload(client, batch);
+        }
+    }
+
+    // 依次发送一批事件，连接断开后没有发出的和服务端出错的事件重试，请求有误(4xx)的不重试
+    void upload(UploadClient &client, std::vector<UploadEvent> &batch) {
+        std::vector<httplib::Request> requests;
+        requests.reserve(batch.size());
+        for (auto &event : batch) {
+            LOG_INFO("Upload alarm event, devCode = {}, realIp = {}, alarmType = {}, alarmData = {}", event.devCode, event.realIp, event.alarmType,
+                     event.alarmData);
+            requests.push_back(buildRequest(event));
+            std::string().swap(event.image);
+        }
+
+        std::vector<bool> done(batch.size(), false);
+        for (int32_t attempt = 0; attempt <= FLAGS_event_upload_retries; attempt++) {
+            // 请求体包含图片，移动而不是复制，发送后移回
+            std::vector<size_t> pending;
+            std::vector<httplib::Request> sending;
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (!done[i]) {
+                    pending.push_back(i);
+                    sending.push_back(std::move(requests[i]));
+                }
+            }
+            if (pending.empty()) {
+                break;
+            }
+
+            uint64_t start = TimeTool::now_to_ms();
+            std::vector<httplib::Response> responses;
+            client.send(sending, responses);
+            uint64_t now = TimeTool::now_to_ms();
+            for (size_t i = 0; i < pending.size(); i++) {
+                requests[pending[i]] = std::move(sending[i]);
+            }
+
+            // 连接出错时responses只包含出错前收到的响应
+            std::unique_lock<std::mutex> lck(mutex_);
+            stats_.batches++;
+            stats_.retries += attempt > 0 ? pending.size() : 0;
+            stats_.uploadTotalMs += now - start;
+            stats_.uploadMaxMs = std::max(stats_.uploadMaxMs, now - start);
+            for (size_t i = 0; i < responses.size(); i++) {
+                UploadEvent &event = batch[pending[i]];
+                int status         = responses[i].status;
+                if (status >= 200 && status < 300) {
+                    EVENT_SPOOL().Ack(event.seq);
+                    done[pending[i]] = true;
+                    healthy_         = true;
+                    stats_.uploaded++;
+                    stats_.latencyTotalMs += now - event.queuedAt;
+                    stats_.latencyMaxMs = std::max(stats_.latencyMaxMs, now - event.queuedAt);
+                } else if (status >= 400 && status < 500) {
+                    LOG_ERROR("Alarm event of {} is rejected, status {}", event.devCode, status);
+                    EVENT_SPOOL().Ack(event.seq);
+                    done[pending[i]] = true;
+                    healthy_         = true;
+                    stats_.failures++;
+                } else {
+                    LOG_ERROR("Failed to upload alarm event of {}, status {}", event.devCode, status);
+                }
+            }
+        }
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (!done[i]) {
+                LOG_ERROR("Failed to upload alarm event of {} to {}:{}, give up", batch[i].devCode, host_, port_);
+                healthy_ = false;
+                stats_.failures++;
+                discard(batch[i]);
+            }
+        }
+    }
+
+    static httplib::Request buildRequest(const UploadEvent &event) {
+        httplib::MultipartFormDataItems items = {
+            {"path", event.path, "", ""},
+            {"realIp", event.realIp, "", ""},
+            {"dateTime", event.dateTime, "", ""},
+            {"alarmType", std::to_string(event.alarmType), "", ""},
+            {"alarmData", event.alarmData, "", "application/json"},
+        };
+        std::string boundary = httplib::detail::make_multipart_data_boundary();
+
+        httplib::Request req;
+        req.method = "POST";
+        req.path   = "/v3/upload";
+        req.body.reserve(event.GetBytes() + 1024);
+        for (const auto &item : items) {
+            appendPart(req.body, boundary, item.name, item.filename, item.content_type);
+            req.body += item.content + "\r\n";
+        }
+        // 图片直接追加到请求体，不再经过MultipartFormDataItems复制一次
+        appendPart(req.body, boundary, "image", event.devCode + ".jpg", "image/jpeg");
+        req.body.append(event.image).append("\r\n");
+        req.body += "--" + boundary + "--\r\n";
+        req.set_header("Content-Type", "multipart/form-data; boundary=" + boundary);
+        return req;
+    }
+
+    static void appendPart(std::string &body, const std::string &boundary, const std::string &name, const std::string &filename,
+                           const std::string &contentType) {
+        body += "--" + boundary + "\r\n";
+        body += "Content-Disposition: form-data; name=\"" + name + "\"";
+        if (!filename.empty()) {
+            body += "; filename=\"" + filename + "\"";
+        }
+        body += "\r\n";
+        if (!contentType.empty()) {
+            body += "Content-Type: " + contentType + "\r\n";
+        }
+        body += "\r\n";
+    }
+
+private:
+    std::string host_;
+    int port_;
+    bool stopping_;
+    bool healthy_; // 最近一次上传是否得到接收方的响应
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::condition_variable replayCond_;
+    std::deque<UploadEvent> queue_;
+    uint64_t bytes_;
+    std::vector<std::thread> workers_;
+    std::thread replayer_;
+    EventUploadStats stats_;
+};
+
+inline EventUploader &EVENT_UPLOADER() {
+    return Singleton<EventUploader>::getInstance();
+}
+
+} // namespace sdkproxy
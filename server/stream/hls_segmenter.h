@@ -0,0 +1,431 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <sstream>
+#include <iomanip>
+
+#include <gflags/gflags.h>
+#include <butil/iobuf.h>
+#include <brpc/controller.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+#include "3rdsdk/stub/sdk_stub.h"
+
+#include "common/media/frame_parser.h"
+#include "common/media/ts_muxer.h"
+#include "server/stream/real_stream_hub.h"
+#include "server/stream/stream_reactor.h"
+
+DEFINE_int32(hls_segment_duration_ms, 2000, "Target duration of a HLS segment, segments are cut on the first key frame after it");
+DEFINE_int32(hls_part_duration_ms, 500, "Target duration of a LL-HLS partial segment, 0 disables partial segments");
+DEFINE_int32(hls_playlist_segments, 6, "Segments listed in a HLS playlist");
+DEFINE_int32(hls_idle_timeout_s, 30, "HLS channel is stopped if no client requests it during the last `hls_idle_timeout_s'");
+
+namespace sdkproxy {
+
+// 部分分片(LL-HLS)，数据放在IOBuf中由所有客户端共享
+typedef struct tagHlsPart {
+    butil::IOBuf data;
+    uint64_t duration; // 90kHz
+    bool independent;
+} HlsPart;
+
+typedef struct tagHlsSegment {
+    uint64_t seq;
+    uint64_t duration; // 90kHz
+    butil::IOBuf data;
+    std::vector<std::shared_ptr<const HlsPart>> parts;
+} HlsSegment;
+
+// 等待播放列表更新的请求(LL-HLS阻塞刷新)
+typedef struct tagHlsWaiter {
+    brpc::Controller *cntl;
+    google::protobuf::Closure *done;
+    uint64_t msn;
+    int64_t part;
+    uint64_t deadline;
+} HlsWaiter;
+
+// 一个通道的HLS切片，作为实时流的一个观看者，在内存中按关键帧切成TS分片
+class HlsChannel final : public StreamTask {
+public:
+    HlsChannel(const std::string &id, const std::string &key, std::shared_ptr<RealStreamViewer> viewer)
+        : StreamTask("hls", key), id_(id), key_(key), viewer_(viewer), started_(false), segStartPts_(0), partStartPts_(0), lastPts_(0),
+          ptsOffset_(0), partIndependent_(false), nextSeq_(0), lastAccess_(TimeTool::now_to_ms()) {}
+
+    const std::string &GetId() const { return id_; }
+
+    const std::string &GetKey() const { return key_; }
+
+    int GetFd() override { return viewer_->GetNotifyFd(); }
+
+    bool OnReadable() override {
+        std::vector<SharedMediaRing::Chunk> frames;
+        int r = viewer_->Read(frames, 0);
+        if (-1 == r) {
+            return false;
+        }
+
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            for (auto &f : frames) {
+                addBytes(f->data.size());
+                process(f);
+            }
+        }
+        wakeWaiters(false);
+
+        // 长时间没有客户端访问时停止
+        if (TimeTool::now_to_ms() - lastAccess_ > (uint64_t)FLAGS_hls_idle_timeout_s * 1000) {
+            return false;
+        }
+        retryAfter(100);
+        return true;
+    }
+
+    void OnFinished(const std::string &reason) override;
+
+    // 返回播放列表，msn/part有效且对应的分片还没有生成时，请求会被挂起直到分片生成或超时
+    void Playlist(brpc::Controller *cntl, google::protobuf::Closure *done, int64_t msn, int64_t part) {
+        lastAccess_ = TimeTool::now_to_ms();
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            // 还没有任何分片时等待第一个分片
+            if (msn < 0 && segments_.empty()) {
+                msn  = nextSeq_;
+                part = FLAGS_hls_part_duration_ms > 0 ? 0 : -1;
+            }
+            if (msn >= 0 && (uint64_t)msn > nextSeq_ + 2) {
+                cntl->http_response().set_status_code(brpc::HTTP_STATUS_BAD_REQUEST);
+                cntl->response_attachment().append("_HLS_msn is too far in the future");
+                done->Run();
+                return;
+            }
+            if (msn >= 0 && !ready(msn, part)) {
+                HlsWaiter w;
+                w.cntl     = cntl;
+                w.done     = done;
+                w.msn      = msn;
+                w.part     = part;
+                w.deadline = TimeTool::now_to_ms() + 3 * std::max(FLAGS_hls_segment_duration_ms, 1000);
+                waiters_.push_back(w);
+                return;
+            }
+            render(cntl);
+        }
+        done->Run();
+    }
+
+    // 读取完整分片或者部分分片
+    bool GetSegment(uint64_t seq, int64_t part, butil::IOBuf &out) {
+        lastAccess_ = TimeTool::now_to_ms();
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        std::shared_ptr<const HlsSegment> seg;
+        for (auto &s : segments_) {
+            if (s->seq == seq) {
+                seg = s;
+                break;
+            }
+        }
+        if (nullptr == seg && seq == nextSeq_ && part >= 0 && (size_t)part < parts_.size()) {
+            out.append(parts_[part]->data);
+            return true;
+        }
+        if (nullptr == seg) {
+            return false;
+        }
+        if (part < 0) {
+            out.append(seg->data);
+            return true;
+        }
+        if ((size_t)part >= seg->parts.size()) {
+            return false;
+        }
+        out.append(seg->parts[part]->data);
+        return true;
+    }
+
+private:
+    bool ready(uint64_t msn, int64_t part) const {
+        if (msn < nextSeq_) {
+            return true;
+        }
+        return msn == nextSeq_ && part >= 0 && (size_t)part < parts_.size();
+    }
+
+    void wakeWaiters(bool all) {
+        std::vector<HlsWaiter> done;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            uint64_t now = TimeTool::now_to_ms();
+            for (auto iter = waiters_.begin(); iter != waiters_.end();) {
+                if (all || now >= iter->deadline || ready(iter->msn, iter->part)) {
+                    render(iter->cntl);
+                    done.push_back(*iter);
+                    iter = waiters_.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+        for (auto &w : done) {
+            w.done->Run();
+        }
+    }
+
+    std::string segmentUri(uint64_t seq, int64_t part) const {
+        std::string uri = "Segment?stream=" + id_ + "&seq=" + std::to_string(seq);
+        if (part >= 0) {
+            uri += "&part=" + std::to_string(part);
+        }
+        return uri;
+    }
+
+    static std::string seconds(uint64_t duration) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", duration / 90000.0);
+        return buf;
+    }
+
+    void renderParts(std::ostringstream &os, uint64_t seq, const std::vector<std::shared_ptr<const HlsPart>> &parts) const {
+        for (size_t i = 0; i < parts.size(); i++) {
+            os << "#EXT-X-PART:DURATION=" << seconds(parts[i]->duration) << ",URI=\"" << segmentUri(seq, i) << "\"";
+            if (parts[i]->independent) {
+                os << ",INDEPENDENT=YES";
+            }
+            os << "\n";
+        }
+    }
+
+    void render(brpc::Controller *cntl) const {
+        bool lowLatency = FLAGS_hls_part_duration_ms > 0;
+
+        uint64_t target = FLAGS_hls_segment_duration_ms * 90;
+        for (auto &s : segments_) {
+            target = std::max(target, s->duration);
+        }
+
+        std::ostringstream os;
+        os << "#EXTM3U\n";
+        os << "#EXT-X-VERSION:6\n";
+        os << "#EXT-X-TARGETDURATION:" << (target + 89999) / 90000 << "\n";
+        if (lowLatency) {
+            os << "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" << seconds(FLAGS_hls_part_duration_ms * 90 * 3) << "\n";
+            os << "#EXT-X-PART-INF:PART-TARGET=" << seconds(FLAGS_hls_part_duration_ms * 90) << "\n";
+        }
+        os << "#EXT-X-MEDIA-SEQUENCE:" << (segments_.empty() ? nextSeq_ : segments_.front()->seq) << "\n";
+
+        for (size_t i = 0; i < segments_.size(); i++) {
+            auto &s = segments_[i];
+            // 只列出最近几个分片的部分分片
+            if (lowLatency && i + 2 >= segments_.size()) {
+                renderParts(os, s->seq, s->parts);
+            }
+            os << "#EXTINF:" << seconds(s->duration) << ",\n";
+            os << segmentUri(s->seq, -1) << "\n";
+        }
+        if (lowLatency) {
+            renderParts(os, nextSeq_, parts_);
+        }
+
+        cntl->http_response().set_content_type("application/vnd.apple.mpegurl");
+        cntl->http_response().SetHeader("Cache-Control", "max-age=1");
+        cntl->response_attachment().append(os.str());
+    }
+
+    void process(const SharedMediaRing::Chunk &frame) {
+        uint64_t pts = 0;
+        if (!extractor_.Extract(*frame, es_, pts)) {
+            return;
+        }
+        muxer_.SetCodec(extractor_.GetCodec());
+
+        // 时间戳回退或跳变时，接着上一帧继续
+        pts += ptsOffset_;
+        if (started_ && (pts <= lastPts_ || pts - lastPts_ > 10 * 90000)) {
+            ptsOffset_ += lastPts_ + 3600 - pts;
+            pts = lastPts_ + 3600;
+        }
+
+        if (!started_) {
+            // 从第一个关键帧开始
+            if (!frame->IsKey()) {
+                return;
+            }
+            started_         = true;
+            segStartPts_     = pts;
+            partStartPts_    = pts;
+            partIndependent_ = true;
+        } else if (frame->IsKey() && pts - segStartPts_ >= (uint64_t)FLAGS_hls_segment_duration_ms * 90) {
+            closePart(pts, true);
+            closeSegment(pts);
+        } else if (FLAGS_hls_part_duration_ms > 0 && pts - partStartPts_ >= (uint64_t)FLAGS_hls_part_duration_ms * 90) {
+            closePart(pts, frame->IsKey());
+        }
+
+        lastPts_ = pts;
+        muxer_.WriteVideo((const uint8_t *)es_.data(), es_.size(), pts, frame->IsKey(), partBuf_);
+    }
+
+    void closePart(uint64_t pts, bool nextIndependent) {
+        if (!partBuf_.empty()) {
+            std::shared_ptr<HlsPart> part = std::make_shared<HlsPart>();
+            part->data.append(partBuf_);
+            part->duration    = pts - partStartPts_;
+            part->independent = partIndependent_;
+            parts_.push_back(part);
+            partBuf_.clear();
+        }
+        partStartPts_    = pts;
+        partIndependent_ = nextIndependent;
+    }
+
+    void closeSegment(uint64_t pts) {
+        std::shared_ptr<HlsSegment> seg = std::make_shared<HlsSegment>();
+        seg->seq                        = nextSeq_++;
+        seg->duration                   = pts - segStartPts_;
+        for (auto &p : parts_) {
+            seg->data.append(p->data);
+        }
+        seg->parts.swap(parts_);
+        segments_.push_back(seg);
+        while (segments_.size() > (size_t)std::max(FLAGS_hls_playlist_segments, 2)) {
+            segments_.pop_front();
+        }
+        segStartPts_ = pts;
+    }
+
+private:
+    std::string id_;
+    std::string key_;
+    std::shared_ptr<RealStreamViewer> viewer_;
+    std::mutex mutex_;
+    EsExtractor extractor_;
+    TsMuxer muxer_;
+    std::string es_;
+    bool started_;
+    uint64_t segStartPts_;
+    uint64_t partStartPts_;
+    uint64_t lastPts_;
+    uint64_t ptsOffset_;
+    std::string partBuf_;
+    bool partIndependent_;
+    std::vector<std::shared_ptr<const HlsPart>> parts_; // 当前分片已完成的部分分片
+    std::deque<std::shared_ptr<const HlsSegment>> segments_;
+    uint64_t nextSeq_; // 当前正在生成的分片序号
+    std::vector<HlsWaiter> waiters_;
+    std::atomic<uint64_t> lastAccess_;
+};
+
+// 所有通道的HLS切片，同一通道的所有HLS客户端共享一个切片
+class HlsHub {
+public:
+    // 启动实时流要经过sdk登录和打开码流，在锁外进行，同一通道同时打开时只有第一个请求启动，其余的等待结果
+    std::shared_ptr<HlsChannel> Open(const std::string &ip, std::shared_ptr<sdk::SdkStub> sdk, const std::string &devId) {
+        std::string key = ip + "_" + devId;
+
+        std::shared_ptr<Opening> opening;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            auto iter = channels_.find(key);
+            if (iter != channels_.end()) {
+                return iter->second;
+            }
+            auto o = opening_.find(key);
+            if (o != opening_.end()) {
+                opening = o->second;
+                cond_.wait(lck, [&]() { return opening->done; });
+                return opening->channel;
+            }
+            opening       = std::make_shared<Opening>();
+            opening_[key] = opening;
+        }
+
+        std::shared_ptr<HlsChannel> channel;
+        auto viewer = REAL_STREAM_HUB().Subscribe(ip, sdk, devId);
+        if (nullptr != viewer) {
+            channel = std::make_shared<HlsChannel>(newId(), key, viewer);
+            if (0 != STREAM_REACTOR().Register(channel)) {
+                REAL_STREAM_HUB().Unsubscribe(viewer);
+                channel = nullptr;
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (nullptr != channel) {
+                channels_[key]         = channel;
+                ids_[channel->GetId()] = channel;
+                LOG_INFO("Start hls channel {}, stream {}", key, channel->GetId());
+            }
+            opening->done    = true;
+            opening->channel = channel;
+            opening_.erase(key);
+        }
+        cond_.notify_all();
+        return channel;
+    }
+
+    std::shared_ptr<HlsChannel> Find(const std::string &id) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = ids_.find(id);
+        return iter == ids_.end() ? nullptr : iter->second;
+    }
+
+    void Remove(HlsChannel *channel) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = channels_.find(channel->GetKey());
+        if (iter != channels_.end() && iter->second.get() == channel) {
+            channels_.erase(iter);
+        }
+        ids_.erase(channel->GetId());
+    }
+
+private:
+    typedef struct tagOpening {
+        bool done;
+        std::shared_ptr<HlsChannel> channel;
+
+        tagOpening() : done(false) {}
+    } Opening;
+
+    std::string newId() {
+        std::ostringstream os;
+        os << std::hex << std::setfill('0') << std::setw(16) << rand_() << std::setw(16) << rand_();
+        return os.str();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::mt19937_64 rand_{std::random_device()()};
+    std::map<std::string, std::shared_ptr<HlsChannel>> channels_;
+    std::map<std::string, std::shared_ptr<HlsChannel>> ids_;
+    std::map<std::string, std::shared_ptr<Opening>> opening_; // 正在启动的通道
+};
+
+inline HlsHub &HLS_HUB() {
+    return Singleton<HlsHub>::getInstance();
+}
+
+inline void HlsChannel::OnFinished(const std::string &reason) {
+    HLS_HUB().Remove(this);
+    wakeWaiters(true);
+    REAL_STREAM_HUB().Unsubscribe(viewer_);
+    LOG_INFO("The hls channel is {}, {}, segments {}", reason, key_, nextSeq_);
+}
+
+} // namespace sdkproxy
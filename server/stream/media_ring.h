@@ -0,0 +1,329 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <gflags/gflags.h>
+#include <butil/iobuf.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+
+DEFINE_int32(media_block_size, 16384, "Bytes of a pooled block that carries sdk media data");
+DEFINE_int32(media_pool_max_free_blocks, 8192, "Max idle blocks kept in the media block pool");
+DEFINE_int32(media_ring_slots, 2048, "Capacity in blocks of the ring between a sdk callback and its transport");
+DEFINE_string(media_ring_overflow_policy, "close", "What the sdk callback does when the ring is full, `drop' discards the data, `close' aborts the stream");
+DEFINE_int32(media_ring_block_ms, 10000,
+             "How long a vod download callback waits for ring space when the sdk download cannot be paused, the overflow policy applies after that");
+
+namespace sdkproxy {
+
+// 有新数据时通过eventfd通知读者，pending用于合并多次通知
+class RingListener {
+public:
+    RingListener() : pending(false) { fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); }
+
+    ~RingListener() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void Notify() {
+        if (!pending.exchange(true)) {
+            uint64_t one = 1;
+            write(fd, &one, sizeof(one));
+        }
+    }
+
+    // 先清除标记再读取数据，保证不会丢失通知
+    void Consume() {
+        uint64_t v;
+        read(fd, &v, sizeof(v));
+        pending = false;
+    }
+
+    int fd;
+    std::atomic<bool> pending;
+};
+
+// 内存块，数据紧跟在块头之后
+struct MediaBlock {
+    MediaBlock *next;
+    uint32_t len;
+    uint32_t cap;
+
+    char *Data() { return (char *)(this + 1); }
+};
+
+// 媒体数据块池，避免sdk回调中频繁申请释放内存
+class MediaBlockPool {
+public:
+    MediaBlockPool() : free_(nullptr), freeCount_(0), blockSize_(FLAGS_media_block_size > 0 ? FLAGS_media_block_size : 16384) {}
+
+    ~MediaBlockPool() {
+        while (nullptr != free_) {
+            MediaBlock *b = free_;
+            free_         = b->next;
+            ::free(b);
+        }
+    }
+
+    MediaBlock *Alloc() {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (nullptr != free_) {
+                MediaBlock *b = free_;
+                free_         = b->next;
+                freeCount_--;
+                b->next = nullptr;
+                b->len  = 0;
+                return b;
+            }
+        }
+
+        MediaBlock *b = (MediaBlock *)::malloc(sizeof(MediaBlock) + blockSize_);
+        if (nullptr == b) {
+            return nullptr;
+        }
+        b->next = nullptr;
+        b->len  = 0;
+        b->cap  = blockSize_;
+        return b;
+    }
+
+    void Free(MediaBlock *b) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (freeCount_ < FLAGS_media_pool_max_free_blocks) {
+                b->next = free_;
+                free_   = b;
+                freeCount_++;
+                return;
+            }
+        }
+        ::free(b);
+    }
+
+    uint32_t GetBlockSize() const { return blockSize_; }
+
+    // IOBuf释放用户数据时的回调，data指向块的数据区
+    static void FreeData(void *data);
+
+private:
+    std::mutex mutex_;
+    MediaBlock *free_;
+    int32_t freeCount_;
+    uint32_t blockSize_;
+};
+
+inline MediaBlockPool &MEDIA_BLOCK_POOL() {
+    return Singleton<MediaBlockPool>::getInstance();
+}
+
+inline void MediaBlockPool::FreeData(void *data) {
+    MEDIA_BLOCK_POOL().Free((MediaBlock *)data - 1);
+}
+
+// 单生产者单消费者的无锁环形缓冲，生产者是sdk回调线程，消费者是reactor的事件循环
+// 生产者默认不阻塞，缓冲满时按溢出策略丢弃数据或终止流
+// 不能暂停sdk下载的录像下载开启SetBlocking，缓冲满时生产者最多等待blockMs，用阻塞sdk回调的方式让nvr放慢
+class MediaRing {
+public:
+    enum OverflowPolicy {
+        OVERFLOW_DROP  = 0,
+        OVERFLOW_CLOSE = 1,
+    };
+
+    static OverflowPolicy PolicyFromString(const std::string &policy) { return policy == "drop" ? OVERFLOW_DROP : OVERFLOW_CLOSE; }
+
+    explicit MediaRing(size_t slots, OverflowPolicy policy = PolicyFromString(FLAGS_media_ring_overflow_policy))
+        : policy_(policy), head_(0), tail_(0), closed_(false), aborted_(false), cancelled_(false), blockMs_(0), overflowCount_(0),
+          overflowBytes_(0), blockedCount_(0) {
+        // 容量取2的幂，便于取模
+        size_t cap = 2;
+        while (cap < slots) {
+            cap <<= 1;
+        }
+        slots_.resize(cap, nullptr);
+        mask_ = cap - 1;
+    }
+
+    ~MediaRing() {
+        for (size_t i = head_; i != tail_; i++) {
+            MEDIA_BLOCK_POOL().Free(slots_[i & mask_]);
+        }
+    }
+
+    // 生产者调用，返回false表示数据被丢弃
+    bool Push(const uint8_t *buffer, int32_t bufferLen) {
+        if (closed_.load(std::memory_order_relaxed) || cancelled_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (bufferLen <= 0) {
+            return true;
+        }
+
+        uint32_t blockSize = MEDIA_BLOCK_POOL().GetBlockSize();
+        size_t need        = (bufferLen + blockSize - 1) / blockSize;
+        size_t tail        = tail_.load(std::memory_order_relaxed);
+        if (!waitSpace(tail, need)) {
+            if (!cancelled_.load(std::memory_order_relaxed)) {
+                overflow(bufferLen);
+            }
+            return false;
+        }
+
+        int32_t off = 0;
+        while (off < bufferLen) {
+            MediaBlock *b = MEDIA_BLOCK_POOL().Alloc();
+            if (nullptr == b) {
+                overflow(bufferLen - off);
+                break;
+            }
+            b->len = std::min<uint32_t>(b->cap, bufferLen - off);
+            memcpy(b->Data(), buffer + off, b->len);
+            off += b->len;
+            slots_[tail++ & mask_] = b;
+        }
+        tail_.store(tail, std::memory_order_release);
+        listener_.Notify();
+        return off == bufferLen;
+    }
+
+    // 生产者调用，数据已全部写入
+    void Close() {
+        closed_.store(true, std::memory_order_release);
+        listener_.Notify();
+    }
+
+    // 消费者调用，客户端已断开，之后的数据直接丢弃
+    void Cancel() {
+        cancelled_ = true;
+        std::unique_lock<std::mutex> lck(spaceMutex_);
+        spaceCond_.notify_all();
+    }
+
+    // 消费者调用，缓冲满时生产者最多等待ms毫秒，0表示不等待
+    void SetBlocking(uint32_t ms) { blockMs_ = ms; }
+
+    // 消费者调用，把最多maxBytes的数据零拷贝地追加到out，返回追加的字节数，-1表示流已结束
+    int Drain(butil::IOBuf &out, size_t maxBytes) {
+        listener_.Consume();
+
+        bool closed = closed_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        if (aborted_) {
+            return -1;
+        }
+        if (head == tail) {
+            return closed ? -1 : 0;
+        }
+
+        size_t n = 0;
+        while (head != tail && n < maxBytes) {
+            MediaBlock *b = slots_[head++ & mask_];
+            n += b->len;
+            out.append_user_data(b->Data(), b->len, MediaBlockPool::FreeData);
+        }
+        head_.store(head, std::memory_order_release);
+        if (blockMs_.load(std::memory_order_relaxed) > 0) {
+            std::unique_lock<std::mutex> lck(spaceMutex_);
+            spaceCond_.notify_all();
+        }
+
+        // 没有取完或者已经结束时再通知一次，让事件循环稍后继续
+        if (head != tail || closed) {
+            listener_.Notify();
+        }
+        return (int)n;
+    }
+
+    // 唤醒消费者，例如排队的下载获得了nvr的会话
+    void Wake() { listener_.Notify(); }
+
+    // 消费者暂时不读取数据时清除通知，避免事件循环被反复唤醒
+    void ClearNotify() { listener_.Consume(); }
+
+    int GetNotifyFd() const { return listener_.fd; }
+
+    // 当前积压的块数
+    size_t Size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+
+    size_t Capacity() const { return slots_.size(); }
+
+    bool IsAborted() const { return aborted_; }
+
+    uint64_t GetOverflowCount() const { return overflowCount_; }
+
+    uint64_t GetOverflowBytes() const { return overflowBytes_; }
+
+    // 生产者因缓冲满而等待的次数
+    uint64_t GetBlockedCount() const { return blockedCount_; }
+
+private:
+    bool hasSpace(size_t tail, size_t need) const { return slots_.size() - (tail - head_.load(std::memory_order_acquire)) >= need; }
+
+    // 消费者取走数据时通知，按10ms分片等待，即使错过通知也只多等一个分片
+    bool waitSpace(size_t tail, size_t need) {
+        if (hasSpace(tail, need)) {
+            return true;
+        }
+        uint32_t ms = blockMs_.load(std::memory_order_relaxed);
+        if (0 == ms) {
+            return false;
+        }
+        blockedCount_++;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+        std::unique_lock<std::mutex> lck(spaceMutex_);
+        while (!hasSpace(tail, need)) {
+            if (cancelled_ || std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            spaceCond_.wait_for(lck, std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+
+    void overflow(int32_t len) {
+        overflowCount_++;
+        overflowBytes_ += len;
+        if (OVERFLOW_CLOSE == policy_ && !aborted_.exchange(true)) {
+            LOG_ERROR("Media ring overflow, abort the stream");
+            Close();
+        }
+    }
+
+private:
+    OverflowPolicy policy_;
+    std::vector<MediaBlock *> slots_;
+    size_t mask_;
+    // head只由消费者修改，tail只由生产者修改
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    std::atomic<bool> closed_;
+    std::atomic<bool> aborted_;
+    std::atomic<bool> cancelled_;
+    std::atomic<uint32_t> blockMs_;
+    std::atomic<uint64_t> overflowCount_;
+    std::atomic<uint64_t> overflowBytes_;
+    std::atomic<uint64_t> blockedCount_;
+    std::mutex spaceMutex_;
+    std::condition_variable spaceCond_;
+    RingListener listener_;
+};
+
+} // namespace sdkproxy
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <atomic>
+
+#include <gflags/gflags.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+
+#include "3rdsdk/stub/sdk_stub.h"
+
+#include "server/stream/media_ring.h"
+#include "common/media/frame_parser.h"
+
+DEFINE_int32(real_stream_ring_chunks, 1024, "Max frames kept in the shared ring of a live channel");
+DEFINE_int32(real_stream_lag_frames, 64, "Frames kept behind the latest GOP for viewers that lag a little");
+DEFINE_bool(gop_cache_enable, true, "Send the latest GOP of a live channel to a new viewer before live data");
+DEFINE_int64(gop_cache_channel_max_bytes, 16 * 1024 * 1024, "Max bytes of frames kept by one live channel");
+DEFINE_int64(gop_cache_max_bytes, 1024 * 1024 * 1024, "Max bytes of frames kept by all live channels");
+
+namespace sdkproxy {
+
+// GOP缓存的全局统计
+typedef struct tagGopCacheStats {
+    std::atomic<int64_t> bytes;
+    std::atomic<int64_t> channels;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    tagGopCacheStats() : bytes(0), channels(0), hits(0), misses(0) {}
+} GopCacheStats;
+
+inline GopCacheStats &GOP_CACHE_STATS() {
+    return Singleton<GopCacheStats>::getInstance();
+}
+
+// 多个观看者共享的广播环形缓冲，每个观看者持有自己的读游标
+// 缓冲保留从最近一个关键帧开始的完整GOP，新观看者可以直接从关键帧开始播放
+class SharedMediaRing {
+public:
+    using Chunk = MediaFramePtr;
+
+    static const uint64_t NO_GOP = UINT64_MAX;
+
+    explicit SharedMediaRing(size_t capacity) : capacity_(capacity), headSeq_(0), gopSeq_(NO_GOP), bytes_(0), closed_(false) {
+        GOP_CACHE_STATS().channels++;
+    }
+
+    ~SharedMediaRing() {
+        GOP_CACHE_STATS().bytes -= bytes_;
+        GOP_CACHE_STATS().channels--;
+    }
+
+    void Push(MediaFramePtr frame) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            // 流头(例如海康的IMKH)单独保存，后加入的观看者需要先收到它
+            if (FRAME_HEADER == frame->type) {
+                header_ = frame;
+                return;
+            }
+            if (frame->IsKey()) {
+                gopSeq_ = tailSeq();
+            }
+            chunks_.push_back(frame);
+            bytes_ += frame->data.size();
+            GOP_CACHE_STATS().bytes += frame->data.size();
+            trim();
+            notifyListeners();
+        }
+        cond_.notify_all();
+    }
+
+    void Close() {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            closed_ = true;
+            notifyListeners();
+        }
+        cond_.notify_all();
+    }
+
+    void AddListener(std::shared_ptr<RingListener> listener) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        listeners_.push_back(listener);
+    }
+
+    void RemoveListener(std::shared_ptr<RingListener> listener) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        listeners_.erase(std::remove(listeners_.begin(), listeners_.end(), listener), listeners_.end());
+    }
+
+    // 返回读取到的块数，0表示超时，-1表示流已结束；落后太多的游标会跳到最旧的块，并累计skipped
+    int Read(uint64_t &cursor, std::vector<Chunk> &out, uint64_t &skipped, int timeoutMs) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        bool ready = cond_.wait_for(lck, std::chrono::milliseconds(timeoutMs), [&]() { return closed_ || cursor < tailSeq(); });
+        if (!ready) {
+            return 0;
+        }
+        if (cursor < headSeq_) {
+            skipped += headSeq_ - cursor;
+            cursor = headSeq_;
+        }
+        uint64_t tail = tailSeq();
+        if (cursor >= tail && closed_) {
+            return -1;
+        }
+        for (; cursor < tail; cursor++) {
+            out.push_back(chunks_[cursor - headSeq_]);
+        }
+        return (int)out.size();
+    }
+
+    bool IsClosed() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return closed_;
+    }
+
+    Chunk GetHeader() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return header_;
+    }
+
+    // 新观看者从缓存的GOP开始读，没有时从最新位置开始读
+    uint64_t StartSeq(bool &hit) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        hit = FLAGS_gop_cache_enable && NO_GOP != gopSeq_;
+        return hit ? gopSeq_ : tailSeq();
+    }
+
+    // 缓存的GOP的帧数和字节数
+    void GetGopSize(uint64_t &frames, int64_t &bytes) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        frames = 0;
+        bytes  = 0;
+        if (NO_GOP != gopSeq_) {
+            for (uint64_t seq = gopSeq_; seq < tailSeq(); seq++) {
+                frames++;
+                bytes += chunks_[seq - headSeq_]->data.size();
+            }
+        }
+    }
+
+private:
+    uint64_t tailSeq() const { return headSeq_ + chunks_.size(); }
+
+    // 丢弃最近GOP之前的帧(保留少量给稍有落后的观看者)，以及超出通道或全局内存上限的帧
+    // 超过全局上限时只有占用超过平均份额的通道丢弃，并且只丢到份额或者全局回到上限以内，占用小的通道不受影响
+    void trim() {
+        uint64_t lag  = FLAGS_real_stream_lag_frames > 0 ? FLAGS_real_stream_lag_frames : 0;
+        int64_t share = FLAGS_gop_cache_max_bytes / std::max<int64_t>(GOP_CACHE_STATS().channels, 1);
+        while (chunks_.size() > 1) {
+            bool beforeGop = NO_GOP != gopSeq_ && headSeq_ < gopSeq_ && tailSeq() - headSeq_ > lag;
+            bool overLimit = chunks_.size() > capacity_ || bytes_ > FLAGS_gop_cache_channel_max_bytes ||
+                             (GOP_CACHE_STATS().bytes > FLAGS_gop_cache_max_bytes && bytes_ > share);
+            if (!beforeGop && !overLimit) {
+                break;
+            }
+            int64_t size = chunks_.front()->data.size();
+            bytes_ -= size;
+            GOP_CACHE_STATS().bytes -= size;
+            chunks_.pop_front();
+            headSeq_++;
+        }
+        if (NO_GOP != gopSeq_ && gopSeq_ < headSeq_) {
+            // GOP超出内存上限，等下一个关键帧
+            gopSeq_ = NO_GOP;
+        }
+    }
+
+    void notifyListeners() {
+        for (auto &l : listeners_) {
+            l->Notify();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Chunk> chunks_;
+    std::vector<std::shared_ptr<RingListener>> listeners_;
+    Chunk header_;
+    size_t capacity_;
+    uint64_t headSeq_;
+    uint64_t gopSeq_; // 最近一个关键帧的序号
+    int64_t bytes_;
+    bool closed_;
+};
+
+// 一个通道的实时流会话，所有观看者共享同一个sdk实时流任务
+class RealStreamSession {
+public:
+    RealStreamSession(const std::string &key, std::shared_ptr<sdk::SdkStub> sdk, const std::string &devId)
+        : key_(key), devId_(devId), sdk_(sdk), ring_(FLAGS_real_stream_ring_chunks), jobId_(0), started_(false), startResult_(0),
+          viewers_(0) {}
+
+    const std::string &GetKey() const { return key_; }
+
+    const std::string &GetDevId() const { return devId_; }
+
+    SharedMediaRing &GetRing() { return ring_; }
+
+    // 只有第一个观看者会真正调用sdk，其他观看者等待并共享启动结果
+    int32_t Start() {
+        std::unique_lock<std::mutex> lck(startMutex_);
+        if (started_) {
+            return startResult_;
+        }
+
+        // 在sdk回调线程中切分成完整的帧，观看者拥塞时按帧丢弃
+        SharedMediaRing *ring                   = &ring_;
+        std::shared_ptr<FrameSplitter> splitter = std::make_shared<FrameSplitter>();
+        startResult_                            = sdk_->StartRealStream(
+            devId_,
+            [ring, splitter](intptr_t id, const uint8_t *buffer, int32_t bufferLen) {
+                std::vector<MediaFramePtr> frames;
+                if (nullptr != buffer) {
+                    splitter->Feed(buffer, bufferLen, frames);
+                } else {
+                    splitter->Flush(frames);
+                }
+                for (auto &f : frames) {
+                    ring->Push(f);
+                }
+                if (nullptr == buffer) {
+                    //通知写完毕
+                    ring->Close();
+                }
+            },
+            jobId_);
+        started_ = true;
+        return startResult_;
+    }
+
+    void Stop() {
+        std::unique_lock<std::mutex> lck(startMutex_);
+        if (started_ && 0 == startResult_) {
+            sdk_->StopRealStream(jobId_);
+        }
+        ring_.Close();
+    }
+
+private:
+    friend class RealStreamHub;
+
+    std::string key_;
+    std::string devId_;
+    std::shared_ptr<sdk::SdkStub> sdk_;
+    SharedMediaRing ring_;
+    std::mutex startMutex_;
+    intptr_t jobId_;
+    bool started_;
+    int32_t startResult_;
+    int32_t viewers_; // 由RealStreamHub的锁保护
+};
+
+// 观看者，持有会话的引用和自己的读游标，有新数据时通过GetNotifyFd()通知
+class RealStreamViewer {
+public:
+    explicit RealStreamViewer(std::shared_ptr<RealStreamSession> session)
+        : session_(session), listener_(new RingListener()), skipped_(0), sentHeader_(false), fromGop_(false), lost_(false) {
+        cursor_ = session_->GetRing().StartSeq(fromGop_);
+        if (fromGop_) {
+            GOP_CACHE_STATS().hits++;
+        } else {
+            GOP_CACHE_STATS().misses++;
+        }
+        session_->GetRing().AddListener(listener_);
+        // 先触发一次，尽快发送流头
+        listener_->Notify();
+    }
+
+    ~RealStreamViewer() { session_->GetRing().RemoveListener(listener_); }
+
+    int GetNotifyFd() const { return listener_->fd; }
+
+    // timeoutMs为0时不等待
+    int Read(std::vector<SharedMediaRing::Chunk> &out, int timeoutMs) {
+        listener_->Consume();
+        if (!sentHeader_) {
+            sentHeader_ = true;
+            auto header = session_->GetRing().GetHeader();
+            if (nullptr != header) {
+                out.push_back(header);
+            }
+        }
+        uint64_t skipped = skipped_;
+        size_t begin     = out.size();
+        int ret          = session_->GetRing().Read(cursor_, out, skipped_, timeoutMs);
+        if (fromGop_ && out.size() > begin) {
+            fromGop_ = false;
+            if (nullptr != out[begin]->psi) {
+                std::shared_ptr<MediaFrame> psi = std::make_shared<MediaFrame>();
+                psi->type                       = FRAME_HEADER;
+                psi->sync                       = true;
+                psi->data                       = *out[begin]->psi;
+                out.insert(out.begin() + begin, psi);
+            }
+        }
+        if (skipped != skipped_) {
+            // 落后太多丢失了数据，需要从下一个关键帧重新开始
+            lost_ = true;
+        }
+        if (ret > 0 && session_->GetRing().IsClosed()) {
+            // 流已结束，再通知一次以便读到结束标记
+            listener_->Notify();
+        }
+        return (ret == 0 && !out.empty()) ? (int)out.size() : ret;
+    }
+
+    uint64_t GetSkipped() const { return skipped_; }
+
+    // 读到的数据是否有缺失，读取后清除
+    bool TakeLost() {
+        bool lost = lost_;
+        lost_     = false;
+        return lost;
+    }
+
+    std::shared_ptr<RealStreamSession> GetSession() { return session_; }
+
+private:
+    std::shared_ptr<RealStreamSession> session_;
+    std::shared_ptr<RingListener> listener_;
+    uint64_t cursor_;
+    uint64_t skipped_;
+    bool sentHeader_;
+    bool fromGop_; // 从缓存的GOP开始读，第一个关键帧前需要补发PAT/PMT
+    bool lost_;
+};
+
+typedef struct tagRealStreamChannelStat {
+    std::string key;
+    int32_t viewers;
+    uint64_t gopFrames;
+    int64_t gopBytes;
+} RealStreamChannelStat;
+
+// 实时流汇聚，按(NVR ip, 通道id)复用sdk实时流，最后一个观看者离开时才停止
+class RealStreamHub {
+public:
+    std::shared_ptr<RealStreamViewer> Subscribe(const std::string &ip, std::shared_ptr<sdk::SdkStub> sdk, const std::string &devId) {
+        std::string key = buildKey(ip, devId);
+
+        std::shared_ptr<RealStreamSession> session;
+        int32_t viewers = 0;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            auto iter = sessions_.find(key);
+            if (iter != sessions_.end()) {
+                session = iter->second;
+            } else {
+                session        = std::make_shared<RealStreamSession>(key, sdk, devId);
+                sessions_[key] = session;
+            }
+            viewers = ++session->viewers_;
+        }
+
+        // 在锁外启动，避免一个通道的sdk调用阻塞其他通道
+        if (0 != session->Start()) {
+            LOG_ERROR("Failed to start real stream {}", key);
+            release(session);
+            return nullptr;
+        }
+
+        LOG_INFO("Subscribe real stream {}, viewers {}", key, viewers);
+
+        return std::make_shared<RealStreamViewer>(session);
+    }
+
+    void Unsubscribe(std::shared_ptr<RealStreamViewer> viewer) {
+        if (nullptr == viewer) {
+            return;
+        }
+        release(viewer->GetSession());
+    }
+
+    int32_t GetViewerCount(const std::string &ip, const std::string &devId) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = sessions_.find(buildKey(ip, devId));
+        return iter == sessions_.end() ? 0 : iter->second->viewers_;
+    }
+
+    std::vector<RealStreamChannelStat> Dump() {
+        std::vector<std::pair<std::shared_ptr<RealStreamSession>, int32_t>> sessions;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            for (auto &p : sessions_) {
+                sessions.push_back(std::make_pair(p.second, p.second->viewers_));
+            }
+        }
+
+        std::vector<RealStreamChannelStat> stats;
+        for (auto &p : sessions) {
+            RealStreamChannelStat s;
+            s.key     = p.first->GetKey();
+            s.viewers = p.second;
+            p.first->GetRing().GetGopSize(s.gopFrames, s.gopBytes);
+            stats.push_back(s);
+        }
+        return stats;
+    }
+
+private:
+    void release(std::shared_ptr<RealStreamSession> session) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (--session->viewers_ > 0) {
+                LOG_INFO("Unsubscribe real stream {}, viewers {}", session->GetKey(), session->viewers_);
+                return;
+            }
+            auto iter = sessions_.find(session->GetKey());
+            if (iter != sessions_.end() && iter->second == session) {
+                sessions_.erase(iter);
+            }
+        }
+
+        session->Stop();
+        LOG_INFO("The last viewer left, real stream {} stopped", session->GetKey());
+    }
+
+    std::string buildKey(const std::string &ip, const std::string &devId) { return ip + "_" + devId; }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<RealStreamSession>> sessions_;
+};
+
+inline RealStreamHub &REAL_STREAM_HUB() {
+    return Singleton<RealStreamHub>::getInstance();
+}
+
+} // namespace sdkproxy
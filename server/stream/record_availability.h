@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include <gflags/gflags.h>
+
+#include "3rdsdk/stub/sdk_stub.h"
+
+DEFINE_int32(vod_availability_parallel, 4, "Channels of one availability request queried concurrently");
+DEFINE_int32(vod_availability_max_slots, 1 << 20, "Max time slots per channel of one availability request");
+
+namespace sdkproxy {
+
+enum AvailabilityEncoding {
+    AVAILABILITY_BITMAP = 0, // 每个时间片一位，高位在前
+    AVAILABILITY_RLE    = 1, // varint编码的游程长度，从无录像开始交替
+};
+
+// 把录像列表转换为按固定时间片划分的有无录像位图，[startTime + i * resolution, startTime + (i + 1) * resolution)
+// 与任意录像重叠时第i个时间片为1
+class RecordAvailability {
+public:
+    RecordAvailability(time_t startTime, uint32_t resolution, uint32_t slots)
+        : startTime_(startTime), resolution_(resolution), slots_(slots), bits_((slots + 7) / 8, 0), count_(0) {}
+
+    void Add(const sdk::RecordInfo &r) { Add(r.startTime.ToTime(), r.endTime.ToTime()); }
+
+    void Add(time_t start, time_t end) {
+        time_t limit = startTime_ + (time_t)resolution_ * slots_;
+        start        = std::max(start, startTime_);
+        end          = std::min(end, limit);
+        if (start >= end) {
+            return;
+        }
+        uint32_t first = (uint32_t)((start - startTime_) / resolution_);
+        uint32_t last  = (uint32_t)((end - startTime_ + resolution_ - 1) / resolution_);
+        for (uint32_t i = first; i < last; i++) {
+            uint8_t mask = 0x80 >> (i & 7);
+            if (0 == (bits_[i >> 3] & mask)) {
+                bits_[i >> 3] |= mask;
+                count_++;
+            }
+        }
+    }
+
+    bool Test(uint32_t i) const { return 0 != (bits_[i >> 3] & (0x80 >> (i & 7))); }
+
+    // 有录像的时间片个数
+    uint32_t GetCount() const { return count_; }
+
+    std::string Encode(AvailabilityEncoding encoding) const {
+        if (AVAILABILITY_BITMAP == encoding) {
+            return std::string(bits_.begin(), bits_.end());
+        }
+
+        std::string out;
+        bool value   = false;
+        uint32_t run = 0;
+        for (uint32_t i = 0; i < slots_; i++) {
+            if (Test(i) != value) {
+                putVarint(out, run);
+                value = !value;
+                run   = 0;
+            }
+            run++;
+        }
+        putVarint(out, run);
+        return out;
+    }
+
+private:
+    static void putVarint(std::string &out, uint32_t v) {
+        while (v >= 0x80) {
+            out.push_back((char)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((char)v);
+    }
+
+private:
+    time_t startTime_;
+    uint32_t resolution_;
+    uint32_t slots_;
+    std::vector<uint8_t> bits_;
+    uint32_t count_;
+};
+
+} // namespace sdkproxy
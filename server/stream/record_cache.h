@@ -0,0 +1,657 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <memory>
+#include <map>
+#include <set>
+#include <list>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <gflags/gflags.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+#include "3rdsdk/stub/metadata_store.h"
+#include "3rdsdk/stub/po_type_serialization.h"
+
+DEFINE_bool(vod_cache_enable, false, "Cache downloaded recordings on disk and serve repeated ranges from the cache");
+DEFINE_string(vod_cache_dir, "/tmp/sdk_vod_cache", "Directory of the recording cache");
+DEFINE_int64(vod_cache_max_bytes, 10LL * 1024 * 1024 * 1024, "Disk budget of the recording cache, least recently used ranges are evicted");
+DEFINE_int32(vod_cache_min_age_s, 300, "Ranges ending less than this many seconds ago are not cached, the nvr may still be recording");
+DEFINE_int64(vod_cache_write_queue_bytes, 64 * 1024 * 1024, "Max bytes waiting for the cache writer thread, a range that does not fit is not cached");
+
+namespace sdkproxy {
+
+using json = nlohmann::json;
+
+// 缓存的一段录像，按(nvr, 通道, 时间段)索引，文件内容就是这个时间段的原始下载数据
+typedef struct tagRecordCacheEntry {
+    std::string id;
+    std::string ip;
+    std::string devId;
+    time_t startTime;
+    time_t endTime;
+    uint64_t bytes;
+    uint64_t lastAccess;
+
+    tagRecordCacheEntry() : startTime(0), endTime(0), bytes(0), lastAccess(0) {}
+} RecordCacheEntry;
+
+// 下载计划中的一段，fd>=0表示从缓存文件读，否则需要从nvr下载
+typedef struct tagRecordCachePiece {
+    time_t startTime;
+    time_t endTime;
+    int fd;
+    uint64_t bytes;
+
+    tagRecordCachePiece(time_t s, time_t e, int f = -1, uint64_t b = 0) : startTime(s), endTime(e), fd(f), bytes(b) {}
+} RecordCachePiece;
+
+typedef struct tagRecordCacheStats {
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t maxBytes;
+    uint64_t lookups;
+    uint64_t hits;        // 实际开始输出的缓存段
+    uint64_t servedBytes; // 从缓存读出并输出的字节，即节省的nvr下载量
+    uint64_t fetchedBytes;
+    uint64_t storedBytes;
+    uint64_t evictions;
+    uint64_t queuedBytes; // 等待写入线程写盘的字节
+    uint64_t skipped;     // 写入队列满而没有缓存的下载
+} RecordCacheStats;
+
+class RecordCache;
+
+// 把一段下载写到临时文件，正常结束时落盘并提交到索引，否则删除
+// sdk回调线程只拷贝数据交给缓存的写入线程，写盘、fsync和提交都在写入线程中进行，回调不会被磁盘阻塞
+// Commit和Abort可能在不同线程调用，只生效一次
+class RecordCacheWriter : public std::enable_shared_from_this<RecordCacheWriter> {
+public:
+    RecordCacheWriter(RecordCache *cache, const RecordCacheEntry &entry, const std::string &path, int fd)
+        : cache_(cache), entry_(entry), path_(path), fd_(fd), done_(false), failed_(false), ioFailed_(false) {}
+
+    // 既没有提交也没有放弃，写入线程也不再引用时删除临时文件
+    ~RecordCacheWriter() {
+        if (fd_ >= 0) {
+            close(fd_);
+            unlink(path_.c_str());
+        }
+    }
+
+    void Write(const uint8_t *buffer, int32_t len);
+
+    void Commit();
+
+    void Abort();
+
+private:
+    friend class RecordCache;
+
+    // 以下在写入线程中调用
+    void doWrite(const std::string &data);
+
+    void doCommit(const RecordCacheEntry &entry);
+
+    void doAbort() {
+        if (fd_ >= 0) {
+            close(fd_);
+            unlink(path_.c_str());
+            fd_ = -1;
+        }
+    }
+
+private:
+    RecordCache *cache_;
+    RecordCacheEntry entry_;
+    std::string path_;
+    int fd_; // 只在写入线程中访问
+    bool done_;
+    bool failed_;   // 超过大小或者写入队列满，不再缓存
+    bool ioFailed_; // 只在写入线程中访问
+    std::mutex mutex_;
+};
+
+// 录像下载的磁盘缓存：同一通道重复下载的时间段直接从磁盘读，只从nvr下载没有缓存的空档
+// 索引保存在独立的leveldb中，文件先写临时文件，fsync并改名后再同步写入索引
+// 写盘、提交和淘汰都在一个写入线程中进行，同步写索引和删除文件时不持有Plan使用的锁
+// 命中时只在内存中更新淘汰顺序，最近访问时间由写入线程定期批量写入索引
+// 重启时按索引和文件大小校验恢复
+// 缓存按时间段整体使用，只有完全落在请求范围内的缓存段才会命中，超出预算时按最近最少使用淘汰
+class RecordCache {
+public:
+    enum {
+        WRITE_DATA   = 0,
+        WRITE_COMMIT = 1,
+        WRITE_ABORT  = 2,
+
+        TOUCH_FLUSH_MS = 10000,
+    };
+
+    RecordCache()
+        : totalBytes_(0), lookups_(0), hits_(0), servedBytes_(0), fetchedBytes_(0), storedBytes_(0), evictions_(0), nextTmp_(0), stopping_(false),
+          queuedBytes_(0), skipped_(0) {
+        if (FLAGS_vod_cache_enable) {
+            load();
+            writer_ = std::thread([this]() { writeLoop(); });
+        }
+    }
+
+    ~RecordCache() {
+        {
+            std::unique_lock<std::mutex> lck(writeMutex_);
+            stopping_ = true;
+        }
+        writeCond_.notify_all();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+    }
+
+    bool IsEnabled() const { return nullptr != store_; }
+
+    // 把[startTime, endTime]切成缓存段和需要下载的空档，缓存段的fd由调用者关闭
+    std::vector<RecordCachePiece> Plan(const std::string &ip, const std::string &devId, time_t startTime, time_t endTime) {
+        std::vector<RecordCachePiece> pieces;
+        if (!IsEnabled()) {
+            pieces.push_back(RecordCachePiece(startTime, endTime));
+            return pieces;
+        }
+
+        std::unique_lock<std::mutex> lck(mutex_);
+        lookups_++;
+        time_t cursor = startTime;
+        auto channel  = index_.find(channelKey(ip, devId));
+        if (channel != index_.end()) {
+            for (auto iter = channel->second.lower_bound(startTime); iter != channel->second.end(); ++iter) {
+                RecordCacheEntry &e = iter->second->entry;
+                if (e.startTime < cursor || e.endTime > endTime) {
+                    continue;
+                }
+                int fd = open(filePath(e.id).c_str(), O_RDONLY);
+                if (fd < 0) {
+                    LOG_ERROR("Recording cache file of {} is missing, errno {}", e.id, errno);
+                    continue;
+                }
+                if (e.startTime > cursor) {
+                    pieces.push_back(RecordCachePiece(cursor, e.startTime));
+                }
+                pieces.push_back(RecordCachePiece(e.startTime, e.endTime, fd, e.bytes));
+                cursor = e.endTime;
+                touch(iter->second);
+            }
+        }
+        if (cursor < endTime) {
+            pieces.push_back(RecordCachePiece(cursor, endTime));
+        }
+        return pieces;
+    }
+
+    // 为一段从nvr下载的数据创建缓存写入，不需要缓存时返回nullptr
+    std::shared_ptr<RecordCacheWriter> BeginWrite(const std::string &ip, const std::string &devId, time_t startTime, time_t endTime) {
+        if (!IsEnabled() || endTime <= startTime || endTime > (time_t)TimeTool::now_to_seconds() - FLAGS_vod_cache_min_age_s) {
+            return nullptr;
+        }
+
+        RecordCacheEntry e;
+        e.ip        = ip;
+        e.devId     = devId;
+        e.startTime = startTime;
+        e.endTime   = endTime;
+        e.id        = entryId(ip, devId, startTime, endTime);
+
+        std::string path = FLAGS_vod_cache_dir + "/" + e.id + "." + std::to_string(nextTmp_++) + ".tmp";
+        int fd           = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd < 0) {
+            LOG_ERROR("Failed to create recording cache file {}, errno {}", path, errno);
+            return nullptr;
+        }
+        return std::make_shared<RecordCacheWriter>(this, e, path, fd);
+    }
+
+    // 记录从nvr下载的字节数，用于计算命中率
+    void AddFetchedBytes(uint64_t n) { fetchedBytes_ += n; }
+
+    // 缓存段的数据实际输出给客户端时调用，first表示这个缓存段第一次输出
+    void AddServedBytes(uint64_t n, bool first) {
+        if (first) {
+            hits_++;
+        }
+        servedBytes_ += n;
+    }
+
+    RecordCacheStats Stats() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        RecordCacheStats s;
+        s.entries      = lru_.size();
+        s.bytes        = totalBytes_;
+        s.maxBytes     = FLAGS_vod_cache_max_bytes;
+        s.lookups      = lookups_;
+        s.hits         = hits_;
+        s.servedBytes  = servedBytes_;
+        s.fetchedBytes = fetchedBytes_;
+        s.storedBytes  = storedBytes_;
+        s.evictions    = evictions_;
+        s.queuedBytes  = queuedBytes_;
+        s.skipped      = skipped_;
+        return s;
+    }
+
+private:
+    friend class RecordCacheWriter;
+
+    typedef struct tagNode {
+        RecordCacheEntry entry;
+        std::list<std::shared_ptr<struct tagNode>>::iterator lru;
+        bool touched; // 最近访问时间还没有写入索引
+        bool dropped;
+
+        tagNode() : touched(false), dropped(false) {}
+    } Node;
+    typedef std::shared_ptr<Node> NodePtr;
+
+    typedef struct tagWriteOp {
+        std::shared_ptr<RecordCacheWriter> writer;
+        int32_t kind;
+        std::string data;
+        RecordCacheEntry entry; // 提交时的索引
+    } WriteOp;
+
+    // 写入队列满时返回false，数据不入队
+    bool enqueue(WriteOp &op) {
+        {
+            std::unique_lock<std::mutex> lck(writeMutex_);
+            if (WRITE_DATA == op.kind && queuedBytes_ + op.data.size() > (uint64_t)FLAGS_vod_cache_write_queue_bytes) {
+                skipped_++;
+                return false;
+            }
+            queuedBytes_ += op.data.size();
+            ops_.push_back(std::move(op));
+        }
+        writeCond_.notify_one();
+        return true;
+    }
+
+    // 停止时写完队列中的数据再退出
+    void writeLoop() {
+        uint64_t lastFlush = TimeTool::now_to_ms();
+        while (true) {
+            std::deque<WriteOp> ops;
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lck(writeMutex_);
+                writeCond_.wait_for(lck, std::chrono::milliseconds(1000), [this]() { return stopping_ || !ops_.empty(); });
+                ops.swap(ops_);
+                stopping = stopping_;
+            }
+            for (auto &op : ops) {
+                if (WRITE_DATA == op.kind) {
+                    op.writer->doWrite(op.data);
+                } else if (WRITE_COMMIT == op.kind) {
+                    op.writer->doCommit(op.entry);
+                } else {
+                    op.writer->doAbort();
+                }
+                std::unique_lock<std::mutex> lck(writeMutex_);
+                queuedBytes_ -= op.data.size();
+            }
+            uint64_t now = TimeTool::now_to_ms();
+            if (stopping || now - lastFlush >= TOUCH_FLUSH_MS) {
+                lastFlush = now;
+                flushTouched();
+            }
+            if (stopping && ops.empty()) {
+                break;
+            }
+        }
+    }
+
+    static std::string channelKey(const std::string &ip, const std::string &devId) { return ip + "_" + devId; }
+
+    static std::string entryId(const std::string &ip, const std::string &devId, time_t startTime, time_t endTime) {
+        std::string id = channelKey(ip, devId) + "_" + std::to_string(startTime) + "_" + std::to_string(endTime);
+        for (auto &c : id) {
+            if (!isalnum((unsigned char)c) && c != '_' && c != '.' && c != '-') {
+                c = '_';
+            }
+        }
+        return id;
+    }
+
+    static std::string filePath(const std::string &id) { return FLAGS_vod_cache_dir + "/" + id + ".dat"; }
+
+    static std::string metaKey(const std::string &id) { return "vodcache/" + id; }
+
+    static std::string toValue(const RecordCacheEntry &e) {
+        json j;
+        j["ip"]         = e.ip;
+        j["devId"]      = e.devId;
+        j["startTime"]  = e.startTime;
+        j["endTime"]    = e.endTime;
+        j["bytes"]      = e.bytes;
+        j["lastAccess"] = e.lastAccess;
+        return j.dump();
+    }
+
+    // 在写入线程中调用，临时文件已经落盘，改名后同步写入索引，之前被它完全覆盖的缓存段删除
+    // 只有写入线程修改索引，检查和插入之间不需要一直持有锁，改名和同步写索引时Plan不会被阻塞
+    bool commit(const std::string &tmpPath, RecordCacheEntry e) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            auto channel = index_.find(channelKey(e.ip, e.devId));
+            if (channel != index_.end()) {
+                for (auto &p : channel->second) {
+                    RecordCacheEntry &old = p.second->entry;
+                    if (old.startTime <= e.startTime && old.endTime >= e.endTime) {
+                        return false;
+                    }
+                }
+            }
+        }
+        if (rename(tmpPath.c_str(), filePath(e.id).c_str()) != 0) {
+            LOG_ERROR("Failed to rename recording cache file {}, errno {}", tmpPath, errno);
+            return false;
+        }
+        e.lastAccess = TimeTool::now_to_seconds();
+        if (!store_->Put(metaKey(e.id), toValue(e), true)) {
+            LOG_ERROR("Failed to save recording cache index of {}", e.id);
+            unlink(filePath(e.id).c_str());
+            return false;
+        }
+
+        std::vector<NodePtr> garbage;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            auto &channel = index_[channelKey(e.ip, e.devId)];
+            for (auto iter = channel.begin(); iter != channel.end();) {
+                RecordCacheEntry &old = iter->second->entry;
+                if (old.startTime >= e.startTime && old.endTime <= e.endTime) {
+                    NodePtr node = iter->second;
+                    iter         = channel.erase(iter);
+                    drop(node, garbage);
+                } else {
+                    ++iter;
+                }
+            }
+
+            insert(e);
+            storedBytes_ += e.bytes;
+            evict(garbage);
+            LOG_INFO("Recording cached, {}, bytes {}, total {}", e.id, e.bytes, totalBytes_);
+        }
+        purge(garbage);
+        return true;
+    }
+
+    // 持有mutex_时调用
+    void insert(const RecordCacheEntry &e) {
+        NodePtr node(new Node());
+        node->entry = e;
+        lru_.push_front(node);
+        node->lru = lru_.begin();
+        index_[channelKey(e.ip, e.devId)].insert(std::make_pair(e.startTime, node));
+        totalBytes_ += e.bytes;
+    }
+
+    // 持有mutex_时调用，只从内存中移除，索引和文件由purge在锁外删除
+    void drop(NodePtr node, std::vector<NodePtr> &garbage) {
+        lru_.erase(node->lru);
+        totalBytes_ -= node->entry.bytes;
+        node->dropped = true;
+        garbage.push_back(node);
+    }
+
+    // 已经打开的文件删除后仍然可以读完
+    void purge(const std::vector<NodePtr> &garbage) {
+        for (auto &node : garbage) {
+            store_->Delete(metaKey(node->entry.id), true);
+            unlink(filePath(node->entry.id).c_str());
+        }
+    }
+
+    // 持有mutex_时调用，只更新内存中的淘汰顺序，最近访问时间由写入线程批量写入索引，丢失只影响重启后的淘汰顺序
+    void touch(NodePtr node) {
+        lru_.splice(lru_.begin(), lru_, node->lru);
+        node->entry.lastAccess = TimeTool::now_to_seconds();
+        if (!node->touched) {
+            node->touched = true;
+            touched_.push_back(node);
+        }
+    }
+
+    // 在写入线程中调用，删除缓存段也只在写入线程中进行，写入的索引不会复活已经删除的缓存段
+    void flushTouched() {
+        std::vector<std::pair<std::string, std::string>> values;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            for (auto &node : touched_) {
+                node->touched = false;
+                if (!node->dropped) {
+                    values.push_back(std::make_pair(metaKey(node->entry.id), toValue(node->entry)));
+                }
+            }
+            touched_.clear();
+        }
+        for (auto &v : values) {
+            store_->Put(v.first, v.second);
+        }
+    }
+
+    // 持有mutex_时调用
+    void evict(std::vector<NodePtr> &garbage) {
+        while (totalBytes_ > (uint64_t)FLAGS_vod_cache_max_bytes && !lru_.empty()) {
+            NodePtr node = lru_.back();
+            auto channel = index_.find(channelKey(node->entry.ip, node->entry.devId));
+            if (channel != index_.end()) {
+                auto range = channel->second.equal_range(node->entry.startTime);
+                for (auto iter = range.first; iter != range.second; ++iter) {
+                    if (iter->second == node) {
+                        channel->second.erase(iter);
+                        break;
+                    }
+                }
+                if (channel->second.empty()) {
+                    index_.erase(channel);
+                }
+            }
+            LOG_INFO("Recording cache evicted {}, bytes {}", node->entry.id, node->entry.bytes);
+            drop(node, garbage);
+            evictions_++;
+        }
+    }
+
+    // 启动时恢复索引：文件缺失或大小不一致的索引删除，没有索引的文件删除
+    void load() {
+        std::string path;
+        for (auto &c : FLAGS_vod_cache_dir + "/") {
+            if (c == '/' && !path.empty()) {
+                mkdir(path.c_str(), 0755);
+            }
+            path.push_back(c);
+        }
+        store_.reset(new sdk::MetaDataStore(FLAGS_vod_cache_dir + "/index"));
+
+        std::vector<RecordCacheEntry> entries;
+        std::vector<std::string> invalid;
+        store_->Scan("vodcache/", [&](const std::string &key, const std::string &value) {
+            RecordCacheEntry e;
+            e.id = key.substr(strlen("vodcache/"));
+            try {
+                json j       = json::parse(value);
+                e.ip         = j["ip"].get<std::string>();
+                e.devId      = j["devId"].get<std::string>();
+                e.startTime  = j["startTime"].get<time_t>();
+                e.endTime    = j["endTime"].get<time_t>();
+                e.bytes      = j["bytes"].get<uint64_t>();
+                e.lastAccess = j["lastAccess"].get<uint64_t>();
+            } catch (const std::exception &ex) {
+                invalid.push_back(key);
+                return true;
+            }
+            struct stat st;
+            if (stat(filePath(e.id).c_str(), &st) != 0 || (uint64_t)st.st_size != e.bytes) {
+                invalid.push_back(key);
+                return true;
+            }
+            entries.push_back(e);
+            return true;
+        });
+        for (auto &key : invalid) {
+            LOG_ERROR("Drop invalid recording cache entry {}", key);
+            store_->Delete(key);
+        }
+
+        // 按最近访问时间恢复淘汰顺序
+        std::sort(entries.begin(), entries.end(), [](const RecordCacheEntry &a, const RecordCacheEntry &b) { return a.lastAccess < b.lastAccess; });
+        std::set<std::string> known;
+        for (auto &e : entries) {
+            insert(e);
+            known.insert(e.id + ".dat");
+        }
+
+        DIR *dir = opendir(FLAGS_vod_cache_dir.c_str());
+        if (nullptr != dir) {
+            struct dirent *d;
+            while (nullptr != (d = readdir(dir))) {
+                std::string name = d->d_name;
+                bool data        = name.size() > 4 && name.compare(name.size() - 4, 4, ".dat") == 0;
+                bool tmp         = name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0;
+                if ((data && known.count(name) == 0) || tmp) {
+                    unlink((FLAGS_vod_cache_dir + "/" + name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+
+        std::vector<NodePtr> garbage;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            evict(garbage);
+            LOG_INFO("Recording cache loaded from {}, entries {}, bytes {}, invalid {}", FLAGS_vod_cache_dir, lru_.size(), totalBytes_, invalid.size());
+        }
+        purge(garbage);
+    }
+
+private:
+    std::unique_ptr<sdk::MetaDataStore> store_;
+    std::map<std::string, std::multimap<time_t, NodePtr>> index_; // 通道 -> 开始时间 -> 缓存段
+    std::list<NodePtr> lru_;
+    std::vector<NodePtr> touched_;
+    uint64_t totalBytes_;
+    uint64_t lookups_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> servedBytes_;
+    std::atomic<uint64_t> fetchedBytes_;
+    uint64_t storedBytes_;
+    uint64_t evictions_;
+    std::atomic<uint64_t> nextTmp_;
+    std::mutex mutex_;
+    // 写入线程
+    std::thread writer_;
+    std::mutex writeMutex_;
+    std::condition_variable writeCond_;
+    std::deque<WriteOp> ops_;
+    bool stopping_;
+    uint64_t queuedBytes_;
+    uint64_t skipped_;
+};
+
+inline RecordCache &RECORD_CACHE() {
+    return Singleton<RecordCache>::getInstance();
+}
+
+inline void RecordCacheWriter::Write(const uint8_t *buffer, int32_t len) {
+    std::unique_lock<std::mutex> lck(mutex_);
+    if (done_ || failed_ || len <= 0) {
+        return;
+    }
+    // 单段超过预算的一半时不再缓存
+    if (entry_.bytes + len > (uint64_t)FLAGS_vod_cache_max_bytes / 2) {
+        failed_ = true;
+        return;
+    }
+    RecordCache::WriteOp op;
+    op.writer = shared_from_this();
+    op.kind   = RecordCache::WRITE_DATA;
+    op.data.assign((const char *)buffer, len);
+    if (!cache_->enqueue(op)) {
+        LOG_ERROR("Recording cache write queue is full, do not cache {}", entry_.id);
+        failed_ = true;
+        return;
+    }
+    entry_.bytes += len;
+}
+
+inline void RecordCacheWriter::Commit() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    if (done_) {
+        return;
+    }
+    done_ = true;
+    RecordCache::WriteOp op;
+    op.writer = shared_from_this();
+    op.kind   = failed_ || 0 == entry_.bytes ? RecordCache::WRITE_ABORT : RecordCache::WRITE_COMMIT;
+    op.entry  = entry_;
+    cache_->enqueue(op);
+}
+
+inline void RecordCacheWriter::Abort() {
+    std::unique_lock<std::mutex> lck(mutex_);
+    if (done_) {
+        return;
+    }
+    done_ = true;
+    RecordCache::WriteOp op;
+    op.writer = shared_from_this();
+    op.kind   = RecordCache::WRITE_ABORT;
+    cache_->enqueue(op);
+}
+
+inline void RecordCacheWriter::doWrite(const std::string &data) {
+    if (fd_ < 0 || ioFailed_) {
+        return;
+    }
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = write(fd_, data.data() + off, data.size() - off);
+        if (n <= 0) {
+            LOG_ERROR("Failed to write recording cache file {}, errno {}", path_, errno);
+            ioFailed_ = true;
+            return;
+        }
+        off += n;
+    }
+}
+
+inline void RecordCacheWriter::doCommit(const RecordCacheEntry &entry) {
+    if (fd_ < 0) {
+        return;
+    }
+    bool ok = !ioFailed_ && 0 == fsync(fd_);
+    close(fd_);
+    fd_ = -1;
+    if (!ok || !cache_->commit(path_, entry)) {
+        unlink(path_.c_str());
+    }
+}
+
+} // namespace sdkproxy
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+
+#include <gflags/gflags.h>
+#include <bthread/mutex.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+#include "3rdsdk/stub/sdk_stub.h"
+
+DEFINE_bool(vod_record_index_enable, true, "Answer record queries from an in-memory per-channel index, only querying the nvr for missing ranges");
+DEFINE_int32(vod_record_index_ttl_s, 600, "Indexed historical ranges older than this are queried again on the next request");
+DEFINE_int32(vod_record_index_tail_s, 300, "The last seconds before a query are never considered complete, recordings there may still grow");
+DEFINE_int32(vod_record_index_tail_refresh_s, 5, "Min interval between two queries of the tail of one channel");
+DEFINE_int32(vod_record_index_max_records, 200000, "Max records kept in the index, least recently used channels are dropped");
+
+namespace sdkproxy {
+
+typedef struct tagRecordIndexStats {
+    uint64_t queries;
+    uint64_t hits; // 完全由索引回答，没有查询nvr
+    uint64_t nvrQueries;
+    uint64_t records;
+    uint64_t channels;
+    uint64_t evictions;
+} RecordIndexStats;
+
+// 一个通道的录像索引，covered记录已经查询过的时间段和查询时间，records按开始时间排序
+// 查询nvr时持有mutex，同一通道的其他查询在bthread中等待，不占住brpc的工作线程
+typedef struct tagChannelRecordIndex {
+    typedef struct tagCoverage {
+        time_t to;
+        uint64_t fetchedAt;
+    } Coverage;
+
+    typedef struct tagEntry {
+        time_t endTime;
+        sdk::RecordInfo info;
+    } Entry;
+
+    bthread::Mutex mutex;
+    std::map<std::pair<time_t, std::string>, Entry> records; // (开始时间, 文件名) -> 录像
+    std::map<time_t, Coverage> covered;                      // 开始 -> 结束和查询时间，互不重叠
+    time_t tailFrom;                                         // 最近一次查询的末尾，之后的录像可能还在增长
+    uint64_t tailFetchedAt;
+    uint64_t version; // 录像有变化时更新，淘汰后重建的索引也不会重复
+    bool evicted;     // 已经被淘汰，持有mutex时读写
+    std::atomic<uint64_t> lastAccess;
+    std::atomic<size_t> size;
+
+    tagChannelRecordIndex() : tailFrom(0), tailFetchedAt(0), version(0), evicted(false), lastAccess(0), size(0) {}
+} ChannelRecordIndex;
+
+// 按(nvr, 通道)缓存录像查询结果，时间轴界面反复查询同一通道时只向nvr查询索引中缺少的时间段
+// 已经查过的历史时间段超过ttl后再次访问时重新查询，最近tail_s秒的录像可能还在写，每次按间隔重新查询
+// 录像总数超过上限时淘汰最久没有访问的通道
+class RecordIndex {
+public:
+    enum {
+        MAX_RECORD_SECONDS = 86400, // 录像最长按一天计算，从更早的开始时间找与时间段重叠的录像
+    };
+
+    RecordIndex() : totalRecords_(0), queries_(0), hits_(0), nvrQueries_(0), evictions_(0), versions_(0) {}
+
+    // 与SdkStub::FindRecord相同，按开始时间顺序回调与[startTime, endTime]重叠的录像，refresh为true时忽略已有的索引
+    // version返回结果对应的索引版本
+    int32_t Find(std::shared_ptr<sdk::SdkStub> sdk, const std::string &ip, const std::string &devId, const sdk::TimePoint &startTime,
+                 const sdk::TimePoint &endTime, sdk::SdkStub::OnRecord onRecord, bool refresh = false, uint64_t *version = nullptr) {
+        if (!FLAGS_vod_record_index_enable) {
+            return sdk->FindRecord(devId, startTime, endTime, onRecord);
+        }
+
+        queries_++;
+        std::shared_ptr<ChannelRecordIndex> index;
+        time_t start = startTime.ToTime();
+        time_t end   = endTime.ToTime();
+        std::vector<sdk::RecordInfo> result;
+        {
+            // 取到通道和加锁之间可能被淘汰，淘汰后的索引不再计入录像总数，重新取一次
+            std::unique_lock<bthread::Mutex> lck;
+            do {
+                index = channel(ip + "_" + devId);
+                lck   = std::unique_lock<bthread::Mutex>(index->mutex);
+            } while (index->evicted);
+            std::vector<std::pair<time_t, time_t>> missing = refresh ? std::vector<std::pair<time_t, time_t>>(1, std::make_pair(start, end))
+                                                                     : findMissing(*index, start, end);
+            if (missing.empty()) {
+                hits_++;
+            }
+            for (auto &m : missing) {
+                int32_t ret = fetch(sdk, *index, devId, m.first, m.second);
+                if (0 != ret) {
+                    return ret;
+                }
+            }
+            collect(*index, start, end, result);
+            if (nullptr != version) {
+                *version = index->version;
+            }
+        }
+        evict(index);
+
+        for (auto &r : result) {
+            if (!onRecord(r)) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    int32_t Query(std::shared_ptr<sdk::SdkStub> sdk, const std::string &ip, const std::string &devId, const sdk::TimePoint &startTime,
+                  const sdk::TimePoint &endTime, std::vector<sdk::RecordInfo> &records) {
+        return Find(sdk, ip, devId, startTime, endTime, [&records](const sdk::RecordInfo &r) {
+            records.push_back(r);
+            return true;
+        });
+    }
+
+    // [startTime, endTime]不需要查询nvr时返回true和当前的索引版本，版本不变时结果也不变
+    bool IsCached(const std::string &ip, const std::string &devId, const sdk::TimePoint &startTime, const sdk::TimePoint &endTime,
+                  uint64_t &version) {
+        if (!FLAGS_vod_record_index_enable) {
+            return false;
+        }
+        std::shared_ptr<ChannelRecordIndex> index;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            auto iter = channels_.find(ip + "_" + devId);
+            if (iter == channels_.end()) {
+                return false;
+            }
+            index = iter->second;
+        }
+        std::unique_lock<bthread::Mutex> lck(index->mutex);
+        if (!findMissing(*index, startTime.ToTime(), endTime.ToTime()).empty()) {
+            return false;
+        }
+        version = index->version;
+        return true;
+    }
+
+    RecordIndexStats Stats() {
+        RecordIndexStats s;
+        s.queries    = queries_;
+        s.hits       = hits_;
+        s.nvrQueries = nvrQueries_;
+        s.records    = totalRecords_;
+        s.evictions  = evictions_;
+        std::unique_lock<std::mutex> lck(mutex_);
+        s.channels = channels_.size();
+        return s;
+    }
+
+private:
+    std::shared_ptr<ChannelRecordIndex> channel(const std::string &key) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        std::shared_ptr<ChannelRecordIndex> &index = channels_[key];
+        if (nullptr == index) {
+            index          = std::make_shared<ChannelRecordIndex>();
+            index->version = ++versions_;
+        }
+        index->lastAccess = TimeTool::now_to_ms();
+        return index;
+    }
+
+    // 持有通道的锁时调用，返回[start, end]中没有查询过、已经过期或者需要刷新的尾部
+    static std::vector<std::pair<time_t, time_t>> findMissing(ChannelRecordIndex &index, time_t start, time_t end) {
+        std::vector<std::pair<time_t, time_t>> missing;
+        uint64_t now  = TimeTool::now_to_ms();
+        uint64_t ttl  = (uint64_t)FLAGS_vod_record_index_ttl_s * 1000;
+        time_t cursor = start;
+
+        auto iter = index.covered.upper_bound(start);
+        if (iter != index.covered.begin()) {
+            --iter;
+        }
+        for (; iter != index.covered.end() && iter->first < end && cursor < end; ++iter) {
+            if (iter->second.to <= cursor) {
+                continue;
+            }
+            if (iter->first > cursor) {
+                missing.push_back(std::make_pair(cursor, iter->first));
+            }
+            if (now - iter->second.fetchedAt > ttl) {
+                missing.push_back(std::make_pair(std::max(cursor, iter->first), std::min(end, iter->second.to)));
+            }
+            cursor = std::min(end, iter->second.to);
+        }
+        if (cursor < end) {
+            // 尾部在刷新间隔内已经查询过
+            bool fresh = cursor >= index.tailFrom && index.tailFetchedAt > 0
+                         && now - index.tailFetchedAt < (uint64_t)FLAGS_vod_record_index_tail_refresh_s * 1000;
+            if (!fresh) {
+                missing.push_back(std::make_pair(cursor, end));
+            }
+        }
+
+        // 合并相邻的时间段，减少查询次数
+        std::vector<std::pair<time_t, time_t>> merged;
+        for (auto &m : missing) {
+            if (!merged.empty() && merged.back().second >= m.first) {
+                merged.back().second = std::max(merged.back().second, m.second);
+            } else {
+                merged.push_back(m);
+            }
+        }
+        return merged;
+    }
+
+    // 持有通道的锁时调用，查询成功后替换这个时间段内的录像
+    int32_t fetch(std::shared_ptr<sdk::SdkStub> sdk, ChannelRecordIndex &index, const std::string &devId, time_t from, time_t to) {
+        std::vector<sdk::RecordInfo> found;
+        sdk::TimePoint a, b;
+        a.FromTime(from);
+        b.FromTime(to);
+        nvrQueries_++;
+        int32_t ret = sdk->FindRecord(devId, a, b, [&found](const sdk::RecordInfo &r) {
+            found.push_back(r);
+            return true;
+        });
+        if (0 != ret) {
+            LOG_ERROR("Failed to query record for index, dev {}, {} - {}, ret {}", devId, a.ToString(), b.ToString(), ret);
+            return ret;
+        }
+
+        // 与这个时间段有重叠的录像以新的结果为准，包括在from之前开始的录像，nvr循环覆盖删除的录像也随之删除
+        auto first = index.records.lower_bound(std::make_pair(from - MAX_RECORD_SECONDS, std::string()));
+        auto last  = index.records.lower_bound(std::make_pair(to, std::string()));
+        if (changed(index.records, first, last, found, from, to)) {
+            index.version = ++versions_;
+        }
+        for (auto iter = first; iter != last;) {
+            if (overlaps(iter->first.first, iter->second.endTime, from, to)) {
+                iter = index.records.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        for (auto &r : found) {
+            ChannelRecordIndex::Entry e;
+            e.endTime = r.endTime.ToTime();
+            e.info    = r;
+            index.records[std::make_pair(r.startTime.ToTime(), r.fileName)] = e;
+        }
+        totalRecords_ += index.records.size();
+        totalRecords_ -= index.size;
+        index.size = index.records.size();
+
+        // 最近tail_s秒的录像可能还在增长，不算查询过
+        uint64_t now = TimeTool::now_to_ms();
+        time_t edge  = (time_t)(now / 1000) - FLAGS_vod_record_index_tail_s;
+        if (to > edge) {
+            index.tailFrom      = std::max(from, edge);
+            index.tailFetchedAt = now;
+        }
+        if (std::min(to, edge) > from) {
+            cover(index, from, std::min(to, edge), now);
+        }
+        return 0;
+    }
+
+    // 录像与[from, to)有重叠，在from之前开始、结束在from之后的也算
+    static bool overlaps(time_t startTime, time_t endTime, time_t from, time_t to) { return startTime < to && (startTime >= from || endTime > from); }
+
+    // 新查到的与[from, to)重叠的录像与索引中与[from, to)重叠的录像是否不同，索引中只需要看[first, last)
+    // 在from之前开始、还在增长的录像结束时间变化时也算变化
+    static bool changed(const std::map<std::pair<time_t, std::string>, ChannelRecordIndex::Entry> &records,
+                        std::map<std::pair<time_t, std::string>, ChannelRecordIndex::Entry>::const_iterator first,
+                        std::map<std::pair<time_t, std::string>, ChannelRecordIndex::Entry>::const_iterator last,
+                        const std::vector<sdk::RecordInfo> &found, time_t from, time_t to) {
+        size_t count = 0;
+        for (auto &r : found) {
+            time_t startTime = r.startTime.ToTime();
+            if (!overlaps(startTime, r.endTime.ToTime(), from, to)) {
+                continue;
+            }
+            count++;
+            auto iter = records.find(std::make_pair(startTime, r.fileName));
+            if (iter == records.end() || iter->second.endTime != r.endTime.ToTime() || iter->second.info.fileSize != r.fileSize) {
+                return true;
+            }
+        }
+        for (auto iter = first; iter != last; ++iter) {
+            if (overlaps(iter->first.first, iter->second.endTime, from, to) && 0 == count--) {
+                return true;
+            }
+        }
+        return 0 != count;
+    }
+
+    // 持有通道的锁时调用，把[from, to]标记为在now查询过，截断重叠的时间段
+    // 相邻并且都没有过期的时间段合并，取较早的查询时间，避免尾部的多次查询产生碎片
+    static void cover(ChannelRecordIndex &index, time_t from, time_t to, uint64_t now) {
+        auto &covered = index.covered;
+        auto iter     = covered.lower_bound(from);
+        if (iter != covered.begin()) {
+            auto prev = std::prev(iter);
+            if (prev->second.to > to) {
+                covered[to] = prev->second;
+            }
+            if (prev->second.to >= from) {
+                prev->second.to = from;
+            }
+        }
+        while (iter != covered.end() && iter->first < to) {
+            if (iter->second.to > to) {
+                covered[to] = iter->second;
+            }
+            iter = covered.erase(iter);
+        }
+
+        uint64_t ttl                   = (uint64_t)FLAGS_vod_record_index_ttl_s * 1000;
+        ChannelRecordIndex::Coverage c = {to, now};
+        iter                           = covered.insert(std::make_pair(from, c)).first;
+        // 与前后相邻的时间段合并
+        if (iter != covered.begin()) {
+            auto prev = std::prev(iter);
+            if (prev->second.to == from && now - prev->second.fetchedAt <= ttl) {
+                prev->second.to        = iter->second.to;
+                prev->second.fetchedAt = std::min(prev->second.fetchedAt, iter->second.fetchedAt);
+                covered.erase(iter);
+                iter = prev;
+            }
+        }
+        auto next = std::next(iter);
+        if (next != covered.end() && next->first == iter->second.to && now - next->second.fetchedAt <= ttl) {
+            iter->second.to        = next->second.to;
+            iter->second.fetchedAt = std::min(iter->second.fetchedAt, next->second.fetchedAt);
+            covered.erase(next);
+        }
+    }
+
+    // 持有通道的锁时调用
+    static void collect(ChannelRecordIndex &index, time_t start, time_t end, std::vector<sdk::RecordInfo> &result) {
+        auto iter = index.records.lower_bound(std::make_pair(start - MAX_RECORD_SECONDS, std::string()));
+        for (; iter != index.records.end() && iter->first.first <= end; ++iter) {
+            if (iter->second.endTime >= start) {
+                result.push_back(iter->second.info);
+            }
+        }
+    }
+
+    // 录像总数超过上限时淘汰最久没有访问的通道，不淘汰正在使用的通道
+    void evict(std::shared_ptr<ChannelRecordIndex> current) {
+        while (totalRecords_ > (uint64_t)FLAGS_vod_record_index_max_records) {
+            std::shared_ptr<ChannelRecordIndex> victim;
+            std::string key;
+            {
+                std::unique_lock<std::mutex> lck(mutex_);
+                for (auto &p : channels_) {
+                    if (p.second != current && (nullptr == victim || p.second->lastAccess < victim->lastAccess)) {
+                        victim = p.second;
+                        key    = p.first;
+                    }
+                }
+                if (nullptr == victim) {
+                    return;
+                }
+                channels_.erase(key);
+            }
+            std::unique_lock<bthread::Mutex> lck(victim->mutex);
+            totalRecords_ -= victim->size;
+            victim->size    = 0;
+            victim->evicted = true;
+            evictions_++;
+            LOG_INFO("Record index evicted channel {}", key);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<ChannelRecordIndex>> channels_;
+    std::atomic<uint64_t> totalRecords_;
+    std::atomic<uint64_t> queries_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> nvrQueries_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<uint64_t> versions_;
+};
+
+inline RecordIndex &RECORD_INDEX() {
+    return Singleton<RecordIndex>::getInstance();
+}
+
+} // namespace sdkproxy
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+
+#include <gflags/gflags.h>
+#include <brpc/controller.h>
+#include <brpc/policy/gzip_compress.h>
+#include <butil/iobuf.h>
+
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+
+DEFINE_bool(response_cache_enable, true, "Cache serialized responses of catalog and query endpoints");
+DEFINE_int64(response_cache_max_bytes, 64 * 1024 * 1024, "Max bytes of cached responses, plain and gzip bodies together");
+DEFINE_int32(response_cache_gzip_min_bytes, 1024, "Responses smaller than this are not gzip compressed");
+
+namespace sdkproxy {
+
+typedef struct tagCachedResponse {
+    std::string key;
+    uint64_t version;
+    uint64_t expireAt; // 0表示只由版本决定是否有效
+    std::string etag;
+    std::string contentType;
+    butil::IOBuf body;
+    butil::IOBuf gzipBody; // 太小或者压缩后没有变小时为空
+
+    size_t GetBytes() const { return body.size() + gzipBody.size(); }
+} CachedResponse;
+
+typedef struct tagResponseCacheStats {
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t notModified; // 回复304的次数
+    uint64_t gzipped;     // 回复压缩内容的次数
+    uint64_t bytesSaved;  // 因为304和压缩少发送的字节数
+    uint64_t evictions;
+} ResponseCacheStats;
+
+// 保存序列化好的响应，按(请求参数, 内容版本)查找，回复时共享IOBuf的数据块，不复制
+// ETag由响应内容计算，内容没有变化时即使缓存失效重新生成，客户端的If-None-Match仍然命中
+class ResponseCache {
+public:
+    ResponseCache() : bytes_(0), stats_() {}
+
+    std::shared_ptr<const CachedResponse> Get(const std::string &key, uint64_t version) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = entries_.find(key);
+        if (iter == entries_.end()) {
+            stats_.misses++;
+            return nullptr;
+        }
+        std::shared_ptr<const CachedResponse> r = *iter->second;
+        if (r->version != version || (0 != r->expireAt && TimeTool::now_to_ms() >= r->expireAt)) {
+            stats_.misses++;
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, iter->second);
+        stats_.hits++;
+        return r;
+    }
+
+    // 生成响应并在允许缓存时保存，ttlMs为0时只由版本决定是否有效
+    std::shared_ptr<const CachedResponse> Put(const std::string &key, uint64_t version, const std::string &contentType, const std::string &body,
+                                              uint64_t ttlMs = 0) {
+        std::shared_ptr<CachedResponse> r = std::make_shared<CachedResponse>();
+        r->key                            = key;
+        r->version                        = version;
+        r->expireAt                       = 0 == ttlMs ? 0 : TimeTool::now_to_ms() + ttlMs;
+        r->etag                           = makeETag(body);
+        r->contentType                    = contentType;
+        r->body.append(body);
+        if (body.size() >= (size_t)FLAGS_response_cache_gzip_min_bytes) {
+            butil::IOBuf gzip;
+            if (brpc::policy::GzipCompress(r->body, &gzip, nullptr) && gzip.size() < body.size()) {
+                r->gzipBody.swap(gzip);
+            }
+        }
+
+        if (FLAGS_response_cache_enable && (int64_t)r->GetBytes() <= FLAGS_response_cache_max_bytes / 8) {
+            std::unique_lock<std::mutex> lck(mutex_);
+            auto iter = entries_.find(key);
+            if (iter != entries_.end()) {
+                bytes_ -= (*iter->second)->GetBytes();
+                lru_.erase(iter->second);
+            }
+            lru_.push_front(r);
+            entries_[key] = lru_.begin();
+            bytes_ += r->GetBytes();
+            while (bytes_ > (uint64_t)FLAGS_response_cache_max_bytes && !lru_.empty()) {
+                bytes_ -= lru_.back()->GetBytes();
+                entries_.erase(lru_.back()->key);
+                lru_.pop_back();
+                stats_.evictions++;
+            }
+        }
+        return r;
+    }
+
+    // If-None-Match命中时回复304，客户端接受gzip时回复压缩的内容
+    void Reply(brpc::Controller *cntl, std::shared_ptr<const CachedResponse> r) {
+        cntl->http_response().set_content_type(r->contentType);
+        cntl->http_response().SetHeader("ETag", r->etag);
+        cntl->http_response().SetHeader("Cache-Control", "no-cache");
+        cntl->http_response().SetHeader("Vary", "Accept-Encoding");
+
+        const std::string *ifNoneMatch = cntl->http_request().GetHeader("If-None-Match");
+        if (nullptr != ifNoneMatch && matchETag(*ifNoneMatch, r->etag)) {
+            cntl->http_response().set_status_code(brpc::HTTP_STATUS_NOT_MODIFIED);
+            std::unique_lock<std::mutex> lck(mutex_);
+            stats_.notModified++;
+            stats_.bytesSaved += r->body.size();
+            return;
+        }
+
+        const std::string *acceptEncoding = cntl->http_request().GetHeader("Accept-Encoding");
+        if (!r->gzipBody.empty() && nullptr != acceptEncoding && std::string::npos != acceptEncoding->find("gzip")) {
+            cntl->http_response().SetHeader("Content-Encoding", "gzip");
+            cntl->response_attachment().append(r->gzipBody);
+            std::unique_lock<std::mutex> lck(mutex_);
+            stats_.gzipped++;
+            stats_.bytesSaved += r->body.size() - r->gzipBody.size();
+            return;
+        }
+        cntl->response_attachment().append(r->body);
+    }
+
+    ResponseCacheStats Stats() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        ResponseCacheStats s = stats_;
+        s.entries            = entries_.size();
+        s.bytes              = bytes_;
+        return s;
+    }
+
+private:
+    // 同一个ETag对应原始和压缩两种编码，所以是弱ETag
+    static std::string makeETag(const std::string &body) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : body) {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        char etag[32] = {0};
+        snprintf(etag, sizeof(etag), "W/\"%016llx-%zx\"", (unsigned long long)hash, body.size());
+        return etag;
+    }
+
+    // If-None-Match可以是*或者逗号分隔的多个ETag，按弱比较忽略W/前缀
+    static bool matchETag(const std::string &ifNoneMatch, const std::string &etag) {
+        if ("*" == ifNoneMatch) {
+            return true;
+        }
+        std::string opaque = etag.substr(2);
+        size_t pos         = 0;
+        while (std::string::npos != (pos = ifNoneMatch.find(opaque, pos))) {
+            size_t end = pos + opaque.size();
+            if (end == ifNoneMatch.size() || ',' == ifNoneMatch[end] || ' ' == ifNoneMatch[end]) {
+                return true;
+            }
+            pos = end;
+        }
+        return false;
+    }
+
+private:
+    std::mutex mutex_;
+    std::list<std::shared_ptr<const CachedResponse>> lru_;
+    std::unordered_map<std::string, std::list<std::shared_ptr<const CachedResponse>>::iterator> entries_;
+    uint64_t bytes_;
+    ResponseCacheStats stats_;
+};
+
+inline ResponseCache &RESPONSE_CACHE() {
+    return Singleton<ResponseCache>::getInstance();
+}
+
+} // namespace sdkproxy
@@ -0,0 +1,611 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <gflags/gflags.h>
+#include <butil/iobuf.h>
+
+#include "common/helper/logger.h"
+#include "common/media/ts_joiner.h"
+
+#include "3rdsdk/stub/sdk_stub.h"
+
+#include "server/stream/media_ring.h"
+#include "server/stream/stream_reactor.h"
+#include "server/stream/record_cache.h"
+#include "server/stream/download_scheduler.h"
+
+DEFINE_int32(vod_parallel_max_segments, 8, "Max sub-ranges a parallel download is split into");
+DEFINE_int32(vod_parallel_min_segment_s, 30, "Sub-ranges of a parallel download are at least this long");
+DEFINE_int64(vod_parallel_memory_bytes, 8 * 1024 * 1024, "Bytes a sub-range buffers in memory before spilling to disk");
+DEFINE_string(vod_spill_dir, "/tmp", "Directory of the spill files of parallel downloads");
+
+namespace sdkproxy {
+
+// 一个子区间的下载缓冲，sdk回调线程写入，事件循环线程按顺序读出
+// 内存超过上限后后续数据写到临时文件，读者先读内存再读文件
+class SpillBuffer {
+public:
+    explicit SpillBuffer(std::shared_ptr<RingListener> listener)
+        : listener_(listener), fd_(-1), writeOff_(0), readOff_(0), closed_(false), failed_(false), spilledBytes_(0) {}
+
+    ~SpillBuffer() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    // 生产者调用
+    void Append(const uint8_t *buffer, int32_t len) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            if (closed_ || failed_ || len <= 0) {
+                return;
+            }
+            if (fd_ < 0 && mem_.size() + len <= (size_t)FLAGS_vod_parallel_memory_bytes) {
+                mem_.append(buffer, len);
+            } else if (!spill(buffer, len)) {
+                failed_ = true;
+            }
+        }
+        listener_->Notify();
+    }
+
+    // 生产者调用，数据已全部写入
+    void Close() {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            closed_ = true;
+        }
+        listener_->Notify();
+    }
+
+    // 直接读一个已经写完的文件，例如录像缓存，从offset开始读，接管fd
+    void Load(int fd, uint64_t size, uint64_t offset) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            fd_       = fd;
+            writeOff_ = size;
+            readOff_  = std::min(offset, size);
+            closed_   = true;
+        }
+        listener_->Notify();
+    }
+
+    // 消费者调用，返回追加的字节数，-1表示已经读完
+    int Read(butil::IOBuf &out, size_t maxBytes) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        if (!mem_.empty()) {
+            return (int)mem_.cutn(&out, maxBytes);
+        }
+        if (readOff_ < writeOff_) {
+            return readFile(out, maxBytes);
+        }
+        return closed_ ? -1 : 0;
+    }
+
+    // 丢弃还没有读出的最多n个字节，返回丢弃的字节数
+    uint64_t Discard(uint64_t n) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        uint64_t m = mem_.pop_front(std::min<uint64_t>(n, mem_.size()));
+        uint64_t f = std::min<uint64_t>(n - m, writeOff_ - readOff_);
+        readOff_ += f;
+        return m + f;
+    }
+
+    bool IsFailed() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return failed_;
+    }
+
+    // 生产者已经写完，数据可能还没有读完
+    bool IsClosed() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return closed_;
+    }
+
+    uint64_t GetSpilledBytes() const { return spilledBytes_; }
+
+private:
+    // 持有mutex_时调用，临时文件创建后立即删除，关闭时自动回收
+    bool spill(const uint8_t *buffer, int32_t len) {
+        if (fd_ < 0) {
+            std::string path = FLAGS_vod_spill_dir + "/sdkproxy_spill_XXXXXX";
+            std::vector<char> tmpl(path.begin(), path.end());
+            tmpl.push_back('\0');
+            fd_ = mkstemp(tmpl.data());
+            if (fd_ < 0) {
+                LOG_ERROR("Failed to create spill file in {}, errno {}", FLAGS_vod_spill_dir, errno);
+                return false;
+            }
+            unlink(tmpl.data());
+        }
+        int32_t off = 0;
+        while (off < len) {
+            ssize_t n = pwrite(fd_, buffer + off, len - off, writeOff_);
+            if (n <= 0) {
+                LOG_ERROR("Failed to write spill file, errno {}", errno);
+                return false;
+            }
+            off += n;
+            writeOff_ += n;
+        }
+        spilledBytes_ += len;
+        return true;
+    }
+
+    // 持有mutex_时调用，读到池化的内存块中
+    int readFile(butil::IOBuf &out, size_t maxBytes) {
+        size_t total = 0;
+        while (readOff_ < writeOff_ && total < maxBytes) {
+            MediaBlock *b = MEDIA_BLOCK_POOL().Alloc();
+            if (nullptr == b) {
+                break;
+            }
+            size_t want = std::min<size_t>(b->cap, writeOff_ - readOff_);
+            ssize_t n   = pread(fd_, b->Data(), want, readOff_);
+            if (n <= 0) {
+                LOG_ERROR("Failed to read spill file, errno {}", errno);
+                MEDIA_BLOCK_POOL().Free(b);
+                failed_ = true;
+                break;
+            }
+            b->len = n;
+            out.append_user_data(b->Data(), b->len, MediaBlockPool::FreeData);
+            readOff_ += n;
+            total += n;
+        }
+        return (int)total;
+    }
+
+private:
+    std::shared_ptr<RingListener> listener_;
+    std::mutex mutex_;
+    butil::IOBuf mem_;
+    int fd_;
+    uint64_t writeOff_;
+    uint64_t readOff_;
+    bool closed_;
+    bool failed_;
+    std::atomic<uint64_t> spilledBytes_;
+};
+
+// 子区间在sdk调用线程中启动的结果，done之后事件循环线程才读取其他字段
+typedef struct tagSegmentStart {
+    std::atomic<bool> done;
+    int32_t ret;
+    intptr_t jobId;
+    int32_t speed; // 实际生效的倍速
+    std::shared_ptr<RecordCacheWriter> writer;
+
+    tagSegmentStart() : done(false), ret(0), jobId(0), speed(1) {}
+} SegmentStart;
+
+typedef struct tagDownloadSegment {
+    sdk::TimePoint startTime;
+    sdk::TimePoint endTime;
+    bool started;
+    bool starting; // 启动调用还没有返回
+    bool stopped;
+    bool cached;   // 从录像缓存读，不占用nvr的会话
+    bool served;   // 缓存段已经开始输出，用于统计命中
+    uint64_t size; // 缓存段输出的字节数
+    std::shared_ptr<SpillBuffer> buffer;
+    std::shared_ptr<SegmentStart> start;
+    std::shared_ptr<SdkCallStrand> calls;
+    DownloadTicketPtr ticket; // nvr会话的排队凭证
+
+    tagDownloadSegment() : started(false), starting(false), stopped(false), cached(false), served(false), size(0) {}
+} DownloadSegment;
+
+// 分段并行下载：按录像文件边界把时间段切成若干子区间，每个子区间一个sdk下载任务
+// 子区间并发下载到各自的缓冲，输出严格按时间顺序，除Stop外只在事件循环线程中调用
+// 开启录像缓存时每个子区间先查缓存，命中的部分从磁盘读，只下载空档，下载完成的空档写入缓存
+// sdk的启动和停止在SDK_CALL_POOL中进行，完成后通知事件循环，子区间下载完成时立即停止并释放nvr的会话，不等读完
+// 每个子区间是独立的TS时用TsJoiner拼接，连续计数器和时间戳在子区间之间保持连续
+class SegmentedDownload {
+public:
+    typedef std::pair<time_t, time_t> Range;
+
+    SegmentedDownload(std::shared_ptr<sdk::SdkStub> sdk, const std::string &ip, const std::string &devId, const std::vector<Range> &ranges)
+        : sdk_(sdk), ip_(ip), devId_(devId), listener_(std::make_shared<RingListener>()), cur_(0), running_(0), failed_(false), skip_(0),
+          cachedCount_(0), cachedBytes_(0), priority_(PRIORITY_INTERACTIVE), speed_(1), joinMode_(JOIN_UNKNOWN), joinedSegment_(0) {
+        for (auto &r : ranges) {
+            for (auto &p : RECORD_CACHE().Plan(ip, devId, r.first, r.second)) {
+                DownloadSegment s;
+                s.startTime.FromTime(p.startTime);
+                s.endTime.FromTime(p.endTime);
+                s.buffer = std::make_shared<SpillBuffer>(listener_);
+                s.calls  = std::make_shared<SdkCallStrand>();
+                if (p.fd >= 0) {
+                    uint64_t offset = segments_.empty() ? 0 : headerSize(p.fd);
+                    s.cached        = true;
+                    s.started       = true;
+                    s.stopped       = true;
+                    s.size          = p.bytes - std::min(offset, p.bytes);
+                    s.buffer->Load(p.fd, p.bytes, offset);
+                    contentTag(p.fd, p.bytes);
+                    cachedCount_++;
+                    cachedBytes_ += p.bytes;
+                }
+                segments_.push_back(s);
+            }
+        }
+        // 让事件循环立即回调一次，启动没能立即启动的子区间
+        listener_->Notify();
+    }
+
+    ~SegmentedDownload() { Stop(); }
+
+    // 在[startTime, endTime]内按录像文件的边界切成最多n个时长接近的子区间
+    static std::vector<Range> Split(const std::vector<sdk::RecordInfo> &records, time_t startTime, time_t endTime, int32_t n) {
+        std::vector<time_t> bounds;
+        for (auto &r : records) {
+            time_t b[] = {r.startTime.ToTime(), r.endTime.ToTime()};
+            for (time_t t : b) {
+                if (t > startTime && t < endTime) {
+                    bounds.push_back(t);
+                }
+            }
+        }
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+        // 每个理想切分点取最近的文件边界
+        std::vector<Range> ranges;
+        time_t from    = startTime;
+        time_t minimum = std::max(FLAGS_vod_parallel_min_segment_s, 1);
+        for (int32_t k = 1; k < n; k++) {
+            time_t ideal = startTime + (endTime - startTime) * k / n;
+            time_t best  = 0;
+            for (time_t b : bounds) {
+                if (b - from >= minimum && endTime - b >= minimum && (0 == best || std::abs(b - ideal) < std::abs(best - ideal))) {
+                    best = b;
+                }
+            }
+            if (0 == best) {
+                continue;
+            }
+            ranges.push_back(Range(from, best));
+            from = best;
+        }
+        ranges.push_back(Range(from, endTime));
+        return ranges;
+    }
+
+    int GetNotifyFd() const { return listener_->fd; }
+
+    size_t GetSegmentCount() const { return segments_.size(); }
+
+    size_t GetCachedCount() const { return cachedCount_; }
+
+    uint64_t GetCachedBytes() const { return cachedBytes_; }
+
+    // 全部从缓存读时输出的总字节数已知，否则返回-1
+    int64_t GetTotalBytes() const {
+        uint64_t total = 0;
+        for (auto &s : segments_) {
+            if (!s.cached) {
+                return -1;
+            }
+            total += s.size;
+        }
+        return (int64_t)total;
+    }
+
+    // 缓存文件内容的标识，由各缓存文件的inode、修改时间和大小组成，缓存段被淘汰后重新下载时会变化
+    // 只在GetTotalBytes()>=0即全部从缓存读时有意义
+    const std::string &GetContentTag() const { return contentTag_; }
+
+    // 排队申请nvr会话时用于公平调度的客户端和优先级，在Pump之前调用
+    void SetOwner(const std::string &client, DownloadPriority priority) {
+        client_   = client;
+        priority_ = priority;
+    }
+
+    // 请求nvr按speed倍速下载每个子区间，在Pump之前调用
+    void SetSpeed(int32_t speed) { speed_ = speed; }
+
+    // 正在输出的子区间在nvr上的排队情况，没有在排队时返回false
+    bool GetQueueInfo(DownloadQueueInfo &info) const {
+        if (!IsWaiting() || nullptr == segments_[cur_].ticket) {
+            return false;
+        }
+        info = DOWNLOAD_SCHEDULER().GetQueueInfo(segments_[cur_].ticket);
+        return true;
+    }
+
+    // 断点续传时跳过输出的前n个字节，只在全部从缓存读时使用
+    void Skip(uint64_t n) { skip_ = n; }
+
+    bool IsFailed() const { return failed_; }
+
+    // 正在输出的子区间还在等待nvr的会话
+    bool IsWaiting() const { return cur_ < segments_.size() && !segments_[cur_].started; }
+
+    // 正在输出的子区间已经获得会话，sdk的启动调用还没有返回
+    bool IsStarting() const { return cur_ < segments_.size() && segments_[cur_].starting; }
+
+    bool HasPending() const {
+        for (size_t i = cur_; i < segments_.size(); i++) {
+            if (!segments_[i].started) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 按时间顺序为后面的子区间申请nvr的会话，由调度器排队，授予后启动
+    // 处理已经返回的启动调用，下载完成的子区间停止sdk下载并归还会话
+    void Pump() {
+        for (size_t i = cur_; i < segments_.size() && !failed_; i++) {
+            DownloadSegment &s = segments_[i];
+            if (s.starting && s.start->done.load(std::memory_order_acquire)) {
+                started(i);
+            }
+            if (s.started && !s.starting && !s.stopped && s.buffer->IsClosed()) {
+                finish(s);
+            }
+            if (s.started) {
+                continue;
+            }
+            if (nullptr == s.ticket) {
+                std::shared_ptr<RingListener> listener = listener_;
+                s.ticket = DOWNLOAD_SCHEDULER().Acquire(ip_, client_, priority_, [listener]() { listener->Notify(); });
+            }
+            if (s.ticket->IsGranted()) {
+                start(i);
+            } else if (s.ticket->IsExpired()) {
+                LOG_ERROR("Parallel download segment {} - {} waited too long for a session on {}", s.startTime.ToString(), s.endTime.ToString(), ip_);
+                failed_ = true;
+                listener_->Notify();
+            }
+        }
+    }
+
+    // 返回追加的字节数，-1表示全部读完，-2表示出错，当前子区间没有数据时返回0
+    // 断点续传跳过的数据在拼接TS时也要经过TsJoiner，保证之后的连续计数器和时间戳正确
+    int Read(butil::IOBuf &out, size_t maxBytes) {
+        listener_->Consume();
+        while (cur_ < segments_.size() && !failed_) {
+            DownloadSegment &s = segments_[cur_];
+            if (!s.started || s.starting) {
+                return 0;
+            }
+            if (s.buffer->IsFailed()) {
+                LOG_ERROR("Parallel download failed to buffer segment {}, {} - {}", cur_, s.startTime.ToString(), s.endTime.ToString());
+                failed_ = true;
+                break;
+            }
+            if (skip_ > 0 && JOIN_PASS == joinMode_) {
+                skip_ -= s.buffer->Discard(skip_);
+            }
+            butil::IOBuf data;
+            int n = s.buffer->Read(data, maxBytes);
+            if (n > 0) {
+                join(data);
+                if (skip_ > 0) {
+                    skip_ -= data.pop_front(std::min<uint64_t>(skip_, data.size()));
+                }
+                n = (int)data.size();
+                if (s.cached && n > 0) {
+                    RECORD_CACHE().AddServedBytes(n, !s.served);
+                    s.served = true;
+                }
+                out.append(data);
+                // 可能还有数据，让事件循环稍后继续
+                listener_->Notify();
+                if (n > 0) {
+                    return n;
+                }
+                continue;
+            } else if (0 == n) {
+                return 0;
+            }
+            // 子区间结束时输出不完整的包
+            if (JOIN_TS == joinMode_) {
+                std::string rest;
+                joiner_.Finish(rest);
+                out.append(rest);
+            }
+            finish(s);
+            cur_++;
+            Pump();
+        }
+        return failed_ ? -2 : -1;
+    }
+
+    // 停止所有正在进行的下载，放弃还在排队的会话
+    void Stop() {
+        for (auto &s : segments_) {
+            if (s.started && !s.stopped) {
+                s.buffer->Close();
+                finish(s);
+            } else if (!s.started && nullptr != s.ticket) {
+                DOWNLOAD_SCHEDULER().Release(s.ticket);
+                s.ticket.reset();
+            }
+        }
+    }
+
+private:
+    enum JoinMode {
+        JOIN_UNKNOWN = 0,
+        JOIN_PASS    = 1, // 不是TS，原样输出
+        JOIN_TS      = 2,
+    };
+
+    // 第一个子区间的开头决定输出格式，TS时所有数据经过TsJoiner改写，其他格式零拷贝输出
+    void join(butil::IOBuf &data) {
+        if (JOIN_UNKNOWN == joinMode_) {
+            char head[189];
+            size_t n       = data.copy_to(head, sizeof(head));
+            joinMode_      = (n > 0 && 0x47 == (uint8_t)head[0] && (n < sizeof(head) || 0x47 == (uint8_t)head[188])) ? JOIN_TS : JOIN_PASS;
+            joinedSegment_ = cur_;
+        }
+        if (JOIN_TS != joinMode_) {
+            return;
+        }
+        std::string joined;
+        if (joinedSegment_ != cur_) {
+            joiner_.Begin(joined);
+            joinedSegment_ = cur_;
+        }
+        std::string raw = data.to_string();
+        joiner_.Feed(raw.data(), raw.size(), joined);
+        data.clear();
+        data.append(joined);
+    }
+
+    // 在sdk调用线程中启动，完成后通知事件循环，由started处理结果
+    void start(size_t index) {
+        DownloadSegment &s = segments_[index];
+        s.started          = true;
+        s.starting         = true;
+        s.start            = std::make_shared<SegmentStart>();
+
+        // 海康的每个下载都以40字节的IMKH头开始，拼接时只保留第一个，缓存中保留完整的数据
+        std::shared_ptr<sdk::SdkStub> sdk      = sdk_;
+        std::shared_ptr<SpillBuffer> buffer    = s.buffer;
+        std::shared_ptr<SegmentStart> result   = s.start;
+        std::shared_ptr<RingListener> listener = listener_;
+        std::string ip                         = ip_;
+        std::string devId                      = devId_;
+        sdk::TimePoint startTime               = s.startTime;
+        sdk::TimePoint endTime                 = s.endTime;
+        bool skipHeader                        = index > 0;
+        int32_t speed                          = speed_;
+        s.calls->Post([sdk, buffer, result, listener, ip, devId, startTime, endTime, skipHeader, speed]() {
+            std::shared_ptr<RecordCacheWriter> writer = RECORD_CACHE().BeginWrite(ip, devId, startTime.ToTime(), endTime.ToTime());
+            result->writer                            = writer;
+            result->ret                               = sdk->DownloadRecordByTime(
+                devId, startTime, endTime,
+                [buffer, writer, skipHeader](intptr_t id, const uint8_t *data, int32_t len) {
+                    if (nullptr == data) {
+                        // 只缓存正常结束的下载
+                        if (nullptr != writer) {
+                            len < 0 ? writer->Abort() : writer->Commit();
+                        }
+                        buffer->Close();
+                        return;
+                    }
+                    if (nullptr != writer) {
+                        writer->Write(data, len);
+                    }
+                    RECORD_CACHE().AddFetchedBytes(len);
+                    if (!(skipHeader && len == 40 && 0 == memcmp(data, "IMKH", 4))) {
+                        buffer->Append(data, len);
+                    }
+                },
+                result->jobId);
+            if (0 == result->ret && speed > 1) {
+                result->speed = sdk->SetDownloadSpeed(result->jobId, speed);
+            }
+            result->done.store(true, std::memory_order_release);
+            listener->Notify();
+        });
+    }
+
+    void started(size_t index) {
+        DownloadSegment &s = segments_[index];
+        s.starting         = false;
+        int32_t ret        = s.start->ret;
+        if (0 != ret) {
+            s.start->writer.reset();
+            // nvr的会话已满，降低上限后用同一个凭证重新排队，其他错误立即失败
+            if (sdk_->IsSessionLimitError(ret) && DOWNLOAD_SCHEDULER().Refuse(s.ticket)) {
+                LOG_INFO("Nvr {} is busy, requeue segment {}, {} - {}, error {}", ip_, index, s.startTime.ToString(), s.endTime.ToString(), ret);
+                s.started = false;
+                return;
+            }
+            LOG_ERROR("Parallel download failed to start segment {}, {} - {}, error {}", index, s.startTime.ToString(), s.endTime.ToString(), ret);
+            DOWNLOAD_SCHEDULER().Release(s.ticket);
+            s.ticket.reset();
+            s.stopped = true;
+            failed_   = true;
+            listener_->Notify();
+            return;
+        }
+        running_++;
+        LOG_INFO("Parallel download started segment {}/{}, {} - {}, speed {}x", index + 1, segments_.size(), s.startTime.ToString(),
+                 s.endTime.ToString(), s.start->speed);
+    }
+
+    // 停止排在启动之后，启动还没有返回时也可以调用，停止后才把会话还给调度器
+    void finish(DownloadSegment &s) {
+        if (!s.started || s.stopped) {
+            return;
+        }
+        s.stopped = true;
+        if (!s.starting) {
+            running_--;
+        }
+        std::shared_ptr<sdk::SdkStub> sdk    = sdk_;
+        std::shared_ptr<SegmentStart> result = s.start;
+        DownloadTicketPtr ticket             = s.ticket;
+        s.ticket.reset();
+        s.calls->Post([sdk, result, ticket]() {
+            if (0 == result->ret) {
+                sdk->StopDownloadRecord(result->jobId);
+            }
+            DOWNLOAD_SCHEDULER().Release(ticket);
+            // 没有正常结束的下载不缓存，已经提交的不受影响
+            if (nullptr != result->writer) {
+                result->writer->Abort();
+                result->writer.reset();
+            }
+        });
+        if (s.buffer->GetSpilledBytes() > 0) {
+            LOG_INFO("Parallel download segment {} - {} spilled {} bytes", s.startTime.ToString(), s.endTime.ToString(), s.buffer->GetSpilledBytes());
+        }
+    }
+
+    // 缓存文件以IMKH头开始时拼接在后面需要跳过
+    static uint64_t headerSize(int fd) {
+        char header[4];
+        return (pread(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) && 0 == memcmp(header, "IMKH", 4)) ? 40 : 0;
+    }
+
+    // 缓存文件提交后不再修改，重新缓存时是新的文件
+    void contentTag(int fd, uint64_t bytes) {
+        struct stat st;
+        if (0 != fstat(fd, &st)) {
+            memset(&st, 0, sizeof(st));
+        }
+        contentTag_ += std::to_string((uint64_t)st.st_ino) + ":" + std::to_string((int64_t)st.st_mtime) + ":" + std::to_string(bytes) + ";";
+    }
+
+private:
+    std::shared_ptr<sdk::SdkStub> sdk_;
+    std::string ip_;
+    std::string devId_;
+    std::shared_ptr<RingListener> listener_;
+    std::vector<DownloadSegment> segments_;
+    size_t cur_; // 正在输出的子区间
+    int32_t running_;
+    bool failed_;
+    uint64_t skip_;
+    size_t cachedCount_;
+    uint64_t cachedBytes_;
+    std::string contentTag_;
+    std::string client_;
+    DownloadPriority priority_;
+    int32_t speed_;
+    JoinMode joinMode_;
+    size_t joinedSegment_; // TsJoiner正在处理的子区间
+    TsJoiner joiner_;
+};
+
+} // namespace sdkproxy
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <functional>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <gflags/gflags.h>
+
+#include "common/helper/logger.h"
+#include "common/helper/singleton.h"
+#include "common/helper/time_tool.h"
+#include "common/helper/threadpool.h"
+
+DEFINE_int32(stream_reactor_threads, 4, "Number of event loops that drive all stream transports");
+DEFINE_int32(stream_idle_timeout_s, 30, "Stream is closed if no data arrives during the last `stream_idle_timeout_s'");
+DEFINE_int32(stream_read_buffer_size, 65536, "Bytes read from a stream source in one call");
+DEFINE_int32(stream_sdk_call_threads, 16, "Threads running blocking sdk calls of stream transports, e.g. starting, pausing and stopping downloads");
+
+namespace sdkproxy {
+
+// 由reactor驱动的一路流传输，fd可读时在所属的事件循环线程中回调
+class StreamTask {
+public:
+    StreamTask(const std::string &kind, const std::string &name)
+        : kind_(kind), name_(name), id_(0), bytes_(0), droppedFrames_(0), droppedBytes_(0), startTime_(TimeTool::now_to_ms()),
+          lastActiveTime_(TimeTool::now_to_ms()), retryAt_(0), retryScheduled_(false) {}
+
+    virtual ~StreamTask() {}
+
+    virtual int GetFd() = 0;
+
+    // 返回false表示传输结束，reactor随后会移除该任务并调用OnFinished
+    virtual bool OnReadable() = 0;
+
+    // 在事件循环线程中调用，此时fd已从epoll中移除
+    virtual void OnFinished(const std::string &reason) = 0;
+
+    uint64_t GetId() const { return id_; }
+
+    const std::string &GetKind() const { return kind_; }
+
+    const std::string &GetName() const { return name_; }
+
+    uint64_t GetBytes() const { return bytes_; }
+
+    uint64_t GetDroppedFrames() const { return droppedFrames_; }
+
+    uint64_t GetDroppedBytes() const { return droppedBytes_; }
+
+    uint64_t GetStartTime() const { return startTime_; }
+
+    uint64_t GetLastActiveTime() const { return lastActiveTime_; }
+
+    // 因缓冲溢出丢弃的数据量，由具体的传输定义单位
+    virtual uint64_t GetOverflow() const { return 0; }
+
+protected:
+    void addBytes(uint64_t n) {
+        bytes_ += n;
+        lastActiveTime_ = TimeTool::now_to_ms();
+    }
+
+    // 拥塞时主动丢弃的帧
+    void addDropped(uint64_t frames, uint64_t bytes) {
+        droppedFrames_ += frames;
+        droppedBytes_ += bytes;
+    }
+
+    // 在事件循环线程中调用，ms毫秒后即使fd上没有事件也会再次回调OnReadable
+    void retryAfter(uint32_t ms) { retryAt_ = TimeTool::now_to_ms() + ms; }
+
+private:
+    friend class StreamReactor;
+    friend class StreamEventLoop;
+
+    std::string kind_;
+    std::string name_;
+    uint64_t id_;
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> droppedFrames_;
+    std::atomic<uint64_t> droppedBytes_;
+    uint64_t startTime_;
+    std::atomic<uint64_t> lastActiveTime_;
+    uint64_t retryAt_; // 只在事件循环线程中访问
+    bool retryScheduled_;
+};
+
+typedef struct tagStreamStat {
+    uint64_t id;
+    std::string kind;
+    std::string name;
+    uint64_t bytes;
+    uint64_t startTime;
+    uint64_t idleMs;
+    uint64_t overflow;
+    uint64_t droppedFrames;
+    uint64_t droppedBytes;
+    int32_t loop;
+} StreamStat;
+
+// 单线程事件循环，一个循环内的任务不会被并发回调
+class StreamEventLoop {
+public:
+    explicit StreamEventLoop(int32_t index) : index_(index), running_(true) {
+        epfd_   = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        struct epoll_event ev = {0};
+        ev.events             = EPOLLIN;
+        ev.data.fd            = wakeFd_;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~StreamEventLoop() {
+        running_ = false;
+        uint64_t one = 1;
+        write(wakeFd_, &one, sizeof(one));
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        close(wakeFd_);
+        close(epfd_);
+    }
+
+    int Add(std::shared_ptr<StreamTask> task) {
+        std::unique_lock<std::mutex> lck(mutex_);
+
+        struct epoll_event ev = {0};
+        ev.events             = EPOLLIN;
+        ev.data.fd            = task->GetFd();
+        if (0 != epoll_ctl(epfd_, EPOLL_CTL_ADD, task->GetFd(), &ev)) {
+            LOG_ERROR("Failed to add stream {} to event loop {}, errno {}", task->GetName(), index_, errno);
+            return -1;
+        }
+        tasks_[task->GetFd()] = task;
+        return 0;
+    }
+
+    void Dump(std::vector<StreamStat> &stats) {
+        uint64_t now = TimeTool::now_to_ms();
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (auto &p : tasks_) {
+            auto &t = p.second;
+            StreamStat s;
+            s.id            = t->GetId();
+            s.kind          = t->GetKind();
+            s.name          = t->GetName();
+            s.bytes         = t->GetBytes();
+            s.startTime     = t->GetStartTime();
+            s.idleMs        = now - t->GetLastActiveTime();
+            s.overflow      = t->GetOverflow();
+            s.droppedFrames = t->GetDroppedFrames();
+            s.droppedBytes  = t->GetDroppedBytes();
+            s.loop          = index_;
+            stats.push_back(s);
+        }
+    }
+
+    size_t Size() {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return tasks_.size();
+    }
+
+private:
+    void run() {
+        const int MAX_EVENTS = 64;
+        struct epoll_event events[MAX_EVENTS];
+        uint64_t lastSweep = TimeTool::now_to_ms();
+
+        while (running_) {
+            int timeout = 1000;
+            if (!retries_.empty()) {
+                uint64_t now = TimeTool::now_to_ms();
+                uint64_t at  = retries_.begin()->first;
+                timeout      = at <= now ? 0 : std::min<uint64_t>(timeout, at - now);
+            }
+
+            int n = epoll_wait(epfd_, events, MAX_EVENTS, timeout);
+            if (n < 0 && errno != EINTR) {
+                LOG_ERROR("Event loop {} wait error, errno {}", index_, errno);
+                break;
+            }
+
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == wakeFd_) {
+                    uint64_t v;
+                    read(wakeFd_, &v, sizeof(v));
+                    continue;
+                }
+
+                std::shared_ptr<StreamTask> task = find(fd);
+                if (nullptr == task) {
+                    continue;
+                }
+                dispatch(task);
+            }
+
+            // 到期的重试
+            uint64_t now = TimeTool::now_to_ms();
+            while (!retries_.empty() && retries_.begin()->first <= now) {
+                std::shared_ptr<StreamTask> task = retries_.begin()->second;
+                retries_.erase(retries_.begin());
+                task->retryScheduled_ = false;
+                if (find(task->GetFd()) == task) {
+                    dispatch(task);
+                }
+            }
+
+            // 清理长时间没有数据的流
+            if (now - lastSweep >= 1000) {
+                lastSweep = now;
+                for (auto &t : collectIdle(now)) {
+                    LOG_ERROR("Wait for data timeout, stream {}", t->GetName());
+                    remove(t, "timeout");
+                }
+            }
+        }
+
+        // 退出时结束所有任务
+        retries_.clear();
+        std::map<int, std::shared_ptr<StreamTask>> tasks;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            tasks.swap(tasks_);
+        }
+        for (auto &p : tasks) {
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, p.first, nullptr);
+            p.second->OnFinished("shutdown");
+        }
+    }
+
+    void dispatch(std::shared_ptr<StreamTask> task) {
+        task->retryAt_ = 0;
+        if (!task->OnReadable()) {
+            remove(task, "completed");
+            return;
+        }
+        if (0 != task->retryAt_ && !task->retryScheduled_) {
+            task->retryScheduled_ = true;
+            retries_.insert(std::make_pair(task->retryAt_, task));
+        }
+    }
+
+    std::shared_ptr<StreamTask> find(int fd) {
+        std::unique_lock<std::mutex> lck(mutex_);
+        auto iter = tasks_.find(fd);
+        return iter == tasks_.end() ? nullptr : iter->second;
+    }
+
+    std::vector<std::shared_ptr<StreamTask>> collectIdle(uint64_t now) {
+        uint64_t timeout = (uint64_t)FLAGS_stream_idle_timeout_s * 1000;
+        std::vector<std::shared_ptr<StreamTask>> idle;
+        std::unique_lock<std::mutex> lck(mutex_);
+        for (auto &p : tasks_) {
+            if (now - p.second->GetLastActiveTime() >= timeout) {
+                idle.push_back(p.second);
+            }
+        }
+        return idle;
+    }
+
+    void remove(std::shared_ptr<StreamTask> task, const std::string &reason) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, task->GetFd(), nullptr);
+            tasks_.erase(task->GetFd());
+        }
+        task->OnFinished(reason);
+    }
+
+private:
+    int32_t index_;
+    int epfd_;
+    int wakeFd_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::map<int, std::shared_ptr<StreamTask>> tasks_;
+    std::multimap<uint64_t, std::shared_ptr<StreamTask>> retries_; // 只在事件循环线程中访问
+};
+
+// 所有流传输共享的固定数量事件循环，取代每路流一个线程
+class StreamReactor {
+public:
+    StreamReactor() : nextId_(1) {
+        int32_t num = FLAGS_stream_reactor_threads > 0 ? FLAGS_stream_reactor_threads : 1;
+        for (int32_t i = 0; i < num; i++) {
+            loops_.emplace_back(new StreamEventLoop(i));
+        }
+        LOG_INFO("Stream reactor started with {} event loops", num);
+    }
+
+    int Register(std::shared_ptr<StreamTask> task) {
+        task->id_ = nextId_++;
+        // 按id轮流分配到各个事件循环
+        return loops_[task->id_ % loops_.size()]->Add(task);
+    }
+
+    std::vector<StreamStat> Dump() {
+        std::vector<StreamStat> stats;
+        for (auto &l : loops_) {
+            l->Dump(stats);
+        }
+        return stats;
+    }
+
+    size_t Size() {
+        size_t n = 0;
+        for (auto &l : loops_) {
+            n += l->Size();
+        }
+        return n;
+    }
+
+private:
+    std::atomic<uint64_t> nextId_;
+    std::vector<std::unique_ptr<StreamEventLoop>> loops_;
+};
+
+inline StreamReactor &STREAM_REACTOR() {
+    return Singleton<StreamReactor>::getInstance();
+}
+
+// 执行流传输的阻塞sdk调用，一台nvr响应慢时不会卡住事件循环，调用方在完成后唤醒自己的fd回到事件循环处理结果
+class SdkCallPool {
+public:
+    SdkCallPool() : pool_((unsigned short)std::max(1, std::min(FLAGS_stream_sdk_call_threads, THREADPOOL_MAX_NUM))) {}
+
+    void Post(std::function<void()> call) { pool_.commit(call); }
+
+private:
+    std::threadpool pool_;
+};
+
+inline SdkCallPool &SDK_CALL_POOL() {
+    return Singleton<SdkCallPool>::getInstance();
+}
+
+// 按提交顺序依次执行一路流的sdk调用，例如暂停和恢复不能乱序，停止要在启动完成之后
+class SdkCallStrand : public std::enable_shared_from_this<SdkCallStrand> {
+public:
+    SdkCallStrand() : running_(false) {}
+
+    void Post(std::function<void()> call) {
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            calls_.push_back(call);
+            if (running_) {
+                return;
+            }
+            running_ = true;
+        }
+        std::shared_ptr<SdkCallStrand> self = shared_from_this();
+        SDK_CALL_POOL().Post([self]() { self->run(); });
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> call;
+            {
+                std::unique_lock<std::mutex> lck(mutex_);
+                if (calls_.empty()) {
+                    running_ = false;
+                    return;
+                }
+                call = calls_.front();
+                calls_.pop_front();
+            }
+            call();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<std::function<void()>> calls_;
+    bool running_;
+};
+
+} // namespace sdkproxy
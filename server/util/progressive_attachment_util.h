@@ -26,6 +26,21 @@ public:
 
         return n;
     }
+
+    // 不会阻塞的写，返回0表示已写入，1表示连接拥塞数据未写入，-1表示失败
+    static int trywrite(brpc::ProgressiveAttachment *pa, const butil::IOBuf &buf) {
+        if (pa->Write(buf) == -1) {
+            return errno == 1011 ? 1 : -1; // EOVERCROWDED
+        }
+        return 0;
+    }
+
+    static int trywrite(brpc::ProgressiveAttachment *pa, const char *buf, size_t n) {
+        if (pa->Write(buf, n) == -1) {
+            return errno == 1011 ? 1 : -1; // EOVERCROWDED
+        }
+        return 0;
+    }
 };
 
 } // namespace sdkproxy
\ No newline at end of file
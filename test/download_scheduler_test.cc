@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "server/stream/download_scheduler.h"
+
+using namespace sdkproxy;
+
+namespace {
+
+// 按授予的顺序记录客户端
+class GrantLog {
+public:
+    std::function<void()> On(const std::string &name) {
+        return [this, name]() { names.push_back(name); };
+    }
+
+    std::vector<std::string> names;
+};
+
+// 先占住n个会话
+void holdAll(DownloadScheduler &scheduler, const std::string &ip, int32_t n, std::vector<DownloadTicketPtr> &held) {
+    for (int32_t i = 0; i < n; i++) {
+        held.push_back(scheduler.Acquire(ip, "holder", PRIORITY_INTERACTIVE, nullptr));
+    }
+}
+
+} // namespace
+
+TEST(DownloadSchedulerTest, QueuesBeyondTheSessionLimit) {
+    FLAGS_vod_nvr_session_limits = "10.0.0.1=2";
+    DownloadScheduler scheduler;
+    GrantLog log;
+
+    DownloadTicketPtr a = scheduler.Acquire("10.0.0.1", "a", PRIORITY_INTERACTIVE, log.On("a"));
+    DownloadTicketPtr b = scheduler.Acquire("10.0.0.1", "b", PRIORITY_INTERACTIVE, log.On("b"));
+    DownloadTicketPtr c = scheduler.Acquire("10.0.0.1", "c", PRIORITY_INTERACTIVE, log.On("c"));
+    EXPECT_TRUE(a->IsGranted());
+    EXPECT_TRUE(b->IsGranted());
+    EXPECT_TRUE(c->IsWaiting());
+    // 立即授予的凭证不回调
+    EXPECT_TRUE(log.names.empty());
+    EXPECT_EQ(0, scheduler.GetQueueInfo(c).position);
+
+    scheduler.Release(a);
+    EXPECT_TRUE(c->IsGranted());
+    EXPECT_EQ(std::vector<std::string>({"c"}), log.names);
+}
+
+TEST(DownloadSchedulerTest, RoundRobinsBetweenClients) {
+    FLAGS_vod_nvr_session_limits = "10.0.0.2=1";
+    DownloadScheduler scheduler;
+    GrantLog log;
+    std::vector<DownloadTicketPtr> held;
+    holdAll(scheduler, "10.0.0.2", 1, held);
+
+    // 客户端a先排了三个，b后到的一个不用等a的全部完成
+    std::vector<DownloadTicketPtr> queued;
+    queued.push_back(scheduler.Acquire("10.0.0.2", "a", PRIORITY_INTERACTIVE, log.On("a1")));
+    queued.push_back(scheduler.Acquire("10.0.0.2", "a", PRIORITY_INTERACTIVE, log.On("a2")));
+    queued.push_back(scheduler.Acquire("10.0.0.2", "a", PRIORITY_INTERACTIVE, log.On("a3")));
+    queued.push_back(scheduler.Acquire("10.0.0.2", "b", PRIORITY_INTERACTIVE, log.On("b1")));
+    EXPECT_EQ(1, scheduler.GetQueueInfo(queued[3]).position);
+    EXPECT_EQ(3, scheduler.GetQueueInfo(queued[2]).position);
+
+    scheduler.Release(held[0]);
+    for (size_t i = 0; i < queued.size(); i++) {
+        for (auto &t : queued) {
+            if (t->IsGranted()) {
+                scheduler.Release(t);
+                break;
+            }
+        }
+    }
+    EXPECT_EQ(std::vector<std::string>({"a1", "b1", "a2", "a3"}), log.names);
+}
+
+TEST(DownloadSchedulerTest, InteractiveBeforeBulk) {
+    FLAGS_vod_nvr_session_limits = "10.0.0.3=1";
+    DownloadScheduler scheduler;
+    GrantLog log;
+    std::vector<DownloadTicketPtr> held;
+    holdAll(scheduler, "10.0.0.3", 1, held);
+
+    DownloadTicketPtr bulk        = scheduler.Acquire("10.0.0.3", "export", PRIORITY_BULK, log.On("bulk"));
+    DownloadTicketPtr interactive = scheduler.Acquire("10.0.0.3", "viewer", PRIORITY_INTERACTIVE, log.On("interactive"));
+    EXPECT_EQ(1, scheduler.GetQueueInfo(bulk).position);
+    EXPECT_EQ(0, scheduler.GetQueueInfo(interactive).position);
+
+    scheduler.Release(held[0]);
+    EXPECT_TRUE(interactive->IsGranted());
+    EXPECT_TRUE(bulk->IsWaiting());
+    scheduler.Release(interactive);
+    EXPECT_TRUE(bulk->IsGranted());
+    EXPECT_EQ(std::vector<std::string>({"interactive", "bulk"}), log.names);
+}
+
+TEST(DownloadSchedulerTest, ReleasingAWaitingTicketLeavesTheQueue) {
+    FLAGS_vod_nvr_session_limits = "10.0.0.4=1";
+    DownloadScheduler scheduler;
+    GrantLog log;
+    std::vector<DownloadTicketPtr> held;
+    holdAll(scheduler, "10.0.0.4", 1, held);
+
+    DownloadTicketPtr gone = scheduler.Acquire("10.0.0.4", "a", PRIORITY_INTERACTIVE, log.On("gone"));
+    DownloadTicketPtr next = scheduler.Acquire("10.0.0.4", "b", PRIORITY_INTERACTIVE, log.On("next"));
+    scheduler.Release(gone);
+    DownloadQueueInfo info;
+    EXPECT_FALSE(scheduler.GetQueueInfo(gone->GetId(), info));
+    EXPECT_EQ(0, scheduler.GetQueueInfo(next).position);
+
+    scheduler.Release(held[0]);
+    EXPECT_EQ(std::vector<std::string>({"next"}), log.names);
+}
+
+TEST(DownloadSchedulerTest, RefuseRequeuesAtTheHeadAndLowersTheLimit) {
+    FLAGS_vod_nvr_session_limits = "10.0.0.5=3";
+    DownloadScheduler scheduler;
+    GrantLog log;
+    std::vector<DownloadTicketPtr> held;
+    holdAll(scheduler, "10.0.0.5", 2, held);
+
+    DownloadTicketPtr refused = scheduler.Acquire("10.0.0.5", "a", PRIORITY_INTERACTIVE, log.On("refused"));
+    DownloadTicketPtr later   = scheduler.Acquire("10.0.0.5", "a", PRIORITY_INTERACTIVE, log.On("later"));
+    ASSERT_TRUE(refused->IsGranted());
+    uint64_t id = refused->GetId();
+
+    // nvr实际只接受两个会话
+    EXPECT_TRUE(scheduler.Refuse(refused));
+    EXPECT_TRUE(refused->IsWaiting());
+    EXPECT_EQ(id, refused->GetId());
+    EXPECT_EQ(0, scheduler.GetQueueInfo(refused).position);
+    std::vector<NvrScheduleInfo> nvrs = scheduler.DumpNvrs();
+    ASSERT_EQ(1u, nvrs.size());
+    EXPECT_EQ(2, nvrs[0].limit);
+    EXPECT_EQ(3, nvrs[0].configuredLimit);
+    EXPECT_EQ(2, nvrs[0].running);
+
+    scheduler.Release(held[0]);
+    EXPECT_TRUE(refused->IsGranted());
+    EXPECT_TRUE(later->IsWaiting());
+    EXPECT_EQ(std::vector<std::string>({"refused"}), log.names);
+}
+
+TEST(DownloadSchedulerTest, RefuseWithoutOtherSessionsReleases) {
+    FLAGS_vod_nvr_session_limits = "10.0.0.6=2";
+    DownloadScheduler scheduler;
+
+    DownloadTicketPtr only = scheduler.Acquire("10.0.0.6", "a", PRIORITY_INTERACTIVE, nullptr);
+    ASSERT_TRUE(only->IsGranted());
+    EXPECT_FALSE(scheduler.Refuse(only));
+    EXPECT_FALSE(only->IsGranted());
+    EXPECT_FALSE(only->IsWaiting());
+    std::vector<NvrScheduleInfo> nvrs = scheduler.DumpNvrs();
+    ASSERT_EQ(1u, nvrs.size());
+    EXPECT_EQ(0, nvrs[0].running);
+    EXPECT_EQ(2, nvrs[0].limit);
+}
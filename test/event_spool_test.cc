@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "server/stream/event_spool.h"
+
+using namespace sdkproxy;
+
+namespace {
+
+UploadEvent makeEvent(int i, size_t imageBytes) {
+    UploadEvent e;
+    e.devCode   = "dev" + std::to_string(i);
+    e.realIp    = "10.0.0.1";
+    e.path      = "/alarm";
+    e.dateTime  = "2024-01-01 00:00:00";
+    e.alarmType = i;
+    e.alarmData = "{\"index\":" + std::to_string(i) + "}";
+    e.image.assign(imageBytes, (char)('a' + i % 26));
+    return e;
+}
+
+// 读出所有待重放的事件，按序号顺序
+std::vector<UploadEvent> replay(EventSpool &spool) {
+    std::vector<UploadEvent> events;
+    uint64_t pos = 0;
+    UploadEvent e;
+    while (spool.Next(pos, e)) {
+        events.push_back(e);
+    }
+    return events;
+}
+
+std::vector<std::string> listSegments(const std::string &dir) {
+    std::vector<std::string> files;
+    DIR *d = opendir(dir.c_str());
+    if (nullptr == d) {
+        return files;
+    }
+    struct dirent *ent;
+    while (nullptr != (ent = readdir(d))) {
+        std::string name = ent->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wal") == 0) {
+            files.push_back(dir + "/" + name);
+        }
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+class EventSpoolTest : public testing::Test {
+protected:
+    void SetUp() override {
+        char dir[]                   = "/tmp/event_spool_test_XXXXXX";
+        dir_                         = mkdtemp(dir);
+        FLAGS_event_spool_dir        = dir_;
+        FLAGS_event_spool_segment_mb = 1;
+        FLAGS_event_spool_max_bytes  = 64LL * 1024 * 1024;
+        FLAGS_event_spool_max_age_h  = 72;
+        FLAGS_event_spool_fsync_ms   = 200;
+    }
+
+    void TearDown() override { system(("rm -rf " + dir_).c_str()); }
+
+    // 写入n个事件，返回序号
+    std::vector<uint64_t> append(EventSpool &spool, int n, size_t imageBytes) {
+        std::vector<uint64_t> seqs;
+        for (int i = 0; i < n; i++) {
+            UploadEvent e = makeEvent(i, imageBytes);
+            EXPECT_TRUE(spool.Append(e));
+            seqs.push_back(e.seq);
+        }
+        return seqs;
+    }
+
+    std::string dir_;
+};
+
+} // namespace
+
+TEST_F(EventSpoolTest, UnackedEventsAreReplayedAfterReopen) {
+    {
+        EventSpool spool;
+        ASSERT_TRUE(spool.Open());
+        std::vector<uint64_t> seqs = append(spool, 10, 1000);
+        // 确认一部分，释放另一部分
+        for (int i = 0; i < 4; i++) {
+            spool.Ack(seqs[i]);
+        }
+        spool.Ack(seqs[6]);
+        for (int i = 4; i < 10; i++) {
+            spool.Release(seqs[i]);
+        }
+        EXPECT_EQ(5u, spool.Stats().pending);
+        spool.Close();
+    }
+
+    EventSpool spool;
+    ASSERT_TRUE(spool.Open());
+    std::vector<UploadEvent> events = replay(spool);
+    // 确认位置之后单独确认的事件没有落盘，重启后会再上传一次
+    ASSERT_EQ(6u, events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        UploadEvent expected = makeEvent(4 + (int)i, 1000);
+        EXPECT_EQ(expected.devCode, events[i].devCode);
+        EXPECT_EQ(expected.alarmType, events[i].alarmType);
+        EXPECT_EQ(expected.alarmData, events[i].alarmData);
+        EXPECT_EQ(expected.image, events[i].image);
+    }
+    // 新的事件接着已有的序号
+    UploadEvent e = makeEvent(100, 10);
+    ASSERT_TRUE(spool.Append(e));
+    EXPECT_EQ(events.back().seq + 1, e.seq);
+}
+
+TEST_F(EventSpoolTest, InflightEventsAreSkippedUntilReleased) {
+    EventSpool spool;
+    ASSERT_TRUE(spool.Open());
+    std::vector<uint64_t> seqs = append(spool, 3, 100);
+    EXPECT_TRUE(replay(spool).empty());
+    EXPECT_EQ(3u, spool.Stats().inflight);
+
+    spool.Release(seqs[1]);
+    std::vector<UploadEvent> events = replay(spool);
+    ASSERT_EQ(1u, events.size());
+    EXPECT_EQ(seqs[1], events[0].seq);
+    // Next返回的事件又标记为正在上传
+    EXPECT_TRUE(replay(spool).empty());
+}
+
+TEST_F(EventSpoolTest, SegmentsRollAndAreDeletedOnceAcked) {
+    EventSpool spool;
+    ASSERT_TRUE(spool.Open());
+    std::vector<uint64_t> seqs = append(spool, 10, 300 * 1024);
+    EXPECT_GE(spool.Stats().segments, 3u);
+
+    for (uint64_t seq : seqs) {
+        spool.Ack(seq);
+    }
+    EventSpoolStats stats = spool.Stats();
+    EXPECT_EQ(0u, stats.pending);
+    EXPECT_EQ(10u, stats.acked);
+    // 只剩正在写的段
+    EXPECT_EQ(1u, stats.segments);
+    spool.Close();
+
+    ASSERT_TRUE(spool.Open());
+    EXPECT_TRUE(replay(spool).empty());
+}
+
+TEST_F(EventSpoolTest, TornTailIsDroppedOnRecovery) {
+    {
+        EventSpool spool;
+        ASSERT_TRUE(spool.Open());
+        append(spool, 5, 1000);
+        spool.Close();
+    }
+
+    // 破坏最后一个事件的内容，模拟写到一半时崩溃
+    std::vector<std::string> files = listSegments(dir_);
+    ASSERT_EQ(1u, files.size());
+    std::string data;
+    {
+        std::ifstream in(files[0], std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        data = ss.str();
+    }
+    size_t off  = 0;
+    size_t last = 0;
+    for (int i = 0; i < 5; i++) {
+        uint32_t len = 0;
+        memcpy(&len, data.data() + off + 8, 4);
+        last = off;
+        off += (EventSpool::HEADER_BYTES + len + 7) & ~(size_t)7;
+    }
+    data[last + EventSpool::HEADER_BYTES + 10] ^= 0xff;
+    {
+        std::ofstream out(files[0], std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+    }
+
+    EventSpool spool;
+    ASSERT_TRUE(spool.Open());
+    std::vector<UploadEvent> events = replay(spool);
+    ASSERT_EQ(4u, events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        EXPECT_EQ(makeEvent((int)i, 1000).alarmData, events[i].alarmData);
+    }
+    // 段截断到最后一个完整的事件，被破坏的事件的序号重新使用
+    struct stat st;
+    ASSERT_EQ(0, stat(files[0].c_str(), &st));
+    EXPECT_EQ(last, (size_t)st.st_size);
+    UploadEvent e = makeEvent(100, 10);
+    ASSERT_TRUE(spool.Append(e));
+    EXPECT_EQ(events.back().seq + 1, e.seq);
+}
+
+TEST_F(EventSpoolTest, GarbageSegmentIsIgnored) {
+    {
+        EventSpool spool;
+        ASSERT_TRUE(spool.Open());
+        append(spool, 3, 100);
+        spool.Close();
+    }
+    std::ofstream(dir_ + "/00000000000000001000.wal", std::ios::binary) << std::string(4096, '\x5a');
+
+    EventSpool spool;
+    ASSERT_TRUE(spool.Open());
+    EXPECT_EQ(3u, replay(spool).size());
+    EXPECT_EQ(1u, listSegments(dir_).size());
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "common/media/frame_parser.h"
+
+using namespace sdkproxy;
+
+namespace {
+
+std::string pes(uint8_t streamId, const std::string &payload) {
+    std::string s("\0\0\1", 3);
+    size_t len = 3 + payload.size();
+    s += (char)streamId;
+    s += (char)(len >> 8);
+    s += (char)(len & 0xff);
+    s += std::string("\x80\x80\0", 3);
+    s += payload;
+    return s;
+}
+
+std::string psPack() { return std::string("\0\0\1\xba", 4) + std::string(9, '\x44') + (char)0xf8; }
+
+std::string psSystemHeader() { return std::string("\0\0\1\xbb\0\x06", 6) + std::string(6, '\x01'); }
+
+// 只有一个H.264视频流的PSM
+std::string psMap() { return std::string("\0\0\1\xbc\0\x0e\xe0\xff\0\0\0\x04\x1b\xe0\0\0\0\0\0\0", 20); }
+
+std::string nal(bool key, size_t len) { return std::string("\0\0\0\1", 4) + (char)(key ? 0x65 : 0x41) + std::string(len, '\x11'); }
+
+// 按1到max字节的随机分块输入
+void feed(FrameSplitter &splitter, const std::string &data, size_t max, std::vector<MediaFramePtr> &out) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t n = std::min(data.size() - pos, (size_t)(rand() % max + 1));
+        splitter.Feed((const uint8_t *)data.data() + pos, n, out);
+        pos += n;
+    }
+}
+
+std::vector<int> types(const std::vector<MediaFramePtr> &frames) {
+    std::vector<int> v;
+    for (auto &f : frames) {
+        v.push_back(f->type);
+    }
+    return v;
+}
+
+std::string concat(const std::vector<MediaFramePtr> &frames) {
+    std::string s;
+    for (auto &f : frames) {
+        s += f->data;
+    }
+    return s;
+}
+
+} // namespace
+
+TEST(FrameSplitterTest, SplitsPsIntoFrames) {
+    std::string ps;
+    std::vector<int> expected = {FRAME_HEADER};
+    for (int i = 0; i < 30; i++) {
+        bool key       = 0 == i % 10;
+        std::string es = nal(key, 3000);
+        ps += psPack();
+        if (key) {
+            ps += psSystemHeader();
+            ps += psMap();
+        }
+        // 一帧分在两个PS包中
+        ps += pes(0xe0, es.substr(0, 2000));
+        ps += psPack();
+        ps += pes(0xe0, es.substr(2000));
+        expected.push_back(key ? FRAME_VIDEO_KEY : FRAME_VIDEO);
+        ps += psPack();
+        ps += pes(0xc0, std::string(100, '\x22'));
+        expected.push_back(FRAME_AUDIO);
+    }
+
+    FrameSplitter splitter;
+    std::vector<MediaFramePtr> frames;
+    std::string header = "IMKH" + std::string(36, '\x01');
+    srand(1);
+    splitter.Feed((const uint8_t *)header.data(), header.size(), frames);
+    feed(splitter, ps, 5000, frames);
+    splitter.Flush(frames);
+
+    EXPECT_EQ(FORMAT_PS, splitter.GetFormat());
+    EXPECT_EQ(CODEC_H264, splitter.GetCodec());
+    EXPECT_EQ(expected, types(frames));
+    EXPECT_EQ(header + ps, concat(frames));
+    for (auto &f : frames) {
+        EXPECT_EQ(f->type != FRAME_VIDEO && f->type != FRAME_AUDIO, f->sync);
+    }
+}
+
+TEST(FrameSplitterTest, SplitsDavIntoFrames) {
+    std::string dav;
+    std::vector<int> expected;
+    for (int i = 0; i < 20; i++) {
+        uint8_t type = 0 == i % 5 ? 0xfd : (i % 2 ? 0xf0 : 0xfc);
+        size_t body  = 500 + i;
+        size_t len   = 24 + body + 8;
+        std::string frame("DHAV", 4);
+        frame += (char)type;
+        frame += std::string(7, '\0');
+        frame += (char)(len & 0xff);
+        frame += (char)(len >> 8);
+        frame += std::string(10, '\0');
+        frame += std::string(body, '\x33');
+        frame += std::string("dhav\0\0\0\0", 8);
+        dav += frame;
+        expected.push_back(0xfd == type ? FRAME_VIDEO_KEY : (0xf0 == type ? FRAME_AUDIO : FRAME_VIDEO));
+    }
+
+    FrameSplitter splitter;
+    std::vector<MediaFramePtr> frames;
+    srand(2);
+    feed(splitter, dav, 700, frames);
+    splitter.Flush(frames);
+
+    EXPECT_EQ(FORMAT_DAV, splitter.GetFormat());
+    EXPECT_EQ(expected, types(frames));
+    EXPECT_EQ(dav, concat(frames));
+}
+
+TEST(FrameSplitterTest, SplitsTsIntoFrames) {
+    // 188字节的TS包，负载不足时用适配域填充
+    auto packet = [](int pid, bool start, const std::string &payload) {
+        std::string p(188, '\xff');
+        p[0]         = 0x47;
+        p[1]         = (char)((start ? 0x40 : 0) | ((pid >> 8) & 0x1f));
+        p[2]         = (char)(pid & 0xff);
+        size_t adapt = 184 - payload.size();
+        if (adapt > 0) {
+            p[3] = 0x30;
+            p[4] = (char)(adapt - 1);
+            if (adapt > 1) {
+                p[5] = 0;
+            }
+        } else {
+            p[3] = 0x10;
+        }
+        memcpy(&p[4 + adapt], payload.data(), payload.size());
+        return p;
+    };
+    std::string pat = std::string("\0\0\xb0\x0d\0\x01\xc1\0\0\0\x01\xe1\0\0\0\0\0", 17);
+    std::string pmt = std::string("\0\x02\xb0\x12\0\x01\xc1\0\0\xe1\x01\xf0\0\x1b\xe1\x01\xf0\0\0\0\0\0", 22);
+
+    std::string ts;
+    std::vector<int> expected;
+    for (int i = 0; i < 20; i++) {
+        bool key = 0 == i % 5;
+        if (key) {
+            ts += packet(0, true, pat);
+            ts += packet(0x100, true, pmt);
+        }
+        ts += packet(0x101, true, pes(0xe0, nal(key, 100)));
+        ts += packet(0x101, false, std::string(184, '\x12'));
+        ts += packet(0x102, true, pes(0xc0, std::string(50, '\x01')));
+        expected.push_back(key ? FRAME_VIDEO_KEY : FRAME_VIDEO);
+    }
+
+    FrameSplitter splitter;
+    std::vector<MediaFramePtr> frames;
+    srand(3);
+    feed(splitter, ts, 600, frames);
+    splitter.Flush(frames);
+
+    EXPECT_EQ(FORMAT_TS, splitter.GetFormat());
+    EXPECT_EQ(CODEC_H264, splitter.GetCodec());
+    EXPECT_EQ(expected, types(frames));
+    EXPECT_EQ(ts, concat(frames));
+    // 关键帧从PAT开始
+    for (auto &f : frames) {
+        if (f->IsKey()) {
+            EXPECT_EQ(0x40, (uint8_t)f->data[1]);
+        }
+    }
+}
+
+TEST(FrameSplitterTest, UnknownFormatIsPassedThrough) {
+    std::string data(10000, '\x5a');
+    FrameSplitter splitter;
+    std::vector<MediaFramePtr> frames;
+    srand(4);
+    feed(splitter, data, 3000, frames);
+    splitter.Flush(frames);
+
+    EXPECT_EQ(FORMAT_UNKNOWN, splitter.GetFormat());
+    EXPECT_EQ(data, concat(frames));
+    for (auto &f : frames) {
+        EXPECT_EQ(FRAME_OTHER, f->type);
+    }
+}
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "server/stream/record_index.h"
+
+using namespace sdkproxy;
+
+namespace {
+
+// 按给定的录像列表回答查询，记录每次查询的时间段
+class MockStub : public sdk::SdkStub {
+public:
+    MockStub() : SdkStub("mock", "mock", 0) {}
+
+    int32_t FindRecord(const std::string &devId, const sdk::TimePoint &startTime, const sdk::TimePoint &endTime, OnRecord onRecord) override {
+        time_t a = startTime.ToTime();
+        time_t b = endTime.ToTime();
+        queries.push_back(std::make_pair(a, b));
+        for (auto &r : records) {
+            if (r.startTime.ToTime() <= b && r.endTime.ToTime() >= a && !onRecord(r)) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    // [from, to)按step切成连续的录像
+    void Record(time_t from, time_t to, time_t step) {
+        for (time_t t = from; t < to; t += step) {
+            sdk::RecordInfo r;
+            r.fileName = "f" + std::to_string(t);
+            r.fileSize = 1024;
+            r.startTime.FromTime(t);
+            r.endTime.FromTime(std::min(t + step, to));
+            records.push_back(r);
+        }
+    }
+
+    std::vector<sdk::RecordInfo> records;
+    std::vector<std::pair<time_t, time_t>> queries;
+};
+
+sdk::TimePoint at(time_t t) {
+    sdk::TimePoint p;
+    p.FromTime(t);
+    return p;
+}
+
+std::vector<std::string> names(const std::vector<sdk::RecordInfo> &records) {
+    std::vector<std::string> v;
+    for (auto &r : records) {
+        v.push_back(r.fileName);
+    }
+    return v;
+}
+
+class RecordIndexTest : public testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_vod_record_index_enable         = true;
+        FLAGS_vod_record_index_ttl_s          = 600;
+        FLAGS_vod_record_index_tail_s         = 300;
+        FLAGS_vod_record_index_max_records    = 200000;
+        FLAGS_vod_record_index_tail_refresh_s = 5;
+        now_  = time(nullptr) / 60 * 60;
+        base_ = now_ - 86400; // 都在tail之外的历史录像
+        stub_ = std::make_shared<MockStub>();
+        stub_->Record(base_ - 3600, base_ + 6 * 3600, 600);
+    }
+
+    std::vector<sdk::RecordInfo> query(RecordIndex &index, time_t from, time_t to) {
+        std::vector<sdk::RecordInfo> records;
+        EXPECT_EQ(0, index.Query(stub_, "10.0.0.1", "1", at(from), at(to), records));
+        return records;
+    }
+
+    // 直接查询nvr的结果
+    std::vector<sdk::RecordInfo> direct(time_t from, time_t to) {
+        std::vector<sdk::RecordInfo> records;
+        stub_->FindRecord("1", at(from), at(to), [&records](const sdk::RecordInfo &r) {
+            records.push_back(r);
+            return true;
+        });
+        stub_->queries.pop_back();
+        return records;
+    }
+
+    time_t now_;
+    time_t base_;
+    std::shared_ptr<MockStub> stub_;
+};
+
+} // namespace
+
+TEST_F(RecordIndexTest, RepeatedQueryIsAnsweredFromTheIndex) {
+    RecordIndex index;
+    std::vector<sdk::RecordInfo> first = query(index, base_, base_ + 3600);
+    EXPECT_EQ(names(direct(base_, base_ + 3600)), names(first));
+    ASSERT_EQ(1u, stub_->queries.size());
+
+    EXPECT_EQ(names(first), names(query(index, base_, base_ + 3600)));
+    EXPECT_EQ(names(direct(base_ + 600, base_ + 1800)), names(query(index, base_ + 600, base_ + 1800)));
+    EXPECT_EQ(1u, stub_->queries.size());
+
+    RecordIndexStats stats = index.Stats();
+    EXPECT_EQ(3u, stats.queries);
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(1u, stats.nvrQueries);
+}
+
+TEST_F(RecordIndexTest, AdjacentRangesMergeCoverage) {
+    RecordIndex index;
+    uint64_t version = 0;
+    query(index, base_, base_ + 3600);
+    query(index, base_ + 3600, base_ + 7200);
+    EXPECT_TRUE(index.IsCached("10.0.0.1", "1", at(base_), at(base_ + 7200), version));
+    EXPECT_FALSE(index.IsCached("10.0.0.1", "1", at(base_), at(base_ + 7201), version));
+    EXPECT_FALSE(index.IsCached("10.0.0.2", "1", at(base_), at(base_ + 3600), version));
+
+    EXPECT_EQ(names(direct(base_, base_ + 7200)), names(query(index, base_, base_ + 7200)));
+    EXPECT_EQ(2u, stub_->queries.size());
+}
+
+TEST_F(RecordIndexTest, OnlyTheGapIsQueried) {
+    RecordIndex index;
+    query(index, base_, base_ + 3600);
+    query(index, base_ + 7200, base_ + 10800);
+    ASSERT_EQ(2u, stub_->queries.size());
+
+    EXPECT_EQ(names(direct(base_, base_ + 10800)), names(query(index, base_, base_ + 10800)));
+    ASSERT_EQ(3u, stub_->queries.size());
+    EXPECT_EQ(std::make_pair(base_ + 3600, base_ + 7200), stub_->queries[2]);
+}
+
+TEST_F(RecordIndexTest, RecordStartingBeforeTheRangeIsReturned) {
+    RecordIndex index;
+    // 一个跨越查询开始时间的长录像
+    stub_->records.clear();
+    stub_->Record(base_ - 7200, base_ + 3600, 10800);
+    std::vector<sdk::RecordInfo> records = query(index, base_, base_ + 600);
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ("f" + std::to_string(base_ - 7200), records[0].fileName);
+    EXPECT_EQ(1u, query(index, base_ + 100, base_ + 500).size());
+    EXPECT_EQ(1u, stub_->queries.size());
+}
+
+TEST_F(RecordIndexTest, TailIsQueriedAgainAndGrowingRecordsChangeTheVersion) {
+    RecordIndex index;
+    FLAGS_vod_record_index_tail_refresh_s = 0;
+    stub_->records.clear();
+    stub_->Record(now_ - 3600, now_ - 60, 600);
+
+    uint64_t before = 0;
+    std::vector<sdk::RecordInfo> records;
+    ASSERT_EQ(0, index.Find(stub_, "10.0.0.1", "1", at(now_ - 3600), at(now_ + 60), [&records](const sdk::RecordInfo &r) {
+        records.push_back(r);
+        return true;
+    }, false, &before));
+    ASSERT_EQ(1u, stub_->queries.size());
+
+    // 没有变化时版本不变
+    uint64_t same = 0;
+    ASSERT_EQ(0, index.Find(stub_, "10.0.0.1", "1", at(now_ - 3600), at(now_ + 60), [](const sdk::RecordInfo &) { return true; }, false, &same));
+    EXPECT_EQ(before, same);
+    EXPECT_GE(stub_->queries.size(), 2u);
+    // 只重新查询尾部
+    EXPECT_GE(stub_->queries.back().first, now_ - FLAGS_vod_record_index_tail_s - 1);
+
+    // 正在写的录像变长
+    stub_->records.back().endTime.FromTime(now_);
+    uint64_t after = 0;
+    records.clear();
+    ASSERT_EQ(0, index.Find(stub_, "10.0.0.1", "1", at(now_ - 3600), at(now_ + 60), [&records](const sdk::RecordInfo &r) {
+        records.push_back(r);
+        return true;
+    }, false, &after));
+    EXPECT_NE(before, after);
+    ASSERT_FALSE(records.empty());
+    EXPECT_EQ(now_, records.back().endTime.ToTime());
+}
+
+TEST_F(RecordIndexTest, RefreshReplacesDeletedRecords) {
+    RecordIndex index;
+    uint64_t before = 0;
+    ASSERT_EQ(0, index.Find(stub_, "10.0.0.1", "1", at(base_), at(base_ + 3600), [](const sdk::RecordInfo &) { return true; }, false, &before));
+    // nvr删掉了中间的两个录像
+    stub_->records.erase(stub_->records.begin() + 7, stub_->records.begin() + 9);
+
+    uint64_t after = 0;
+    std::vector<sdk::RecordInfo> records;
+    ASSERT_EQ(0, index.Find(stub_, "10.0.0.1", "1", at(base_), at(base_ + 3600), [&records](const sdk::RecordInfo &r) {
+        records.push_back(r);
+        return true;
+    }, true, &after));
+    EXPECT_NE(before, after);
+    EXPECT_EQ(names(direct(base_, base_ + 3600)), names(records));
+}
+
+TEST_F(RecordIndexTest, LeastRecentlyUsedChannelIsEvicted) {
+    RecordIndex index;
+    FLAGS_vod_record_index_max_records = 10;
+    std::vector<sdk::RecordInfo> records;
+    ASSERT_EQ(0, index.Query(stub_, "10.0.0.1", "1", at(base_), at(base_ + 3600), records));
+    ASSERT_EQ(0, index.Query(stub_, "10.0.0.1", "2", at(base_), at(base_ + 3600), records));
+
+    RecordIndexStats stats = index.Stats();
+    EXPECT_EQ(1u, stats.channels);
+    EXPECT_EQ(1u, stats.evictions);
+    EXPECT_LE(stats.records, 10u);
+    uint64_t version = 0;
+    EXPECT_FALSE(index.IsCached("10.0.0.1", "1", at(base_), at(base_ + 3600), version));
+    EXPECT_TRUE(index.IsCached("10.0.0.1", "2", at(base_), at(base_ + 3600), version));
+}
@@ -0,0 +1,156 @@
+// 分段并行下载的基准：模拟nvr每个会话限速为实时的60倍，比较串行、4路并行和8路并行(受会话上限和内存限制)下载一段录像的耗时
+// 输出的每秒数据以该秒的时间戳开头，同时校验输出严格按时间顺序
+// xmake build segmented_download_bench && xmake run segmented_download_bench [--bench_minutes=60]
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+#include <poll.h>
+
+#include <gflags/gflags.h>
+
+#include "server/stream/segmented_download.h"
+
+DEFINE_int32(bench_minutes, 60, "Minutes of recordings downloaded in each run");
+DEFINE_int32(bench_speed, 60, "Each session of the mock nvr delivers this many seconds of recordings per second");
+
+using namespace sdkproxy;
+
+namespace {
+
+// 每个会话限速的模拟nvr，先回调40字节的IMKH头，之后每秒录像对应固定字节，内容以该秒的时间戳开头
+class MockStub : public sdk::SdkStub {
+public:
+    static const int32_t BYTES_PER_SEC = 64 * 1024;
+
+    explicit MockStub(int32_t speed) : SdkStub("mock", "mock", 0), speed_(speed) {}
+
+    int32_t DownloadRecordByTime(const std::string &devId, const sdk::TimePoint &startTime, const sdk::TimePoint &endTime, OnDownloadData onData,
+                                 intptr_t &jobId) override {
+        std::shared_ptr<std::atomic<bool>> stop = std::make_shared<std::atomic<bool>>(false);
+        time_t from                             = startTime.ToTime();
+        time_t to                               = endTime.ToTime();
+        uint64_t intervalUs                     = 1000000 / speed_;
+        std::unique_lock<std::mutex> lck(mutex_);
+        jobId      = ++nextJob_;
+        Job &job   = jobs_[jobId];
+        job.stop   = stop;
+        job.worker = std::thread([stop, from, to, intervalUs, onData]() {
+            uint8_t header[40] = {'I', 'M', 'K', 'H'};
+            onData(0, header, sizeof(header));
+            std::string chunk(BYTES_PER_SEC, '\0');
+            for (time_t t = from; t < to && !*stop; t++) {
+                memcpy(&chunk[0], &t, sizeof(t));
+                std::this_thread::sleep_for(std::chrono::microseconds(intervalUs));
+                onData(0, (const uint8_t *)chunk.data(), (int32_t)chunk.size());
+            }
+            if (!*stop) {
+                onData(0, nullptr, -1);
+            }
+        });
+        return 0;
+    }
+
+    int32_t StopDownloadRecord(intptr_t &jobId) override {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lck(mutex_);
+            auto iter = jobs_.find(jobId);
+            if (iter == jobs_.end()) {
+                return -1;
+            }
+            job.stop   = iter->second.stop;
+            job.worker = std::move(iter->second.worker);
+            jobs_.erase(iter);
+        }
+        *job.stop = true;
+        job.worker.join();
+        jobId = 0;
+        return 0;
+    }
+
+private:
+    typedef struct tagJob {
+        std::shared_ptr<std::atomic<bool>> stop;
+        std::thread worker;
+    } Job;
+
+    int32_t speed_;
+    std::mutex mutex_;
+    intptr_t nextJob_ = 0;
+    std::map<intptr_t, Job> jobs_;
+};
+
+// 下载[from, to)，返回耗时(秒)，顺序错误或者长度不对时返回-1
+double run(int32_t parallel, int64_t memoryBytes, time_t from, time_t to) {
+    FLAGS_vod_parallel_memory_bytes = memoryBytes;
+    std::shared_ptr<MockStub> stub  = std::make_shared<MockStub>(FLAGS_bench_speed);
+
+    // 每7分钟一个录像文件
+    std::vector<sdk::RecordInfo> records;
+    for (time_t t = from; t < to; t += 7 * 60) {
+        sdk::RecordInfo r;
+        r.startTime.FromTime(t);
+        r.endTime.FromTime(std::min<time_t>(t + 7 * 60, to));
+        records.push_back(r);
+    }
+    std::vector<SegmentedDownload::Range> ranges =
+        parallel > 1 ? SegmentedDownload::Split(records, from, to, parallel) : std::vector<SegmentedDownload::Range>(1, SegmentedDownload::Range(from, to));
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    butil::IOBuf buf;
+    int n = 0;
+    {
+        SegmentedDownload download(stub, "10.0.0.1", "1", ranges);
+        while (true) {
+            download.Pump();
+            n = download.Read(buf, 1 << 20);
+            if (n < 0) {
+                break;
+            }
+            if (0 == n) {
+                struct pollfd pfd = {download.GetNotifyFd(), POLLIN, 0};
+                poll(&pfd, 1, 10);
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::string out = buf.to_string();
+    size_t expected = 40 + (size_t)(to - from) * MockStub::BYTES_PER_SEC;
+    int32_t errors  = 0;
+    for (time_t t = 0; t < to - from && 40 + (size_t)(t + 1) * MockStub::BYTES_PER_SEC <= out.size(); t++) {
+        time_t v = 0;
+        memcpy(&v, &out[40 + (size_t)t * MockStub::BYTES_PER_SEC], sizeof(v));
+        if (v != from + t) {
+            errors++;
+        }
+    }
+    printf("parallel %d, segments %zu, memory %lld bytes: %.1f s, %zu/%zu bytes, order errors %d%s\n", parallel, ranges.size(),
+           (long long)memoryBytes, seconds, out.size(), expected, errors, -2 == n ? ", failed" : "");
+    return (-2 == n || out.size() != expected || errors > 0) ? -1 : seconds;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    FLAGS_vod_cache_enable = false;
+
+    time_t from = sdk::TimePoint().FromString("2026-01-01 10:00:00").ToTime();
+    time_t to   = from + FLAGS_bench_minutes * 60;
+    printf("%d minutes of recordings, %dx realtime per session, %d sessions per nvr\n", FLAGS_bench_minutes, FLAGS_bench_speed,
+           FLAGS_vod_sessions_per_nvr);
+    double serial   = run(1, 1LL << 30, from, to);
+    double parallel = run(4, 1LL << 30, from, to);
+    double spilling = run(8, 1LL << 20, from, to);
+    if (serial < 0 || parallel < 0 || spilling < 0) {
+        return 1;
+    }
+    printf("parallel=4: %.2fx, parallel=8 with 1 MB memory: %.2fx\n", serial / parallel, serial / spilling);
+    return 0;
+}
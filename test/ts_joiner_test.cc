@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+#include "common/media/ts_muxer.h"
+#include "common/media/ts_joiner.h"
+
+using namespace sdkproxy;
+
+namespace {
+
+// 一段独立封装的TS，视频25fps，每帧后跟一个音频帧
+std::string segment(uint64_t base, int frames) {
+    TsMuxer muxer;
+    muxer.SetAudioCodec(AUDIO_G711A);
+    std::string out;
+    std::string video(8000, 'v');
+    std::string audio(320, 'a');
+    for (int i = 0; i < frames; i++) {
+        muxer.WriteVideo((const uint8_t *)video.data(), 5000 + (i * 37) % 3000, base + i * 3600, 0 == i % 25, out);
+        muxer.WriteAudio((const uint8_t *)audio.data(), audio.size(), base + i * 3600 + 100, out);
+    }
+    return out;
+}
+
+uint64_t readPts(const uint8_t *q) {
+    return ((uint64_t)((q[0] >> 1) & 7) << 30) | ((uint64_t)q[1] << 22) | ((uint64_t)(q[2] >> 1) << 15) | ((uint64_t)q[3] << 7) | (q[4] >> 1);
+}
+
+// 检查拼接后的流，返回连续计数器不连续的次数，视频PTS与PCR不一致的次数，相邻视频帧PTS差值的分布
+void check(const std::string &ts, int &ccErrors, int &pcrErrors, std::map<uint64_t, int> &steps) {
+    std::map<int, int> cc;
+    uint64_t last      = 0;
+    size_t videoFrames = 0;
+    ccErrors           = 0;
+    pcrErrors          = 0;
+    for (size_t pos = 0; pos + 188 <= ts.size(); pos += 188) {
+        const uint8_t *p = (const uint8_t *)ts.data() + pos;
+        int pid          = ((p[1] & 0x1f) << 8) | p[2];
+        int counter      = p[3] & 0x0f;
+        if (cc.count(pid) && ((cc[pid] + 1) & 0x0f) != counter) {
+            ccErrors++;
+        }
+        cc[pid] = counter;
+
+        // 视频PES的开始，适配域中带PCR
+        if (0x100 == pid && (p[1] & 0x40)) {
+            size_t offset = 4 + ((p[3] & 0x20) ? 1 + p[4] : 0);
+            uint64_t pts  = readPts(p + offset + 9);
+            uint64_t pcr  = ((uint64_t)p[6] << 25) | ((uint64_t)p[7] << 17) | ((uint64_t)p[8] << 9) | ((uint64_t)p[9] << 1) | (p[10] >> 7);
+            if (pcr != pts) {
+                pcrErrors++;
+            }
+            if (videoFrames > 0) {
+                steps[(pts - last) & TsJoiner::TS_CLOCK_MASK]++;
+            }
+            last = pts;
+            videoFrames++;
+        }
+    }
+}
+
+} // namespace
+
+TEST(TsJoinerTest, SegmentsBecomeOneContinuousStream) {
+    // 第三段的时间戳在段内回绕
+    std::string segments[3] = {segment(900000, 100), segment(123, 80), segment(TsJoiner::TS_CLOCK_MASK - 20000, 60)};
+    TsJoiner joiner;
+    std::string out;
+    size_t in = 0;
+    srand(1);
+    for (int s = 0; s < 3; s++) {
+        if (s > 0) {
+            joiner.Begin(out);
+        }
+        // 按任意大小的分块输入
+        size_t pos = 0;
+        while (pos < segments[s].size()) {
+            size_t n = std::min<size_t>(segments[s].size() - pos, 1 + rand() % 5000);
+            joiner.Feed(segments[s].data() + pos, n, out);
+            pos += n;
+        }
+        in += segments[s].size();
+    }
+    joiner.Finish(out);
+
+    EXPECT_EQ(in, out.size());
+    int ccErrors  = 0;
+    int pcrErrors = 0;
+    std::map<uint64_t, int> steps;
+    check(out, ccErrors, pcrErrors, steps);
+    EXPECT_EQ(0, ccErrors);
+    EXPECT_EQ(0, pcrErrors);
+    // 段内逐帧加3600，段之间接在上一段最后的音频之后
+    std::map<uint64_t, int> expected = {{3600, 237}, {100 + TsJoiner::JOIN_GAP, 2}};
+    EXPECT_EQ(expected, steps);
+}
+
+TEST(TsJoinerTest, FirstSegmentIsUnchanged) {
+    std::string first = segment(900000, 30);
+    TsJoiner joiner;
+    std::string out;
+    joiner.Feed(first.data(), first.size(), out);
+    joiner.Finish(out);
+    EXPECT_EQ(first, out);
+}
+
+TEST(TsJoinerTest, IncompletePacketIsPassedThrough) {
+    std::string first = segment(900000, 10);
+    std::string tail(100, '\x47');
+    TsJoiner joiner;
+    std::string out;
+    joiner.Feed(first.data(), first.size(), out);
+    joiner.Feed(tail.data(), tail.size(), out);
+    EXPECT_EQ(first.size(), out.size());
+    joiner.Begin(out);
+    EXPECT_EQ(first + tail, out);
+}
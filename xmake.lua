@@ -16,7 +16,7 @@ add_syslinks("dl", "pthread")
 target("dahuanvr_stub_impl")
 	set_kind("shared")
 	add_files("3rdsdk/vendor/dahuanvr/**.cc")
-	add_links("dhnetsdk", "avnetsdk", "dhplay")
+	add_links("dhnetsdk", "avnetsdk")
 	local sdk_root="/root/dahuanvr_sdk"
 	add_includedirs(sdk_root .. "/include")
 	add_linkdirs(sdk_root .. "/lib")
@@ -40,4 +40,21 @@ target("sdk_proxy_server")
 	set_kind("binary")
 	add_files("server/**.cc")
 	add_deps("dahuanvr_stub_impl", "hikvisionnvr_stub_impl")
-	add_links("brpc", "gflags", "protobuf", "leveldb", "z", "ssl", "crypto")
\ No newline at end of file
+	add_links("brpc", "gflags", "protobuf", "leveldb", "z", "ssl", "crypto")
+-- 单元测试：xmake build -g test && xmake run -g test
+for _, file in ipairs(os.files("test/*_test.cc")) do
+	target(path.basename(file))
+		set_kind("binary")
+		set_default(false)
+		set_group("test")
+		set_languages("cxx14")
+		add_files(file)
+		add_links("gtest_main", "gtest", "brpc", "gflags", "protobuf", "leveldb", "z", "ssl", "crypto")
+end
+
+-- 分段并行下载的基准，不在test组中：xmake build segmented_download_bench && xmake run segmented_download_bench
+target("segmented_download_bench")
+	set_kind("binary")
+	set_default(false)
+	add_files("test/segmented_download_bench.cc")
+	add_links("brpc", "gflags", "protobuf", "leveldb", "z", "ssl", "crypto")